@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_ALLOCATOR_H_
+#define BCTBX_ALLOCATOR_H_
+#include "bctoolbox/port.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * A size class pool allocator for the many small and short lived allocations, strings and list nodes mostly.
+ * Blocks up to BCTBX_POOL_ALLOCATOR_MAX_SIZE bytes are carved from large slabs and recycled through per thread caches,
+ * so that most allocations and frees touch no lock; bigger ones go to the C library.
+ * Slabs are never given back to the system: the footprint is the peak of the small allocations.
+ * Install it for the whole process with:
+ * @code
+ * BctoolboxMemoryFunctions functions;
+ * bctbx_pool_allocator_get_memory_functions(&functions);
+ * bctbx_set_memory_functions(&functions);
+ * @endcode
+ */
+#define BCTBX_POOL_ALLOCATOR_MAX_SIZE 4096
+#define BCTBX_POOL_ALLOCATOR_CLASS_COUNT 16
+
+typedef struct _bctbx_pool_allocator_class_stats_t {
+	size_t blockSize; /**< usable size of the blocks of this class */
+	uint64_t allocations; /**< blocks handed out since the start */
+	int64_t blocksInUse;
+} bctbx_pool_allocator_class_stats_t;
+
+typedef struct _bctbx_pool_allocator_stats_t {
+	int64_t bytesInUse; /**< in blocks handed out, counted with their class size, and in big allocations */
+	uint64_t bytesReserved; /**< obtained from the C library: slabs and big allocations */
+	uint64_t peakBytesReserved;
+	bctbx_pool_allocator_class_stats_t classes[BCTBX_POOL_ALLOCATOR_CLASS_COUNT];
+} bctbx_pool_allocator_stats_t;
+
+BCTBX_PUBLIC void *bctbx_pool_malloc(size_t size);
+BCTBX_PUBLIC void *bctbx_pool_realloc(void *ptr, size_t size);
+BCTBX_PUBLIC void bctbx_pool_free(void *ptr);
+
+/**
+ * Fill the functions to give to bctbx_set_memory_functions() to make the pool allocator the bctoolbox allocator.
+ */
+BCTBX_PUBLIC void bctbx_pool_allocator_get_memory_functions(BctoolboxMemoryFunctions *functions);
+
+/**
+ * Gather the counters of every thread. They are read while other threads may be allocating, so the result is not a snapshot.
+ */
+BCTBX_PUBLIC void bctbx_pool_allocator_get_stats(bctbx_pool_allocator_stats_t *stats);
+
+/**
+ * An arena hands out memory from big blocks, and frees all of it at once, for data living as long as a request or a parsing.
+ * Single threaded. Allocations are aligned on 16 bytes and cannot be freed or resized one by one.
+ */
+typedef struct _bctbx_arena_t bctbx_arena_t;
+
+typedef struct _bctbx_arena_stats_t {
+	size_t bytesUsed; /**< allocated since the last reset, including alignment padding */
+	size_t bytesReserved; /**< in the blocks currently owned by the arena */
+	size_t peakBytesUsed;
+} bctbx_arena_stats_t;
+
+/**
+ * Create an arena.
+ * @param[in] block_size size of the blocks obtained from bctbx_malloc(), 0 for a default of 4KB.
+ * Bigger allocations get a block of their own.
+ */
+BCTBX_PUBLIC bctbx_arena_t *bctbx_arena_new(size_t block_size);
+
+/**
+ * Free the arena and everything allocated from it.
+ */
+BCTBX_PUBLIC void bctbx_arena_free(bctbx_arena_t *arena);
+
+/**
+ * Free everything allocated from the arena, which keeps its first block for the next allocations.
+ */
+BCTBX_PUBLIC void bctbx_arena_reset(bctbx_arena_t *arena);
+
+/**
+ * Allocate size bytes aligned on 16 bytes from the arena, they are freed with it.
+ * @return the allocated memory, NULL if it cannot be allocated or size is too large to be.
+ */
+BCTBX_PUBLIC void *bctbx_arena_alloc(bctbx_arena_t *arena, size_t size);
+BCTBX_PUBLIC void *bctbx_arena_alloc0(bctbx_arena_t *arena, size_t size);
+BCTBX_PUBLIC char *bctbx_arena_strdup(bctbx_arena_t *arena, const char *str);
+BCTBX_PUBLIC char *bctbx_arena_strdup_printf(bctbx_arena_t *arena, const char *fmt, ...) BCTBX_PRINTF_LIKE(2, 3);
+
+BCTBX_PUBLIC void bctbx_arena_get_stats(const bctbx_arena_t *arena, bctbx_arena_stats_t *stats);
+
+/**
+ * Opt-in accounting of the bctoolbox allocations, to follow the memory growth of a long running process.
+ * It wraps the memory functions: each thread counts its own allocations, and the counters are gathered when
+ * statistics are requested. One allocation out of sampling_interval is recorded with the tag of its thread,
+ * the records still alive make the leak report.
+ * Install it for the whole process, on top of the C library or of another allocator, with:
+ * @code
+ * BctoolboxMemoryFunctions functions;
+ * bctbx_memory_accounting_get_memory_functions(NULL, 1024, &functions);
+ * bctbx_set_memory_functions(&functions);
+ * @endcode
+ */
+typedef struct _bctbx_memory_stats_t {
+	int64_t liveBytes; /**< requested by the allocations not freed yet */
+	int64_t peakLiveBytes; /**< may be late by 64KB per thread */
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t bytesAllocated; /**< since the start */
+	double allocationsPerSecond; /**< since the previous call to bctbx_memory_get_stats() */
+} bctbx_memory_stats_t;
+
+/**
+ * Get the accounting memory functions. The first call sets up the accounting, the next ones ignore their arguments.
+ * @param[in] underlying		the functions doing the allocations, NULL for the C library ones
+ * @param[in] sampling_interval	record one allocation out of this many for the leak report, 0 to record none
+ * @param[out] functions		to give to bctbx_set_memory_functions()
+ */
+BCTBX_PUBLIC void bctbx_memory_accounting_get_memory_functions(const BctoolboxMemoryFunctions *underlying, unsigned int sampling_interval, BctoolboxMemoryFunctions *functions);
+
+/**
+ * Enabled means set up: the accounting memory functions have been requested with
+ * bctbx_memory_accounting_get_memory_functions(), they count nothing until they are given to bctbx_set_memory_functions().
+ * @return TRUE once the accounting memory functions have been set up
+ */
+BCTBX_PUBLIC bool_t bctbx_memory_accounting_enabled(void);
+
+/**
+ * Tag the next allocations of the calling thread, for the leak report.
+ * @param[in] tag	a string living as long as the process, a module or call site name, NULL to clear
+ * @return the previous tag, to restore it at the end of the tagged section
+ */
+BCTBX_PUBLIC const char *bctbx_memory_set_tag(const char *tag);
+
+BCTBX_PUBLIC void bctbx_memory_get_stats(bctbx_memory_stats_t *stats);
+
+/**
+ * Describe the recorded allocations still alive, grouped by tag, biggest first, typically at shutdown.
+ * Sizes are extrapolated from the sampling interval.
+ * @param[in] max_entries	maximum number of tags listed
+ * @return the report, to be freed with bctbx_free()
+ */
+BCTBX_PUBLIC char *bctbx_memory_get_leak_report(size_t max_entries);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_ALLOCATOR_H_ */
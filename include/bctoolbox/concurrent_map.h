@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_CONCURRENT_MAP_H_
+#define BCTBX_CONCURRENT_MAP_H_
+#include "bctoolbox/list.h"
+#include "bctoolbox/map.h"
+#include "bctoolbox/port.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * A thread-safe multimap, split in shards each protected by its own reader-writer lock.
+ * A key always lands in the same shard, so threads working on different keys rarely contend,
+ * and lookups of the same shard run concurrently.
+ * There are no iterators: values are returned by copy of the pointer, and traversal is done
+ * through a callback invoked with the shard read lock held (the callback must not access the map,
+ * and may run concurrently with lookups and other traversals).
+ */
+typedef struct _bctbx_concurrent_map_t bctbx_concurrent_map_t;
+
+typedef void (*bctbx_concurrent_map_ullong_func)(unsigned long long key, void *value, void *user_data);
+typedef void (*bctbx_concurrent_map_cchar_func)(const char *key, void *value, void *user_data);
+
+/**
+ * Create a concurrent map.
+ * @param[in] shard_count number of shards, rounded up to a power of two. 0 selects a default suitable for most uses.
+ */
+BCTBX_PUBLIC bctbx_concurrent_map_t *bctbx_concurrent_map_ullong_new(size_t shard_count);
+BCTBX_PUBLIC bctbx_concurrent_map_t *bctbx_concurrent_map_cchar_new(size_t shard_count);
+BCTBX_PUBLIC void bctbx_concurrent_map_ullong_delete(bctbx_concurrent_map_t *map);
+BCTBX_PUBLIC void bctbx_concurrent_map_cchar_delete(bctbx_concurrent_map_t *map);
+BCTBX_PUBLIC void bctbx_concurrent_map_ullong_delete_with_data(bctbx_concurrent_map_t *map, bctbx_map_free_func freefunc);
+BCTBX_PUBLIC void bctbx_concurrent_map_cchar_delete_with_data(bctbx_concurrent_map_t *map, bctbx_map_free_func freefunc);
+
+/*insert a value, several values may share the same key*/
+BCTBX_PUBLIC void bctbx_concurrent_map_ullong_insert(bctbx_concurrent_map_t *map, unsigned long long key, void *value);
+BCTBX_PUBLIC void bctbx_concurrent_map_cchar_insert(bctbx_concurrent_map_t *map, const char *key, void *value);
+
+/*look for the key, return TRUE and set *value (if not NULL) to the first value found for it*/
+BCTBX_PUBLIC bool_t bctbx_concurrent_map_ullong_find_key(const bctbx_concurrent_map_t *map, unsigned long long key, void **value);
+BCTBX_PUBLIC bool_t bctbx_concurrent_map_cchar_find_key(const bctbx_concurrent_map_t *map, const char *key, void **value);
+
+/*return the first value for which compare_func(value, user_data) returns 0, or NULL. Shards are locked one at a time.*/
+BCTBX_PUBLIC void *bctbx_concurrent_map_ullong_find_custom(const bctbx_concurrent_map_t *map, bctbx_compare_func compare_func, const void *user_data);
+BCTBX_PUBLIC void *bctbx_concurrent_map_cchar_find_custom(const bctbx_concurrent_map_t *map, bctbx_compare_func compare_func, const void *user_data);
+
+/*remove the first value found for the key, return TRUE and set *value (if not NULL) to it, FALSE if the key is absent*/
+BCTBX_PUBLIC bool_t bctbx_concurrent_map_ullong_erase(bctbx_concurrent_map_t *map, unsigned long long key, void **value);
+BCTBX_PUBLIC bool_t bctbx_concurrent_map_cchar_erase(bctbx_concurrent_map_t *map, const char *key, void **value);
+
+/*call func on every element, shard after shard. The result is not a snapshot of the whole map.*/
+BCTBX_PUBLIC void bctbx_concurrent_map_ullong_for_each(const bctbx_concurrent_map_t *map, bctbx_concurrent_map_ullong_func func, void *user_data);
+BCTBX_PUBLIC void bctbx_concurrent_map_cchar_for_each(const bctbx_concurrent_map_t *map, bctbx_concurrent_map_cchar_func func, void *user_data);
+
+/* return the size of the map, summed over the shards*/
+BCTBX_PUBLIC size_t bctbx_concurrent_map_ullong_size(const bctbx_concurrent_map_t *map);
+BCTBX_PUBLIC size_t bctbx_concurrent_map_cchar_size(const bctbx_concurrent_map_t *map);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_CONCURRENT_MAP_H_ */
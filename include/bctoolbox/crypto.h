@@ -21,6 +21,7 @@
 
 #include "bctoolbox/port.h"
 #include "bctoolbox/list.h"
+#include "bctoolbox/vfs.h"
 
 /* key agreements settings defines */
 /* Each algo is defined as a bit toggled in a 32 bits integer,
@@ -85,9 +86,7 @@ bctoolbox will fail to compile if these values are not in sync with the decaf on
 /* Error codes : All error codes are negative and defined  on 32 bits on format -0x7XXXXXXX
  * in order to be sure to not overlap on crypto librairy (polarssl or mbedtls for now) which are defined on 16 bits 0x[7-0]XXX */
 #define BCTBX_ERROR_UNSPECIFIED_ERROR			-0x70000000
-#define BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL		-0x70001000
-#define BCTBX_ERROR_INVALID_BASE64_INPUT		-0x70002000
-#define BCTBX_ERROR_INVALID_INPUT_DATA			-0x70004000
+/* BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL, BCTBX_ERROR_INVALID_BASE64_INPUT and BCTBX_ERROR_INVALID_INPUT_DATA are defined in port.h, with the codecs */
 #define BCTBX_ERROR_UNAVAILABLE_FUNCTION		-0x70008000
 
 /* key related */
@@ -115,6 +114,9 @@ bctoolbox will fail to compile if these values are not in sync with the decaf on
 /* Symmetric ciphers related */
 #define BCTBX_ERROR_AUTHENTICATION_FAILED	-0x70040000
 
+/* Crypto providers related */
+#define BCTBX_ERROR_SELF_TEST_FAILED		-0x70050000
+
 /* certificate verification flags codes */
 #define BCTBX_CERTIFICATE_VERIFY_ALL_FLAGS				0xFFFFFFFF
 #define BCTBX_CERTIFICATE_VERIFY_BADCERT_EXPIRED		0x01  /**< The certificate validity has expired. */
@@ -183,32 +185,7 @@ extern "C"{
  */
 BCTBX_PUBLIC void bctbx_strerror(int32_t error_code, char *buffer, size_t buffer_length);
 
-/**
- * @brief Encode a buffer into base64 format
- * @param[out]		output			base64 encoded buffer
- * @param[in/out]	output_length	output buffer max size and actual size of buffer after encoding
- * @param[in]		input			source plain buffer
- * @param[in]		input_length	Length in bytes of plain buffer to be encoded
- *
- * @return 0 if success or BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL if the output buffer cannot contain the encoded data
- *
- * @note If the function is called with *output_length=0, set the requested buffer size in output_length
- */
-BCTBX_PUBLIC int32_t bctbx_base64_encode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length);
-
-/**
- * @brief Decode a base64 formatted buffer.
- * @param[out]		output			plain buffer
- * @param[in/out]	output_length	output buffer max size and actual size of buffer after decoding
- * @param[in]		input			source base64 encoded buffer
- * @param[in]		input_length	Length in bytes of base64 buffer to be decoded
- *
- * @return 0 if success, BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL if the output buffer cannot contain the decoded data
- * or BCTBX_ERROR_INVALID_BASE64_INPUT if encoded buffer was incorrect base64 data
- *
- * @note If the function is called with *output_length=0, set the requested buffer size in output_length
- */
-BCTBX_PUBLIC int32_t bctbx_base64_decode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length);
+/* bctbx_base64_encode and bctbx_base64_decode are declared in port.h */
 
 /*****************************************************************************/
 /****** Random Number Generation                                        ******/
@@ -224,6 +201,15 @@ typedef struct bctbx_rng_context_struct bctbx_rng_context_t;
  */
 BCTBX_PUBLIC bctbx_rng_context_t *bctbx_rng_context_new(void);
 
+/**
+ * @brief Get a handle on the RNG context of the calling thread
+ * bctbx_rng_get called with this handle uses a context private to the calling thread, seeded at first use:
+ * no allocation, no seeding and no lock on each call. The same handle can be used from any thread.
+ * bctbx_rng_context_free ignores it.
+ * @return a pointer to the thread RNG context handle
+ */
+BCTBX_PUBLIC bctbx_rng_context_t *bctbx_rng_context_get_thread(void);
+
 /**
  * @brief Get some random material
  *
@@ -369,6 +355,40 @@ BCTBX_PUBLIC int32_t bctbx_x509_certificate_parse_file(bctbx_x509_certificate_t
  */
 BCTBX_PUBLIC int32_t bctbx_x509_certificate_parse_path(bctbx_x509_certificate_t *cert, const char *path);
 
+/**
+ * @brief A parsed set of trusted CA certificates, shared by the whole process
+ * Parsing a CA directory or bundle is expensive: stores are kept in a process wide cache keyed by path
+ * and parsed again only when the path modification time or size changes, for a directory the newest modification time
+ * and the total size of the files it contains. A store is immutable and
+ * reference counted, an outdated store stays valid until its last reference is released.
+ */
+typedef struct bctbx_x509_ca_store_struct bctbx_x509_ca_store_t;
+
+/**
+ * @brief Get the CA store of a path, parsing it if it is not cached or has changed since it was parsed
+ *
+ * @param[in]	path	a file or a directory of certificates, as accepted by bctbx_x509_certificate_parse_file/parse_path
+ *
+ * @return a reference on the store, release it with bctbx_x509_ca_store_unref. NULL if the path cannot be read or parsed
+ */
+BCTBX_PUBLIC bctbx_x509_ca_store_t *bctbx_x509_ca_store_get(const char *path);
+BCTBX_PUBLIC bctbx_x509_ca_store_t *bctbx_x509_ca_store_ref(bctbx_x509_ca_store_t *store);
+BCTBX_PUBLIC void bctbx_x509_ca_store_unref(bctbx_x509_ca_store_t *store);
+
+/**
+ * @brief Get the certificates chain of a store, valid as long as a reference on the store is held
+ * It is shared: it must not be modified nor freed.
+ */
+BCTBX_PUBLIC const bctbx_x509_certificate_t *bctbx_x509_ca_store_get_certificates(const bctbx_x509_ca_store_t *store);
+
+/**
+ * @brief Drop a path from the CA store cache, it is parsed again at next bctbx_x509_ca_store_get
+ * Stores still referenced are not affected.
+ *
+ * @param[in]	path	the path to drop, NULL to drop them all
+ */
+BCTBX_PUBLIC void bctbx_x509_ca_store_invalidate(const char *path);
+
 /**
  * @brief Get the length in bytes of a certifcate chain in DER format
  *
@@ -508,6 +528,127 @@ BCTBX_PUBLIC const bctbx_x509_certificate_t *bctbx_ssl_get_peer_certificate(bctb
 BCTBX_PUBLIC const char *bctbx_ssl_get_ciphersuite(bctbx_ssl_context_t *ssl_ctx);
 BCTBX_PUBLIC int bctbx_ssl_get_ciphersuite_id(const char* ciphersuite);
 BCTBX_PUBLIC const char *bctbx_ssl_get_version(bctbx_ssl_context_t *ssl_ctx);
+/* peer certificate verification result of the handshake, a combination of BCTBX_CERTIFICATE_VERIFY_* flags, 0 if it succeeded */
+BCTBX_PUBLIC uint32_t bctbx_ssl_get_verify_result(bctbx_ssl_context_t *ssl_ctx);
+
+/***** Batched record I/O, stream transport only *****/
+/**
+ * @brief Coalesce the records sent by bctbx_ssl_write
+ * When on, the records produced by bctbx_ssl_write are stored instead of being given one by one to the send callback.
+ * They are sent at once by bctbx_ssl_flush, or when the next record does not fit in the batch anymore.
+ * Records sent outside of bctbx_ssl_write (handshake, alerts) flush the pending ones first.
+ *
+ * @param[in/out]	ssl_ctx		a context, already set up
+ * @param[in]		max_size	the batch capacity in bytes, 0 to turn batching off. Pending records are flushed first.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_set_write_batching(bctbx_ssl_context_t *ssl_ctx, size_t max_size);
+
+/**
+ * @brief Send the batched records
+ *
+ * @return 0 when everything was sent, BCTBX_ERROR_NET_WANT_WRITE if the send callback could not take it all
+ * (the remaining part is kept for the next flush), or the error returned by the send callback
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_flush(bctbx_ssl_context_t *ssl_ctx);
+
+/**
+ * @brief Read ahead of the records
+ * mbedtls reads a record header then its body, a call to the recv callback each. When on, the recv callback is asked
+ * for size bytes at once and several records are decrypted from a single read.
+ * As received data may then wait in the context, use bctbx_ssl_has_pending before polling the transport.
+ *
+ * @param[in/out]	ssl_ctx		a context, already set up
+ * @param[in]		size		size of the reads, 0 to turn read ahead off. Data already read ahead is kept.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_set_read_ahead(bctbx_ssl_context_t *ssl_ctx, size_t size);
+
+/* TRUE if bctbx_ssl_read can return data without reading from the transport */
+BCTBX_PUBLIC bool_t bctbx_ssl_has_pending(bctbx_ssl_context_t *ssl_ctx);
+
+/***** Session resumption *****/
+/**
+ * A TLS session, saved by a client after a successful handshake and given back to a later connection to
+ * the same server so it can resume it (by session id or ticket) instead of running a full handshake.
+ */
+typedef struct bctbx_ssl_session_struct bctbx_ssl_session_t;
+BCTBX_PUBLIC bctbx_ssl_session_t *bctbx_ssl_session_new(void);
+BCTBX_PUBLIC void bctbx_ssl_session_free(bctbx_ssl_session_t *session);
+
+/**
+ * @brief Save the session negotiated by a client context, once the handshake is complete
+ *
+ * @param[in]	ssl_ctx		a client context, handshake completed
+ * @param[out]	session		the session to fill, any session previously saved in it is replaced
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_get_session(const bctbx_ssl_context_t *ssl_ctx, bctbx_ssl_session_t *session);
+
+/**
+ * @brief Ask a client context to resume a session on its next handshake
+ * Call it after bctbx_ssl_context_setup or bctbx_ssl_session_reset and before the handshake.
+ * If the server does not know the session anymore, a full handshake is performed.
+ *
+ * @param[in/out]	ssl_ctx		a client context
+ * @param[in]		session		a session saved by bctbx_ssl_get_session, it can be used again afterward
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_set_session(bctbx_ssl_context_t *ssl_ctx, const bctbx_ssl_session_t *session);
+
+/**
+ * A server side session cache: a bounded table of the sessions negotiated by the server, keyed by session id.
+ * When full, the least recently used session is dropped. It is thread-safe and can be shared
+ * by several configurations (eg: all the listening points of a server), it must outlive them.
+ */
+typedef struct bctbx_ssl_session_cache_struct bctbx_ssl_session_cache_t;
+
+/**
+ * @brief Create a session cache
+ *
+ * @param[in]	max_entries	maximum number of sessions kept, 0 selects the default (1024)
+ * @param[in]	timeout		lifetime of a cached session in seconds, 0 selects the default (86400)
+ *
+ * @return the session cache, NULL if session caching is not supported by the crypto library
+ */
+BCTBX_PUBLIC bctbx_ssl_session_cache_t *bctbx_ssl_session_cache_new(size_t max_entries, uint32_t timeout);
+BCTBX_PUBLIC void bctbx_ssl_session_cache_free(bctbx_ssl_session_cache_t *cache);
+/* number of sessions currently in the cache */
+BCTBX_PUBLIC size_t bctbx_ssl_session_cache_size(bctbx_ssl_session_cache_t *cache);
+
+/**
+ * A cache of server certificate verification results, for clients connecting again and again to the same servers.
+ * Results are keyed by the SHA-256 of the server chain, the host name, the key exchange of the ciphersuite (it selects
+ * the key usages checked) and the trust settings of the configuration (CA chain, revocation lists, certificate profile,
+ * accepted curves): changing them never reuses results obtained with the previous ones. The trust settings are read
+ * when a context is set up or reset, whether they were set through bctoolbox or the crypto library configuration.
+ * A result is reused at most until the timeout or until a certificate or revocation list involved expires or becomes
+ * valid, whichever comes first. Failed verifications are cached too.
+ * When full, the least recently used result is dropped. It is thread-safe and can be shared by several
+ * configurations, it must outlive them.
+ * A verify callback must be called on every chain: configurations with one set (bctbx_ssl_config_set_callback_verify)
+ * do not use the cache, the chain is verified at each handshake.
+ */
+typedef struct bctbx_x509_verify_cache_struct bctbx_x509_verify_cache_t;
+
+/**
+ * @brief Create a verification cache
+ *
+ * @param[in]	max_entries	maximum number of results kept, 0 selects the default (1024)
+ * @param[in]	timeout		lifetime of a cached result in seconds, 0 selects the default (3600)
+ *
+ * @return the verification cache, NULL if it is not supported by the crypto library or its build configuration
+ */
+BCTBX_PUBLIC bctbx_x509_verify_cache_t *bctbx_x509_verify_cache_new(size_t max_entries, uint32_t timeout);
+BCTBX_PUBLIC void bctbx_x509_verify_cache_free(bctbx_x509_verify_cache_t *cache);
+/* drop all the cached results, eg: when a certificate revocation list changed */
+BCTBX_PUBLIC void bctbx_x509_verify_cache_purge(bctbx_x509_verify_cache_t *cache);
+/* number of results currently in the cache */
+BCTBX_PUBLIC size_t bctbx_x509_verify_cache_size(bctbx_x509_verify_cache_t *cache);
 	
 BCTBX_PUBLIC bctbx_ssl_config_t *bctbx_ssl_config_new(void);
 BCTBX_PUBLIC int32_t bctbx_ssl_config_set_crypto_library_config(bctbx_ssl_config_t *ssl_config, void *internal_config);
@@ -521,8 +662,47 @@ BCTBX_PUBLIC int32_t bctbx_ssl_config_set_rng(bctbx_ssl_config_t *ssl_config, in
 BCTBX_PUBLIC int32_t bctbx_ssl_config_set_callback_verify(bctbx_ssl_config_t *ssl_config, int(*callback_function)(void *, bctbx_x509_certificate_t *, int, uint32_t *), void *callback_data);
 BCTBX_PUBLIC int32_t bctbx_ssl_config_set_callback_cli_cert(bctbx_ssl_config_t *ssl_config, int(*callback_function)(void *, bctbx_ssl_context_t *, const bctbx_list_t *), void *callback_data);
 BCTBX_PUBLIC int32_t bctbx_ssl_config_set_ca_chain(bctbx_ssl_config_t *ssl_config, bctbx_x509_certificate_t *ca_chain);
+/* use the certificates of a shared CA store as trusted CA chain, the configuration holds a reference on the store until it is freed or given another CA chain */
+BCTBX_PUBLIC int32_t bctbx_ssl_config_set_ca_store(bctbx_ssl_config_t *ssl_config, bctbx_x509_ca_store_t *ca_store);
 BCTBX_PUBLIC int32_t bctbx_ssl_config_set_own_cert(bctbx_ssl_config_t *ssl_config, bctbx_x509_certificate_t *cert, bctbx_signing_key_t *key);
 BCTBX_PUBLIC int32_t bctbx_ssl_config_set_ciphersuites(bctbx_ssl_config_t *ssl_config,const int *ciphersuites);
+
+/**
+ * @brief Store the sessions negotiated with a server configuration in a cache, so clients can resume them
+ *
+ * @param[in/out]	ssl_config	a server configuration
+ * @param[in]		cache		the session cache, NULL to disable caching
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_config_set_session_cache(bctbx_ssl_config_t *ssl_config, bctbx_ssl_session_cache_t *cache);
+
+/**
+ * @brief Verify the server certificates through a cache of verification results
+ * Call it after bctbx_ssl_config_defaults.
+ *
+ * @param[in/out]	ssl_config	a client configuration
+ * @param[in]		cache		the verification cache, NULL to verify every handshake
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_config_set_verify_cache(bctbx_ssl_config_t *ssl_config, bctbx_x509_verify_cache_t *cache);
+
+/**
+ * @brief Enable or disable session tickets (RFC5077)
+ * On a server configuration, enabling generates the ticket protection keys: tickets are encrypted
+ * with AES-256-GCM and the keys are renewed every lifetime seconds, using the configuration RNG.
+ * The server then keeps no state per client.
+ * On a client configuration, it sets whether the client requests and uses tickets (enabled by default).
+ * Call it after bctbx_ssl_config_defaults and bctbx_ssl_config_set_rng, before any context is set up with the configuration.
+ *
+ * @param[in/out]	ssl_config	the configuration
+ * @param[in]		enable		TRUE to enable tickets, FALSE to disable them
+ * @param[in]		lifetime	server only: ticket lifetime in seconds, 0 selects the default (86400)
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+BCTBX_PUBLIC int32_t bctbx_ssl_config_set_session_tickets(bctbx_ssl_config_t *ssl_config, bool_t enable, uint32_t lifetime);
 	
 /***** DTLS-SRTP functions *****/
 BCTBX_PUBLIC bctbx_dtls_srtp_profile_t bctbx_ssl_get_dtls_srtp_protection_profile(bctbx_ssl_context_t *ssl_ctx);
@@ -821,6 +1001,33 @@ BCTBX_PUBLIC void bctbx_EDDSA_setSecretKey(bctbx_EDDSAContext_t *context, const
  */
 BCTBX_PUBLIC int bctbx_EDDSA_verify(bctbx_EDDSAContext_t *context, const uint8_t *message, size_t messageLength, const uint8_t *associatedData, const uint8_t associatedDataLength, const uint8_t *signature, size_t signatureLength);
 
+/**
+ * One signature to check in a batch verification
+ */
+typedef struct {
+	const uint8_t *message; /**< Message to verify */
+	size_t messageLength; /**< Length of the message buffer */
+	const uint8_t *associatedData; /**< A "context" for this signature of up to 255 bytes, may be NULL */
+	uint8_t associatedDataLength; /**< Length of the context */
+	const uint8_t *publicKey; /**< The signer public key */
+	size_t publicKeyLength; /**< Length of the public key, must match the algorithm */
+	const uint8_t *signature; /**< The signature */
+	size_t signatureLength; /**< The size of the signature buffer */
+} bctbx_EDDSABatchEntry_t;
+
+/**
+ *
+ * @brief Verify many signatures at once, spread on the available cores for large batches
+ *
+ * @param[in]	EDDSAAlgo	The algorithm type(BCTBX_EDDSA_25519 or BCTBX_EDDSA_448) of all the signatures
+ * @param[in]	entries		The signatures to verify
+ * @param[in]	entriesCount	Number of entries
+ * @param[out]	results		If not NULL, entriesCount results: BCTBX_VERIFY_SUCCESS or BCTBX_VERIFY_FAILED for each entry
+ *
+ * @return BCTBX_VERIFY_SUCCESS if all the signatures are valid, BCTBX_VERIFY_FAILED otherwise
+ */
+BCTBX_PUBLIC int bctbx_EDDSA_verify_batch(uint8_t EDDSAAlgo, const bctbx_EDDSABatchEntry_t *entries, size_t entriesCount, int *results);
+
 
 /**
  *
@@ -846,6 +1053,42 @@ BCTBX_PUBLIC void bctbx_EDDSA_ECDH_privateKeyConversion(const bctbx_EDDSAContext
 */
 BCTBX_PUBLIC void bctbx_EDDSA_ECDH_publicKeyConversion(const bctbx_EDDSAContext_t *ed, bctbx_ECDHContext_t *x, uint8_t isSelf);
 
+/**
+ * A pool of precomputed ephemeral key pairs for one algorithm, so that creating a key pair
+ * does not cost a scalar multiplication when it is needed (eg: at call setup).
+ * A thread of the pool keeps it filled, using its own RNG. Unused keys are wiped when the pool is destroyed.
+ */
+typedef struct bctbx_ECCKeyPairPool_struct bctbx_ECCKeyPairPool_t;
+
+/**
+ *
+ * @brief Create a key pair pool for ECDH or EDDSA, its thread starts filling it immediately
+ *
+ * @param[in] ECDHAlgo/EDDSAAlgo	The algorithm type(BCTBX_ECDH_X25519, BCTBX_ECDH_X448 or BCTBX_EDDSA_25519, BCTBX_EDDSA_448)
+ * @param[in] depth			Number of key pairs kept ready, 0 selects the default (16)
+ * @param[in] refillRate		Maximum number of key pairs generated per second, 0 for no limit
+ *
+ * @return The pool(must then be freed calling bctbx_DestroyECCKeyPairPool), NULL on error or if ECC is not available
+ */
+BCTBX_PUBLIC bctbx_ECCKeyPairPool_t *bctbx_CreateECDHKeyPairPool(const uint8_t ECDHAlgo, size_t depth, uint32_t refillRate);
+BCTBX_PUBLIC bctbx_ECCKeyPairPool_t *bctbx_CreateEDDSAKeyPairPool(const uint8_t EDDSAAlgo, size_t depth, uint32_t refillRate);
+BCTBX_PUBLIC void bctbx_DestroyECCKeyPairPool(bctbx_ECCKeyPairPool_t *pool);
+/* number of key pairs currently ready in the pool */
+BCTBX_PUBLIC size_t bctbx_ECCKeyPairPoolSize(bctbx_ECCKeyPairPool_t *pool);
+
+/**
+ *
+ * @brief Same as bctbx_ECDHCreateKeyPair/bctbx_EDDSACreateKeyPair but take the key pair from a pool
+ * The key pair is generated with the given RNG when the pool is empty, NULL or for another algorithm.
+ *
+ * @param[in/out] 	context		ECDH or EDDSA context, will store the key pair
+ * @param[in]		pool		a pool created for the context algorithm
+ * @param[in] 		rngFunction	pointer to a random number generator used to create the secret when the pool cannot provide it
+ * @param[in]		rngContext	pointer to the rng context if neeeded
+ */
+BCTBX_PUBLIC void bctbx_ECDHCreateKeyPairFromPool(bctbx_ECDHContext_t *context, bctbx_ECCKeyPairPool_t *pool, int (*rngFunction)(void *, uint8_t *, size_t), void *rngContext);
+BCTBX_PUBLIC void bctbx_EDDSACreateKeyPairFromPool(bctbx_EDDSAContext_t *context, bctbx_ECCKeyPairPool_t *pool, int (*rngFunction)(void *, uint8_t *, size_t), void *rngContext);
+
 /*****************************************************************************/
 /***** Hashing                                                           *****/
 /*****************************************************************************/
@@ -955,6 +1198,187 @@ BCTBX_PUBLIC void bctbx_hmacSha1(const uint8_t *key,
 		uint8_t hmacLength,
 		uint8_t *output);
 
+/**
+ * @brief SHA256 context, for incremental hashing of a message or hashing of many messages
+ * without allocating a new context each time.
+ * The block function is selected at runtime and uses the CPU SHA extensions when available.
+ */
+typedef struct bctbx_sha256_context_struct bctbx_sha256_context_t;
+
+/**
+ * @brief Create and initialise a SHA256 context
+ * @return a context, to be destroyed with bctbx_sha256_context_free
+ */
+BCTBX_PUBLIC bctbx_sha256_context_t *bctbx_sha256_context_new(void);
+
+/**
+ * @brief Feed data to the hash, may be called any number of times
+ * @param[in/out]	context		SHA256 context
+ * @param[in]	input 		Input data buffer
+ * @param[in]   inputLength	Input data length in bytes
+ */
+BCTBX_PUBLIC void bctbx_sha256_update(bctbx_sha256_context_t *context, const uint8_t *input, size_t inputLength);
+
+/**
+ * @brief Output the hash of all the data given since creation or last finish, the context is then reset and can hash a new message
+ * @param[in/out]	context		SHA256 context
+ * @param[in]	hashLength	Length of output required in bytes, SHA256 output is truncated to the hashLength left bytes. 32 bytes maximum
+ * @param[out]	output		Output data buffer.
+ */
+BCTBX_PUBLIC void bctbx_sha256_finish(bctbx_sha256_context_t *context, uint8_t hashLength, uint8_t *output);
+
+/**
+ * @brief Destroy a SHA256 context
+ * @param[in/out]	context		SHA256 context, may be NULL
+ */
+BCTBX_PUBLIC void bctbx_sha256_context_free(bctbx_sha256_context_t *context);
+
+/**
+ * @brief Hash count independent messages in one call
+ * On x86 CPUs with AVX2 but without the SHA extensions, the messages are hashed eight at a time.
+ * @param[in]	inputs		Array of count input buffers
+ * @param[in]	inputLengths	Array of count input lengths in bytes
+ * @param[in]	count		Number of messages
+ * @param[in]	hashLength	Length of each output in bytes, 32 bytes maximum
+ * @param[out]	output		Output buffer of count*hashLength bytes, hash i is written at offset i*hashLength
+ */
+BCTBX_PUBLIC void bctbx_sha256_batch(const uint8_t * const *inputs,
+		const size_t *inputLengths,
+		size_t count,
+		uint8_t hashLength,
+		uint8_t *output);
+
+/**
+ * @brief HMAC-SHA256 context: the key is processed once at creation, then any number of messages can be authenticated with it
+ */
+typedef struct bctbx_hmacSha256_context_struct bctbx_hmacSha256_context_t;
+
+/**
+ * @brief Create a HMAC-SHA256 context
+ * @param[in] 	key		HMAC secret key
+ * @param[in] 	keyLength	HMAC key length in bytes
+ * @return a context, to be destroyed with bctbx_hmacSha256_context_free
+ */
+BCTBX_PUBLIC bctbx_hmacSha256_context_t *bctbx_hmacSha256_context_new(const uint8_t *key, size_t keyLength);
+
+/**
+ * @brief Feed message data to the HMAC, may be called any number of times
+ * @param[in/out]	context		HMAC-SHA256 context
+ * @param[in]	input 		Input data buffer
+ * @param[in]   inputLength	Input data length in bytes
+ */
+BCTBX_PUBLIC void bctbx_hmacSha256_update(bctbx_hmacSha256_context_t *context, const uint8_t *input, size_t inputLength);
+
+/**
+ * @brief Output the HMAC of the current message, the context keeps its key and is ready for the next message
+ * @param[in/out]	context		HMAC-SHA256 context
+ * @param[in]	hmacLength	Length of output required in bytes, HMAC output is truncated to the hmacLength left bytes. 32 bytes maximum
+ * @param[out]	output		Output data buffer.
+ */
+BCTBX_PUBLIC void bctbx_hmacSha256_finish(bctbx_hmacSha256_context_t *context, uint8_t hmacLength, uint8_t *output);
+
+/**
+ * @brief Destroy a HMAC-SHA256 context, the key material is wiped
+ * @param[in/out]	context		HMAC-SHA256 context, may be NULL
+ */
+BCTBX_PUBLIC void bctbx_hmacSha256_context_free(bctbx_hmacSha256_context_t *context);
+
+/**
+ * @brief Compute the HMAC-SHA256 of count independent messages with the same key
+ * On x86 CPUs with AVX2 but without the SHA extensions, the messages are hashed eight at a time.
+ * @param[in] 	key		HMAC secret key
+ * @param[in] 	keyLength	HMAC key length in bytes
+ * @param[in]	inputs		Array of count input buffers
+ * @param[in]	inputLengths	Array of count input lengths in bytes
+ * @param[in]	count		Number of messages
+ * @param[in]	hmacLength	Length of each output in bytes, 32 bytes maximum
+ * @param[out]	output		Output buffer of count*hmacLength bytes, HMAC i is written at offset i*hmacLength
+ */
+BCTBX_PUBLIC void bctbx_hmacSha256_batch(const uint8_t *key,
+		size_t keyLength,
+		const uint8_t * const *inputs,
+		const size_t *inputLengths,
+		size_t count,
+		uint8_t hmacLength,
+		uint8_t *output);
+
+/**
+ * @brief Tell if the SHA256 contexts and batch functions run on the CPU SHA extensions
+ * @return 1 if hardware accelerated, 0 otherwise
+ */
+BCTBX_PUBLIC int bctbx_sha256_hardware_acceleration(void);
+
+/*****************************************************************************/
+/***** Crypto providers                                                  *****/
+/*****************************************************************************/
+/* The hash, HMAC and AES-GCM one shot functions (bctbx_sha256, bctbx_hmacSha256, bctbx_aes_gcm_encrypt_and_tag, ...)
+ * are dispatched at runtime to the selected provider of each primitive. The crypto backend and the bctoolbox
+ * SHA256 implementation are built-in providers, the fastest one is selected at first use. HKDF is built on the HMAC functions. */
+typedef enum {
+	BCTBX_CRYPTO_SHA256,
+	BCTBX_CRYPTO_SHA384,
+	BCTBX_CRYPTO_SHA512,
+	BCTBX_CRYPTO_HMAC_SHA256,
+	BCTBX_CRYPTO_HMAC_SHA384,
+	BCTBX_CRYPTO_HMAC_SHA512,
+	BCTBX_CRYPTO_AES_GCM,
+	BCTBX_CRYPTO_PRIMITIVES_COUNT
+} bctbx_crypto_primitive_t;
+
+/**
+ * A set of primitive implementations. Any function can be NULL when the provider does not implement the primitive.
+ * The functions have the signature and the semantic of the matching bctbx_* function.
+ */
+typedef struct {
+	const char *name;
+	void (*sha256)(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output);
+	void (*sha384)(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output);
+	void (*sha512)(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output);
+	void (*hmacSha256)(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output);
+	void (*hmacSha384)(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output);
+	void (*hmacSha512)(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output);
+	/* aesGcmEncrypt and aesGcmDecrypt must be both set or both NULL */
+	int32_t (*aesGcmEncrypt)(const uint8_t *key, size_t keyLength, const uint8_t *plainText, size_t plainTextLength,
+		const uint8_t *authenticatedData, size_t authenticatedDataLength, const uint8_t *initializationVector, size_t initializationVectorLength,
+		uint8_t *tag, size_t tagLength, uint8_t *output);
+	int32_t (*aesGcmDecrypt)(const uint8_t *key, size_t keyLength, const uint8_t *cipherText, size_t cipherTextLength,
+		const uint8_t *authenticatedData, size_t authenticatedDataLength, const uint8_t *initializationVector, size_t initializationVectorLength,
+		const uint8_t *tag, size_t tagLength, uint8_t *output);
+} bctbx_crypto_provider_t;
+
+/**
+ * @brief Register a crypto provider.
+ * Each primitive implemented by the provider is checked against known answer tests first, the failing ones are ignored.
+ *
+ * @param[in]	provider	the provider, it and its code must stay valid as long as a call may run on it: calls already
+ * 							dispatched to it keep running after bctbx_crypto_provider_unregister() returns, which does not
+ * 							wait for them. In practice, keep it for the lifetime of the process.
+ * @param[in]	benchmark	FALSE: the provider primitives override the currently selected ones.
+ * 							TRUE: each primitive is benchmarked and only overrides the selected one when it is faster.
+ *
+ * @return 0 on success, BCTBX_ERROR_SELF_TEST_FAILED if at least one primitive failed its test, BCTBX_ERROR_INVALID_INPUT_DATA if the provider is invalid or already registered
+ */
+BCTBX_PUBLIC int bctbx_crypto_provider_register(const bctbx_crypto_provider_t *provider, bool_t benchmark);
+
+/**
+ * @brief Unregister a crypto provider, the primitives it was selected for go back to the previous selection.
+ * The calls made afterwards no longer use the provider, the calls already running on it are not waited for:
+ * it must not be freed nor unloaded while one of them may still run.
+ * Built-in providers cannot be unregistered.
+ *
+ * @param[in]	provider	a provider given to bctbx_crypto_provider_register
+ */
+BCTBX_PUBLIC void bctbx_crypto_provider_unregister(const bctbx_crypto_provider_t *provider);
+
+/**
+ * @brief Get the name of the provider selected for a primitive.
+ *
+ * @param[in]	primitive	the primitive
+ *
+ * @return the provider name, NULL for an invalid primitive
+ */
+BCTBX_PUBLIC const char *bctbx_crypto_provider_get_selected(bctbx_crypto_primitive_t primitive);
+
 /**
  * @brief MD5 wrapper
  * output = md5(input)
@@ -972,6 +1396,8 @@ BCTBX_PUBLIC void bctbx_md5(const uint8_t *input,
 /***** Encryption/Decryption                                             *****/
 /*****************************************************************************/
 typedef struct bctbx_aes_gcm_context_struct bctbx_aes_gcm_context_t;
+/* size of the blocks read and written by bctbx_aes_gcm_encryptFileStream/bctbx_aes_gcm_decryptFileStream */
+#define BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE	65536
 /**
  * @Brief AES-GCM encrypt and tag buffer
  *
@@ -1133,6 +1559,89 @@ BCTBX_PUBLIC void bctbx_aes256CfbDecrypt(const uint8_t *key,
 		size_t inputLength,
 		uint8_t *output);
 
+typedef struct bctbx_aes_cfb_context_struct bctbx_aes_cfb_context_t;
+
+/**
+ * @brief One independent buffer processed by bctbx_aes_cfb_encrypt_packets or bctbx_aes_cfb_decrypt_packets
+ */
+typedef struct {
+	const uint8_t *IV; /**< initialisation vector, 128 bits long, not modified */
+	const uint8_t *input; /**< input data buffer */
+	size_t inputLength; /**< input data length */
+	uint8_t *output; /**< output data buffer, at least inputLength bytes, can be the input buffer */
+} bctbx_aes_cfb_packet_t;
+
+/**
+ * @brief Create an AES in CFB128 mode context: the key schedule is computed once and reused for every buffer processed with it.
+ * The context uses the AES-NI instructions when the CPU provides them.
+ *
+ * @param[in]	key			encryption key
+ * @param[in]	keyLength	key length in bytes, must be 16 or 32
+ *
+ * @return the context to be freed using bctbx_aes_cfb_context_free, NULL if the key length is invalid
+ */
+BCTBX_PUBLIC bctbx_aes_cfb_context_t *bctbx_aes_cfb_context_new(const uint8_t *key, size_t keyLength);
+
+/**
+ * @brief Free an AES in CFB128 mode context, the key schedule is erased
+ *
+ * @param[in/out]	context		the context to free, can be NULL
+ */
+BCTBX_PUBLIC void bctbx_aes_cfb_context_free(bctbx_aes_cfb_context_t *context);
+
+/**
+ * @brief AES in CFB128 mode encryption using a context, same output as bctbx_aes128CfbEncrypt/bctbx_aes256CfbEncrypt
+ *
+ * @param[in]	context		a context created by bctbx_aes_cfb_context_new
+ * @param[in]	IV			Initialisation vector, 128 bits long, is not modified by this function.
+ * @param[in]	input		Input data buffer
+ * @param[in]	inputLength	Input data length
+ * @param[out]	output		Output data buffer, can be the input buffer
+ */
+BCTBX_PUBLIC void bctbx_aes_cfb_encrypt(const bctbx_aes_cfb_context_t *context,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output);
+
+/**
+ * @brief AES in CFB128 mode decryption using a context, same output as bctbx_aes128CfbDecrypt/bctbx_aes256CfbDecrypt
+ *
+ * @param[in]	context		a context created by bctbx_aes_cfb_context_new
+ * @param[in]	IV			Initialisation vector, 128 bits long, is not modified by this function.
+ * @param[in]	input		Input data buffer
+ * @param[in]	inputLength	Input data length
+ * @param[out]	output		Output data buffer, can be the input buffer
+ */
+BCTBX_PUBLIC void bctbx_aes_cfb_decrypt(const bctbx_aes_cfb_context_t *context,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output);
+
+/**
+ * @brief AES in CFB128 mode encryption of many independent packets sharing the same key.
+ * CFB encryption of a single buffer is sequential, several packets are processed side by side to make better use of the CPU.
+ *
+ * @param[in]	context			a context created by bctbx_aes_cfb_context_new
+ * @param[in]	packets			the packets to encrypt, each one with its own IV
+ * @param[in]	packetsCount	number of packets
+ */
+BCTBX_PUBLIC void bctbx_aes_cfb_encrypt_packets(const bctbx_aes_cfb_context_t *context,
+		const bctbx_aes_cfb_packet_t *packets,
+		size_t packetsCount);
+
+/**
+ * @brief AES in CFB128 mode decryption of many independent packets sharing the same key.
+ *
+ * @param[in]	context			a context created by bctbx_aes_cfb_context_new
+ * @param[in]	packets			the packets to decrypt, each one with its own IV
+ * @param[in]	packetsCount	number of packets
+ */
+BCTBX_PUBLIC void bctbx_aes_cfb_decrypt_packets(const bctbx_aes_cfb_context_t *context,
+		const bctbx_aes_cfb_packet_t *packets,
+		size_t packetsCount);
+
 /**
  * @brief encrypt the file in input buffer for linphone encrypted file transfer
  *
@@ -1161,6 +1670,40 @@ BCTBX_PUBLIC int bctbx_aes_gcm_encryptFile(void **cryptoContext, unsigned char *
  */
 BCTBX_PUBLIC int bctbx_aes_gcm_decryptFile(void **cryptoContext, unsigned char *key, size_t length, char *plain, char *cipher);
 
+/**
+ * @brief encrypt a whole file for linphone encrypted file transfer, without loading it in memory
+ *
+ * The plain file is read from its beginning to its end by blocks of BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE bytes, the next block
+ * being read while the current one is encrypted and written, so the memory used does not depend on the file size.
+ * The output is the same as the one produced by successive calls to bctbx_aes_gcm_encryptFile.
+ *
+ * @param[in]		key			encryption key: 192 bits of key || 64 bits of initialisation vector
+ * @param[in]		plainFile	the file to encrypt, opened for reading
+ * @param[out]		cipherFile	the file to store the encrypted data in, truncated then written from its beginning, opened for writing
+ * @param[out]		tag			buffer to store the authentication tag, can be NULL if tagLength is 0
+ * @param[in]		tagLength	length of the requested authentication tag, max 16
+ *
+ * @return 0 on success, BCTBX_VFS_ERROR if a file access failed, BCTBX_ERROR_INVALID_INPUT_DATA on invalid parameters or crypto library error code
+ */
+BCTBX_PUBLIC int bctbx_aes_gcm_encryptFileStream(const unsigned char *key, bctbx_vfs_file_t *plainFile, bctbx_vfs_file_t *cipherFile, uint8_t *tag, size_t tagLength);
+
+/**
+ * @brief decrypt a whole file for linphone encrypted file transfer, without loading it in memory
+ *
+ * Counterpart of bctbx_aes_gcm_encryptFileStream. When a tag is given, it is checked once the whole file is decrypted.
+ * On mismatch, as on any other failure once started, the plain file is truncated to 0 so no unauthenticated data is left in it.
+ *
+ * @param[in]		key			encryption key: 192 bits of key || 64 bits of initialisation vector
+ * @param[in]		cipherFile	the file to decrypt, opened for reading
+ * @param[out]		plainFile	the file to store the decrypted data in, truncated then written from its beginning, opened for writing
+ * @param[in]		tag			the expected authentication tag, can be NULL if tagLength is 0 to skip the check
+ * @param[in]		tagLength	length of the authentication tag, max 16
+ *
+ * @return 0 on success, BCTBX_ERROR_AUTHENTICATION_FAILED if the tag does not match, BCTBX_VFS_ERROR if a file access failed,
+ * BCTBX_ERROR_INVALID_INPUT_DATA on invalid parameters or crypto library error code
+ */
+BCTBX_PUBLIC int bctbx_aes_gcm_decryptFileStream(const unsigned char *key, bctbx_vfs_file_t *cipherFile, bctbx_vfs_file_t *plainFile, const uint8_t *tag, size_t tagLength);
+
 /*****************************************************************************/
 /***** Cleaning                                                          *****/
 /*****************************************************************************/
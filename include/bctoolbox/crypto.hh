@@ -32,8 +32,12 @@ namespace bctoolbox {
  *
  * This wrapper provides an interface to a RNG.
  * Two ways to get some random numbers:
- *  - calling the static class functions(cRandomize) : do not use this to feed cryptographic functions
- *  - instanciate a RNG object and call the randomize method : use this one for cryptographic quality random
+ *  - calling the static class functions(cRandomize) : they use a context private to the calling thread,
+ *    seeded at first use, so they are thread-safe and lock-free
+ *  - instanciate a RNG object and call the randomize method : the object holds its own context
+ *
+ * All the contexts are seeded from a DRBG pool, itself seeded from the system entropy source,
+ * and periodically reseeded from it, so creating a RNG object is cheap.
  *
  * Any call (including creation), may throw an exception if some error are detected on the random source
  */
@@ -63,13 +67,13 @@ class RNG {
 		 * @param[in,out]	buffer 	The buffer to be filled with random (callers responsability to allocate memory)
 		 * @param[in]		size	size in bytes of the random generated, buffer must be at least of this size
 		 *
-		 * @note This function uses a shared RNG context, do not use it to generate sensitive material
+		 * @note This function uses the calling thread RNG context
 		 **/
 		static void cRandomize(uint8_t *buffer, size_t size);
 		/**
 		 * generates a 32 bits random unsigned number
 		 *
-		 * @note This function uses a shared RNG context, do not use it to generate sensitive material
+		 * @note This function uses the calling thread RNG context
 		 **/
 		static uint32_t cRandomize();
 
@@ -78,7 +82,6 @@ class RNG {
 	private:
 		struct Impl;
 		std::unique_ptr<Impl> pImpl;
-		static std::unique_ptr<Impl> pImplClass;
 }; //class RNG
 
 
@@ -228,6 +231,87 @@ template <> std::vector<uint8_t> AEADEncrypt<AES256GCM128>(const std::vector<uin
 template <> bool AEADDecrypt<AES256GCM128>(const std::vector<uint8_t> &key, const std::vector<uint8_t> &IV, const std::vector<uint8_t> &cipher, const std::vector<uint8_t> &AD,
 		const std::vector<uint8_t> &tag, std::vector<uint8_t> &plain);
 
+/**
+ * @brief AEAD context keyed once and used to process any number of messages
+ *
+ * The key schedule (and the GHASH tables for GCM) is computed at construction only.
+ * Messages can be processed into caller provided buffers, output and input may be the same buffer for in place operation.
+ * The backend hardware acceleration (AES-NI and carry-less multiplication for GCM) is used when available.
+ *
+ * An object must not be used concurrently by several threads.
+ * Any call (including creation) may throw an exception on invalid parameters or backend error.
+ */
+template <typename AEADAlgo>
+class AEAD {
+	public:
+		/**
+		 * @param[in]	key	Encryption key, of AEADAlgo::keySize() bytes
+		 */
+		explicit AEAD(const std::vector<uint8_t> &key);
+		AEAD(const uint8_t *key, size_t keySize);
+		~AEAD();
+		AEAD(const AEAD &) = delete;
+		AEAD &operator=(const AEAD &) = delete;
+
+		/**
+		 * @brief Encrypt and tag
+		 *
+		 * @param[in]	IV		Initialisation vector
+		 * @param[in]	IVSize		Initialisation vector size in bytes
+		 * @param[in]	AD		Additional data used in tag computation
+		 * @param[in]	ADSize		Additional data size in bytes
+		 * @param[in]	plain		Plain text
+		 * @param[in]	size		Plain text size in bytes
+		 * @param[out]	cipher		Cipher text buffer of size bytes, may be the same buffer than plain
+		 * @param[out]	tag		Generated authentication tag buffer of AEADAlgo::tagSize() bytes
+		 */
+		void encrypt(const uint8_t *IV, size_t IVSize, const uint8_t *AD, size_t ADSize,
+				const uint8_t *plain, size_t size, uint8_t *cipher, uint8_t *tag);
+
+		/**
+		 * @brief Authenticate and decrypt
+		 *
+		 * @param[in]	IV		Initialisation vector
+		 * @param[in]	IVSize		Initialisation vector size in bytes
+		 * @param[in]	AD		Additional data used in tag computation
+		 * @param[in]	ADSize		Additional data size in bytes
+		 * @param[in]	cipher		Cipher text
+		 * @param[in]	size		Cipher text size in bytes
+		 * @param[in]	tag		Authentication tag of AEADAlgo::tagSize() bytes
+		 * @param[out]	plain		Plain text buffer of size bytes, may be the same buffer than cipher
+		 *
+		 * @return true if authentication tag match and decryption was successful
+		 */
+		bool decrypt(const uint8_t *IV, size_t IVSize, const uint8_t *AD, size_t ADSize,
+				const uint8_t *cipher, size_t size, const uint8_t *tag, uint8_t *plain);
+
+		/**
+		 * @brief Encrypt and tag, same as AEADEncrypt but without the key setup
+		 * @return	the cipher text
+		 */
+		std::vector<uint8_t> encrypt(const std::vector<uint8_t> &IV, const std::vector<uint8_t> &plain, const std::vector<uint8_t> &AD,
+				std::vector<uint8_t> &tag);
+
+		/**
+		 * @brief Authenticate and decrypt, same as AEADDecrypt but without the key setup
+		 * @return true if authentication tag match and decryption was successful
+		 */
+		bool decrypt(const std::vector<uint8_t> &IV, const std::vector<uint8_t> &cipher, const std::vector<uint8_t> &AD,
+				const std::vector<uint8_t> &tag, std::vector<uint8_t> &plain);
+
+		/**
+		 * @return true if the backend runs this algorithm on dedicated CPU instructions
+		 */
+		static bool hardwareAccelerated();
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> pImpl;
+}; // class AEAD
+
+/* AEAD is instanciated in the backend for: AES256-GCM with 128 bits auth tag */
+extern template class AEAD<AES256GCM128>;
+
 /************************** AES Key Wrap Algorithm ***************************/
 enum class AesId {AES128, AES192, AES256};
 
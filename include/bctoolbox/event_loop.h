@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_EVENT_LOOP_H_
+#define BCTBX_EVENT_LOOP_H_
+#include "bctoolbox/port.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * A readiness multiplexer for sockets and file descriptors (pipes, on platforms where they are file descriptors), with timers.
+ * It uses edge-triggered epoll on Linux, poll() elsewhere. Timers are kept in a hashed timer wheel of millisecond resolution:
+ * starting and stopping a timer are O(1).
+ * A loop and its sources and timers are used from a single thread, the one running the loop,
+ * except bctbx_event_loop_wakeup(), bctbx_event_loop_post() and bctbx_event_loop_stop() which may be called from any thread.
+ */
+typedef struct _bctbx_event_loop_t bctbx_event_loop_t;
+typedef struct _bctbx_event_source_t bctbx_event_source_t;
+typedef struct _bctbx_event_timer_t bctbx_event_timer_t;
+
+#define BCTBX_EVENT_READ	(1 << 0)
+#define BCTBX_EVENT_WRITE	(1 << 1)
+#define BCTBX_EVENT_ERROR	(1 << 2) /**< error or hang up, always reported */
+
+/**
+ * Called when the file descriptor becomes ready. Readiness is edge-triggered with epoll: the callback must read (or write)
+ * until the operation would block, it is not called again for data that was already there. It is level-triggered with poll(),
+ * so portable users only watch BCTBX_EVENT_WRITE while they have data waiting to be written.
+ * @param[in] events	a combination of BCTBX_EVENT_READ, BCTBX_EVENT_WRITE and BCTBX_EVENT_ERROR
+ */
+typedef void (*bctbx_event_source_callback_t)(void *user_data, bctbx_socket_t fd, int events);
+typedef void (*bctbx_event_timer_callback_t)(void *user_data, bctbx_event_timer_t *timer);
+typedef void (*bctbx_event_loop_task_t)(void *user_data);
+
+/**
+ * Create an event loop.
+ * @return the loop, or NULL if the system multiplexer could not be created.
+ */
+BCTBX_PUBLIC bctbx_event_loop_t *bctbx_event_loop_new(void);
+
+/**
+ * Destroy an event loop. Its sources and timers must have been removed and freed, tasks still posted are dropped.
+ */
+BCTBX_PUBLIC void bctbx_event_loop_free(bctbx_event_loop_t *loop);
+
+/**
+ * Run one iteration: wait for readiness, timers or wake up, at most timeout_ms (negative to wait until something happens),
+ * then invoke the callbacks.
+ * @return the number of callbacks invoked, or -1 on error.
+ */
+BCTBX_PUBLIC int bctbx_event_loop_run_once(bctbx_event_loop_t *loop, int timeout_ms);
+
+/**
+ * Run the loop until bctbx_event_loop_stop() is called.
+ */
+BCTBX_PUBLIC void bctbx_event_loop_run(bctbx_event_loop_t *loop);
+
+/**
+ * Get the loop time, a monotonic time in milliseconds read once per iteration when the loop wakes up.
+ * Callbacks use it instead of reading the clock again.
+ */
+BCTBX_PUBLIC uint64_t bctbx_event_loop_get_time_ms(const bctbx_event_loop_t *loop);
+
+/**
+ * Refresh the loop time, for callbacks that ran long enough to make it stale.
+ */
+BCTBX_PUBLIC void bctbx_event_loop_update_time(bctbx_event_loop_t *loop);
+
+/**
+ * Make bctbx_event_loop_run() return after the current iteration. Thread safe.
+ */
+BCTBX_PUBLIC void bctbx_event_loop_stop(bctbx_event_loop_t *loop);
+
+/**
+ * Interrupt the wait of the loop. Thread safe.
+ */
+BCTBX_PUBLIC void bctbx_event_loop_wakeup(bctbx_event_loop_t *loop);
+
+/**
+ * Run a task on the loop thread, at its next iteration. Tasks run in the order they were posted. Thread safe.
+ */
+BCTBX_PUBLIC void bctbx_event_loop_post(bctbx_event_loop_t *loop, bctbx_event_loop_task_t task, void *user_data);
+
+/**
+ * Watch a file descriptor.
+ * @param[in] events	BCTBX_EVENT_READ and/or BCTBX_EVENT_WRITE
+ * @return the source, or NULL if the descriptor could not be watched
+ */
+BCTBX_PUBLIC bctbx_event_source_t *bctbx_event_loop_add_source(bctbx_event_loop_t *loop, bctbx_socket_t fd, int events, bctbx_event_source_callback_t callback, void *user_data);
+
+/**
+ * Change the events watched on a source.
+ * @return 0 on success, -1 on error
+ */
+BCTBX_PUBLIC int bctbx_event_source_set_events(bctbx_event_source_t *source, int events);
+
+/**
+ * Stop watching a file descriptor and free the source, which must be done before closing the descriptor.
+ * May be called from any callback of the loop, the source callback is not invoked anymore.
+ */
+BCTBX_PUBLIC void bctbx_event_source_remove(bctbx_event_source_t *source);
+
+/**
+ * Create a timer, initially stopped.
+ */
+BCTBX_PUBLIC bctbx_event_timer_t *bctbx_event_timer_new(bctbx_event_loop_t *loop, bctbx_event_timer_callback_t callback, void *user_data);
+
+/**
+ * (Re)start a timer.
+ * @param[in] delay_ms		delay before the first expiry, counted from the loop time, updated when the loop wakes up
+ * @param[in] interval_ms	period of the following expiries, 0 for a single shot timer
+ */
+BCTBX_PUBLIC void bctbx_event_timer_start(bctbx_event_timer_t *timer, uint64_t delay_ms, uint64_t interval_ms);
+
+/**
+ * Stop a timer, it may be started again.
+ */
+BCTBX_PUBLIC void bctbx_event_timer_stop(bctbx_event_timer_t *timer);
+
+BCTBX_PUBLIC bool_t bctbx_event_timer_is_running(const bctbx_event_timer_t *timer);
+
+/**
+ * Stop and free a timer. May be called from any callback of the loop, including the timer's.
+ */
+BCTBX_PUBLIC void bctbx_event_timer_free(bctbx_event_timer_t *timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_EVENT_LOOP_H_ */
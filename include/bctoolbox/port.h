@@ -57,6 +57,7 @@
 typedef int bctbx_socket_t;
 typedef pthread_t bctbx_thread_t;
 typedef pthread_mutex_t bctbx_mutex_t;
+typedef pthread_rwlock_t bctbx_rwlock_t;
 typedef pthread_cond_t bctbx_cond_t;
 
 #ifdef __INTEL_COMPILER
@@ -84,6 +85,7 @@ typedef pthread_cond_t bctbx_cond_t;
 #define BCTBX_EHOSTUNREACH	EHOSTUNREACH
 #define BCTBX_ENOTCONN		ENOTCONN
 #define BCTBX_EPROTOTYPE	EPROTOTYPE /* Protocol wrong type for socket */
+#define BCTBX_EINVAL		EINVAL
 
 #ifdef __cplusplus
 extern "C"
@@ -106,6 +108,12 @@ unsigned long __bctbx_thread_self(void);
 #define bctbx_mutex_lock       pthread_mutex_lock
 #define bctbx_mutex_unlock     pthread_mutex_unlock
 #define bctbx_mutex_destroy    pthread_mutex_destroy
+#define bctbx_rwlock_init      pthread_rwlock_init
+#define bctbx_rwlock_rdlock    pthread_rwlock_rdlock
+#define bctbx_rwlock_wrlock    pthread_rwlock_wrlock
+#define bctbx_rwlock_rdunlock  pthread_rwlock_unlock
+#define bctbx_rwlock_wrunlock  pthread_rwlock_unlock
+#define bctbx_rwlock_destroy   pthread_rwlock_destroy
 #define bctbx_cond_init        pthread_cond_init
 #define bctbx_cond_signal      pthread_cond_signal
 #define bctbx_cond_broadcast   pthread_cond_broadcast
@@ -295,6 +303,7 @@ typedef HANDLE bctbx_mutex_t;
 typedef CONDITION_VARIABLE bctbx_cond_t;
 typedef SRWLOCK bctbx_mutex_t;
 #endif
+typedef SRWLOCK bctbx_rwlock_t;
 typedef HANDLE bctbx_thread_t;
 
 #define bctbx_thread_create     __bctbx_WIN_thread_create
@@ -305,6 +314,12 @@ typedef HANDLE bctbx_thread_t;
 #define bctbx_mutex_lock        __bctbx_WIN_mutex_lock
 #define bctbx_mutex_unlock      __bctbx_WIN_mutex_unlock
 #define bctbx_mutex_destroy     __bctbx_WIN_mutex_destroy
+#define bctbx_rwlock_init       __bctbx_WIN_rwlock_init
+#define bctbx_rwlock_rdlock     __bctbx_WIN_rwlock_rdlock
+#define bctbx_rwlock_wrlock     __bctbx_WIN_rwlock_wrlock
+#define bctbx_rwlock_rdunlock   __bctbx_WIN_rwlock_rdunlock
+#define bctbx_rwlock_wrunlock   __bctbx_WIN_rwlock_wrunlock
+#define bctbx_rwlock_destroy    __bctbx_WIN_rwlock_destroy
 #define bctbx_cond_init         __bctbx_WIN_cond_init
 #define bctbx_cond_signal       __bctbx_WIN_cond_signal
 #define bctbx_cond_broadcast    __bctbx_WIN_cond_broadcast
@@ -322,6 +337,12 @@ BCTBX_PUBLIC int __bctbx_WIN_mutex_init(bctbx_mutex_t *m, void *attr_unused);
 BCTBX_PUBLIC int __bctbx_WIN_mutex_lock(bctbx_mutex_t *mutex);
 BCTBX_PUBLIC int __bctbx_WIN_mutex_unlock(bctbx_mutex_t *mutex);
 BCTBX_PUBLIC int __bctbx_WIN_mutex_destroy(bctbx_mutex_t *mutex);
+BCTBX_PUBLIC int __bctbx_WIN_rwlock_init(bctbx_rwlock_t *lock, void *attr_unused);
+BCTBX_PUBLIC int __bctbx_WIN_rwlock_rdlock(bctbx_rwlock_t *lock);
+BCTBX_PUBLIC int __bctbx_WIN_rwlock_wrlock(bctbx_rwlock_t *lock);
+BCTBX_PUBLIC int __bctbx_WIN_rwlock_rdunlock(bctbx_rwlock_t *lock);
+BCTBX_PUBLIC int __bctbx_WIN_rwlock_wrunlock(bctbx_rwlock_t *lock);
+BCTBX_PUBLIC int __bctbx_WIN_rwlock_destroy(bctbx_rwlock_t *lock);
 BCTBX_PUBLIC int __bctbx_WIN_thread_create(bctbx_thread_t *t, void *attr_unused, void *(*func)(void*), void *arg);
 BCTBX_PUBLIC int __bctbx_WIN_thread_join(bctbx_thread_t thread, void **unused);
 BCTBX_PUBLIC unsigned long __bctbx_WIN_thread_self(void);
@@ -344,6 +365,7 @@ BCTBX_PUBLIC int __bctbx_WIN_inet_aton (const char * cp, struct in_addr * addr);
 #define BCTBX_EHOSTUNREACH WSAEHOSTUNREACH
 #define BCTBX_ENOTCONN     WSAENOTCONN
 #define BCTBX_EPROTOTYPE	WSAEPROTOTYPE /* Protocol wrong type for socket */
+#define BCTBX_EINVAL		WSAEINVAL
 
 #if defined(_WIN32_WCE)
 
@@ -446,6 +468,26 @@ typedef struct bctoolboxTimeSpec{
 	int64_t tv_nsec;
 }bctoolboxTimeSpec;
 
+typedef struct _bctbx_lock_stats_t {
+	uint64_t acquisitions;
+	uint64_t contentions; /**< acquisitions that found the lock held */
+	uint64_t sleeps; /**< times a contending thread gave up spinning and went to sleep */
+} bctbx_lock_stats_t;
+
+/**
+ * A mutex for very short critical sections. A contended lock spins a while before sleeping, the spin duration adapting
+ * to how long the mutex is usually held. Threads sleep on a futex on Linux, and yield elsewhere. It is not recursive.
+ * It counts the contentions it sees, to spot the locks worth splitting.
+ * Initialize with bctbx_adaptive_mutex_init() or BCTBX_ADAPTIVE_MUTEX_INITIALIZER.
+ */
+typedef struct _bctbx_adaptive_mutex_t {
+	int state; /* 0: free, 1: locked, 2: locked and there may be sleepers */
+	int spins; /* running average of the spins that acquired the mutex, in 1/16 of a spin */
+	bctbx_lock_stats_t stats;
+} bctbx_adaptive_mutex_t;
+
+#define BCTBX_ADAPTIVE_MUTEX_INITIALIZER {0, 0, {0, 0, 0}}
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -584,6 +626,32 @@ BCTBX_PUBLIC void bctbx_get_cur_time(bctoolboxTimeSpec *ret);
 BCTBX_PUBLIC void bctbx_get_utc_cur_time(bctoolboxTimeSpec *ret);
 
 BCTBX_PUBLIC uint64_t bctbx_get_cur_time_ms(void);
+
+/**
+ * @brief Monotonic time in milliseconds from a coarse clock (CLOCK_MONOTONIC_COARSE on Linux, the tick count on Windows),
+ *        with a resolution of a few milliseconds. Much cheaper than bctbx_get_cur_time_ms(), for timeouts and expiry checks
+ *        made at high rates.
+ */
+BCTBX_PUBLIC uint64_t bctbx_get_coarse_time_ms(void);
+
+/**
+ * @brief Read a high resolution counter for profiling: the TSC on x86 hosts with an invariant TSC, the virtual counter on aarch64,
+ *        a monotonic clock in nanoseconds elsewhere. Only differences between two reads are meaningful, see bctbx_tsc_to_ns().
+ */
+BCTBX_PUBLIC uint64_t bctbx_tsc_read(void);
+
+/**
+ * @brief Frequency of the bctbx_tsc_read() counter, in ticks per second.
+ *        The TSC is calibrated against the monotonic clock at the first call, which takes about 10ms:
+ *        call it once at startup to keep the calibration out of the measurements.
+ */
+BCTBX_PUBLIC uint64_t bctbx_tsc_frequency(void);
+
+/**
+ * @brief Convert a number of bctbx_tsc_read() ticks to nanoseconds.
+ */
+BCTBX_PUBLIC uint64_t bctbx_tsc_to_ns(uint64_t ticks);
+
 BCTBX_PUBLIC void bctbx_sleep_ms(int ms);
 BCTBX_PUBLIC void bctbx_sleep_until(const bctoolboxTimeSpec *ts);
 
@@ -631,6 +699,44 @@ BCTBX_PUBLIC ssize_t bctbx_send(bctbx_socket_t socket, const void *buffer, size_
 BCTBX_PUBLIC ssize_t bctbx_sendto(bctbx_socket_t socket, const void *message, size_t length, int flags, const struct sockaddr *dest_addr,	socklen_t dest_len);
 BCTBX_PUBLIC ssize_t bctbx_recv(bctbx_socket_t socket, void *buffer, size_t length, int flags);
 BCTBX_PUBLIC ssize_t bctbx_recvfrom(bctbx_socket_t socket, void *buffer, size_t length, int flags, struct sockaddr *address, socklen_t *address_len);
+
+/**
+ * A datagram moved by bctbx_sendmmsg()/bctbx_recvmmsg().
+ */
+typedef struct {
+	void *buffer; /**< data to send, or storage for the received data */
+	size_t size; /**< size of the buffer, used on reception */
+	size_t length; /**< length of the data to send, or received length */
+	size_t segmentSize; /**< on emission, 0 or the size of the segments the data is split into (UDP GSO). On reception, the size of the segments coalesced in the buffer (UDP GRO), equal to length when not coalesced. The last segment may be shorter. */
+	struct sockaddr_storage address; /**< destination, or source on reception */
+	socklen_t addressLength;
+} bctbx_datagram_t;
+
+/**
+ * Send a batch of datagrams, with sendmmsg() when available and one sendto() per datagram otherwise.
+ * A datagram with a segmentSize is sent as length/segmentSize datagrams of segmentSize bytes to the same destination,
+ * segmented by the kernel (UDP GSO) on Linux, and here with one sendto() per segment elsewhere or when the kernel cannot.
+ * On every platform, a datagram with a segmentSize above 65535 is not sent and stops the batch with BCTBX_EINVAL.
+ * A datagram segmented here may fail after some of its segments were sent: it is counted as not sent,
+ * so sending it again repeats these segments.
+ * @return the number of datagrams sent, fewer than count if the socket buffer is full, or -1 if none was sent, with the socket error set.
+ */
+BCTBX_PUBLIC int bctbx_sendmmsg(bctbx_socket_t socket, const bctbx_datagram_t *datagrams, unsigned int count, int flags);
+
+/**
+ * Receive a batch of datagrams, with recvmmsg() when available and several recvfrom() otherwise.
+ * Only the first datagram is waited for (according to the socket blocking mode), the others are the ones already queued.
+ * @return the number of datagrams received, or -1 on error with the socket error set.
+ */
+BCTBX_PUBLIC int bctbx_recvmmsg(bctbx_socket_t socket, bctbx_datagram_t *datagrams, unsigned int count, int flags);
+
+/**
+ * Let the kernel coalesce consecutive datagrams from the same source in one reception (UDP GRO, Linux only).
+ * bctbx_recvmmsg() reports the segment size of the coalesced datagrams.
+ * @return 0 on success, -1 if not supported
+ */
+BCTBX_PUBLIC int bctbx_socket_enable_udp_gro(bctbx_socket_t socket);
+
 BCTBX_PUBLIC ssize_t bctbx_read(int fd, void *buf, size_t nbytes);
 BCTBX_PUBLIC ssize_t bctbx_write(int fd, const void *buf, size_t nbytes);
 
@@ -744,6 +850,69 @@ BCTBX_PUBLIC bool_t bctbx_is_multicast_addr(const struct sockaddr *addr);
 
 #endif
 
+/* Error codes of the codecs, also used by the crypto functions */
+#define BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL		-0x70001000
+#define BCTBX_ERROR_INVALID_BASE64_INPUT		-0x70002000
+#define BCTBX_ERROR_INVALID_INPUT_DATA			-0x70004000
+
+/**
+ * @brief Encode a buffer into a lower case hexadecimal string, null terminated
+ * @param[out]		output			hexadecimal string
+ * @param[in/out]	output_length	output buffer max size and length of the string after encoding(without the null termination)
+ * @param[in]		input			source plain buffer
+ * @param[in]		input_length	Length in bytes of plain buffer to be encoded
+ *
+ * @return 0 if success or BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL if the output buffer cannot contain the encoded data
+ *
+ * @note If the output buffer is NULL or too small, set the requested buffer size (2*input_length+1) in output_length
+ */
+BCTBX_PUBLIC int32_t bctbx_hex_encode(char *output, size_t *output_length, const uint8_t *input, size_t input_length);
+
+/**
+ * @brief Decode an hexadecimal string, upper and lower case digits are accepted
+ * @param[out]		output			plain buffer
+ * @param[in/out]	output_length	output buffer max size and actual size of buffer after decoding
+ * @param[in]		input			source hexadecimal string
+ * @param[in]		input_length	Length in chars of the hexadecimal string, must be even
+ *
+ * @return 0 if success, BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL if the output buffer cannot contain the decoded data
+ * or BCTBX_ERROR_INVALID_INPUT_DATA if the input is not an hexadecimal string(the output content is then undefined)
+ *
+ * @note If the output buffer is NULL or too small, set the requested buffer size (input_length/2) in output_length
+ */
+BCTBX_PUBLIC int32_t bctbx_hex_decode(uint8_t *output, size_t *output_length, const char *input, size_t input_length);
+
+/**
+ * @brief Encode a buffer into base64 format
+ * @param[out]		output			base64 encoded buffer
+ * @param[in/out]	output_length	output buffer max size and actual size of buffer after encoding
+ * @param[in]		input			source plain buffer
+ * @param[in]		input_length	Length in bytes of plain buffer to be encoded
+ *
+ * @return 0 if success or BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL if the output buffer cannot contain the encoded data
+ *
+ * @note If the function is called with *output_length=0, set the requested buffer size in output_length,
+ * including the null termination written after the encoded data
+ */
+BCTBX_PUBLIC int32_t bctbx_base64_encode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length);
+
+/**
+ * @brief Decode a base64 formatted buffer.
+ * @param[out]		output			plain buffer
+ * @param[in/out]	output_length	output buffer max size and actual size of buffer after decoding
+ * @param[in]		input			source base64 encoded buffer
+ * @param[in]		input_length	Length in bytes of base64 buffer to be decoded
+ *
+ * The input must be padded to a multiple of 4 chars, it may be split in lines (CR and LF are ignored)
+ * but contain no other char out of the base64 alphabet.
+ *
+ * @return 0 if success, BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL if the output buffer cannot contain the decoded data
+ * or BCTBX_ERROR_INVALID_BASE64_INPUT if encoded buffer was incorrect base64 data
+ *
+ * @note If the function is called with *output_length=0, set the requested buffer size in output_length
+ */
+BCTBX_PUBLIC int32_t bctbx_base64_decode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length);
+
 /**
  * @brief	convert an hexa char [0-9a-fA-F] into the corresponding unsigned integer value
  * Any invalid char will be converted to zero without any warning
@@ -842,6 +1011,22 @@ BCTBX_PUBLIC int bctbx_strcmp(const char *a, const char *b);
  */
 BCTBX_PUBLIC void bctbx_set_self_thread_name(const char *name);
 
+BCTBX_PUBLIC void bctbx_adaptive_mutex_init(bctbx_adaptive_mutex_t *mutex);
+BCTBX_PUBLIC void bctbx_adaptive_mutex_lock(bctbx_adaptive_mutex_t *mutex);
+/**
+ * @return 0 if the mutex was acquired, -1 if it is held
+ */
+BCTBX_PUBLIC int bctbx_adaptive_mutex_trylock(bctbx_adaptive_mutex_t *mutex);
+BCTBX_PUBLIC void bctbx_adaptive_mutex_unlock(bctbx_adaptive_mutex_t *mutex);
+BCTBX_PUBLIC void bctbx_adaptive_mutex_destroy(bctbx_adaptive_mutex_t *mutex);
+
+/**
+ * @brief Get the contention counters of an adaptive mutex.
+ * They are updated by the lock holder, so they are only exact when read with the mutex held or unused.
+ */
+BCTBX_PUBLIC void bctbx_adaptive_mutex_get_stats(const bctbx_adaptive_mutex_t *mutex, bctbx_lock_stats_t *stats);
+BCTBX_PUBLIC void bctbx_adaptive_mutex_reset_stats(bctbx_adaptive_mutex_t *mutex);
+
 /**
  * @brief Set handlers to catch exceptions and write the stack trace into log. Available for Windows.
  * It keeps old handlers.
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_RESOLVER_H_
+#define BCTBX_RESOLVER_H_
+#include "bctoolbox/port.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * An asynchronous name resolver: lookups run on a small pool of threads owned by the resolver,
+ * concurrent queries for the same name, family, socktype and port share a single lookup,
+ * and results are cached, successes for the positive TTL and unknown names for the negative TTL.
+ * Transient failures (EAI_AGAIN...) are never cached.
+ */
+typedef struct _bctbx_resolver_t bctbx_resolver_t;
+typedef struct _bctbx_resolver_query_t bctbx_resolver_query_t;
+
+/**
+ * Called once the query completes, always from a resolver thread, cache hits included: never before bctbx_resolver_resolve() returned.
+ * @param[in] user_data	as given to bctbx_resolver_resolve()
+ * @param[in] error		0 or a getaddrinfo error code (EAI_*)
+ * @param[in] result	the sorted addresses, NULL on error. It is owned by the resolver, use bctbx_resolver_query_get_result() to keep it longer than the callback.
+ */
+typedef void (*bctbx_resolver_callback_t)(void *user_data, int error, const struct addrinfo *result);
+
+/**
+ * A lookup function replacing bctbx_getaddrinfo(), to plug in a stub resolver or a hosts file.
+ * *res must be freeable by bctbx_freeaddrinfo(), bctbx_ip_address_to_addrinfo() builds suitable entries.
+ * *ttl holds the configured positive TTL on input, the function may set it to the TTL of the records it found.
+ * Failures use the negative TTL.
+ * @return 0 or a getaddrinfo error code (EAI_*)
+ */
+typedef int (*bctbx_resolver_lookup_func_t)(void *user_data, const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res, uint32_t *ttl);
+
+/**
+ * Create a resolver.
+ * @param[in] thread_count number of lookup threads, 0 selects a default of 2.
+ */
+BCTBX_PUBLIC bctbx_resolver_t *bctbx_resolver_new(int thread_count);
+
+/**
+ * Destroy a resolver. Lookups in progress are waited for, queries still pending complete with EAI_AGAIN.
+ * Query handles stay valid and must still be freed with bctbx_resolver_query_free().
+ */
+BCTBX_PUBLIC void bctbx_resolver_free(bctbx_resolver_t *resolver);
+
+/**
+ * Set the cache TTLs in seconds, default to 60s for found names and 10s for unknown names. 0 disables caching.
+ * getaddrinfo does not report the records TTL, so this is the lifetime of every cached result unless the lookup function reports one.
+ */
+BCTBX_PUBLIC void bctbx_resolver_set_ttls(bctbx_resolver_t *resolver, uint32_t positive_ttl, uint32_t negative_ttl);
+
+/**
+ * Replace the lookup function, NULL restores bctbx_getaddrinfo(). Must be set before submitting queries.
+ */
+BCTBX_PUBLIC void bctbx_resolver_set_lookup_func(bctbx_resolver_t *resolver, bctbx_resolver_lookup_func_t func, void *user_data);
+
+/**
+ * Drop every cached result.
+ */
+BCTBX_PUBLIC void bctbx_resolver_clear_cache(bctbx_resolver_t *resolver);
+
+/**
+ * Resolve a name asynchronously, with the same conventions as bctbx_name_to_addrinfo().
+ * @param[in] callback	invoked once when the query completes, unless the query is freed before. May be NULL to poll the query instead.
+ * @return a query handle, to be freed with bctbx_resolver_query_free()
+ */
+BCTBX_PUBLIC bctbx_resolver_query_t *bctbx_resolver_resolve(bctbx_resolver_t *resolver, int family, int socktype, const char *name, int port, bctbx_resolver_callback_t callback, void *user_data);
+
+/**
+ * Wait for a query to complete, including the return of its callback. Do not wait for a query from its own callback.
+ * @param[in] timeout_ms	maximum waiting time, 0 just polls, a negative value waits forever
+ * @return TRUE if the query is complete
+ */
+BCTBX_PUBLIC bool_t bctbx_resolver_query_wait(bctbx_resolver_query_t *query, int timeout_ms);
+
+/**
+ * Get the result of a completed query.
+ * @param[out] result	the sorted addresses, or NULL. They are valid until the query is freed.
+ * @return 0 or a getaddrinfo error code, EAI_AGAIN if the query is not complete yet
+ */
+BCTBX_PUBLIC int bctbx_resolver_query_get_result(const bctbx_resolver_query_t *query, const struct addrinfo **result);
+
+/**
+ * Release a query. Once it returns, its callback is not running and will not be invoked anymore.
+ * It may be called from the callback itself.
+ */
+BCTBX_PUBLIC void bctbx_resolver_query_free(bctbx_resolver_query_t *query);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_RESOLVER_H_ */
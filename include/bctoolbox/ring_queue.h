@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_RING_QUEUE_H_
+#define BCTBX_RING_QUEUE_H_
+#include "bctoolbox/port.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Bounded lock-free queues of pointers, to hand data over from threads to a consumer thread.
+ * A spsc queue has a single producer thread and a single consumer thread, a mpsc queue accepts any number of producer threads.
+ * Pushing and popping never take a lock: producers only touch a mutex to wake up a consumer sleeping in *_pop_wait().
+ * The capacity is fixed at creation, pushing to a full queue fails.
+ * NULL may be queued, the return value of pop tells it apart from an empty queue.
+ */
+typedef struct _bctbx_spsc_queue_t bctbx_spsc_queue_t;
+typedef struct _bctbx_mpsc_queue_t bctbx_mpsc_queue_t;
+
+/**
+ * Create a queue.
+ * @param[in] capacity maximum number of queued elements, rounded up to a power of two.
+ */
+BCTBX_PUBLIC bctbx_spsc_queue_t *bctbx_spsc_queue_new(size_t capacity);
+BCTBX_PUBLIC bctbx_mpsc_queue_t *bctbx_mpsc_queue_new(size_t capacity);
+
+/*the queue must be empty, or hold nothing that needs to be freed*/
+BCTBX_PUBLIC void bctbx_spsc_queue_delete(bctbx_spsc_queue_t *queue);
+BCTBX_PUBLIC void bctbx_mpsc_queue_delete(bctbx_mpsc_queue_t *queue);
+
+/*append a value, return FALSE if the queue is full*/
+BCTBX_PUBLIC bool_t bctbx_spsc_queue_push(bctbx_spsc_queue_t *queue, void *value);
+BCTBX_PUBLIC bool_t bctbx_mpsc_queue_push(bctbx_mpsc_queue_t *queue, void *value);
+
+/*remove the oldest value, return TRUE and set *value (if not NULL) to it, FALSE if the queue is empty. Consumer thread only.*/
+BCTBX_PUBLIC bool_t bctbx_spsc_queue_pop(bctbx_spsc_queue_t *queue, void **value);
+BCTBX_PUBLIC bool_t bctbx_mpsc_queue_pop(bctbx_mpsc_queue_t *queue, void **value);
+
+/*same as pop, but sleep until a value is pushed. Return FALSE without a value when woken up by *_wakeup(). Consumer thread only.*/
+BCTBX_PUBLIC bool_t bctbx_spsc_queue_pop_wait(bctbx_spsc_queue_t *queue, void **value);
+BCTBX_PUBLIC bool_t bctbx_mpsc_queue_pop_wait(bctbx_mpsc_queue_t *queue, void **value);
+
+/*make the current or next *_pop_wait() return FALSE, for instance to stop the consumer thread. Thread safe.*/
+BCTBX_PUBLIC void bctbx_spsc_queue_wakeup(bctbx_spsc_queue_t *queue);
+BCTBX_PUBLIC void bctbx_mpsc_queue_wakeup(bctbx_mpsc_queue_t *queue);
+
+/*return the number of queued values, only a hint while other threads use the queue*/
+BCTBX_PUBLIC size_t bctbx_spsc_queue_size(const bctbx_spsc_queue_t *queue);
+BCTBX_PUBLIC size_t bctbx_mpsc_queue_size(const bctbx_mpsc_queue_t *queue);
+
+BCTBX_PUBLIC size_t bctbx_spsc_queue_capacity(const bctbx_spsc_queue_t *queue);
+BCTBX_PUBLIC size_t bctbx_mpsc_queue_capacity(const bctbx_mpsc_queue_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_RING_QUEUE_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_THREAD_POOL_H_
+#define BCTBX_THREAD_POOL_H_
+#include "bctoolbox/port.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * A fixed set of worker threads running short tasks.
+ * Each worker has its own deque: tasks submitted from a worker go to its deque and are run newest first by that worker,
+ * tasks submitted from other threads go to a shared queue, and idle workers steal the oldest tasks of the busy ones.
+ * Modules share the default pool, sized after the number of cores, rather than each starting its own threads.
+ * Tasks must not block on I/O for long, this would starve the other users of the pool.
+ */
+typedef struct _bctbx_thread_pool_t bctbx_thread_pool_t;
+typedef struct _bctbx_thread_pool_task_t bctbx_thread_pool_task_t;
+
+typedef void (*bctbx_thread_pool_func_t)(void *user_data);
+
+#define BCTBX_THREAD_POOL_PIN_WORKERS	(1 << 0) /**< bind worker i to the processor i modulo the number of processors */
+
+/**
+ * Create a thread pool.
+ * @param[in] thread_count	number of workers, 0 for one per processor
+ * @param[in] flags			0 or BCTBX_THREAD_POOL_PIN_WORKERS
+ */
+BCTBX_PUBLIC bctbx_thread_pool_t *bctbx_thread_pool_new(int thread_count, int flags);
+
+/**
+ * Destroy a thread pool, after running every task already submitted.
+ * Must not be called from one of its workers, nor on the default pool.
+ */
+BCTBX_PUBLIC void bctbx_thread_pool_free(bctbx_thread_pool_t *pool);
+
+/**
+ * Get the process wide pool, with one worker per processor, created on first use and never destroyed.
+ */
+BCTBX_PUBLIC bctbx_thread_pool_t *bctbx_thread_pool_get_default(void);
+
+BCTBX_PUBLIC int bctbx_thread_pool_get_thread_count(const bctbx_thread_pool_t *pool);
+
+/**
+ * Bind a worker to a processor.
+ * @return 0 on success, -1 if the index is out of range or the platform does not support it
+ */
+BCTBX_PUBLIC int bctbx_thread_pool_set_worker_affinity(bctbx_thread_pool_t *pool, int worker_index, int cpu);
+
+/**
+ * Run a task on the pool, without a way to wait for it. Thread safe.
+ */
+BCTBX_PUBLIC void bctbx_thread_pool_post(bctbx_thread_pool_t *pool, bctbx_thread_pool_func_t func, void *user_data);
+
+/**
+ * Run a task on the pool. Thread safe.
+ * @return a handle to wait for the task, to be freed with bctbx_thread_pool_task_free()
+ */
+BCTBX_PUBLIC bctbx_thread_pool_task_t *bctbx_thread_pool_submit(bctbx_thread_pool_t *pool, bctbx_thread_pool_func_t func, void *user_data);
+
+/**
+ * Wait for a task to complete. When called from a worker of the pool, the worker runs other tasks meanwhile,
+ * so that tasks may wait for the tasks they submitted without exhausting the workers.
+ * @param[in] timeout_ms	maximum waiting time, 0 just polls, a negative value waits forever
+ * @return TRUE if the task is complete
+ */
+BCTBX_PUBLIC bool_t bctbx_thread_pool_task_wait(bctbx_thread_pool_task_t *task, int timeout_ms);
+
+/**
+ * Release a task handle. The task still runs if it did not yet.
+ */
+BCTBX_PUBLIC void bctbx_thread_pool_task_free(bctbx_thread_pool_task_t *task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_THREAD_POOL_H_ */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_THREAD_POOL_HH
+#define BCTBX_THREAD_POOL_HH
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "bctoolbox/thread_pool.h"
+
+namespace bctoolbox {
+
+/**
+ * C++ interface of bctbx_thread_pool_t.
+ * Waiting on a future from a task of the same pool holds its worker: use bctbx_thread_pool_task_wait() for nested tasks.
+ */
+class BCTBX_PUBLIC ThreadPool {
+public:
+	explicit ThreadPool(int threadCount = 0, int flags = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	/* The process wide pool, see bctbx_thread_pool_get_default(). */
+	static ThreadPool &getDefault();
+
+	int getThreadCount() const;
+	bctbx_thread_pool_t *getCPool() const {
+		return mPool;
+	}
+
+	/* Run a job on the pool. An exception escaping the job is logged and dropped. */
+	void post(std::function<void()> job);
+
+	/* Run a callable on the pool, its result or exception is delivered through the future. */
+	template <typename Callable>
+	std::future<decltype(std::declval<Callable &>()())> submit(Callable &&callable) {
+		using Result = decltype(std::declval<Callable &>()());
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Callable>(callable));
+		std::future<Result> future = task->get_future();
+		post([task]() { (*task)(); });
+		return future;
+	}
+
+private:
+	explicit ThreadPool(bctbx_thread_pool_t *pool);
+
+	bctbx_thread_pool_t *mPool;
+	bool mOwned;
+};
+
+} // namespace bctoolbox
+
+#endif /* BCTBX_THREAD_POOL_HH */
@@ -47,7 +47,8 @@ namespace bctoolbox {
 		// Replace all "from" by "to" in source. Use 'recursive' to avoid replacing what has been replaced.
 		BCTBX_PUBLIC void replace(std::string& source, const std::string& from, const std::string& to, const bool& recursive = true);
 		
-		// Return the current state of memory as a string. This is currently implemented only for Windows.
+		// Return the current state of memory as a string: the system memory on Windows, the process memory on Linux,
+		// followed by the bctbx_malloc() statistics when memory accounting is enabled (see bctbx_memory_accounting_get_memory_functions()).
 		BCTBX_PUBLIC std::string getMemoryReportAsString();
 		
 // Replace const_cast in order to be adapted from types. Be carefull when using it.
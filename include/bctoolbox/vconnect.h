@@ -36,6 +36,7 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 
@@ -43,6 +44,34 @@
 
 #define BCTBX_VCONNECT_ERROR       -255   /* Some kind of socket error occurred */
 
+/**
+ * Scatter/gather element, a struct iovec where it exists.
+ */
+#ifndef _WIN32
+typedef struct iovec bctbx_iovec_t;
+#else
+typedef struct {
+	void *iov_base;
+	size_t iov_len;
+} bctbx_iovec_t;
+#endif
+
+/* send flag requesting a zero copy send (MSG_ZEROCOPY), the socket must have been set up with bctbx_socket_enable_zerocopy(). 0 where not supported. */
+#ifdef __linux__
+#define BCTBX_MSG_ZEROCOPY 0x4000000
+#else
+#define BCTBX_MSG_ZEROCOPY 0
+#endif
+
+/**
+ * A range of completed zero copy sends, numbered in sending order from 0 on each socket.
+ */
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+	bool_t copied; /**< the kernel copied the data anyway, zero copy does not pay off for this destination (loopback...) */
+} bctbx_zerocopy_completion_t;
+
 
 #ifdef __cplusplus
 extern "C"{
@@ -71,9 +100,20 @@ struct bctbx_vsocket_methods_t {
 	int (*pFuncClose)(bctbx_socket_t sock);
 	char* (*pFuncGetError)(int err);
 	int (*pFuncShutdown)(bctbx_socket_t sock, int how);
+};
 
-
-
+/**
+ * Scatter/gather methods, set apart from bctbx_vsocket_methods_t with bctbx_vsocket_api_set_msg_methods()
+ * so that the methods tables built against earlier versions keep their layout.
+ * Members added by later versions are only read from tables declaring such a version.
+ */
+#define BCTBX_VSOCKET_MSG_METHODS_VERSION 1
+typedef struct bctbx_vsocket_msg_methods_t bctbx_vsocket_msg_methods_t;
+struct bctbx_vsocket_msg_methods_t {
+	int version; /* BCTBX_VSOCKET_MSG_METHODS_VERSION the table is built with */
+	/* the following may be NULL, the libc implementation is used then */
+	ssize_t (*pFuncSendMsg)(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, const struct sockaddr *address, socklen_t address_len, int flags);
+	ssize_t (*pFuncRecvMsg)(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, struct sockaddr *address, socklen_t *address_len, int flags);
 };
 
 
@@ -176,6 +216,47 @@ BCTBX_PUBLIC int bctbx_bind(bctbx_socket_t sockfd, const struct sockaddr *addres
  */
 BCTBX_PUBLIC int bctbx_connect(bctbx_socket_t sockfd, const struct sockaddr *address, socklen_t address_len);
 
+/**
+ * Send the data of several buffers at once (sendmsg/WSASendTo).
+ * @param  sockfd      socket file descriptor
+ * @param  iov         the buffers, sent one after the other
+ * @param  iovcnt      number of buffers
+ * @param  address     destination, NULL on a connected socket
+ * @param  address_len size of the address structure pointed to by address (bytes)
+ * @param  flags       as for send(), including BCTBX_MSG_ZEROCOPY: the buffers must then stay untouched until the send completion is reported by bctbx_socket_get_zerocopy_completions()
+ * @return             number of bytes sent, or -1 on error and errno is set.
+ */
+BCTBX_PUBLIC ssize_t bctbx_sendmsg(bctbx_socket_t sockfd, const bctbx_iovec_t *iov, int iovcnt, const struct sockaddr *address, socklen_t address_len, int flags);
+
+/**
+ * Receive data into several buffers at once (recvmsg/WSARecvFrom).
+ * @param  sockfd      socket file descriptor
+ * @param  iov         the buffers, filled one after the other
+ * @param  iovcnt      number of buffers
+ * @param  address     if not NULL, set to the source address
+ * @param  address_len size of the address structure pointed to by address on input, length of the source address on output
+ * @param  flags       as for recv()
+ * @return             number of bytes received, or -1 on error and errno is set.
+ */
+BCTBX_PUBLIC ssize_t bctbx_recvmsg(bctbx_socket_t sockfd, const bctbx_iovec_t *iov, int iovcnt, struct sockaddr *address, socklen_t *address_len, int flags);
+
+/**
+ * Allow zero copy sends on a socket (SO_ZEROCOPY, Linux only). They are worth it for large TCP sends, above ~10KB.
+ * @param  sockfd socket file descriptor
+ * @return        0 on success, -1 if not supported
+ */
+BCTBX_PUBLIC int bctbx_socket_enable_zerocopy(bctbx_socket_t sockfd);
+
+/**
+ * Read the completions of zero copy sends from the socket error queue. It does not block.
+ * The socket becomes readable with an error (BCTBX_EVENT_ERROR in an event loop) when completions are available.
+ * @param  sockfd      socket file descriptor
+ * @param  completions filled with the ranges of completed sends
+ * @param  count       size of the completions array
+ * @return             number of completions read, 0 if none is available, -1 on error
+ */
+BCTBX_PUBLIC int bctbx_socket_get_zerocopy_completions(bctbx_socket_t sockfd, bctbx_zerocopy_completion_t *completions, int count);
+
 /**
  * strerror equivalent.
  * When an error is returned on a socket operations, returns
@@ -194,6 +275,12 @@ BCTBX_PUBLIC char* bctbx_socket_error(int err);
  */
 BCTBX_PUBLIC void bctbx_vsocket_api_set_default(bctbx_vsocket_api_t *my_vsocket_api);
 
+/**
+ * Set the methods used by bctbx_sendmsg() and bctbx_recvmsg(), independently of the default socket API.
+ * @param methods Pointer to a bctbx_vsocket_msg_methods_t structure, kept until replaced. NULL selects the libc implementation.
+ */
+BCTBX_PUBLIC void bctbx_vsocket_api_set_msg_methods(const bctbx_vsocket_msg_methods_t *methods);
+
 
 /**
  * Returns the value of the global variable pDefaultvSocket,
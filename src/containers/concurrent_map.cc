@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/concurrent_map.h"
+#include <map>
+#include <string>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+namespace {
+
+/* keep every shard on its own cache lines so that locking one does not invalidate its neighbours */
+constexpr size_t shardAlignment = 64;
+
+template<typename K> class ConcurrentMap {
+public:
+	typedef std::multimap<K, void*> Map;
+
+	struct Shard {
+		bctbx_rwlock_t lock; /* the lookups, most of the traffic, share it */
+		Map map;
+		char padding[shardAlignment];
+	};
+
+	class ShardReadLock {
+	public:
+		explicit ShardReadLock(Shard &shard) : mShard(shard) {
+			bctbx_rwlock_rdlock(&mShard.lock);
+		}
+		~ShardReadLock() {
+			bctbx_rwlock_rdunlock(&mShard.lock);
+		}
+	private:
+		Shard &mShard;
+	};
+
+	class ShardWriteLock {
+	public:
+		explicit ShardWriteLock(Shard &shard) : mShard(shard) {
+			bctbx_rwlock_wrlock(&mShard.lock);
+		}
+		~ShardWriteLock() {
+			bctbx_rwlock_wrunlock(&mShard.lock);
+		}
+	private:
+		Shard &mShard;
+	};
+
+	explicit ConcurrentMap(size_t shardCount) {
+		if (shardCount == 0) {
+			/* a few shards per core keeps the collision probability low between concurrent users */
+			shardCount = 4 * std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		}
+		mShardCount = 1;
+		mShardBits = 0;
+		while (mShardCount < shardCount) {
+			mShardCount <<= 1;
+			mShardBits++;
+		}
+		mShards = new Shard[mShardCount];
+		for (size_t i = 0; i < mShardCount; i++) {
+			bctbx_rwlock_init(&mShards[i].lock, NULL);
+		}
+	}
+
+	~ConcurrentMap() {
+		for (size_t i = 0; i < mShardCount; i++) {
+			bctbx_rwlock_destroy(&mShards[i].lock);
+		}
+		delete[] mShards;
+	}
+
+	Shard &getShard(const K &key) const {
+		if (mShardBits == 0) return mShards[0];
+		/* fibonacci hashing: spreads consecutive keys and keeps the high bits, which are the well mixed ones */
+		uint64_t h = (uint64_t)hashKey(key) * 0x9E3779B97F4A7C15ULL;
+		return mShards[h >> (64 - mShardBits)];
+	}
+
+	void insert(const K &key, void *value) {
+		Shard &shard = getShard(key);
+		ShardWriteLock lock(shard);
+		shard.map.insert(typename Map::value_type(key, value));
+	}
+
+	bool_t find(const K &key, void **value) const {
+		Shard &shard = getShard(key);
+		ShardReadLock lock(shard);
+		auto it = shard.map.find(key);
+		if (it == shard.map.end()) return FALSE;
+		if (value) *value = it->second;
+		return TRUE;
+	}
+
+	bool_t erase(const K &key, void **value) {
+		Shard &shard = getShard(key);
+		ShardWriteLock lock(shard);
+		auto it = shard.map.find(key);
+		if (it == shard.map.end()) return FALSE;
+		if (value) *value = it->second;
+		shard.map.erase(it);
+		return TRUE;
+	}
+
+	void *findCustom(bctbx_compare_func compareFunc, const void *userData) const {
+		for (size_t i = 0; i < mShardCount; i++) {
+			ShardReadLock lock(mShards[i]);
+			for (const auto &pair : mShards[i].map) {
+				if (compareFunc(pair.second, userData) == 0) return pair.second;
+			}
+		}
+		return NULL;
+	}
+
+	void forEach(const std::function<void(const K &, void *)> &func) const {
+		for (size_t i = 0; i < mShardCount; i++) {
+			ShardReadLock lock(mShards[i]);
+			for (const auto &pair : mShards[i].map) {
+				func(pair.first, pair.second);
+			}
+		}
+	}
+
+	size_t size() const {
+		size_t ret = 0;
+		for (size_t i = 0; i < mShardCount; i++) {
+			ShardReadLock lock(mShards[i]);
+			ret += mShards[i].map.size();
+		}
+		return ret;
+	}
+
+private:
+	static size_t hashKey(unsigned long long key) {
+		return (size_t)(key ^ (key >> 32));
+	}
+	static size_t hashKey(const std::string &key) {
+		return std::hash<std::string>()(key);
+	}
+
+	Shard *mShards;
+	size_t mShardCount;
+	unsigned int mShardBits;
+};
+
+typedef ConcurrentMap<unsigned long long> cmap_ullong_t;
+typedef ConcurrentMap<std::string> cmap_cchar_t;
+
+}
+
+extern "C" bctbx_concurrent_map_t *bctbx_concurrent_map_ullong_new(size_t shard_count) {
+	return (bctbx_concurrent_map_t *) new cmap_ullong_t(shard_count);
+}
+extern "C" bctbx_concurrent_map_t *bctbx_concurrent_map_cchar_new(size_t shard_count) {
+	return (bctbx_concurrent_map_t *) new cmap_cchar_t(shard_count);
+}
+
+extern "C" void bctbx_concurrent_map_ullong_delete(bctbx_concurrent_map_t *map) {
+	delete (cmap_ullong_t *)map;
+}
+extern "C" void bctbx_concurrent_map_cchar_delete(bctbx_concurrent_map_t *map) {
+	delete (cmap_cchar_t *)map;
+}
+
+extern "C" void bctbx_concurrent_map_ullong_delete_with_data(bctbx_concurrent_map_t *map, bctbx_map_free_func freefunc) {
+	((cmap_ullong_t *)map)->forEach([freefunc](const unsigned long long &, void *value) { freefunc(value); });
+	bctbx_concurrent_map_ullong_delete(map);
+}
+extern "C" void bctbx_concurrent_map_cchar_delete_with_data(bctbx_concurrent_map_t *map, bctbx_map_free_func freefunc) {
+	((cmap_cchar_t *)map)->forEach([freefunc](const std::string &, void *value) { freefunc(value); });
+	bctbx_concurrent_map_cchar_delete(map);
+}
+
+extern "C" void bctbx_concurrent_map_ullong_insert(bctbx_concurrent_map_t *map, unsigned long long key, void *value) {
+	((cmap_ullong_t *)map)->insert(key, value);
+}
+extern "C" void bctbx_concurrent_map_cchar_insert(bctbx_concurrent_map_t *map, const char *key, void *value) {
+	((cmap_cchar_t *)map)->insert(key, value);
+}
+
+extern "C" bool_t bctbx_concurrent_map_ullong_find_key(const bctbx_concurrent_map_t *map, unsigned long long key, void **value) {
+	return ((const cmap_ullong_t *)map)->find(key, value);
+}
+extern "C" bool_t bctbx_concurrent_map_cchar_find_key(const bctbx_concurrent_map_t *map, const char *key, void **value) {
+	return ((const cmap_cchar_t *)map)->find(key, value);
+}
+
+extern "C" void *bctbx_concurrent_map_ullong_find_custom(const bctbx_concurrent_map_t *map, bctbx_compare_func compare_func, const void *user_data) {
+	return ((const cmap_ullong_t *)map)->findCustom(compare_func, user_data);
+}
+extern "C" void *bctbx_concurrent_map_cchar_find_custom(const bctbx_concurrent_map_t *map, bctbx_compare_func compare_func, const void *user_data) {
+	return ((const cmap_cchar_t *)map)->findCustom(compare_func, user_data);
+}
+
+extern "C" bool_t bctbx_concurrent_map_ullong_erase(bctbx_concurrent_map_t *map, unsigned long long key, void **value) {
+	return ((cmap_ullong_t *)map)->erase(key, value);
+}
+extern "C" bool_t bctbx_concurrent_map_cchar_erase(bctbx_concurrent_map_t *map, const char *key, void **value) {
+	return ((cmap_cchar_t *)map)->erase(key, value);
+}
+
+extern "C" void bctbx_concurrent_map_ullong_for_each(const bctbx_concurrent_map_t *map, bctbx_concurrent_map_ullong_func func, void *user_data) {
+	((const cmap_ullong_t *)map)->forEach([func, user_data](const unsigned long long &key, void *value) { func(key, value, user_data); });
+}
+extern "C" void bctbx_concurrent_map_cchar_for_each(const bctbx_concurrent_map_t *map, bctbx_concurrent_map_cchar_func func, void *user_data) {
+	((const cmap_cchar_t *)map)->forEach([func, user_data](const std::string &key, void *value) { func(key.c_str(), value, user_data); });
+}
+
+extern "C" size_t bctbx_concurrent_map_ullong_size(const bctbx_concurrent_map_t *map) {
+	return ((const cmap_ullong_t *)map)->size();
+}
+extern "C" size_t bctbx_concurrent_map_cchar_size(const bctbx_concurrent_map_t *map) {
+	return ((const cmap_cchar_t *)map)->size();
+}
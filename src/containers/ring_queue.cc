@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/ring_queue.h"
+#include <atomic>
+
+namespace {
+
+/* the indices written by the producers and by the consumer live on distinct cache lines */
+constexpr size_t cacheLineSize = 64;
+
+size_t roundCapacity(size_t capacity) {
+	size_t ret = 1;
+	while (ret < capacity) ret <<= 1;
+	return ret;
+}
+
+/* puts the consumer to sleep on an empty queue, producers only take the mutex when it sleeps */
+class ConsumerWaiter {
+public:
+	ConsumerWaiter() {
+		bctbx_mutex_init(&mLock, NULL);
+		bctbx_cond_init(&mCond, NULL);
+	}
+	~ConsumerWaiter() {
+		bctbx_cond_destroy(&mCond);
+		bctbx_mutex_destroy(&mLock);
+	}
+
+	/* to be called by producers after publishing a value */
+	void notify() {
+		/* pairs with the fence in wait(): either the consumer sees the value, or we see it sleeping */
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (mSleeping.load(std::memory_order_relaxed)) {
+			bctbx_mutex_lock(&mLock);
+			bctbx_cond_signal(&mCond);
+			bctbx_mutex_unlock(&mLock);
+		}
+	}
+
+	void wakeup() {
+		bctbx_mutex_lock(&mLock);
+		mWakeupRequested = true;
+		bctbx_cond_signal(&mCond);
+		bctbx_mutex_unlock(&mLock);
+	}
+
+	template <typename Queue> bool_t wait(Queue &queue, void **value) {
+		if (queue.pop(value)) return TRUE;
+		bool_t ret = FALSE;
+		bctbx_mutex_lock(&mLock);
+		while (true) {
+			mSleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (queue.pop(value)) {
+				ret = TRUE;
+				break;
+			}
+			if (mWakeupRequested) {
+				mWakeupRequested = false;
+				break;
+			}
+			bctbx_cond_wait(&mCond, &mLock);
+		}
+		mSleeping.store(false, std::memory_order_relaxed);
+		bctbx_mutex_unlock(&mLock);
+		return ret;
+	}
+
+private:
+	bctbx_mutex_t mLock;
+	bctbx_cond_t mCond;
+	std::atomic<bool> mSleeping{false};
+	bool mWakeupRequested = false;
+};
+
+/* Lamport's ring, each side keeping a copy of the other side's index to read the shared one only when it looks full or empty */
+class SpscQueue {
+public:
+	explicit SpscQueue(size_t capacity) : mCapacity(roundCapacity(capacity)), mMask(mCapacity - 1) {
+		mSlots = new void *[mCapacity];
+	}
+	~SpscQueue() {
+		delete[] mSlots;
+	}
+
+	bool_t push(void *value) {
+		size_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mCachedHead == mCapacity) {
+			mCachedHead = mHead.load(std::memory_order_acquire);
+			if (tail - mCachedHead == mCapacity) return FALSE;
+		}
+		mSlots[tail & mMask] = value;
+		mTail.store(tail + 1, std::memory_order_release);
+		mWaiter.notify();
+		return TRUE;
+	}
+
+	bool_t pop(void **value) {
+		size_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mCachedTail) {
+			mCachedTail = mTail.load(std::memory_order_acquire);
+			if (head == mCachedTail) return FALSE;
+		}
+		if (value) *value = mSlots[head & mMask];
+		mHead.store(head + 1, std::memory_order_release);
+		return TRUE;
+	}
+
+	bool_t popWait(void **value) {
+		return mWaiter.wait(*this, value);
+	}
+
+	void wakeup() {
+		mWaiter.wakeup();
+	}
+
+	size_t size() const {
+		return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return mCapacity;
+	}
+
+private:
+	const size_t mCapacity;
+	const size_t mMask;
+	void **mSlots;
+	char mPadding0[cacheLineSize];
+	/* producer side */
+	std::atomic<size_t> mTail{0};
+	size_t mCachedHead = 0;
+	char mPadding1[cacheLineSize];
+	/* consumer side */
+	std::atomic<size_t> mHead{0};
+	size_t mCachedTail = 0;
+	char mPadding2[cacheLineSize];
+	ConsumerWaiter mWaiter;
+};
+
+/* Vyukov's bounded queue: the sequence number of a slot tells whether it is free for the producer claiming this position,
+ * or filled for the consumer */
+class MpscQueue {
+public:
+	explicit MpscQueue(size_t capacity) : mCapacity(roundCapacity(capacity)), mMask(mCapacity - 1) {
+		mSlots = new Slot[mCapacity];
+		for (size_t i = 0; i < mCapacity; i++) {
+			mSlots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	~MpscQueue() {
+		delete[] mSlots;
+	}
+
+	bool_t push(void *value) {
+		size_t tail = mTail.load(std::memory_order_relaxed);
+		Slot *slot;
+		while (true) {
+			slot = &mSlots[tail & mMask];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)sequence - (intptr_t)tail;
+			if (diff == 0) {
+				if (mTail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) break;
+			} else if (diff < 0) {
+				return FALSE; /* the consumer did not free this slot yet: full */
+			} else {
+				tail = mTail.load(std::memory_order_relaxed); /* another producer claimed it */
+			}
+		}
+		slot->value = value;
+		slot->sequence.store(tail + 1, std::memory_order_release);
+		mWaiter.notify();
+		return TRUE;
+	}
+
+	bool_t pop(void **value) {
+		size_t head = mHead.load(std::memory_order_relaxed);
+		Slot *slot = &mSlots[head & mMask];
+		if (slot->sequence.load(std::memory_order_acquire) != head + 1) return FALSE;
+		if (value) *value = slot->value;
+		/* the slot is free again for the producer coming one lap later */
+		slot->sequence.store(head + mCapacity, std::memory_order_release);
+		mHead.store(head + 1, std::memory_order_relaxed);
+		return TRUE;
+	}
+
+	bool_t popWait(void **value) {
+		return mWaiter.wait(*this, value);
+	}
+
+	void wakeup() {
+		mWaiter.wakeup();
+	}
+
+	size_t size() const {
+		size_t head = mHead.load(std::memory_order_relaxed);
+		size_t tail = mTail.load(std::memory_order_relaxed);
+		/* claimed positions may not be filled yet, and the two loads are not a snapshot */
+		return tail > head ? tail - head : 0;
+	}
+
+	size_t capacity() const {
+		return mCapacity;
+	}
+
+private:
+	struct Slot {
+		std::atomic<size_t> sequence;
+		void *value;
+	};
+
+	const size_t mCapacity;
+	const size_t mMask;
+	Slot *mSlots;
+	char mPadding0[cacheLineSize];
+	std::atomic<size_t> mTail{0};
+	char mPadding1[cacheLineSize];
+	std::atomic<size_t> mHead{0};
+	char mPadding2[cacheLineSize];
+	ConsumerWaiter mWaiter;
+};
+
+}
+
+extern "C" bctbx_spsc_queue_t *bctbx_spsc_queue_new(size_t capacity) {
+	return (bctbx_spsc_queue_t *) new SpscQueue(capacity);
+}
+extern "C" bctbx_mpsc_queue_t *bctbx_mpsc_queue_new(size_t capacity) {
+	return (bctbx_mpsc_queue_t *) new MpscQueue(capacity);
+}
+
+extern "C" void bctbx_spsc_queue_delete(bctbx_spsc_queue_t *queue) {
+	delete (SpscQueue *)queue;
+}
+extern "C" void bctbx_mpsc_queue_delete(bctbx_mpsc_queue_t *queue) {
+	delete (MpscQueue *)queue;
+}
+
+extern "C" bool_t bctbx_spsc_queue_push(bctbx_spsc_queue_t *queue, void *value) {
+	return ((SpscQueue *)queue)->push(value);
+}
+extern "C" bool_t bctbx_mpsc_queue_push(bctbx_mpsc_queue_t *queue, void *value) {
+	return ((MpscQueue *)queue)->push(value);
+}
+
+extern "C" bool_t bctbx_spsc_queue_pop(bctbx_spsc_queue_t *queue, void **value) {
+	return ((SpscQueue *)queue)->pop(value);
+}
+extern "C" bool_t bctbx_mpsc_queue_pop(bctbx_mpsc_queue_t *queue, void **value) {
+	return ((MpscQueue *)queue)->pop(value);
+}
+
+extern "C" bool_t bctbx_spsc_queue_pop_wait(bctbx_spsc_queue_t *queue, void **value) {
+	return ((SpscQueue *)queue)->popWait(value);
+}
+extern "C" bool_t bctbx_mpsc_queue_pop_wait(bctbx_mpsc_queue_t *queue, void **value) {
+	return ((MpscQueue *)queue)->popWait(value);
+}
+
+extern "C" void bctbx_spsc_queue_wakeup(bctbx_spsc_queue_t *queue) {
+	((SpscQueue *)queue)->wakeup();
+}
+extern "C" void bctbx_mpsc_queue_wakeup(bctbx_mpsc_queue_t *queue) {
+	((MpscQueue *)queue)->wakeup();
+}
+
+extern "C" size_t bctbx_spsc_queue_size(const bctbx_spsc_queue_t *queue) {
+	return ((const SpscQueue *)queue)->size();
+}
+extern "C" size_t bctbx_mpsc_queue_size(const bctbx_mpsc_queue_t *queue) {
+	return ((const MpscQueue *)queue)->size();
+}
+
+extern "C" size_t bctbx_spsc_queue_capacity(const bctbx_spsc_queue_t *queue) {
+	return ((const SpscQueue *)queue)->capacity();
+}
+extern "C" size_t bctbx_mpsc_queue_capacity(const bctbx_mpsc_queue_t *queue) {
+	return ((const MpscQueue *)queue)->capacity();
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * AES-CFB128 with the x86 AES instructions, shared by the crypto backends.
+ * CFB encryption is serial inside a buffer: throughput comes from interleaving
+ * independent packets. CFB decryption is parallel and processes 4 blocks at once.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "utils.h"
+#include "aesni.h"
+
+#ifdef BCTBX_X86_INTRINSICS
+#include <immintrin.h>
+
+#define AESNI_LANES 4
+
+BCTBX_TARGET("aes,sse2")
+static __m128i aesni_key_128_assist(__m128i key, __m128i assist) {
+	__m128i tmp;
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	tmp = _mm_slli_si128(key, 4);
+	key = _mm_xor_si128(key, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	key = _mm_xor_si128(key, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	key = _mm_xor_si128(key, tmp);
+	return _mm_xor_si128(key, assist);
+}
+
+BCTBX_TARGET("aes,sse2")
+static __m128i aesni_key_256_assist(__m128i key, __m128i previous) {
+	__m128i tmp, assist;
+	assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(previous, 0x00), 0xaa);
+	tmp = _mm_slli_si128(key, 4);
+	key = _mm_xor_si128(key, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	key = _mm_xor_si128(key, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	key = _mm_xor_si128(key, tmp);
+	return _mm_xor_si128(key, assist);
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_expand_key_128(const uint8_t *key, __m128i rk[11]) {
+	rk[0] = _mm_loadu_si128((const __m128i *)key);
+	/* the round constant of aeskeygenassist must be an immediate */
+	rk[1] = aesni_key_128_assist(rk[0], _mm_aeskeygenassist_si128(rk[0], 0x01));
+	rk[2] = aesni_key_128_assist(rk[1], _mm_aeskeygenassist_si128(rk[1], 0x02));
+	rk[3] = aesni_key_128_assist(rk[2], _mm_aeskeygenassist_si128(rk[2], 0x04));
+	rk[4] = aesni_key_128_assist(rk[3], _mm_aeskeygenassist_si128(rk[3], 0x08));
+	rk[5] = aesni_key_128_assist(rk[4], _mm_aeskeygenassist_si128(rk[4], 0x10));
+	rk[6] = aesni_key_128_assist(rk[5], _mm_aeskeygenassist_si128(rk[5], 0x20));
+	rk[7] = aesni_key_128_assist(rk[6], _mm_aeskeygenassist_si128(rk[6], 0x40));
+	rk[8] = aesni_key_128_assist(rk[7], _mm_aeskeygenassist_si128(rk[7], 0x80));
+	rk[9] = aesni_key_128_assist(rk[8], _mm_aeskeygenassist_si128(rk[8], 0x1b));
+	rk[10] = aesni_key_128_assist(rk[9], _mm_aeskeygenassist_si128(rk[9], 0x36));
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_expand_key_256(const uint8_t *key, __m128i rk[15]) {
+	rk[0] = _mm_loadu_si128((const __m128i *)key);
+	rk[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+	rk[2] = aesni_key_128_assist(rk[0], _mm_aeskeygenassist_si128(rk[1], 0x01));
+	rk[3] = aesni_key_256_assist(rk[1], rk[2]);
+	rk[4] = aesni_key_128_assist(rk[2], _mm_aeskeygenassist_si128(rk[3], 0x02));
+	rk[5] = aesni_key_256_assist(rk[3], rk[4]);
+	rk[6] = aesni_key_128_assist(rk[4], _mm_aeskeygenassist_si128(rk[5], 0x04));
+	rk[7] = aesni_key_256_assist(rk[5], rk[6]);
+	rk[8] = aesni_key_128_assist(rk[6], _mm_aeskeygenassist_si128(rk[7], 0x08));
+	rk[9] = aesni_key_256_assist(rk[7], rk[8]);
+	rk[10] = aesni_key_128_assist(rk[8], _mm_aeskeygenassist_si128(rk[9], 0x10));
+	rk[11] = aesni_key_256_assist(rk[9], rk[10]);
+	rk[12] = aesni_key_128_assist(rk[10], _mm_aeskeygenassist_si128(rk[11], 0x20));
+	rk[13] = aesni_key_256_assist(rk[11], rk[12]);
+	rk[14] = aesni_key_128_assist(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+}
+
+BCTBX_TARGET("aes,sse2")
+static int aesni_setkey(bctbx_aesni_key_t *aesniKey, const uint8_t *key, size_t keyLength) {
+	__m128i rk[15];
+	int i;
+
+	if (keyLength == 16) {
+		aesni_expand_key_128(key, rk);
+		aesniKey->rounds = 10;
+	} else {
+		aesni_expand_key_256(key, rk);
+		aesniKey->rounds = 14;
+	}
+	for (i = 0; i <= aesniKey->rounds; i++) {
+		_mm_storeu_si128((__m128i *)(aesniKey->roundKeys + 16 * i), rk[i]);
+	}
+	return 0;
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_load_key(const bctbx_aesni_key_t *aesniKey, __m128i rk[15]) {
+	int i;
+	for (i = 0; i <= aesniKey->rounds; i++) {
+		rk[i] = _mm_loadu_si128((const __m128i *)(aesniKey->roundKeys + 16 * i));
+	}
+}
+
+BCTBX_TARGET("aes,sse2")
+static __m128i aesni_encrypt_block(const __m128i *rk, int rounds, __m128i block) {
+	int i;
+	block = _mm_xor_si128(block, rk[0]);
+	for (i = 1; i < rounds; i++) {
+		block = _mm_aesenc_si128(block, rk[i]);
+	}
+	return _mm_aesenclast_si128(block, rk[rounds]);
+}
+
+/* encrypt 4 independent blocks in place, their rounds interleaved to hide the aesenc latency */
+BCTBX_TARGET("aes,sse2")
+static void aesni_encrypt_4_blocks(const __m128i *rk, int rounds, __m128i blocks[AESNI_LANES]) {
+	__m128i b0 = _mm_xor_si128(blocks[0], rk[0]);
+	__m128i b1 = _mm_xor_si128(blocks[1], rk[0]);
+	__m128i b2 = _mm_xor_si128(blocks[2], rk[0]);
+	__m128i b3 = _mm_xor_si128(blocks[3], rk[0]);
+	int i;
+	for (i = 1; i < rounds; i++) {
+		b0 = _mm_aesenc_si128(b0, rk[i]);
+		b1 = _mm_aesenc_si128(b1, rk[i]);
+		b2 = _mm_aesenc_si128(b2, rk[i]);
+		b3 = _mm_aesenc_si128(b3, rk[i]);
+	}
+	blocks[0] = _mm_aesenclast_si128(b0, rk[rounds]);
+	blocks[1] = _mm_aesenclast_si128(b1, rk[rounds]);
+	blocks[2] = _mm_aesenclast_si128(b2, rk[rounds]);
+	blocks[3] = _mm_aesenclast_si128(b3, rk[rounds]);
+}
+
+/* last partial block: both directions xor the input with the encrypted feedback */
+BCTBX_TARGET("aes,sse2")
+static void aesni_cfb_tail(__m128i keyStream, const uint8_t *input, size_t inputLength, uint8_t *output) {
+	uint8_t buffer[16];
+	size_t i;
+	_mm_storeu_si128((__m128i *)buffer, keyStream);
+	for (i = 0; i < inputLength; i++) {
+		output[i] = input[i] ^ buffer[i];
+	}
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_cfb_encrypt_from(const __m128i *rk, int rounds, __m128i feedback, const uint8_t *input, size_t inputLength, uint8_t *output) {
+	while (inputLength >= 16) {
+		feedback = _mm_xor_si128(aesni_encrypt_block(rk, rounds, feedback), _mm_loadu_si128((const __m128i *)input));
+		_mm_storeu_si128((__m128i *)output, feedback);
+		input += 16;
+		output += 16;
+		inputLength -= 16;
+	}
+	if (inputLength > 0) {
+		aesni_cfb_tail(aesni_encrypt_block(rk, rounds, feedback), input, inputLength, output);
+	}
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_cfb_encrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output) {
+	__m128i rk[15];
+	aesni_load_key(aesniKey, rk);
+	aesni_cfb_encrypt_from(rk, aesniKey->rounds, _mm_loadu_si128((const __m128i *)IV), input, inputLength, output);
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_cfb_decrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output) {
+	__m128i rk[15];
+	__m128i feedback = _mm_loadu_si128((const __m128i *)IV);
+	__m128i cipher[AESNI_LANES], keyStream[AESNI_LANES];
+	int rounds = aesniKey->rounds;
+	int i;
+
+	aesni_load_key(aesniKey, rk);
+	/* the key stream of each block only depends on the previous cipher block: 4 blocks at once */
+	while (inputLength >= 16 * AESNI_LANES) {
+		for (i = 0; i < AESNI_LANES; i++) {
+			cipher[i] = _mm_loadu_si128((const __m128i *)(input + 16 * i));
+		}
+		keyStream[0] = feedback;
+		keyStream[1] = cipher[0];
+		keyStream[2] = cipher[1];
+		keyStream[3] = cipher[2];
+		aesni_encrypt_4_blocks(rk, rounds, keyStream);
+		for (i = 0; i < AESNI_LANES; i++) {
+			_mm_storeu_si128((__m128i *)(output + 16 * i), _mm_xor_si128(cipher[i], keyStream[i]));
+		}
+		feedback = cipher[3];
+		input += 16 * AESNI_LANES;
+		output += 16 * AESNI_LANES;
+		inputLength -= 16 * AESNI_LANES;
+	}
+	while (inputLength >= 16) {
+		cipher[0] = _mm_loadu_si128((const __m128i *)input);
+		_mm_storeu_si128((__m128i *)output, _mm_xor_si128(cipher[0], aesni_encrypt_block(rk, rounds, feedback)));
+		feedback = cipher[0];
+		input += 16;
+		output += 16;
+		inputLength -= 16;
+	}
+	if (inputLength > 0) {
+		aesni_cfb_tail(aesni_encrypt_block(rk, rounds, feedback), input, inputLength, output);
+	}
+}
+
+BCTBX_TARGET("aes,sse2")
+static void aesni_cfb_encrypt_packets(const bctbx_aesni_key_t *aesniKey, const bctbx_aes_cfb_packet_t *packets, size_t packetsCount) {
+	__m128i rk[15];
+	__m128i feedback[AESNI_LANES];
+	const uint8_t *input[AESNI_LANES];
+	uint8_t *output[AESNI_LANES];
+	int rounds = aesniKey->rounds;
+	size_t blocks, n;
+	int i;
+
+	aesni_load_key(aesniKey, rk);
+	for (; packetsCount >= AESNI_LANES; packets += AESNI_LANES, packetsCount -= AESNI_LANES) {
+		/* run the 4 packets side by side for as many blocks as the shortest one has */
+		blocks = packets[0].inputLength / 16;
+		for (i = 0; i < AESNI_LANES; i++) {
+			feedback[i] = _mm_loadu_si128((const __m128i *)packets[i].IV);
+			input[i] = packets[i].input;
+			output[i] = packets[i].output;
+			if (packets[i].inputLength / 16 < blocks) blocks = packets[i].inputLength / 16;
+		}
+		for (n = 0; n < blocks; n++) {
+			aesni_encrypt_4_blocks(rk, rounds, feedback);
+			for (i = 0; i < AESNI_LANES; i++) {
+				feedback[i] = _mm_xor_si128(feedback[i], _mm_loadu_si128((const __m128i *)input[i]));
+				_mm_storeu_si128((__m128i *)output[i], feedback[i]);
+				input[i] += 16;
+				output[i] += 16;
+			}
+		}
+		for (i = 0; i < AESNI_LANES; i++) {
+			aesni_cfb_encrypt_from(rk, rounds, feedback[i], input[i], packets[i].inputLength - 16 * blocks, output[i]);
+		}
+	}
+	for (; packetsCount > 0; packets++, packetsCount--) {
+		aesni_cfb_encrypt_from(rk, rounds, _mm_loadu_si128((const __m128i *)packets->IV), packets->input, packets->inputLength, packets->output);
+	}
+}
+
+int bctbx_aesni_setkey(bctbx_aesni_key_t *aesniKey, const uint8_t *key, size_t keyLength) {
+	const uint32_t required = BCTBX_CPU_FEATURE_AESNI;
+	if ((keyLength != 16 && keyLength != 32) || (bctbx_cpu_features() & required) != required) {
+		return -1;
+	}
+	return aesni_setkey(aesniKey, key, keyLength);
+}
+
+void bctbx_aesni_cfb_encrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output) {
+	aesni_cfb_encrypt(aesniKey, IV, input, inputLength, output);
+}
+
+void bctbx_aesni_cfb_decrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output) {
+	aesni_cfb_decrypt(aesniKey, IV, input, inputLength, output);
+}
+
+void bctbx_aesni_cfb_encrypt_packets(const bctbx_aesni_key_t *aesniKey, const bctbx_aes_cfb_packet_t *packets, size_t packetsCount) {
+	aesni_cfb_encrypt_packets(aesniKey, packets, packetsCount);
+}
+
+#else /* BCTBX_X86_INTRINSICS */
+
+/* no AES-NI on this architecture: bctbx_aesni_setkey always fails so the other functions are never called */
+int bctbx_aesni_setkey(bctbx_aesni_key_t *aesniKey, const uint8_t *key, size_t keyLength) {
+	return -1;
+}
+
+void bctbx_aesni_cfb_encrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output) {
+}
+
+void bctbx_aesni_cfb_decrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output) {
+}
+
+void bctbx_aesni_cfb_encrypt_packets(const bctbx_aesni_key_t *aesniKey, const bctbx_aes_cfb_packet_t *packets, size_t packetsCount) {
+}
+
+#endif /* BCTBX_X86_INTRINSICS */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_AESNI_H
+#define BCTBX_AESNI_H
+
+#include "bctoolbox/crypto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * AES-128/AES-256 encryption key schedule for the AES-NI code paths.
+ * The crypto backends keep their own implementation for hosts without AES-NI.
+ */
+typedef struct {
+	uint8_t roundKeys[15 * 16];
+	int rounds; /**< 10 or 14 */
+} bctbx_aesni_key_t;
+
+/**
+ * @brief Expand an AES key for the AES-NI code paths.
+ * @param[out]	aesniKey	the key schedule
+ * @param[in]	key			the AES key
+ * @param[in]	keyLength	key length in bytes, 16 or 32
+ * @return 0 on success, -1 if the host has no AES-NI or the key length is not supported
+ */
+int bctbx_aesni_setkey(bctbx_aesni_key_t *aesniKey, const uint8_t *key, size_t keyLength);
+
+/**
+ * @brief AES-CFB128 encryption of a buffer, the IV is not modified. input and output may be the same buffer.
+ */
+void bctbx_aesni_cfb_encrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output);
+
+/**
+ * @brief AES-CFB128 decryption of a buffer, the IV is not modified. input and output may be the same buffer.
+ */
+void bctbx_aesni_cfb_decrypt(const bctbx_aesni_key_t *aesniKey, const uint8_t IV[16], const uint8_t *input, size_t inputLength, uint8_t *output);
+
+/**
+ * @brief AES-CFB128 encryption of independent packets, interleaved to fill the AES-NI pipeline.
+ */
+void bctbx_aesni_cfb_encrypt_packets(const bctbx_aesni_key_t *aesniKey, const bctbx_aes_cfb_packet_t *packets, size_t packetsCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_AESNI_H */
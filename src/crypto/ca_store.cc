@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/crypto.h"
+#include "bctoolbox/list.h"
+#include "bctoolbox/logging.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef S_ISDIR /* MSVC */
+#define S_ISDIR(mode) (((mode) & _S_IFMT) == _S_IFDIR)
+#endif
+
+struct bctbx_x509_ca_store_struct {
+	std::atomic<int> refCount{1};
+	time_t mtime = 0; /**< modification time of the path when it was parsed, the newest of its files for a directory */
+	long long size = 0; /**< size of the path when it was parsed, the total of its files for a directory */
+	bctbx_x509_certificate_t *certificates = nullptr;
+};
+
+namespace {
+
+/**
+ * The process wide table of the parsed CA stores, keyed by path.
+ * It holds a reference on the last store parsed for each path, handed out again while the path
+ * modification time and size are unchanged. For a directory, these are the newest modification time
+ * and the total size of the files it contains, so editing one of them is noticed.
+ * A store replaced by a newer parse stays valid for its holders until they release it.
+ */
+class CAStoreCache {
+public:
+	static CAStoreCache &instance() {
+		/* never destroyed: stores may still be released while static objects are destroyed at exit */
+		static CAStoreCache *cache = new CAStoreCache();
+		return *cache;
+	}
+
+	bctbx_x509_ca_store_t *get(const std::string &path) {
+		Stamp stamp;
+		if (!getStamp(path, stamp)) {
+			bctbx_warning("CA store: cannot access [%s]", path.c_str());
+			return nullptr;
+		}
+
+		std::shared_ptr<Slot> slot;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			auto &entry = mSlots[path];
+			if (!entry) entry = std::make_shared<Slot>();
+			slot = entry;
+		}
+
+		/* the slot lock makes concurrent users of the same path wait for a single parse, other paths are not blocked */
+		std::lock_guard<std::mutex> lock(slot->mutex);
+		if (slot->store == nullptr || slot->store->mtime != stamp.mtime || slot->store->size != stamp.size) {
+			bctbx_x509_ca_store_t *store = parse(path, stamp);
+			if (store == nullptr) return nullptr;
+			if (slot->store) bctbx_x509_ca_store_unref(slot->store);
+			slot->store = store;
+		}
+		return bctbx_x509_ca_store_ref(slot->store);
+	}
+
+	void invalidate(const char *path) {
+		/* the slots release their store once the last get() still using them is done, outside of mMutex */
+		std::map<std::string, std::shared_ptr<Slot>> dropped;
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (path == nullptr) {
+			dropped.swap(mSlots);
+		} else {
+			auto it = mSlots.find(path);
+			if (it == mSlots.end()) return;
+			dropped.insert(*it);
+			mSlots.erase(it);
+		}
+	}
+
+private:
+	struct Slot {
+		~Slot() {
+			if (store) bctbx_x509_ca_store_unref(store);
+		}
+		std::mutex mutex;
+		bctbx_x509_ca_store_t *store = nullptr;
+	};
+
+	struct Stamp {
+		bool directory = false;
+		time_t mtime = 0;
+		long long size = 0;
+	};
+
+	static bool getStamp(const std::string &path, Stamp &stamp) {
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) return false;
+		stamp.directory = S_ISDIR(st.st_mode);
+		stamp.mtime = st.st_mtime;
+		stamp.size = stamp.directory ? 0 : (long long)st.st_size;
+		if (stamp.directory) {
+			/* the directory itself only changes when files are added, removed or renamed */
+			bctbx_list_t *files = bctbx_parse_directory(path.c_str(), nullptr);
+			for (bctbx_list_t *it = files; it != nullptr; it = it->next) {
+				if (stat((const char *)it->data, &st) != 0) continue;
+				if (st.st_mtime > stamp.mtime) stamp.mtime = st.st_mtime;
+				stamp.size += (long long)st.st_size;
+			}
+			bctbx_list_free_with_data(files, bctbx_free);
+		}
+		return true;
+	}
+
+	static bctbx_x509_ca_store_t *parse(const std::string &path, const Stamp &stamp) {
+		bctbx_x509_certificate_t *certificates = bctbx_x509_certificate_new();
+		int32_t ret;
+		if (stamp.directory) {
+			ret = bctbx_x509_certificate_parse_path(certificates, path.c_str());
+		} else {
+			ret = bctbx_x509_certificate_parse_file(certificates, path.c_str());
+		}
+		/* a positive value is the number of files which failed to parse, the others are usable */
+		if (ret < 0) {
+			char error[128];
+			bctbx_strerror(ret, error, sizeof(error));
+			bctbx_error("CA store: cannot parse [%s]: %s", path.c_str(), error);
+			bctbx_x509_certificate_free(certificates);
+			return nullptr;
+		}
+		bctbx_x509_ca_store_t *store = new bctbx_x509_ca_store_struct();
+		store->mtime = stamp.mtime;
+		store->size = stamp.size;
+		store->certificates = certificates;
+		return store;
+	}
+
+	std::mutex mMutex;
+	std::map<std::string, std::shared_ptr<Slot>> mSlots;
+};
+
+} // anonymous namespace
+
+extern "C" bctbx_x509_ca_store_t *bctbx_x509_ca_store_get(const char *path) {
+	if (path == nullptr) return nullptr;
+	return CAStoreCache::instance().get(path);
+}
+
+extern "C" bctbx_x509_ca_store_t *bctbx_x509_ca_store_ref(bctbx_x509_ca_store_t *store) {
+	store->refCount.fetch_add(1, std::memory_order_relaxed);
+	return store;
+}
+
+extern "C" void bctbx_x509_ca_store_unref(bctbx_x509_ca_store_t *store) {
+	if (store == nullptr) return;
+	if (store->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		bctbx_x509_certificate_free(store->certificates);
+		delete store;
+	}
+}
+
+extern "C" const bctbx_x509_certificate_t *bctbx_x509_ca_store_get_certificates(const bctbx_x509_ca_store_t *store) {
+	return store->certificates;
+}
+
+extern "C" void bctbx_x509_ca_store_invalidate(const char *path) {
+	CAStoreCache::instance().invalidate(path);
+}
@@ -20,6 +20,8 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include <bctoolbox/crypto.h>
 
 /**
@@ -117,3 +119,183 @@ int bctbx_aes_gcm_decryptFile(void **cryptoContext, unsigned char *key, size_t l
 
 	return 0;
 }
+
+/*****************************************************************************/
+/***** AES GCM streaming file encryption/decryption                      *****/
+/*****************************************************************************/
+/**
+ * Double buffered reader: a thread reads the next block of the input file while the current one is processed.
+ * Blocks are processed in place, so the memory used is two blocks whatever the file size.
+ */
+typedef struct {
+	bctbx_vfs_file_t *file;
+	uint8_t *buffers[2];
+	ssize_t lengths[2]; /**< bytes read in each buffer, 0 at end of file, BCTBX_VFS_ERROR on failure */
+	bool_t filled[2];
+	bool_t stop;
+	bctbx_mutex_t mutex;
+	bctbx_cond_t cond;
+} bctbx_aes_gcm_file_reader_t;
+
+static void *bctbx_aes_gcm_file_reader_run(void *arg) {
+	bctbx_aes_gcm_file_reader_t *reader = (bctbx_aes_gcm_file_reader_t *)arg;
+	off_t offset = 0;
+	size_t length;
+	int index = 0;
+	ssize_t ret;
+
+	do {
+		bctbx_mutex_lock(&reader->mutex);
+		while (reader->filled[index] && !reader->stop) {
+			bctbx_cond_wait(&reader->cond, &reader->mutex);
+		}
+		if (reader->stop) {
+			bctbx_mutex_unlock(&reader->mutex);
+			break;
+		}
+		bctbx_mutex_unlock(&reader->mutex);
+
+		/* always fill whole blocks: AES-GCM chunks other than the last one must be a multiple of 16 bytes */
+		length = 0;
+		do {
+			ret = bctbx_file_read(reader->file, reader->buffers[index] + length, BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE - length, offset + length);
+			if (ret > 0) length += (size_t)ret;
+		} while (ret > 0 && length < BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE);
+		offset += length;
+		ret = (ret < 0) ? BCTBX_VFS_ERROR : (ssize_t)length;
+
+		bctbx_mutex_lock(&reader->mutex);
+		reader->lengths[index] = ret;
+		reader->filled[index] = TRUE;
+		bctbx_cond_signal(&reader->cond);
+		bctbx_mutex_unlock(&reader->mutex);
+		index ^= 1;
+	} while (ret > 0);
+
+	return NULL;
+}
+
+/* the full 16 bytes tag is always computed: the crypto library may reject shorter ones, callers keep what they need.
+ * The output file is truncated first, a longer previous content would otherwise be left after the new one */
+static int bctbx_aes_gcm_process_file(const unsigned char *key, uint8_t mode, bctbx_vfs_file_t *inputFile, bctbx_vfs_file_t *outputFile, uint8_t tag[16]) {
+	bctbx_aes_gcm_file_reader_t reader;
+	bctbx_aes_gcm_context_t *gcmContext;
+	bctbx_thread_t thread;
+	uint8_t *buffer;
+	off_t offset = 0;
+	int index = 0;
+	ssize_t length;
+	int ret = 0;
+
+	if (bctbx_file_truncate(outputFile, 0) < 0) {
+		return BCTBX_VFS_ERROR;
+	}
+
+	/* key contains 192bits of key || 64 bits of Initialisation Vector, no additional data */
+	gcmContext = bctbx_aes_gcm_context_new(key, 24, NULL, 0, key+24, 8, mode);
+	if (gcmContext == NULL) {
+		return BCTBX_ERROR_UNSPECIFIED_ERROR;
+	}
+
+	memset(&reader, 0, sizeof(reader));
+	reader.file = inputFile;
+	buffer = (uint8_t *)bctbx_malloc(2 * BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE);
+	reader.buffers[0] = buffer;
+	reader.buffers[1] = buffer + BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE;
+	bctbx_mutex_init(&reader.mutex, NULL);
+	bctbx_cond_init(&reader.cond, NULL);
+	if (bctbx_thread_create(&thread, NULL, bctbx_aes_gcm_file_reader_run, &reader) != 0) {
+		bctbx_cond_destroy(&reader.cond);
+		bctbx_mutex_destroy(&reader.mutex);
+		bctbx_free(buffer);
+		bctbx_aes_gcm_finish(gcmContext, tag, 16);
+		return BCTBX_ERROR_UNSPECIFIED_ERROR;
+	}
+
+	while (1) {
+		bctbx_mutex_lock(&reader.mutex);
+		while (!reader.filled[index]) {
+			bctbx_cond_wait(&reader.cond, &reader.mutex);
+		}
+		length = reader.lengths[index];
+		bctbx_mutex_unlock(&reader.mutex);
+
+		if (length <= 0) {
+			if (length < 0) ret = BCTBX_VFS_ERROR;
+			break;
+		}
+		ret = bctbx_aes_gcm_process_chunk(gcmContext, reader.buffers[index], (size_t)length, reader.buffers[index]);
+		if (ret != 0) break;
+		if (bctbx_file_write(outputFile, reader.buffers[index], (size_t)length, offset) != length) {
+			ret = BCTBX_VFS_ERROR;
+			break;
+		}
+		offset += length;
+
+		/* hand the buffer back to the reader */
+		bctbx_mutex_lock(&reader.mutex);
+		reader.filled[index] = FALSE;
+		bctbx_cond_signal(&reader.cond);
+		bctbx_mutex_unlock(&reader.mutex);
+		index ^= 1;
+	}
+
+	bctbx_mutex_lock(&reader.mutex);
+	reader.stop = TRUE;
+	bctbx_cond_signal(&reader.cond);
+	bctbx_mutex_unlock(&reader.mutex);
+	bctbx_thread_join(thread, NULL);
+
+	bctbx_clean(buffer, 2 * BCTBX_AES_GCM_FILE_STREAM_BLOCK_SIZE);
+	bctbx_free(buffer);
+	bctbx_cond_destroy(&reader.cond);
+	bctbx_mutex_destroy(&reader.mutex);
+
+	if (ret == 0) {
+		return bctbx_aes_gcm_finish(gcmContext, tag, 16);
+	}
+	bctbx_aes_gcm_finish(gcmContext, tag, 16);
+	return ret;
+}
+
+int bctbx_aes_gcm_encryptFileStream(const unsigned char *key, bctbx_vfs_file_t *plainFile, bctbx_vfs_file_t *cipherFile, uint8_t *tag, size_t tagLength) {
+	uint8_t computedTag[16];
+	int ret;
+
+	if (key == NULL || plainFile == NULL || cipherFile == NULL || tagLength > 16 || (tag == NULL && tagLength > 0)) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+
+	ret = bctbx_aes_gcm_process_file(key, BCTBX_GCM_ENCRYPT, plainFile, cipherFile, computedTag);
+	if (ret == 0 && tagLength > 0) {
+		memcpy(tag, computedTag, tagLength);
+	}
+	return ret;
+}
+
+int bctbx_aes_gcm_decryptFileStream(const unsigned char *key, bctbx_vfs_file_t *cipherFile, bctbx_vfs_file_t *plainFile, const uint8_t *tag, size_t tagLength) {
+	uint8_t computedTag[16];
+	uint8_t diff = 0;
+	size_t i;
+	int ret;
+
+	if (key == NULL || cipherFile == NULL || plainFile == NULL || tagLength > 16 || (tag == NULL && tagLength > 0)) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+
+	ret = bctbx_aes_gcm_process_file(key, BCTBX_GCM_DECRYPT, cipherFile, plainFile, computedTag);
+	if (ret == 0) {
+		/* constant time comparison */
+		for (i = 0; i < tagLength; i++) {
+			diff |= computedTag[i] ^ tag[i];
+		}
+		if (diff != 0) {
+			ret = BCTBX_ERROR_AUTHENTICATION_FAILED;
+		}
+	}
+	/* whatever went wrong, do not leave unauthenticated data in the plain file */
+	if (ret != 0) {
+		bctbx_file_truncate(plainFile, 0);
+	}
+	return ret;
+}
@@ -25,6 +25,16 @@
 
 #ifdef HAVE_DECAF
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bctoolbox/thread_pool.h"
 #include "decaf.h"
 #include "decaf/ed255.h"
 #include "decaf/ed448.h"
@@ -401,6 +411,26 @@ void bctbx_EDDSA_setSecretKey(bctbx_EDDSAContext_t *context, const uint8_t *secr
 	}
 }
 
+/* verify one signature with a raw public key, the public key must have the length of the algo public keys */
+static int bctbx_EDDSA_verify_with_key(uint8_t algo, const uint8_t *publicKey, const uint8_t *message, size_t messageLength, const uint8_t *associatedData, const uint8_t associatedDataLength, const uint8_t *signature, size_t signatureLength) {
+	decaf_error_t retDecaf = DECAF_FAILURE;
+	switch (algo) {
+		case BCTBX_EDDSA_25519:
+			if (signatureLength==DECAF_EDDSA_25519_SIGNATURE_BYTES) { /* check length of given signature */
+				retDecaf = decaf_ed25519_verify (signature, publicKey, message, messageLength, 0, associatedData, associatedDataLength);
+			}
+			break;
+		case BCTBX_EDDSA_448:
+			if (signatureLength==DECAF_EDDSA_448_SIGNATURE_BYTES) { /* check lenght of given signature */
+				retDecaf = decaf_ed448_verify (signature, publicKey, message, messageLength, 0, associatedData, associatedDataLength);
+			}
+			break;
+		default:
+			break;
+	}
+	return (retDecaf == DECAF_SUCCESS) ? BCTBX_VERIFY_SUCCESS : BCTBX_VERIFY_FAILED;
+}
+
 /**
  *
  * @brief Use the public key set in context to verify the given signature and message
@@ -416,28 +446,59 @@ void bctbx_EDDSA_setSecretKey(bctbx_EDDSAContext_t *context, const uint8_t *secr
  * @return BCTBX_VERIFY_SUCCESS or BCTBX_VERIFY_FAILED
  */
 int bctbx_EDDSA_verify(bctbx_EDDSAContext_t *context, const uint8_t *message, size_t messageLength, const uint8_t *associatedData, const uint8_t associatedDataLength, const uint8_t *signature, size_t signatureLength) {
-	int ret = BCTBX_VERIFY_FAILED;
-	if (context!=NULL) {
-		decaf_error_t retDecaf = DECAF_FAILURE;
-		switch (context->algo) {
-			case BCTBX_EDDSA_25519:
-				if (signatureLength==DECAF_EDDSA_25519_SIGNATURE_BYTES) { /* check length of given signature */
-					retDecaf = decaf_ed25519_verify (signature, context->publicKey, message, messageLength, 0, associatedData, associatedDataLength);
-				}
-				break;
-			case BCTBX_EDDSA_448:
-				if (signatureLength==DECAF_EDDSA_448_SIGNATURE_BYTES) { /* check lenght of given signature */
-					retDecaf = decaf_ed448_verify (signature, context->publicKey, message, messageLength, 0, associatedData, associatedDataLength);
-				}
-				break;
-			default:
-				break;
-		}
-		if (retDecaf == DECAF_SUCCESS) {
-			ret = BCTBX_VERIFY_SUCCESS;
+	if (context==NULL || context->publicKey==NULL) {
+		return BCTBX_VERIFY_FAILED;
+	}
+	return bctbx_EDDSA_verify_with_key(context->algo, context->publicKey, message, messageLength, associatedData, associatedDataLength, signature, signatureLength);
+}
+
+/* below this number of signatures per share, handing it to another thread costs more than it saves */
+#define BCTBX_EDDSA_BATCH_MIN_PER_THREAD 16
+
+int bctbx_EDDSA_verify_batch(uint8_t EDDSAAlgo, const bctbx_EDDSABatchEntry_t *entries, size_t entriesCount, int *results) {
+	size_t publicKeyLength;
+	switch (EDDSAAlgo) {
+		case BCTBX_EDDSA_25519:
+			publicKeyLength = DECAF_EDDSA_25519_PUBLIC_BYTES;
+			break;
+		case BCTBX_EDDSA_448:
+			publicKeyLength = DECAF_EDDSA_448_PUBLIC_BYTES;
+			break;
+		default:
+			for (size_t i = 0; i < entriesCount && results != NULL; i++) results[i] = BCTBX_VERIFY_FAILED;
+			return BCTBX_VERIFY_FAILED;
+	}
+
+	/* entries are handed out one at a time, so a slow entry does not hold back a whole share */
+	std::atomic<size_t> next{0};
+	std::atomic<bool> failed{false};
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next.fetch_add(1, std::memory_order_relaxed)) < entriesCount) {
+			const bctbx_EDDSABatchEntry_t &entry = entries[i];
+			int ret = BCTBX_VERIFY_FAILED;
+			if (entry.publicKey != NULL && entry.publicKeyLength == publicKeyLength) {
+				ret = bctbx_EDDSA_verify_with_key(EDDSAAlgo, entry.publicKey, entry.message, entry.messageLength, entry.associatedData, entry.associatedDataLength, entry.signature, entry.signatureLength);
+			}
+			if (results != NULL) results[i] = ret;
+			if (ret != BCTBX_VERIFY_SUCCESS) failed.store(true, std::memory_order_relaxed);
 		}
+	};
+
+	/* the shares run on the default pool, the wait below lets a calling pool worker keep working */
+	bctbx_thread_pool_t *pool = bctbx_thread_pool_get_default();
+	size_t threadsCount = std::min<size_t>((size_t)bctbx_thread_pool_get_thread_count(pool) + 1, entriesCount / BCTBX_EDDSA_BATCH_MIN_PER_THREAD);
+	std::function<void()> share = worker;
+	std::vector<bctbx_thread_pool_task_t *> tasks;
+	for (size_t i = 1; i < threadsCount; i++) {
+		tasks.push_back(bctbx_thread_pool_submit(pool, [](void *data) { (*static_cast<std::function<void()> *>(data))(); }, &share));
 	}
-	return ret;
+	worker(); /* the calling thread takes its share */
+	for (auto task : tasks) {
+		bctbx_thread_pool_task_wait(task, -1);
+		bctbx_thread_pool_task_free(task);
+	}
+	return failed.load() ? BCTBX_VERIFY_FAILED : BCTBX_VERIFY_SUCCESS;
 }
 
 /**
@@ -506,6 +567,170 @@ void bctbx_EDDSA_ECDH_publicKeyConversion(const bctbx_EDDSAContext_t *ed, bctbx_
 
 }
 
+/*****************************************************************************/
+/*** Key pair pool                                                         ***/
+/*****************************************************************************/
+#define BCTBX_ECC_KEYPAIR_POOL_DEFAULT_DEPTH 16
+
+/**
+ * Keys are generated by a thread of the pool, using its own RNG context, and stored in a fixed size stack:
+ * taking a key is a copy under the pool lock. Keys are wiped when taken and when the pool is destroyed.
+ */
+struct bctbx_ECCKeyPairPool_struct {
+	enum class Kind {ECDH, EDDSA};
+
+	bctbx_ECCKeyPairPool_struct(Kind kind, uint8_t algo, size_t secretLength, size_t publicLength, size_t depth, uint32_t refillRate)
+		: mKind(kind), mAlgo(algo), mSecretLength(secretLength), mPublicLength(publicLength),
+		mDepth((depth == 0) ? BCTBX_ECC_KEYPAIR_POOL_DEFAULT_DEPTH : depth),
+		mRefillInterval((refillRate == 0) ? 0 : 1000000 / refillRate),
+		mKeys(mDepth * (secretLength + publicLength)) {
+		mThread = std::thread(&bctbx_ECCKeyPairPool_struct::refill, this);
+	}
+
+	~bctbx_ECCKeyPairPool_struct() {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mCondition.notify_one();
+		mThread.join();
+		bctbx_clean(mKeys.data(), mKeys.size());
+	}
+
+	/* copy a key pair in the given buffers, FALSE if the pool is empty */
+	bool_t take(Kind kind, uint8_t algo, uint8_t *secret, uint8_t *publicKey) {
+		if (kind != mKind || algo != mAlgo) return FALSE;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mCount == 0) return FALSE;
+			mCount--;
+			uint8_t *slot = mKeys.data() + mCount * (mSecretLength + mPublicLength);
+			memcpy(secret, slot, mSecretLength);
+			memcpy(publicKey, slot + mSecretLength, mPublicLength);
+			bctbx_clean(slot, mSecretLength + mPublicLength);
+		}
+		mCondition.notify_one();
+		return TRUE;
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mCount;
+	}
+
+	const Kind mKind;
+	const uint8_t mAlgo;
+	const size_t mSecretLength;
+	const size_t mPublicLength;
+
+private:
+	void generate(uint8_t *secret, uint8_t *publicKey) {
+		bctbx_rng_get(bctbx_rng_context_get_thread(), secret, mSecretLength);
+		if (mKind == Kind::ECDH) {
+			if (mAlgo == BCTBX_ECDH_X25519) decaf_x25519_derive_public_key(publicKey, secret);
+			else decaf_x448_derive_public_key(publicKey, secret);
+		} else {
+			if (mAlgo == BCTBX_EDDSA_25519) decaf_ed25519_derive_public_key(publicKey, secret);
+			else decaf_ed448_derive_public_key(publicKey, secret);
+		}
+	}
+
+	void refill() {
+		std::vector<uint8_t> keyPair(mSecretLength + mPublicLength);
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (!mStop) {
+			if (mCount == mDepth) {
+				mCondition.wait(lock);
+				continue;
+			}
+			/* the scalar multiplication runs unlocked, takers are never delayed by it */
+			lock.unlock();
+			generate(keyPair.data(), keyPair.data() + mSecretLength);
+			lock.lock();
+			memcpy(mKeys.data() + mCount * keyPair.size(), keyPair.data(), keyPair.size());
+			mCount++;
+			if (mRefillInterval.count() > 0) {
+				mCondition.wait_for(lock, mRefillInterval, [this] { return mStop; });
+			}
+		}
+		bctbx_clean(keyPair.data(), keyPair.size());
+	}
+
+	const size_t mDepth;
+	const std::chrono::microseconds mRefillInterval; /**< minimum delay between two generations, 0 for none */
+	std::vector<uint8_t> mKeys; /**< mDepth slots of secret || public, the first mCount are filled */
+	size_t mCount = 0;
+	bool mStop = false;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::thread mThread;
+};
+
+bctbx_ECCKeyPairPool_t *bctbx_CreateECDHKeyPairPool(const uint8_t ECDHAlgo, size_t depth, uint32_t refillRate) {
+	switch (ECDHAlgo) {
+		case BCTBX_ECDH_X25519:
+			return new bctbx_ECCKeyPairPool_struct(bctbx_ECCKeyPairPool_struct::Kind::ECDH, ECDHAlgo, DECAF_X25519_PRIVATE_BYTES, DECAF_X25519_PUBLIC_BYTES, depth, refillRate);
+		case BCTBX_ECDH_X448:
+			return new bctbx_ECCKeyPairPool_struct(bctbx_ECCKeyPairPool_struct::Kind::ECDH, ECDHAlgo, DECAF_X448_PRIVATE_BYTES, DECAF_X448_PUBLIC_BYTES, depth, refillRate);
+		default:
+			return NULL;
+	}
+}
+
+bctbx_ECCKeyPairPool_t *bctbx_CreateEDDSAKeyPairPool(const uint8_t EDDSAAlgo, size_t depth, uint32_t refillRate) {
+	switch (EDDSAAlgo) {
+		case BCTBX_EDDSA_25519:
+			return new bctbx_ECCKeyPairPool_struct(bctbx_ECCKeyPairPool_struct::Kind::EDDSA, EDDSAAlgo, DECAF_EDDSA_25519_PRIVATE_BYTES, DECAF_EDDSA_25519_PUBLIC_BYTES, depth, refillRate);
+		case BCTBX_EDDSA_448:
+			return new bctbx_ECCKeyPairPool_struct(bctbx_ECCKeyPairPool_struct::Kind::EDDSA, EDDSAAlgo, DECAF_EDDSA_448_PRIVATE_BYTES, DECAF_EDDSA_448_PUBLIC_BYTES, depth, refillRate);
+		default:
+			return NULL;
+	}
+}
+
+void bctbx_DestroyECCKeyPairPool(bctbx_ECCKeyPairPool_t *pool) {
+	delete pool;
+}
+
+size_t bctbx_ECCKeyPairPoolSize(bctbx_ECCKeyPairPool_t *pool) {
+	return (pool != NULL) ? pool->size() : 0;
+}
+
+/* take a key pair from the pool, or generate it now if the pool is empty or does not match the context algo */
+void bctbx_ECDHCreateKeyPairFromPool(bctbx_ECDHContext_t *context, bctbx_ECCKeyPairPool_t *pool, int (*rngFunction)(void *, uint8_t *, size_t), void *rngContext) {
+	if (context == NULL) {
+		return;
+	}
+	if (pool != NULL) {
+		uint8_t secret[DECAF_X448_PRIVATE_BYTES];
+		uint8_t selfPublic[DECAF_X448_PUBLIC_BYTES];
+		if (pool->take(bctbx_ECCKeyPairPool_struct::Kind::ECDH, context->algo, secret, selfPublic) == TRUE) {
+			bctbx_ECDHSetSecretKey(context, secret, pool->mSecretLength);
+			bctbx_ECDHSetSelfPublicKey(context, selfPublic, pool->mPublicLength);
+			bctbx_clean(secret, sizeof(secret));
+			return;
+		}
+	}
+	bctbx_ECDHCreateKeyPair(context, rngFunction, rngContext);
+}
+
+void bctbx_EDDSACreateKeyPairFromPool(bctbx_EDDSAContext_t *context, bctbx_ECCKeyPairPool_t *pool, int (*rngFunction)(void *, uint8_t *, size_t), void *rngContext) {
+	if (context == NULL) {
+		return;
+	}
+	if (pool != NULL) {
+		uint8_t secretKey[DECAF_EDDSA_448_PRIVATE_BYTES];
+		uint8_t publicKey[DECAF_EDDSA_448_PUBLIC_BYTES];
+		if (pool->take(bctbx_ECCKeyPairPool_struct::Kind::EDDSA, context->algo, secretKey, publicKey) == TRUE) {
+			bctbx_EDDSA_setSecretKey(context, secretKey, pool->mSecretLength);
+			bctbx_EDDSA_setPublicKey(context, publicKey, pool->mPublicLength);
+			bctbx_clean(secretKey, sizeof(secretKey));
+			return;
+		}
+	}
+	bctbx_EDDSACreateKeyPair(context, rngFunction, rngContext);
+}
+
 #else /* HAVE_DECAF */
 
 /* We do not have lib decaf, implement empty stubs */
@@ -527,6 +752,17 @@ void bctbx_EDDSA_sign(bctbx_EDDSAContext_t *context, const uint8_t *message, con
 void bctbx_EDDSA_setPublicKey(bctbx_EDDSAContext_t *context, const uint8_t *publicKey, const size_t publicKeyLength) {return;}
 void bctbx_EDDSA_setSecretKey(bctbx_EDDSAContext_t *context, const uint8_t *secretKey, const size_t secretKeyLength) {return;}
 int bctbx_EDDSA_verify(bctbx_EDDSAContext_t *context, const uint8_t *message, size_t messageLength, const uint8_t *associatedData, const uint8_t associatedDataLength, const uint8_t *signature, size_t signatureLength) {return BCTBX_VERIFY_FAILED;}
+int bctbx_EDDSA_verify_batch(uint8_t EDDSAAlgo, const bctbx_EDDSABatchEntry_t *entries, size_t entriesCount, int *results) {
+	for (size_t i = 0; i < entriesCount && results != NULL; i++) results[i] = BCTBX_VERIFY_FAILED;
+	return BCTBX_VERIFY_FAILED;
+}
 void bctbx_EDDSA_ECDH_privateKeyConversion(const bctbx_EDDSAContext_t *ed, bctbx_ECDHContext_t *x) {return;}
 void bctbx_EDDSA_ECDH_publicKeyConversion(const bctbx_EDDSAContext_t *ed, bctbx_ECDHContext_t *x, uint8_t isSelf) {return;}
+
+bctbx_ECCKeyPairPool_t *bctbx_CreateECDHKeyPairPool(const uint8_t ECDHAlgo, size_t depth, uint32_t refillRate) {return NULL;}
+bctbx_ECCKeyPairPool_t *bctbx_CreateEDDSAKeyPairPool(const uint8_t EDDSAAlgo, size_t depth, uint32_t refillRate) {return NULL;}
+void bctbx_DestroyECCKeyPairPool(bctbx_ECCKeyPairPool_t *pool) {return;}
+size_t bctbx_ECCKeyPairPoolSize(bctbx_ECCKeyPairPool_t *pool) {return 0;}
+void bctbx_ECDHCreateKeyPairFromPool(bctbx_ECDHContext_t *context, bctbx_ECCKeyPairPool_t *pool, int (*rngFunction)(void *, uint8_t *, size_t), void *rngContext) {return;}
+void bctbx_EDDSACreateKeyPairFromPool(bctbx_EDDSAContext_t *context, bctbx_ECCKeyPairPool_t *pool, int (*rngFunction)(void *, uint8_t *, size_t), void *rngContext) {return;}
 #endif
@@ -22,12 +22,16 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "utils.h"
+#include "aesni.h"
+#include "provider.h"
 
 #include <mbedtls/ssl.h>
+#include <mbedtls/ssl_ticket.h>
+#include <mbedtls/ssl_internal.h> /* mbedtls_ssl_check_cert_usage, mbedtls_ssl_check_curve */
 #include <mbedtls/timing.h>
 #include <mbedtls/error.h>
-#include <mbedtls/base64.h>
 #include <mbedtls/version.h>
 #include <mbedtls/pem.h>
 #include <mbedtls/x509.h>
@@ -48,6 +52,7 @@
 
 #include "bctoolbox/crypto.h"
 #include "bctoolbox/logging.h"
+#include "bctoolbox/map.h"
 
 
 /*** Cleaning ***/
@@ -84,31 +89,6 @@ void bctbx_strerror(int32_t error_code, char *buffer, size_t buffer_length) {
 	return;
 }
 
-/*** base64 ***/
-int32_t bctbx_base64_encode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length) {
-	size_t byte_written = 0;
-	int ret = mbedtls_base64_encode(output, *output_length, &byte_written, input, input_length);
-	*output_length = byte_written;
-	if (ret == MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL) {
-		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
-	}
-	return ret;
-}
-
-int32_t bctbx_base64_decode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length) {
-	size_t byte_written = 0;
-	int ret = mbedtls_base64_decode(output, *output_length, &byte_written, input, input_length);
-	*output_length = byte_written;
-	if (ret == MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL) {
-		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
-	}
-	if (ret == MBEDTLS_ERR_BASE64_INVALID_CHARACTER) {
-		return BCTBX_ERROR_INVALID_BASE64_INPUT;
-	}
-
-	return ret;
-}
-
 /*** signing key ***/
 bctbx_signing_key_t *bctbx_signing_key_new(void) {
 	mbedtls_pk_context *key = bctbx_malloc0(sizeof(mbedtls_pk_context));
@@ -825,6 +805,316 @@ const mbedtls_x509_crt_profile bctbx_x509_crt_profile_default =
 };
 
 /** context **/
+/** Caches **/
+/* the session cache stores serialized sessions, serialization is available from mbedtls v2.19.0 */
+#if defined(MBEDTLS_SSL_SRV_C) && MBEDTLS_VERSION_NUMBER >= 0x02130000
+#define BCTBX_SSL_SESSION_CACHE
+#endif
+
+/* the handshake skips the mbedtls verification through the per handshake authmode, set by mbedtls_ssl_set_hs_authmode
+ * and only available with SNI support on server side, and verifies the server chain itself: it must be kept after parsing */
+#if defined(MBEDTLS_SSL_CLI_C) && defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) \
+	&& (MBEDTLS_VERSION_NUMBER < 0x02110000 || defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE))
+#define BCTBX_X509_VERIFY_CACHE
+#endif
+
+#if defined(BCTBX_SSL_SESSION_CACHE) || defined(BCTBX_X509_VERIFY_CACHE)
+#define BCTBX_SSL_CACHE_DEFAULT_MAX_ENTRIES 1024
+
+/**
+ * A bounded table keyed by a binary id of at most 32 bytes, entries expire after a timeout
+ * and the least recently used one is evicted when the table is full.
+ * It is not locked, the caches embedding it hold their own lock.
+ */
+typedef struct bctbx_ssl_lru_cache {
+	bctbx_map_t *index; /**< hexadecimal id -> link in entries */
+	bctbx_list_t *entries; /**< bctbx_ssl_lru_cache_entry_t, most recently used first */
+	bctbx_list_t *last_entry; /**< least recently used, evicted first */
+	size_t entries_count;
+	size_t max_entries;
+	uint64_t timeout; /**< in ms */
+	void (*free_func)(void *); /**< destroys the entries data */
+} bctbx_ssl_lru_cache_t;
+
+typedef struct bctbx_ssl_lru_cache_entry {
+	char key[2*32+1]; /**< hexadecimal id, key in the index */
+	uint64_t timestamp; /**< insertion time in ms */
+	void *data;
+} bctbx_ssl_lru_cache_entry_t;
+
+static void bctbx_ssl_lru_cache_init(bctbx_ssl_lru_cache_t *lru, size_t max_entries, uint32_t timeout, void (*free_func)(void *)) {
+	memset(lru, 0, sizeof(bctbx_ssl_lru_cache_t));
+	lru->index = bctbx_mmap_cchar_new();
+	lru->max_entries = (max_entries == 0) ? BCTBX_SSL_CACHE_DEFAULT_MAX_ENTRIES : max_entries;
+	lru->timeout = (uint64_t)timeout * 1000;
+	lru->free_func = free_func;
+}
+
+static void bctbx_ssl_lru_cache_entry_free(bctbx_ssl_lru_cache_t *lru, bctbx_ssl_lru_cache_entry_t *entry) {
+	lru->free_func(entry->data);
+	bctbx_free(entry);
+}
+
+static void bctbx_ssl_lru_cache_clear(bctbx_ssl_lru_cache_t *lru) {
+	bctbx_list_t *link;
+	for (link = lru->entries; link != NULL; link = link->next) {
+		bctbx_ssl_lru_cache_entry_free(lru, (bctbx_ssl_lru_cache_entry_t *)link->data);
+	}
+	lru->entries = bctbx_list_free(lru->entries);
+	lru->last_entry = NULL;
+	lru->entries_count = 0;
+	bctbx_mmap_cchar_delete(lru->index);
+	lru->index = bctbx_mmap_cchar_new();
+}
+
+static void bctbx_ssl_lru_cache_uninit(bctbx_ssl_lru_cache_t *lru) {
+	bctbx_ssl_lru_cache_clear(lru);
+	bctbx_mmap_cchar_delete(lru->index);
+	lru->index = NULL;
+}
+
+static void bctbx_ssl_lru_cache_key(char *key, const unsigned char *id, size_t id_length) {
+	bctbx_int8_to_str((uint8_t *)key, id, id_length);
+	key[2*id_length] = '\0';
+}
+
+static void bctbx_ssl_lru_cache_remove(bctbx_ssl_lru_cache_t *lru, bctbx_list_t *link) {
+	bctbx_ssl_lru_cache_entry_t *entry = (bctbx_ssl_lru_cache_entry_t *)link->data;
+	bctbx_iterator_cchar_delete(bctbx_map_cchar_erase(lru->index, bctbx_map_cchar_find_key(lru->index, entry->key)));
+	if (lru->last_entry == link) {
+		lru->last_entry = link->prev;
+	}
+	lru->entries = bctbx_list_erase_link(lru->entries, link);
+	lru->entries_count--;
+	bctbx_ssl_lru_cache_entry_free(lru, entry);
+}
+
+static bctbx_list_t *bctbx_ssl_lru_cache_find(bctbx_ssl_lru_cache_t *lru, const char *key) {
+	bctbx_list_t *link = NULL;
+	bctbx_iterator_t *it = bctbx_map_cchar_find_key(lru->index, key);
+	bctbx_iterator_t *end = bctbx_map_cchar_end(lru->index);
+	if (!bctbx_iterator_cchar_equals(it, end)) {
+		link = (bctbx_list_t *)bctbx_pair_cchar_get_second(bctbx_iterator_cchar_get_pair(it));
+	}
+	bctbx_iterator_cchar_delete(it);
+	bctbx_iterator_cchar_delete(end);
+	return link;
+}
+
+/* return the data stored for id, NULL if there is none or it expired. A hit makes the entry the most recently used */
+static void *bctbx_ssl_lru_cache_get(bctbx_ssl_lru_cache_t *lru, const unsigned char *id, size_t id_length) {
+	char key[2*32+1];
+	bctbx_list_t *link;
+	bctbx_ssl_lru_cache_entry_t *entry;
+
+	bctbx_ssl_lru_cache_key(key, id, id_length);
+	link = bctbx_ssl_lru_cache_find(lru, key);
+	if (link == NULL) {
+		return NULL;
+	}
+	entry = (bctbx_ssl_lru_cache_entry_t *)link->data;
+	if (bctbx_get_coarse_time_ms() - entry->timestamp > lru->timeout) {
+		bctbx_ssl_lru_cache_remove(lru, link);
+		return NULL;
+	}
+	if (link != lru->entries) {
+		if (lru->last_entry == link) {
+			lru->last_entry = link->prev;
+		}
+		lru->entries = bctbx_list_unlink(lru->entries, link);
+		lru->entries = bctbx_list_prepend_link(lru->entries, link);
+	}
+	return entry->data;
+}
+
+/* store data for id, the cache takes its ownership. It replaces any data already stored for id */
+static void bctbx_ssl_lru_cache_set(bctbx_ssl_lru_cache_t *lru, const unsigned char *id, size_t id_length, void *data) {
+	bctbx_ssl_lru_cache_entry_t *entry = bctbx_new0(bctbx_ssl_lru_cache_entry_t, 1);
+	bctbx_list_t *link;
+
+	bctbx_ssl_lru_cache_key(entry->key, id, id_length);
+	entry->timestamp = bctbx_get_coarse_time_ms();
+	entry->data = data;
+
+	link = bctbx_ssl_lru_cache_find(lru, entry->key);
+	if (link != NULL) {
+		bctbx_ssl_lru_cache_remove(lru, link);
+	}
+	while (lru->entries_count >= lru->max_entries) {
+		bctbx_ssl_lru_cache_remove(lru, lru->last_entry);
+	}
+	link = bctbx_list_new(entry);
+	lru->entries = bctbx_list_prepend_link(lru->entries, link);
+	if (lru->last_entry == NULL) {
+		lru->last_entry = link;
+	}
+	bctbx_map_cchar_insert_and_delete(lru->index, (bctbx_pair_t *)bctbx_pair_cchar_new(entry->key, link));
+	lru->entries_count++;
+}
+#endif /* BCTBX_SSL_SESSION_CACHE || BCTBX_X509_VERIFY_CACHE */
+
+/** Certificate verification cache **/
+#ifdef BCTBX_X509_VERIFY_CACHE
+#define BCTBX_X509_VERIFY_CACHE_DEFAULT_TIMEOUT 3600 /* in seconds */
+
+struct bctbx_x509_verify_cache_struct {
+	bctbx_mutex_t lock;
+	bctbx_ssl_lru_cache_t lru; /**< verification key -> bctbx_x509_verify_result_t */
+};
+
+typedef struct bctbx_x509_verify_result {
+	uint32_t flags;
+	int32_t ret; /**< 0, MBEDTLS_ERR_X509_CERT_VERIFY_FAILED or MBEDTLS_ERR_SSL_BAD_HS_CERTIFICATE */
+	int64_t valid_until; /**< in seconds since the epoch, when a certificate or revocation list involved expires or becomes valid */
+} bctbx_x509_verify_result_t;
+
+bctbx_x509_verify_cache_t *bctbx_x509_verify_cache_new(size_t max_entries, uint32_t timeout) {
+	bctbx_x509_verify_cache_t *cache = bctbx_new0(bctbx_x509_verify_cache_t, 1);
+	bctbx_mutex_init(&cache->lock, NULL);
+	bctbx_ssl_lru_cache_init(&cache->lru, max_entries, (timeout == 0) ? BCTBX_X509_VERIFY_CACHE_DEFAULT_TIMEOUT : timeout, bctbx_free);
+	return cache;
+}
+
+void bctbx_x509_verify_cache_free(bctbx_x509_verify_cache_t *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	bctbx_ssl_lru_cache_uninit(&cache->lru);
+	bctbx_mutex_destroy(&cache->lock);
+	bctbx_free(cache);
+}
+
+void bctbx_x509_verify_cache_purge(bctbx_x509_verify_cache_t *cache) {
+	bctbx_mutex_lock(&cache->lock);
+	bctbx_ssl_lru_cache_clear(&cache->lru);
+	bctbx_mutex_unlock(&cache->lock);
+}
+
+size_t bctbx_x509_verify_cache_size(bctbx_x509_verify_cache_t *cache) {
+	size_t ret;
+	bctbx_mutex_lock(&cache->lock);
+	ret = cache->lru.entries_count;
+	bctbx_mutex_unlock(&cache->lock);
+	return ret;
+}
+
+/* return TRUE and set result if the verification result for key is cached and still holds at now */
+static bool_t bctbx_x509_verify_cache_get(bctbx_x509_verify_cache_t *cache, const uint8_t *key, int64_t now, bctbx_x509_verify_result_t *result) {
+	bctbx_x509_verify_result_t *cached;
+	bool_t found = FALSE;
+	bctbx_mutex_lock(&cache->lock);
+	cached = (bctbx_x509_verify_result_t *)bctbx_ssl_lru_cache_get(&cache->lru, key, 32);
+	if (cached != NULL && now < cached->valid_until) {
+		*result = *cached;
+		found = TRUE;
+	}
+	bctbx_mutex_unlock(&cache->lock);
+	return found;
+}
+
+static void bctbx_x509_verify_cache_set(bctbx_x509_verify_cache_t *cache, const uint8_t *key, const bctbx_x509_verify_result_t *result) {
+	bctbx_x509_verify_result_t *cached = bctbx_new(bctbx_x509_verify_result_t, 1);
+	*cached = *result;
+	bctbx_mutex_lock(&cache->lock);
+	bctbx_ssl_lru_cache_set(&cache->lru, key, 32, cached);
+	bctbx_mutex_unlock(&cache->lock);
+}
+
+/* the trust fingerprint changes with anything which may change the verification result of a given chain and host name:
+ * trusted CAs, revocation lists, certificate profile and accepted curves */
+static void bctbx_x509_trust_fingerprint(const mbedtls_ssl_config *conf, uint8_t fingerprint[32]) {
+	const mbedtls_x509_crt *crt;
+	const mbedtls_x509_crl *crl;
+	bctbx_sha256_context_t *sha256 = bctbx_sha256_context_new();
+	uint8_t separator = 0;
+
+	for (crt = conf->ca_chain; crt != NULL && crt->raw.p != NULL; crt = crt->next) {
+		bctbx_sha256_update(sha256, crt->raw.p, crt->raw.len);
+	}
+	bctbx_sha256_update(sha256, &separator, sizeof(separator));
+	for (crl = conf->ca_crl; crl != NULL && crl->raw.p != NULL; crl = crl->next) {
+		bctbx_sha256_update(sha256, crl->raw.p, crl->raw.len);
+	}
+	bctbx_sha256_update(sha256, &separator, sizeof(separator));
+	if (conf->cert_profile != NULL) {
+		bctbx_sha256_update(sha256, (const uint8_t *)conf->cert_profile, sizeof(mbedtls_x509_crt_profile));
+	}
+#if defined(MBEDTLS_ECP_C)
+	if (conf->curve_list != NULL) {
+		const mbedtls_ecp_group_id *curve;
+		for (curve = conf->curve_list; *curve != MBEDTLS_ECP_DP_NONE; curve++) {
+			int32_t id = (int32_t)*curve;
+			bctbx_sha256_update(sha256, (const uint8_t *)&id, sizeof(id));
+		}
+	}
+#endif /* MBEDTLS_ECP_C */
+	bctbx_sha256_finish(sha256, 32, fingerprint);
+	bctbx_sha256_context_free(sha256);
+}
+
+/* seconds since the epoch of a certificate time, which is in UTC */
+static int64_t bctbx_x509_time_to_epoch(const mbedtls_x509_time *t) {
+	/* days since 1970-01-01 of a date in the proleptic Gregorian calendar, years counted from March */
+	int64_t year = t->year - (t->mon <= 2 ? 1 : 0);
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t year_of_era = year - era * 400;
+	int64_t day_of_year = (153 * (t->mon + (t->mon > 2 ? -3 : 9)) + 2) / 5 + t->day - 1;
+	int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	int64_t days = era * 146097 + day_of_era - 719468;
+	return days * 86400 + t->hour * 3600 + t->min * 60 + t->sec;
+}
+
+/* bring valid_until back to the next change of validity of a certificate or revocation list, after now */
+static void bctbx_x509_update_valid_until(const mbedtls_x509_time *from, const mbedtls_x509_time *to, int64_t now, int64_t *valid_until) {
+	int64_t from_epoch = bctbx_x509_time_to_epoch(from);
+	int64_t to_epoch = bctbx_x509_time_to_epoch(to);
+	if (from_epoch > now && from_epoch < *valid_until) {
+		*valid_until = from_epoch;
+	}
+	if (to_epoch > now && to_epoch < *valid_until) {
+		*valid_until = to_epoch;
+	}
+}
+
+/* a verification result holds until a certificate of the chain, a trusted CA which may have issued it or
+ * a revocation list expires or becomes valid, the earliest of these times after now */
+static int64_t bctbx_x509_verify_result_valid_until(const mbedtls_x509_crt *chain, const mbedtls_ssl_config *conf, int64_t now) {
+	const mbedtls_x509_crt *crt, *last = NULL;
+	const mbedtls_x509_crl *crl;
+	int64_t valid_until = INT64_MAX;
+
+	for (crt = chain; crt != NULL && crt->raw.p != NULL; crt = crt->next) {
+		bctbx_x509_update_valid_until(&crt->valid_from, &crt->valid_to, now, &valid_until);
+		last = crt;
+	}
+	for (crt = conf->ca_chain; last != NULL && crt != NULL && crt->raw.p != NULL; crt = crt->next) {
+		if (crt->subject_raw.len == last->issuer_raw.len && memcmp(crt->subject_raw.p, last->issuer_raw.p, crt->subject_raw.len) == 0) {
+			bctbx_x509_update_valid_until(&crt->valid_from, &crt->valid_to, now, &valid_until);
+		}
+	}
+	for (crl = conf->ca_crl; crl != NULL && crl->raw.p != NULL; crl = crl->next) {
+		bctbx_x509_update_valid_until(&crl->this_update, &crl->next_update, now, &valid_until);
+	}
+	return valid_until;
+}
+
+#else /* BCTBX_X509_VERIFY_CACHE */
+bctbx_x509_verify_cache_t *bctbx_x509_verify_cache_new(size_t max_entries, uint32_t timeout) {
+	return NULL;
+}
+
+void bctbx_x509_verify_cache_free(bctbx_x509_verify_cache_t *cache) {
+}
+
+void bctbx_x509_verify_cache_purge(bctbx_x509_verify_cache_t *cache) {
+}
+
+size_t bctbx_x509_verify_cache_size(bctbx_x509_verify_cache_t *cache) {
+	return 0;
+}
+#endif /* BCTBX_X509_VERIFY_CACHE */
+/** Caches **/
+
 struct bctbx_ssl_context_struct {
 	mbedtls_ssl_context ssl_ctx;
 	int(*callback_cli_cert_function)(void *, bctbx_ssl_context_t *, const bctbx_list_t *); /**< pointer to the callback called to update client certificate during handshake
@@ -834,6 +1124,17 @@ struct bctbx_ssl_context_struct {
 	int(*callback_recv_function)(void *, unsigned char *, size_t); /* args: callback data, data buffer to be read, size of data buffer */
 	void *callback_sendrecv_data; /**< data passed to send/recv callbacks */
 	mbedtls_timing_delay_context timer; /**< a timer is requested for DTLS */
+	unsigned char *write_buffer; /**< outgoing records waiting for bctbx_ssl_flush, when write batching is on */
+	size_t write_buffer_size; /**< write_buffer capacity, 0 when write batching is off */
+	size_t write_buffer_length; /**< number of bytes pending in write_buffer */
+	uint8_t write_batching; /**< set while bctbx_ssl_write runs with batching on: records are stored instead of sent */
+	unsigned char *read_buffer; /**< data received ahead of mbedtls requests */
+	size_t read_buffer_size; /**< read_buffer capacity */
+	size_t read_ahead; /**< size of the reads asked to the recv callback, 0 when read ahead is off */
+	size_t read_buffer_start; /**< first byte not yet given to mbedtls */
+	size_t read_buffer_end; /**< end of the received data */
+	bctbx_x509_verify_cache_t *verify_cache; /**< server certificate verification results, client only */
+	uint8_t trust_fingerprint[32]; /**< identifies the trust settings of the configuration in the verify_cache keys, computed when the context is set up or reset */
 };
 
 bctbx_ssl_context_t *bctbx_ssl_context_new(void) {
@@ -849,6 +1150,14 @@ bctbx_ssl_context_t *bctbx_ssl_context_new(void) {
 
 void bctbx_ssl_context_free(bctbx_ssl_context_t *ssl_ctx) {
 	mbedtls_ssl_free(&(ssl_ctx->ssl_ctx));
+	if (ssl_ctx->write_buffer != NULL) {
+		bctbx_clean(ssl_ctx->write_buffer, ssl_ctx->write_buffer_size);
+		bctbx_free(ssl_ctx->write_buffer);
+	}
+	if (ssl_ctx->read_buffer != NULL) {
+		bctbx_clean(ssl_ctx->read_buffer, ssl_ctx->read_buffer_size);
+		bctbx_free(ssl_ctx->read_buffer);
+	}
 	bctbx_free(ssl_ctx);
 }
 
@@ -857,11 +1166,24 @@ int32_t bctbx_ssl_close_notify(bctbx_ssl_context_t *ssl_ctx) {
 }
 
 int32_t bctbx_ssl_session_reset(bctbx_ssl_context_t *ssl_ctx) {
+	/* data buffered for the previous connection is dropped */
+	ssl_ctx->write_buffer_length = 0;
+	ssl_ctx->read_buffer_start = ssl_ctx->read_buffer_end = 0;
+#ifdef BCTBX_X509_VERIFY_CACHE
+	/* the trust settings may have changed since the previous connection */
+	if (ssl_ctx->verify_cache != NULL) {
+		bctbx_x509_trust_fingerprint(ssl_ctx->ssl_ctx.conf, ssl_ctx->trust_fingerprint);
+	}
+#endif /* BCTBX_X509_VERIFY_CACHE */
 	return mbedtls_ssl_session_reset(&(ssl_ctx->ssl_ctx));
 }
 
 int32_t bctbx_ssl_write(bctbx_ssl_context_t *ssl_ctx, const unsigned char *buf, size_t buf_length) {
-	int ret = mbedtls_ssl_write(&(ssl_ctx->ssl_ctx), buf, buf_length);
+	int ret;
+	/* the handshake flights must not wait for a flush */
+	ssl_ctx->write_batching = (ssl_ctx->write_buffer_size > 0 && ssl_ctx->ssl_ctx.state == MBEDTLS_SSL_HANDSHAKE_OVER);
+	ret = mbedtls_ssl_write(&(ssl_ctx->ssl_ctx), buf, buf_length);
+	ssl_ctx->write_batching = 0;
 	/* remap some output code */
 	if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
 		ret = BCTBX_ERROR_NET_WANT_WRITE;
@@ -881,15 +1203,133 @@ int32_t bctbx_ssl_read(bctbx_ssl_context_t *ssl_ctx, unsigned char *buf, size_t
 	return ret;
 }
 
+#ifdef BCTBX_X509_VERIFY_CACHE
+/* the ciphersuite being negotiated moved from the transform to the handshake parameters in mbedtls v2.18.0 */
+#if MBEDTLS_VERSION_NUMBER >= 0x02120000
+#define BCTBX_SSL_NEGOTIATED_CIPHERSUITE(ssl) ((ssl)->handshake->ciphersuite_info)
+#else
+#define BCTBX_SSL_NEGOTIATED_CIPHERSUITE(ssl) ((ssl)->transform_negotiate->ciphersuite_info)
+#endif
+
+/* verify the server chain just parsed by the handshake, reusing the verification result cached for the same chain,
+ * host name, key exchange and trust settings. Mirrors the mbedtls client verification: chain, curve of an EC key,
+ * key usages required by the ciphersuite, then the same error code and alert.
+ * It is not used when a verify callback is set, see bctbx_ssl_handshake */
+static int bctbx_ssl_verify_server_certificate(bctbx_ssl_context_t *ssl_ctx) {
+	mbedtls_ssl_context *ssl = &(ssl_ctx->ssl_ctx);
+	const mbedtls_ssl_config *conf = ssl->conf;
+	const mbedtls_ssl_ciphersuite_t *ciphersuite_info = BCTBX_SSL_NEGOTIATED_CIPHERSUITE(ssl);
+	mbedtls_x509_crt *chain = ssl->session_negotiate->peer_cert;
+	const mbedtls_x509_crt *crt;
+	bctbx_sha256_context_t *sha256;
+	bctbx_x509_verify_result_t result;
+	uint8_t key[32];
+	int32_t key_exchange = (int32_t)ciphersuite_info->key_exchange;
+	int64_t now = (int64_t)time(NULL);
+	int ret;
+
+	if (chain == NULL || conf->authmode == MBEDTLS_SSL_VERIFY_NONE) {
+		return 0;
+	}
+
+	/* key: SHA256(trust fingerprint || host name || key exchange || chain), the key exchange selects the key usages checked */
+	sha256 = bctbx_sha256_context_new();
+	bctbx_sha256_update(sha256, ssl_ctx->trust_fingerprint, sizeof(ssl_ctx->trust_fingerprint));
+	if (ssl->hostname != NULL) {
+		bctbx_sha256_update(sha256, (const uint8_t *)ssl->hostname, strlen(ssl->hostname) + 1);
+	} else {
+		bctbx_sha256_update(sha256, (const uint8_t *)"", 1);
+	}
+	bctbx_sha256_update(sha256, (const uint8_t *)&key_exchange, sizeof(key_exchange));
+	for (crt = chain; crt != NULL && crt->raw.p != NULL; crt = crt->next) {
+		bctbx_sha256_update(sha256, crt->raw.p, crt->raw.len);
+	}
+	bctbx_sha256_finish(sha256, sizeof(key), key);
+	bctbx_sha256_context_free(sha256);
+
+	if (bctbx_x509_verify_cache_get(ssl_ctx->verify_cache, key, now, &result) == FALSE) {
+		result.flags = 0;
+		ret = mbedtls_x509_crt_verify_with_profile(chain, conf->ca_chain, conf->ca_crl, conf->cert_profile, ssl->hostname, &result.flags, NULL, NULL);
+		if (ret != 0 && ret != MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+			/* fatal error not related to the chain itself (eg: allocation failure), do not cache it */
+			return ret;
+		}
+#if defined(MBEDTLS_ECP_C)
+		/* an EC key must be on a curve accepted by the configuration */
+		if (mbedtls_pk_can_do(&chain->pk, MBEDTLS_PK_ECKEY) && mbedtls_ssl_check_curve(ssl, mbedtls_pk_ec(chain->pk)->grp.id) != 0) {
+			result.flags |= MBEDTLS_X509_BADCERT_BAD_KEY;
+			if (ret == 0) {
+				ret = MBEDTLS_ERR_SSL_BAD_HS_CERTIFICATE;
+			}
+		}
+#endif /* MBEDTLS_ECP_C */
+		/* key usage and extended key usage of the server certificate, it sets the flags itself */
+		if (mbedtls_ssl_check_cert_usage(chain, ciphersuite_info, MBEDTLS_SSL_IS_SERVER, &result.flags) != 0 && ret == 0) {
+			ret = MBEDTLS_ERR_SSL_BAD_HS_CERTIFICATE;
+		}
+		result.ret = ret;
+		result.valid_until = bctbx_x509_verify_result_valid_until(chain, conf, now);
+		bctbx_x509_verify_cache_set(ssl_ctx->verify_cache, key, &result);
+	}
+
+	ssl->session_negotiate->verify_result = result.flags;
+	ret = result.ret;
+	if (conf->ca_chain == NULL && conf->authmode == MBEDTLS_SSL_VERIFY_REQUIRED) {
+		ret = MBEDTLS_ERR_SSL_CA_CHAIN_REQUIRED;
+	}
+	if (ret == 0 || conf->authmode == MBEDTLS_SSL_VERIFY_OPTIONAL) {
+		return 0;
+	}
+	{
+		/* the certificate may have been rejected for several reasons, the alert is picked as mbedtls does */
+		unsigned char alert = MBEDTLS_SSL_ALERT_MSG_CERT_UNKNOWN;
+		if (result.flags & MBEDTLS_X509_BADCERT_OTHER) {
+			alert = MBEDTLS_SSL_ALERT_MSG_ACCESS_DENIED;
+		} else if (result.flags & MBEDTLS_X509_BADCERT_CN_MISMATCH) {
+			alert = MBEDTLS_SSL_ALERT_MSG_BAD_CERT;
+		} else if (result.flags & (MBEDTLS_X509_BADCERT_KEY_USAGE | MBEDTLS_X509_BADCERT_EXT_KEY_USAGE | MBEDTLS_X509_BADCERT_NS_CERT_TYPE
+				| MBEDTLS_X509_BADCERT_BAD_PK | MBEDTLS_X509_BADCERT_BAD_KEY)) {
+			alert = MBEDTLS_SSL_ALERT_MSG_UNSUPPORTED_CERT;
+		} else if (result.flags & MBEDTLS_X509_BADCERT_EXPIRED) {
+			alert = MBEDTLS_SSL_ALERT_MSG_CERT_EXPIRED;
+		} else if (result.flags & MBEDTLS_X509_BADCERT_REVOKED) {
+			alert = MBEDTLS_SSL_ALERT_MSG_CERT_REVOKED;
+		} else if (result.flags & MBEDTLS_X509_BADCERT_NOT_TRUSTED) {
+			alert = MBEDTLS_SSL_ALERT_MSG_UNKNOWN_CA;
+		}
+		mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL, alert);
+	}
+	return ret;
+}
+#endif /* BCTBX_X509_VERIFY_CACHE */
+
 int32_t bctbx_ssl_handshake(bctbx_ssl_context_t *ssl_ctx) {
 
 	int ret = 0;
 	while( ssl_ctx->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER )
 	{
+#ifdef BCTBX_X509_VERIFY_CACHE
+		int state = ssl_ctx->ssl_ctx.state;
+		/* the server certificate is verified through the cache: mbedtls only parses it.
+		 * A verify callback must see every chain, so with one set mbedtls verifies as usual */
+		bool_t use_verify_cache = (ssl_ctx->verify_cache != NULL && ssl_ctx->ssl_ctx.conf->f_vrfy == NULL
+			&& state == MBEDTLS_SSL_SERVER_CERTIFICATE) ? TRUE : FALSE;
+		if (use_verify_cache == TRUE) {
+			mbedtls_ssl_set_hs_authmode(&(ssl_ctx->ssl_ctx), MBEDTLS_SSL_VERIFY_NONE);
+		}
+#endif /* BCTBX_X509_VERIFY_CACHE */
 		ret = mbedtls_ssl_handshake_step(&(ssl_ctx->ssl_ctx));
 		if( ret != 0 ) {
 			break;
 		}
+#ifdef BCTBX_X509_VERIFY_CACHE
+		if (use_verify_cache == TRUE && ssl_ctx->ssl_ctx.state != state) {
+			ret = bctbx_ssl_verify_server_certificate(ssl_ctx);
+			if (ret != 0) {
+				break;
+			}
+		}
+#endif /* BCTBX_X509_VERIFY_CACHE */
 
 		/* insert the callback function for client certificate request */
 		if (ssl_ctx->callback_cli_cert_function != NULL) { /* check we have a callback function */
@@ -931,11 +1371,53 @@ int32_t bctbx_ssl_set_hs_own_cert(bctbx_ssl_context_t *ssl_ctx, bctbx_x509_certi
 	}
 }
 
+/* send the pending batched records, return 0 when they are all sent, a bctoolbox error code otherwise */
+static int32_t bctbx_ssl_send_write_buffer(bctbx_ssl_context_t *ssl_ctx) {
+	size_t sent = 0;
+	int32_t ret = 0;
+
+	while (sent < ssl_ctx->write_buffer_length) {
+		ret = ssl_ctx->callback_send_function(ssl_ctx->callback_sendrecv_data, ssl_ctx->write_buffer + sent, ssl_ctx->write_buffer_length - sent);
+		if (ret <= 0) {
+			break;
+		}
+		sent += ret;
+	}
+
+	/* keep what was not sent at the start of the buffer */
+	if (sent > 0) {
+		memmove(ssl_ctx->write_buffer, ssl_ctx->write_buffer + sent, ssl_ctx->write_buffer_length - sent);
+		ssl_ctx->write_buffer_length -= sent;
+	}
+	if (ssl_ctx->write_buffer_length == 0) {
+		return 0;
+	}
+	return (ret < 0) ? ret : BCTBX_ERROR_NET_WANT_WRITE;
+}
+
 int bctbx_ssl_send_callback(void *data, const unsigned char *buffer, size_t buffer_length) {
 	int ret = 0;
 	/* data is the ssl_context which contains the actual callback and data */
 	bctbx_ssl_context_t *ssl_ctx = (bctbx_ssl_context_t *)data;
 
+	/* records of bctbx_ssl_write are stored while they fit in the batch, anything else is sent after the pending ones */
+	if (ssl_ctx->write_batching && ssl_ctx->write_buffer_length + buffer_length <= ssl_ctx->write_buffer_size) {
+		memcpy(ssl_ctx->write_buffer + ssl_ctx->write_buffer_length, buffer, buffer_length);
+		ssl_ctx->write_buffer_length += buffer_length;
+		return (int)buffer_length;
+	}
+	if (ssl_ctx->write_buffer_length > 0) {
+		ret = bctbx_ssl_send_write_buffer(ssl_ctx);
+		if (ret != 0) {
+			return bctbx_ssl_sendrecv_callback_return_remap(ret);
+		}
+		if (ssl_ctx->write_batching && buffer_length <= ssl_ctx->write_buffer_size) {
+			memcpy(ssl_ctx->write_buffer, buffer, buffer_length);
+			ssl_ctx->write_buffer_length = buffer_length;
+			return (int)buffer_length;
+		}
+	}
+
 	ret = ssl_ctx->callback_send_function(ssl_ctx->callback_sendrecv_data, buffer, buffer_length);
 
 	return bctbx_ssl_sendrecv_callback_return_remap(ret);
@@ -946,11 +1428,111 @@ int bctbx_ssl_recv_callback(void *data, unsigned char *buffer, size_t buffer_len
 	/* data is the ssl_context which contains the actual callback and data */
 	bctbx_ssl_context_t *ssl_ctx = (bctbx_ssl_context_t *)data;
 
+	/* with read ahead, mbedtls requests (record header, then record body) are served from one large read */
+	if (ssl_ctx->read_buffer_start == ssl_ctx->read_buffer_end && ssl_ctx->read_ahead > 0) {
+		ret = ssl_ctx->callback_recv_function(ssl_ctx->callback_sendrecv_data, ssl_ctx->read_buffer, ssl_ctx->read_ahead);
+		if (ret <= 0) {
+			return bctbx_ssl_sendrecv_callback_return_remap(ret);
+		}
+		ssl_ctx->read_buffer_start = 0;
+		ssl_ctx->read_buffer_end = (size_t)ret;
+	}
+	if (ssl_ctx->read_buffer_start < ssl_ctx->read_buffer_end) {
+		size_t length = ssl_ctx->read_buffer_end - ssl_ctx->read_buffer_start;
+		if (length > buffer_length) {
+			length = buffer_length;
+		}
+		memcpy(buffer, ssl_ctx->read_buffer + ssl_ctx->read_buffer_start, length);
+		ssl_ctx->read_buffer_start += length;
+		return (int)length;
+	}
+
 	ret = ssl_ctx->callback_recv_function(ssl_ctx->callback_sendrecv_data, buffer, buffer_length);
 
 	return bctbx_ssl_sendrecv_callback_return_remap(ret);
 }
 
+int32_t bctbx_ssl_set_write_batching(bctbx_ssl_context_t *ssl_ctx, size_t max_size) {
+	int32_t ret;
+	if (ssl_ctx == NULL || ssl_ctx->ssl_ctx.conf == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	/* datagrams are sent as soon as they are produced */
+	if (ssl_ctx->ssl_ctx.conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+		return BCTBX_ERROR_INVALID_SSL_TRANSPORT;
+	}
+
+	/* send what was batched with the previous size */
+	ret = bctbx_ssl_flush(ssl_ctx);
+	if (ret != 0) {
+		return ret;
+	}
+	if (ssl_ctx->write_buffer != NULL) {
+		bctbx_free(ssl_ctx->write_buffer);
+		ssl_ctx->write_buffer = NULL;
+	}
+	ssl_ctx->write_buffer_size = max_size;
+	if (max_size > 0) {
+		ssl_ctx->write_buffer = bctbx_malloc(max_size);
+	}
+	return 0;
+}
+
+int32_t bctbx_ssl_flush(bctbx_ssl_context_t *ssl_ctx) {
+	if (ssl_ctx == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	if (ssl_ctx->write_buffer_length == 0) {
+		return 0;
+	}
+	return bctbx_ssl_send_write_buffer(ssl_ctx);
+}
+
+int32_t bctbx_ssl_set_read_ahead(bctbx_ssl_context_t *ssl_ctx, size_t size) {
+	size_t pending;
+	if (ssl_ctx == NULL || ssl_ctx->ssl_ctx.conf == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	/* a datagram holds whole records, there is nothing to read ahead */
+	if (ssl_ctx->ssl_ctx.conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+		return BCTBX_ERROR_INVALID_SSL_TRANSPORT;
+	}
+
+	/* keep the data already received: move it at the start of the buffer, which cannot shrink below it */
+	pending = ssl_ctx->read_buffer_end - ssl_ctx->read_buffer_start;
+	if (pending > 0) {
+		memmove(ssl_ctx->read_buffer, ssl_ctx->read_buffer + ssl_ctx->read_buffer_start, pending);
+	}
+	ssl_ctx->read_buffer_start = 0;
+	ssl_ctx->read_buffer_end = pending;
+	ssl_ctx->read_ahead = size;
+	size = (size > pending) ? size : pending;
+	if (size != ssl_ctx->read_buffer_size) {
+		if (size == 0) {
+			bctbx_free(ssl_ctx->read_buffer);
+			ssl_ctx->read_buffer = NULL;
+		} else {
+			ssl_ctx->read_buffer = bctbx_realloc(ssl_ctx->read_buffer, size);
+		}
+		ssl_ctx->read_buffer_size = size;
+	}
+	return 0;
+}
+
+bool_t bctbx_ssl_has_pending(bctbx_ssl_context_t *ssl_ctx) {
+	if (ssl_ctx->read_buffer_start < ssl_ctx->read_buffer_end) {
+		return TRUE;
+	}
+	if (mbedtls_ssl_get_bytes_avail(&(ssl_ctx->ssl_ctx)) > 0) {
+		return TRUE;
+	}
+#if MBEDTLS_VERSION_NUMBER >= 0x020D0000 // v2.13.0
+	return (mbedtls_ssl_check_pending(&(ssl_ctx->ssl_ctx)) != 0) ? TRUE : FALSE;
+#else
+	return FALSE;
+#endif
+}
+
 void bctbx_ssl_set_io_callbacks(bctbx_ssl_context_t *ssl_ctx, void *callback_data,
 		int(*callback_send_function)(void *, const unsigned char *, size_t), /* callbacks args are: callback data, data buffer to be send, size of data buffer */
 		int(*callback_recv_function)(void *, unsigned char *, size_t)){ /* args: callback data, data buffer to be read, size of data buffer */
@@ -982,6 +1564,10 @@ const char *bctbx_ssl_get_version(bctbx_ssl_context_t *ssl_ctx){
 	return mbedtls_ssl_get_version(&(ssl_ctx->ssl_ctx));
 }
 
+uint32_t bctbx_ssl_get_verify_result(bctbx_ssl_context_t *ssl_ctx) {
+	return bctbx_x509_certificate_remap_flag(mbedtls_ssl_get_verify_result(&(ssl_ctx->ssl_ctx)));
+}
+
 int32_t bctbx_ssl_set_hostname(bctbx_ssl_context_t *ssl_ctx, const char *hostname){
 	return mbedtls_ssl_set_hostname(&(ssl_ctx->ssl_ctx), hostname);
 }
@@ -1057,6 +1643,154 @@ bctbx_dtls_srtp_profile_t bctbx_ssl_get_dtls_srtp_protection_profile(bctbx_ssl_c
 
 /** DTLS SRTP functions **/
 
+/** Session resumption **/
+#define BCTBX_SSL_SESSION_DEFAULT_LIFETIME 86400 /* in seconds, for cached sessions and tickets */
+
+struct bctbx_ssl_session_struct {
+	mbedtls_ssl_session session;
+};
+
+bctbx_ssl_session_t *bctbx_ssl_session_new(void) {
+	bctbx_ssl_session_t *session = bctbx_malloc0(sizeof(bctbx_ssl_session_t));
+	mbedtls_ssl_session_init(&(session->session));
+	return session;
+}
+
+void bctbx_ssl_session_free(bctbx_ssl_session_t *session) {
+	if (session == NULL) {
+		return;
+	}
+	mbedtls_ssl_session_free(&(session->session));
+	bctbx_free(session);
+}
+
+int32_t bctbx_ssl_get_session(const bctbx_ssl_context_t *ssl_ctx, bctbx_ssl_session_t *session) {
+	if (ssl_ctx == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	if (session == NULL) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	/* mbedtls frees the session previously stored in the destination before copying */
+	return mbedtls_ssl_get_session(&(ssl_ctx->ssl_ctx), &(session->session));
+}
+
+int32_t bctbx_ssl_set_session(bctbx_ssl_context_t *ssl_ctx, const bctbx_ssl_session_t *session) {
+	if (ssl_ctx == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	if (session == NULL) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	return mbedtls_ssl_set_session(&(ssl_ctx->ssl_ctx), &(session->session));
+}
+
+#ifdef BCTBX_SSL_SESSION_CACHE
+typedef struct bctbx_ssl_serialized_session {
+	unsigned char *buffer;
+	size_t length;
+} bctbx_ssl_serialized_session_t;
+
+struct bctbx_ssl_session_cache_struct {
+	bctbx_mutex_t lock;
+	bctbx_ssl_lru_cache_t lru; /**< session id -> bctbx_ssl_serialized_session_t */
+};
+
+static void bctbx_ssl_serialized_session_free(void *data) {
+	bctbx_ssl_serialized_session_t *session = (bctbx_ssl_serialized_session_t *)data;
+	bctbx_clean(session->buffer, session->length);
+	bctbx_free(session->buffer);
+	bctbx_free(session);
+}
+
+/* mbedtls get callback: session holds the id proposed by the client, fill it with the cached one. Any non zero return is a miss */
+static int bctbx_ssl_session_cache_get(void *data, mbedtls_ssl_session *session) {
+	bctbx_ssl_session_cache_t *cache = (bctbx_ssl_session_cache_t *)data;
+	bctbx_ssl_serialized_session_t *entry;
+	int ret = 1;
+
+	if (session->id_len == 0 || session->id_len > 32) {
+		return 1;
+	}
+
+	bctbx_mutex_lock(&cache->lock);
+	entry = (bctbx_ssl_serialized_session_t *)bctbx_ssl_lru_cache_get(&cache->lru, session->id, session->id_len);
+	if (entry != NULL) {
+		ret = mbedtls_ssl_session_load(session, entry->buffer, entry->length);
+	}
+	bctbx_mutex_unlock(&cache->lock);
+	return ret;
+}
+
+/* mbedtls set callback: called at the end of each full handshake with a session id */
+static int bctbx_ssl_session_cache_set(void *data, const mbedtls_ssl_session *session) {
+	bctbx_ssl_session_cache_t *cache = (bctbx_ssl_session_cache_t *)data;
+	bctbx_ssl_serialized_session_t *entry;
+	size_t length = 0;
+	int ret;
+
+	if (session->id_len == 0 || session->id_len > 32) {
+		return 1;
+	}
+
+	/* serialize before taking the lock, a first call gives the needed length */
+	ret = mbedtls_ssl_session_save(session, NULL, 0, &length);
+	if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+		return ret;
+	}
+	entry = bctbx_new0(bctbx_ssl_serialized_session_t, 1);
+	entry->buffer = bctbx_malloc(length);
+	entry->length = length;
+	ret = mbedtls_ssl_session_save(session, entry->buffer, entry->length, &length);
+	if (ret != 0) {
+		bctbx_ssl_serialized_session_free(entry);
+		return ret;
+	}
+
+	bctbx_mutex_lock(&cache->lock);
+	bctbx_ssl_lru_cache_set(&cache->lru, session->id, session->id_len, entry);
+	bctbx_mutex_unlock(&cache->lock);
+	return 0;
+}
+
+bctbx_ssl_session_cache_t *bctbx_ssl_session_cache_new(size_t max_entries, uint32_t timeout) {
+	bctbx_ssl_session_cache_t *cache = bctbx_new0(bctbx_ssl_session_cache_t, 1);
+	bctbx_mutex_init(&cache->lock, NULL);
+	bctbx_ssl_lru_cache_init(&cache->lru, max_entries, (timeout == 0) ? BCTBX_SSL_SESSION_DEFAULT_LIFETIME : timeout, bctbx_ssl_serialized_session_free);
+	return cache;
+}
+
+void bctbx_ssl_session_cache_free(bctbx_ssl_session_cache_t *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	bctbx_ssl_lru_cache_uninit(&cache->lru);
+	bctbx_mutex_destroy(&cache->lock);
+	bctbx_free(cache);
+}
+
+size_t bctbx_ssl_session_cache_size(bctbx_ssl_session_cache_t *cache) {
+	size_t ret;
+	bctbx_mutex_lock(&cache->lock);
+	ret = cache->lru.entries_count;
+	bctbx_mutex_unlock(&cache->lock);
+	return ret;
+}
+
+#else /* BCTBX_SSL_SESSION_CACHE */
+bctbx_ssl_session_cache_t *bctbx_ssl_session_cache_new(size_t max_entries, uint32_t timeout) {
+	return NULL;
+}
+
+void bctbx_ssl_session_cache_free(bctbx_ssl_session_cache_t *cache) {
+}
+
+size_t bctbx_ssl_session_cache_size(bctbx_ssl_session_cache_t *cache) {
+	return 0;
+}
+#endif /* BCTBX_SSL_SESSION_CACHE */
+/** Session resumption **/
+
 /** config **/
 #ifdef HAVE_DTLS_SRTP
 typedef struct bctbx_dtls_srtp_keys {
@@ -1072,6 +1806,11 @@ struct bctbx_ssl_config_struct {
 	int(*callback_cli_cert_function)(void *, bctbx_ssl_context_t *, const bctbx_list_t *); /**< pointer to the callback called to update client certificate during handshake
 												callback params are user_data, ssl_context, list of server certificate subject alt name and CN (null terminated strings) */
 	void *callback_cli_cert_data; /**< data passed to the client cert callback */
+	bctbx_x509_ca_store_t *ca_store; /**< shared CA store used as CA chain, if any */
+	bctbx_x509_verify_cache_t *verify_cache; /**< server certificate verification results, client only */
+#if defined(MBEDTLS_SSL_TICKET_C)
+	mbedtls_ssl_ticket_context *ticket; /**< session tickets keys, server only, set when tickets are enabled */
+#endif /* MBEDTLS_SSL_TICKET_C */
 #ifdef HAVE_DTLS_SRTP
 	mbedtls_ssl_srtp_profile dtls_srtp_mbedtls_profiles[MBEDTLS_TLS_SRTP_MAX_PROFILE_LIST_LENGTH + 1]; /**< list of supported DTLS-SRTP profiles, mbedtls won't hold the reference, so we must do it for the lifetime of the config structure. (size is +1 to add the list termination) */
 	bctbx_dtls_srtp_keys_t dtls_srtp_keys; /**< Key material is stored during the handshake there and used after completion to generate the DTLS-SRTP shared secret */
@@ -1126,6 +1865,14 @@ void bctbx_ssl_config_free(bctbx_ssl_config_t *ssl_config) {
 		bctbx_free(ssl_config->ssl_config);
 	}
 
+#if defined(MBEDTLS_SSL_TICKET_C)
+	if (ssl_config->ticket != NULL) {
+		mbedtls_ssl_ticket_free(ssl_config->ticket);
+		bctbx_free(ssl_config->ticket);
+	}
+#endif /* MBEDTLS_SSL_TICKET_C */
+	bctbx_x509_ca_store_unref(ssl_config->ca_store);
+
 #ifdef HAVE_DTLS_SRTP
 	bctbx_clean(ssl_config->dtls_srtp_keys.master_secret, sizeof(ssl_config->dtls_srtp_keys.master_secret));
 	bctbx_clean(ssl_config->dtls_srtp_keys.randoms, sizeof(ssl_config->dtls_srtp_keys.randoms));
@@ -1241,6 +1988,69 @@ int32_t bctbx_ssl_config_set_ciphersuites(bctbx_ssl_config_t *ssl_config, const
 	return 0;
 }
 
+int32_t bctbx_ssl_config_set_session_cache(bctbx_ssl_config_t *ssl_config, bctbx_ssl_session_cache_t *cache) {
+	if (ssl_config == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONFIG;
+	}
+#ifdef BCTBX_SSL_SESSION_CACHE
+	if (cache == NULL) {
+		mbedtls_ssl_conf_session_cache(ssl_config->ssl_config, NULL, NULL, NULL);
+	} else {
+		mbedtls_ssl_conf_session_cache(ssl_config->ssl_config, cache, bctbx_ssl_session_cache_get, bctbx_ssl_session_cache_set);
+	}
+	return 0;
+#else /* BCTBX_SSL_SESSION_CACHE */
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+#endif /* BCTBX_SSL_SESSION_CACHE */
+}
+
+int32_t bctbx_ssl_config_set_session_tickets(bctbx_ssl_config_t *ssl_config, bool_t enable, uint32_t lifetime) {
+	if (ssl_config == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONFIG;
+	}
+
+	if (ssl_config->ssl_config->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_CLI_C)
+		mbedtls_ssl_conf_session_tickets(ssl_config->ssl_config, enable ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED : MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+		return 0;
+#else
+		return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+#endif
+	}
+
+#if defined(MBEDTLS_SSL_TICKET_C) && defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_SRV_C)
+	/* drop the current keys, if any: enabling again starts with fresh keys and the new lifetime */
+	mbedtls_ssl_conf_session_tickets_cb(ssl_config->ssl_config, NULL, NULL, NULL);
+	if (ssl_config->ticket != NULL) {
+		mbedtls_ssl_ticket_free(ssl_config->ticket);
+		bctbx_free(ssl_config->ticket);
+		ssl_config->ticket = NULL;
+	}
+
+	if (enable) {
+		int ret;
+		/* the ticket keys are generated, and then renewed, with the configuration RNG */
+		if (ssl_config->ssl_config->f_rng == NULL) {
+			return BCTBX_ERROR_INVALID_SSL_CONFIG;
+		}
+		ssl_config->ticket = bctbx_malloc0(sizeof(mbedtls_ssl_ticket_context));
+		mbedtls_ssl_ticket_init(ssl_config->ticket);
+		ret = mbedtls_ssl_ticket_setup(ssl_config->ticket, ssl_config->ssl_config->f_rng, ssl_config->ssl_config->p_rng,
+			MBEDTLS_CIPHER_AES_256_GCM, (lifetime == 0) ? BCTBX_SSL_SESSION_DEFAULT_LIFETIME : lifetime);
+		if (ret != 0) {
+			mbedtls_ssl_ticket_free(ssl_config->ticket);
+			bctbx_free(ssl_config->ticket);
+			ssl_config->ticket = NULL;
+			return ret;
+		}
+		mbedtls_ssl_conf_session_tickets_cb(ssl_config->ssl_config, mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse, ssl_config->ticket);
+	}
+	return 0;
+#else
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+#endif
+}
+
 void *bctbx_ssl_config_get_private_config(bctbx_ssl_config_t *ssl_config) {
 	return (void *)ssl_config->ssl_config;
 }
@@ -1282,6 +2092,21 @@ int32_t bctbx_ssl_config_set_rng(bctbx_ssl_config_t *ssl_config, int(*rng_functi
 	return 0;
 }
 
+int32_t bctbx_ssl_config_set_verify_cache(bctbx_ssl_config_t *ssl_config, bctbx_x509_verify_cache_t *cache) {
+	if (ssl_config == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONFIG;
+	}
+#ifdef BCTBX_X509_VERIFY_CACHE
+	if (cache != NULL && ssl_config->ssl_config->endpoint != MBEDTLS_SSL_IS_CLIENT) {
+		return BCTBX_ERROR_INVALID_SSL_ENDPOINT;
+	}
+	ssl_config->verify_cache = cache;
+	return 0;
+#else /* BCTBX_X509_VERIFY_CACHE */
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+#endif /* BCTBX_X509_VERIFY_CACHE */
+}
+
 int32_t bctbx_ssl_config_set_callback_verify(bctbx_ssl_config_t *ssl_config, int(*callback_function)(void *, bctbx_x509_certificate_t *, int, uint32_t *), void *callback_data) {
 	if (ssl_config == NULL) {
 		return BCTBX_ERROR_INVALID_SSL_CONFIG;
@@ -1308,6 +2133,24 @@ int32_t bctbx_ssl_config_set_ca_chain(bctbx_ssl_config_t *ssl_config, bctbx_x509
 	}
 	/* ca_crl (arg 3) is always set to null, add the functionnality if needed */
 	mbedtls_ssl_conf_ca_chain(ssl_config->ssl_config, (mbedtls_x509_crt *)ca_chain, NULL);
+	bctbx_x509_ca_store_unref(ssl_config->ca_store);
+	ssl_config->ca_store = NULL;
+
+	return 0;
+}
+
+int32_t bctbx_ssl_config_set_ca_store(bctbx_ssl_config_t *ssl_config, bctbx_x509_ca_store_t *ca_store) {
+	if (ssl_config == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONFIG;
+	}
+	/* take the new reference first: the store given may be the one already set */
+	if (ca_store != NULL) {
+		bctbx_x509_ca_store_ref(ca_store);
+	}
+	bctbx_x509_ca_store_unref(ssl_config->ca_store);
+	ssl_config->ca_store = ca_store;
+	/* mbedtls only reads the chain during verification, the const cast is safe */
+	mbedtls_ssl_conf_ca_chain(ssl_config->ssl_config, (ca_store != NULL) ? (mbedtls_x509_crt *)bctbx_x509_ca_store_get_certificates(ca_store) : NULL, NULL);
 
 	return 0;
 }
@@ -1404,6 +2247,14 @@ int32_t bctbx_ssl_context_setup(bctbx_ssl_context_t *ssl_ctx, bctbx_ssl_config_t
 		ssl_ctx->callback_cli_cert_function = ssl_config->callback_cli_cert_function;
 		ssl_ctx->callback_cli_cert_data = ssl_config->callback_cli_cert_data;
 	}
+	ssl_ctx->verify_cache = ssl_config->verify_cache;
+#ifdef BCTBX_X509_VERIFY_CACHE
+	/* read from the mbedtls configuration: it covers the trust settings set through it directly or through
+	 * bctbx_ssl_config_set_crypto_library_config, and the chains modified in place since they were set */
+	if (ssl_ctx->verify_cache != NULL) {
+		bctbx_x509_trust_fingerprint(ssl_config->ssl_config, ssl_ctx->trust_fingerprint);
+	}
+#endif /* BCTBX_X509_VERIFY_CACHE */
 
 #ifdef HAVE_DTLS_SRTP
 	/* We do not use DTLS SRTP cookie, so we must set to NULL the callbacks. Cookies are used to prevent DoS attack but our server is on only when during a brief period so we do not need this */
@@ -1432,7 +2283,7 @@ int32_t bctbx_ssl_context_setup(bctbx_ssl_context_t *ssl_ctx, bctbx_ssl_config_t
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_hmacSha512(const uint8_t *key,
+static void bctbx_mbedtls_hmacSha512(const uint8_t *key,
 		size_t keyLength,
 		const uint8_t *input,
 		size_t inputLength,
@@ -1460,7 +2311,7 @@ void bctbx_hmacSha512(const uint8_t *key,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_hmacSha384(const uint8_t *key,
+static void bctbx_mbedtls_hmacSha384(const uint8_t *key,
 		size_t keyLength,
 		const uint8_t *input,
 		size_t inputLength,
@@ -1488,7 +2339,7 @@ void bctbx_hmacSha384(const uint8_t *key,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_hmacSha256(const uint8_t *key,
+static void bctbx_mbedtls_hmacSha256(const uint8_t *key,
 		size_t keyLength,
 		const uint8_t *input,
 		size_t inputLength,
@@ -1514,7 +2365,7 @@ void bctbx_hmacSha256(const uint8_t *key,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_sha512(const uint8_t *input,
+static void bctbx_mbedtls_sha512(const uint8_t *input,
 		size_t inputLength,
 		uint8_t hashLength,
 		uint8_t *output)
@@ -1538,7 +2389,7 @@ void bctbx_sha512(const uint8_t *input,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_sha384(const uint8_t *input,
+static void bctbx_mbedtls_sha384(const uint8_t *input,
 		size_t inputLength,
 		uint8_t hashLength,
 		uint8_t *output)
@@ -1562,7 +2413,7 @@ void bctbx_sha384(const uint8_t *input,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_sha256(const uint8_t *input,
+static void bctbx_mbedtls_sha256(const uint8_t *input,
 		size_t inputLength,
 		uint8_t hashLength,
 		uint8_t *output)
@@ -1641,7 +2492,7 @@ void bctbx_md5(const uint8_t *input,
  * @param[in]	tagLength					Requested length for the generated tag
  * @param[out]	output						Buffer holding the output, shall be at least the length of plainText buffer
  */
-int32_t bctbx_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
+static int32_t bctbx_mbedtls_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
 		const uint8_t *plainText, size_t plainTextLength,
 		const uint8_t *authenticatedData, size_t authenticatedDataLength,
 		const uint8_t *initializationVector, size_t initializationVectorLength,
@@ -1677,7 +2528,7 @@ int32_t bctbx_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
  *
  * @return 0 on succes, BCTBX_ERROR_AUTHENTICATION_FAILED if tag doesn't match or mbedtls error code
  */
-int32_t bctbx_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
+static int32_t bctbx_mbedtls_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
 		const uint8_t *cipherText, size_t cipherTextLength,
 		const uint8_t *authenticatedData, size_t authenticatedDataLength,
 		const uint8_t *initializationVector, size_t initializationVectorLength,
@@ -1700,6 +2551,22 @@ int32_t bctbx_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
 	return ret;
 }
 
+static const bctbx_crypto_provider_t bctbx_mbedtls_provider = {
+	"mbedtls",
+	bctbx_mbedtls_sha256,
+	bctbx_mbedtls_sha384,
+	bctbx_mbedtls_sha512,
+	bctbx_mbedtls_hmacSha256,
+	bctbx_mbedtls_hmacSha384,
+	bctbx_mbedtls_hmacSha512,
+	bctbx_mbedtls_aes_gcm_encrypt_and_tag,
+	bctbx_mbedtls_aes_gcm_decrypt_and_auth
+};
+
+const bctbx_crypto_provider_t *bctbx_crypto_backend_provider(void) {
+	return &bctbx_mbedtls_provider;
+}
+
 
 /**
  * @Brief create and initialise an AES-GCM encryption context
@@ -1785,6 +2652,122 @@ int32_t bctbx_aes_gcm_finish(bctbx_aes_gcm_context_t *context,
 	return ret;
 }
 
+/*** AES in CFB128 mode ***/
+struct bctbx_aes_cfb_context_struct {
+	bctbx_aesni_key_t aesni; /**< key schedule for the AES-NI code path */
+	mbedtls_aes_context aes; /**< used when the CPU has no AES-NI */
+	bool_t useAesni;
+};
+
+static int bctbx_aes_cfb_context_init(bctbx_aes_cfb_context_t *context, const uint8_t *key, size_t keyLength) {
+	if (keyLength != 16 && keyLength != 32) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	memset(context, 0, sizeof(bctbx_aes_cfb_context_t));
+	context->useAesni = (bctbx_aesni_setkey(&context->aesni, key, keyLength) == 0);
+	if (!context->useAesni) {
+		/* use the aes_setkey_enc function for both directions as requested by the documentation of aes_crypt_cfb128 function */
+		mbedtls_aes_init(&context->aes);
+		mbedtls_aes_setkey_enc(&context->aes, key, (unsigned int)keyLength*8);
+	}
+	return 0;
+}
+
+static void bctbx_aes_cfb_context_uninit(bctbx_aes_cfb_context_t *context) {
+	if (!context->useAesni) {
+		mbedtls_aes_free(&context->aes);
+	}
+	bctbx_clean(context, sizeof(bctbx_aes_cfb_context_t));
+}
+
+static void bctbx_aes_cfb_crypt(const bctbx_aes_cfb_context_t *context, int mode,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	uint8_t IVbuffer[16];
+	size_t iv_offset=0; /* is not used by us but needed and updated by mbedtls */
+
+	if (context->useAesni) {
+		if (mode == MBEDTLS_AES_ENCRYPT) {
+			bctbx_aesni_cfb_encrypt(&context->aesni, IV, input, inputLength, output);
+		} else {
+			bctbx_aesni_cfb_decrypt(&context->aesni, IV, input, inputLength, output);
+		}
+		return;
+	}
+
+	/* make a local copy of IV which is modified by the mbedtls AES-CFB function */
+	memcpy(IVbuffer, IV, 16*sizeof(uint8_t));
+	/* mbedtls only reads the key schedule, the context can be shared */
+	mbedtls_aes_crypt_cfb128((mbedtls_aes_context *)&context->aes, mode, inputLength, &iv_offset, IVbuffer, input, output);
+}
+
+bctbx_aes_cfb_context_t *bctbx_aes_cfb_context_new(const uint8_t *key, size_t keyLength) {
+	bctbx_aes_cfb_context_t *context = bctbx_malloc(sizeof(bctbx_aes_cfb_context_t));
+	if (bctbx_aes_cfb_context_init(context, key, keyLength) != 0) {
+		bctbx_free(context);
+		return NULL;
+	}
+	return context;
+}
+
+void bctbx_aes_cfb_context_free(bctbx_aes_cfb_context_t *context) {
+	if (context == NULL) return;
+	bctbx_aes_cfb_context_uninit(context);
+	bctbx_free(context);
+}
+
+void bctbx_aes_cfb_encrypt(const bctbx_aes_cfb_context_t *context,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	bctbx_aes_cfb_crypt(context, MBEDTLS_AES_ENCRYPT, IV, input, inputLength, output);
+}
+
+void bctbx_aes_cfb_decrypt(const bctbx_aes_cfb_context_t *context,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	bctbx_aes_cfb_crypt(context, MBEDTLS_AES_DECRYPT, IV, input, inputLength, output);
+}
+
+void bctbx_aes_cfb_encrypt_packets(const bctbx_aes_cfb_context_t *context,
+		const bctbx_aes_cfb_packet_t *packets,
+		size_t packetsCount) {
+	size_t i;
+	if (context->useAesni) {
+		bctbx_aesni_cfb_encrypt_packets(&context->aesni, packets, packetsCount);
+		return;
+	}
+	for (i = 0; i < packetsCount; i++) {
+		bctbx_aes_cfb_crypt(context, MBEDTLS_AES_ENCRYPT, packets[i].IV, packets[i].input, packets[i].inputLength, packets[i].output);
+	}
+}
+
+void bctbx_aes_cfb_decrypt_packets(const bctbx_aes_cfb_context_t *context,
+		const bctbx_aes_cfb_packet_t *packets,
+		size_t packetsCount) {
+	size_t i;
+	/* decryption is parallel inside each packet already */
+	for (i = 0; i < packetsCount; i++) {
+		bctbx_aes_cfb_crypt(context, MBEDTLS_AES_DECRYPT, packets[i].IV, packets[i].input, packets[i].inputLength, packets[i].output);
+	}
+}
+
+static void bctbx_aes_cfb_oneshot(const uint8_t *key, size_t keyLength, int mode,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	bctbx_aes_cfb_context_t context;
+	bctbx_aes_cfb_context_init(&context, key, keyLength);
+	bctbx_aes_cfb_crypt(&context, mode, IV, input, inputLength, output);
+	bctbx_aes_cfb_context_uninit(&context);
+}
+
 /*
  * @brief Wrapper for AES-128 in CFB128 mode encryption
  * Both key and IV must be 16 bytes long, IV is not updated
@@ -1802,19 +2785,7 @@ void bctbx_aes128CfbEncrypt(const uint8_t *key,
 		size_t inputLength,
 		uint8_t *output)
 {
-	uint8_t IVbuffer[16];
-	size_t iv_offset=0; /* is not used by us but needed and updated by mbedtls */
-	mbedtls_aes_context context;
-	memset (&context, 0, sizeof(mbedtls_aes_context));
-
-	/* make a local copy of IV which is modified by the mbedtls AES-CFB function */
-	memcpy(IVbuffer, IV, 16*sizeof(uint8_t));
-
-	/* initialise the aes context and key */
-	mbedtls_aes_setkey_enc(&context, key, 128);
-
-	/* encrypt */
-	mbedtls_aes_crypt_cfb128 (&context, MBEDTLS_AES_ENCRYPT, inputLength, &iv_offset, IVbuffer, input, output);
+	bctbx_aes_cfb_oneshot(key, 16, MBEDTLS_AES_ENCRYPT, IV, input, inputLength, output);
 }
 
 /*
@@ -1834,19 +2805,7 @@ void bctbx_aes128CfbDecrypt(const uint8_t *key,
 		size_t inputLength,
 		uint8_t *output)
 {
-	uint8_t IVbuffer[16];
-	size_t iv_offset=0; /* is not used by us but needed and updated by mbedtls */
-	mbedtls_aes_context context;
-	memset (&context, 0, sizeof(mbedtls_aes_context));
-
-	/* make a local copy of IV which is modified by the mbedtls AES-CFB function */
-	memcpy(IVbuffer, IV, 16*sizeof(uint8_t));
-
-	/* initialise the aes context and key - use the aes_setkey_enc function as requested by the documentation of aes_crypt_cfb128 function */
-	mbedtls_aes_setkey_enc(&context, key, 128);
-
-	/* encrypt */
-	mbedtls_aes_crypt_cfb128 (&context, MBEDTLS_AES_DECRYPT, inputLength, &iv_offset, IVbuffer, input, output);
+	bctbx_aes_cfb_oneshot(key, 16, MBEDTLS_AES_DECRYPT, IV, input, inputLength, output);
 }
 
 /*
@@ -1866,16 +2825,7 @@ void bctbx_aes256CfbEncrypt(const uint8_t *key,
 		size_t inputLength,
 		uint8_t *output)
 {
-	uint8_t IVbuffer[16];
-	size_t iv_offset=0;
-	mbedtls_aes_context context;
-
-	memcpy(IVbuffer, IV, 16*sizeof(uint8_t));
-	memset (&context, 0, sizeof(mbedtls_aes_context));
-	mbedtls_aes_setkey_enc(&context, key, 256);
-
-	/* encrypt */
-	mbedtls_aes_crypt_cfb128 (&context, MBEDTLS_AES_ENCRYPT, inputLength, &iv_offset, IVbuffer, input, output);
+	bctbx_aes_cfb_oneshot(key, 32, MBEDTLS_AES_ENCRYPT, IV, input, inputLength, output);
 }
 
 /*
@@ -1895,14 +2845,5 @@ void bctbx_aes256CfbDecrypt(const uint8_t *key,
 		size_t inputLength,
 		uint8_t *output)
 {
-	uint8_t IVbuffer[16];
-	size_t iv_offset=0;
-	mbedtls_aes_context context;
-
-	memcpy(IVbuffer, IV, 16*sizeof(uint8_t));
-	memset (&context, 0, sizeof(mbedtls_aes_context));
-	mbedtls_aes_setkey_enc(&context, key, 256);
-
-	/* decrypt */
-	mbedtls_aes_crypt_cfb128 (&context, MBEDTLS_AES_DECRYPT, inputLength, &iv_offset, IVbuffer, input, output);
+	bctbx_aes_cfb_oneshot(key, 32, MBEDTLS_AES_DECRYPT, IV, input, inputLength, output);
 }
@@ -28,6 +28,9 @@
 #include <mbedtls/sha256.h>
 #include <mbedtls/sha512.h>
 #include <mbedtls/gcm.h>
+#if MBEDTLS_VERSION_NUMBER < 0x03000000 && defined(MBEDTLS_AESNI_C)
+#include <mbedtls/aesni.h>
+#endif
 #if MBEDTLS_VERSION_NUMBER >= 0x020B0000 // v2.11.0
 #include <mbedtls/hkdf.h> // HKDF implemented in version 2.11.0 of mbedtls
 #endif
@@ -39,6 +42,7 @@
 #include "bctoolbox/exception.hh"
 
 #include <array>
+#include <mutex>
 
 namespace bctoolbox {
 
@@ -46,27 +50,81 @@ namespace bctoolbox {
 /***                      Random Number Generation                         ***/
 /*****************************************************************************/
 
+namespace {
+/**
+ * Seed source of all the RNG contexts: a DRBG seeded from the system entropy source.
+ * Seeding the contexts from it makes their creation cheap, the system entropy is only polled
+ * here, at creation and then every MBEDTLS_CTR_DRBG_RESEED_INTERVAL requests.
+ * The contexts themselves reseed from it at the same interval.
+ */
+class RNGSeedPool {
+	public:
+		/* entropy callback given to mbedtls_ctr_drbg_seed */
+		static int seed(void *, unsigned char *output, size_t size) {
+			return instance().get(output, size);
+		}
+
+	private:
+		RNGSeedPool() {
+			mbedtls_entropy_init(&mEntropy);
+			mbedtls_ctr_drbg_init(&mCtrDrbg);
+			if (mbedtls_ctr_drbg_seed(&mCtrDrbg, mbedtls_entropy_func, &mEntropy, NULL, 0) != 0) {
+				throw BCTBX_EXCEPTION << "RNG failure at creation: entropy source failure";
+			}
+		}
+
+		static RNGSeedPool &instance() {
+			/* never destroyed: thread contexts may still reseed while static objects are destroyed at exit */
+			static RNGSeedPool *pool = new RNGSeedPool();
+			return *pool;
+		}
+
+		int get(unsigned char *output, size_t size) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mbedtls_ctr_drbg_random_with_add(&mCtrDrbg, output, size, NULL, 0);
+		}
+
+		std::mutex mMutex;
+		mbedtls_entropy_context mEntropy;
+		mbedtls_ctr_drbg_context mCtrDrbg;
+};
+} // anonymous namespace
+
 /**
  * @brief Wrapper around mbedtls implementation
  **/
 struct RNG::Impl {
-	mbedtls_entropy_context entropy; /**< entropy context - store it to be able to free it */
 	mbedtls_ctr_drbg_context ctr_drbg; /**< rng context */
 
 	/**
 	 * Implementation constructor
-	 * Initialise the entropy and RNG context
+	 * Initialise the RNG context, seeded from the pool
 	 */
 	Impl() {
-		mbedtls_entropy_init(&entropy);
 		mbedtls_ctr_drbg_init(&ctr_drbg);
-		if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0) != 0) {
+		if (mbedtls_ctr_drbg_seed(&ctr_drbg, RNGSeedPool::seed, NULL, NULL, 0) != 0) {
+			mbedtls_ctr_drbg_free(&ctr_drbg);
 			throw BCTBX_EXCEPTION << "RNG failure at creation: entropy source failure";
 		}
 	}
 	~Impl() {
 		mbedtls_ctr_drbg_free(&ctr_drbg);
-		mbedtls_entropy_free(&entropy);
+	}
+
+	/**
+	 * The calling thread context, seeded at first use.
+	 * It is accessed by its thread only so no lock is needed: use mbedtls_ctr_drbg_random_with_add
+	 * which, unlike mbedtls_ctr_drbg_random, does not take the context mutex
+	 */
+	static void threadRandomize(uint8_t *buffer, size_t size) {
+		thread_local Impl threadImpl;
+		check(mbedtls_ctr_drbg_random_with_add(&threadImpl.ctr_drbg, buffer, size, NULL, 0));
+	}
+
+	static void check(int ret) {
+		if ( ret != 0) {
+			throw BCTBX_EXCEPTION << ((ret == MBEDTLS_ERR_CTR_DRBG_REQUEST_TOO_BIG)?"RNG failure: Request too big":"RNG failure: entropy source failure");
+		}
 	}
 };
 
@@ -83,23 +141,13 @@ RNG::RNG()
  **/
 RNG::~RNG()=default;
 
-// Instanciate the class RNG context
-std::unique_ptr<RNG::Impl> RNG::pImplClass = std::unique_ptr<RNG::Impl>(new RNG::Impl());
-
-
 void RNG::randomize(uint8_t *buffer, size_t size) {
-	int ret = mbedtls_ctr_drbg_random(&(pImpl->ctr_drbg), buffer, size);
-	if ( ret != 0) {
-		throw BCTBX_EXCEPTION << ((ret == MBEDTLS_ERR_CTR_DRBG_REQUEST_TOO_BIG)?"RNG failure: Request too big":"RNG failure: entropy source failure");
-	}
+	Impl::check(mbedtls_ctr_drbg_random(&(pImpl->ctr_drbg), buffer, size));
 }
 
 std::vector<uint8_t> RNG::randomize(const size_t size) {
 	std::vector<uint8_t> buffer(size);
-	int ret = mbedtls_ctr_drbg_random(&(pImpl->ctr_drbg), buffer.data(), size);
-	if ( ret != 0) {
-		throw BCTBX_EXCEPTION << ((ret == MBEDTLS_ERR_CTR_DRBG_REQUEST_TOO_BIG)?"RNG failure: Request too big":"RNG failure: entropy source failure");
-	}
+	Impl::check(mbedtls_ctr_drbg_random(&(pImpl->ctr_drbg), buffer.data(), size));
 	return buffer;
 }
 
@@ -111,13 +159,10 @@ uint32_t RNG::randomize() {
 
 /*
  * class randomize functions
- * These use the class RNG context
+ * These use the calling thread RNG context
  */
 void RNG::cRandomize(uint8_t *buffer, size_t size) {
-	int ret = mbedtls_ctr_drbg_random(&(pImplClass->ctr_drbg), buffer, size);
-	if ( ret != 0) {
-		throw BCTBX_EXCEPTION << ((ret == MBEDTLS_ERR_CTR_DRBG_REQUEST_TOO_BIG)?"RNG failure: Request too big":"RNG failure: entropy source failure");
-	}
+	Impl::threadRandomize(buffer, size);
 }
 
 uint32_t RNG::cRandomize() {
@@ -368,6 +413,105 @@ template <> bool AEADDecrypt<AES256GCM128>(const std::vector<uint8_t> &key, cons
 	throw BCTBX_EXCEPTION<<"Error during AES_GCM decryption : return value "<<ret;
 }
 
+/* AEAD context: AES256-GCM with 128 bits auth tag */
+template <> struct AEAD<AES256GCM128>::Impl {
+	mbedtls_gcm_context gcmContext;
+
+	Impl(const uint8_t *key, size_t keySize) {
+		// check key size (could have use array but Windows won't compile templates with constexpr functions result as parameter)
+		if (keySize != AES256GCM128::keySize()) {
+			throw BCTBX_EXCEPTION<<"AEAD: Bad input parameter, key is expected to be "<<AES256GCM128::keySize()<<" bytes but "<<keySize<<" provided";
+		}
+		mbedtls_gcm_init(&gcmContext);
+		auto ret = mbedtls_gcm_setkey(&gcmContext, MBEDTLS_CIPHER_ID_AES, key, (unsigned int)keySize*8); // key size in bits
+		if (ret != 0) {
+			mbedtls_gcm_free(&gcmContext);
+			throw BCTBX_EXCEPTION<<"Unable to set key in AES_GCM context : return value "<<ret;
+		}
+	}
+
+	~Impl() {
+		/* wipes the expanded key */
+		mbedtls_gcm_free(&gcmContext);
+	}
+
+	void encrypt(const uint8_t *IV, size_t IVSize, const uint8_t *AD, size_t ADSize, const uint8_t *plain, size_t size, uint8_t *cipher, uint8_t *tag) {
+		auto ret = mbedtls_gcm_crypt_and_tag(&gcmContext, MBEDTLS_GCM_ENCRYPT, size, IV, IVSize, AD, ADSize, plain, cipher, AES256GCM128::tagSize(), tag);
+		if (ret != 0) {
+			throw BCTBX_EXCEPTION<<"Error during AES_GCM encryption : return value "<<ret;
+		}
+	}
+
+	bool decrypt(const uint8_t *IV, size_t IVSize, const uint8_t *AD, size_t ADSize, const uint8_t *cipher, size_t size, const uint8_t *tag, uint8_t *plain) {
+		auto ret = mbedtls_gcm_auth_decrypt(&gcmContext, size, IV, IVSize, AD, ADSize, tag, AES256GCM128::tagSize(), cipher, plain);
+		if (ret == 0) {
+			return true;
+		}
+		if (ret == MBEDTLS_ERR_GCM_AUTH_FAILED) {
+			return false;
+		}
+		throw BCTBX_EXCEPTION<<"Error during AES_GCM decryption : return value "<<ret;
+	}
+
+	static bool hardwareAccelerated() {
+#if defined(MBEDTLS_AESNI_C) && defined(MBEDTLS_HAVE_X86_64)
+		/* mbedtls switches to AES-NI and PCLMULQDQ at runtime when the CPU supports them */
+		return mbedtls_aesni_has_support(MBEDTLS_AESNI_AES) && mbedtls_aesni_has_support(MBEDTLS_AESNI_CLMUL);
+#else
+		return false;
+#endif
+	}
+};
+
+template <typename AEADAlgo>
+AEAD<AEADAlgo>::AEAD(const std::vector<uint8_t> &key)
+:pImpl(std::unique_ptr<Impl>(new Impl(key.data(), key.size()))) {}
+
+template <typename AEADAlgo>
+AEAD<AEADAlgo>::AEAD(const uint8_t *key, size_t keySize)
+:pImpl(std::unique_ptr<Impl>(new Impl(key, keySize))) {}
+
+template <typename AEADAlgo>
+AEAD<AEADAlgo>::~AEAD()=default;
+
+template <typename AEADAlgo>
+void AEAD<AEADAlgo>::encrypt(const uint8_t *IV, size_t IVSize, const uint8_t *AD, size_t ADSize,
+		const uint8_t *plain, size_t size, uint8_t *cipher, uint8_t *tag) {
+	pImpl->encrypt(IV, IVSize, AD, ADSize, plain, size, cipher, tag);
+}
+
+template <typename AEADAlgo>
+bool AEAD<AEADAlgo>::decrypt(const uint8_t *IV, size_t IVSize, const uint8_t *AD, size_t ADSize,
+		const uint8_t *cipher, size_t size, const uint8_t *tag, uint8_t *plain) {
+	return pImpl->decrypt(IV, IVSize, AD, ADSize, cipher, size, tag, plain);
+}
+
+template <typename AEADAlgo>
+std::vector<uint8_t> AEAD<AEADAlgo>::encrypt(const std::vector<uint8_t> &IV, const std::vector<uint8_t> &plain, const std::vector<uint8_t> &AD,
+		std::vector<uint8_t> &tag) {
+	tag.resize(AEADAlgo::tagSize());
+	std::vector<uint8_t> cipher(plain.size()); // cipher size is the same than plain
+	pImpl->encrypt(IV.data(), IV.size(), AD.data(), AD.size(), plain.data(), plain.size(), cipher.data(), tag.data());
+	return cipher;
+}
+
+template <typename AEADAlgo>
+bool AEAD<AEADAlgo>::decrypt(const std::vector<uint8_t> &IV, const std::vector<uint8_t> &cipher, const std::vector<uint8_t> &AD,
+		const std::vector<uint8_t> &tag, std::vector<uint8_t> &plain) {
+	if (tag.size() != AEADAlgo::tagSize()) {
+		throw BCTBX_EXCEPTION<<"AEAD: Bad input parameter, tag is expected to be "<<AEADAlgo::tagSize()<<" bytes but "<<tag.size()<<" provided";
+	}
+	plain.resize(cipher.size()); // plain is the same size than cipher
+	return pImpl->decrypt(IV.data(), IV.size(), AD.data(), AD.size(), cipher.data(), cipher.size(), tag.data(), plain.data());
+}
+
+template <typename AEADAlgo>
+bool AEAD<AEADAlgo>::hardwareAccelerated() {
+	return Impl::hardwareAccelerated();
+}
+
+template class AEAD<AES256GCM128>;
+
 
 int AES_key_wrap(const std::vector<uint8_t> &plaintext, const std::vector<uint8_t> &key, std::vector<uint8_t> &ciphertext, AesId id){
 
@@ -559,9 +703,16 @@ int AES_key_unwrap(const std::vector<uint8_t> &ciphertext, const std::vector<uin
 
 /*** Random Number Generation: C API ***/
 struct bctbx_rng_context_struct {
-	std::unique_ptr<bctoolbox::RNG> m_rng; // encapsulate the RNG in a unique_ptr
+	std::unique_ptr<bctoolbox::RNG> m_rng; // encapsulate the RNG in a unique_ptr, empty for the thread context handle
 };
 
+/* the handle on the thread contexts, m_rng is empty: bctbx_rng_get uses the calling thread context */
+static bctbx_rng_context_t threadRngContext;
+
+bctbx_rng_context_t *bctbx_rng_context_get_thread(void) {
+	return &threadRngContext;
+}
+
 bctbx_rng_context_t *bctbx_rng_context_new(void) {
 	bctbx_rng_context_t *context = new bctbx_rng_context_struct();
 	context->m_rng = std::unique_ptr<bctoolbox::RNG>(new bctoolbox::RNG());
@@ -569,11 +720,16 @@ bctbx_rng_context_t *bctbx_rng_context_new(void) {
 }
 
 int32_t bctbx_rng_get(bctbx_rng_context_t *context, unsigned char*output, size_t output_length) {
+	if (context->m_rng == nullptr) {
+		bctoolbox::RNG::cRandomize(output, output_length);
+		return 0;
+	}
 	context->m_rng->randomize(output, output_length);
 	return 0; // always return 0, in case of problem an exception is raised by randomize
 }
 
 void bctbx_rng_context_free(bctbx_rng_context_t *context) {
+	if (context == &threadRngContext) return;
 	context->m_rng=nullptr; // destroy the RNG
 	delete(context);
 }
@@ -23,12 +23,13 @@
 #endif
 
 #include "utils.h"
+#include "aesni.h"
+#include "provider.h"
 #include <bctoolbox/crypto.h>
 
 #include <polarssl/ssl.h>
 #include <polarssl/error.h>
 #include <polarssl/pem.h>
-#include "polarssl/base64.h"
 #include <polarssl/x509.h>
 #include <polarssl/entropy.h>
 #include <polarssl/ctr_drbg.h>
@@ -90,32 +91,16 @@ void bctbx_strerror(int32_t error_code, char *buffer, size_t buffer_length) {
 	return;
 }
 
-int32_t bctbx_base64_encode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length) {
-	int ret = base64_encode(output, output_length, input, input_length);
-	if (ret == POLARSSL_ERR_BASE64_BUFFER_TOO_SMALL) {
-		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
-	}
-	return ret;
-}
-
-int32_t bctbx_base64_decode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length) {
-	int ret = base64_decode(output, output_length, input, input_length);
-	if (ret == POLARSSL_ERR_BASE64_BUFFER_TOO_SMALL) {
-		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
-	}
-	if (ret == POLARSSL_ERR_BASE64_INVALID_CHARACTER) {
-		return BCTBX_ERROR_INVALID_BASE64_INPUT;
-	}
-
-	return ret;
-}
-
 /*** Random Number Generation ***/
 struct bctbx_rng_context_struct {
 	entropy_context entropy;
 	ctr_drbg_context ctr_drbg;
+	bctbx_mutex_t *lock; /* only set on the context shared between threads */
 };
 
+/* polarssl has no thread local context: the thread handle points to a single context protected by a mutex, created at first use */
+static bctbx_rng_context_t *bctbx_rng_shared_context = NULL;
+
 bctbx_rng_context_t *bctbx_rng_context_new(void) {
 	bctbx_rng_context_t *ctx = bctbx_malloc0(sizeof(bctbx_rng_context_t));
 	entropy_init(&(ctx->entropy));
@@ -123,11 +108,43 @@ bctbx_rng_context_t *bctbx_rng_context_new(void) {
 	return ctx;
 }
 
+bctbx_rng_context_t *bctbx_rng_context_get_thread(void) {
+	bctbx_rng_context_t *ctx = bctbx_rng_shared_context;
+	if (ctx == NULL) {
+		bctbx_rng_context_t *previous;
+		ctx = bctbx_rng_context_new();
+		ctx->lock = bctbx_new(bctbx_mutex_t, 1);
+		bctbx_mutex_init(ctx->lock, NULL);
+		/* another thread may have created it meanwhile, keep the first one */
+#ifdef _WIN32
+		previous = InterlockedCompareExchangePointer((PVOID volatile *)&bctbx_rng_shared_context, ctx, NULL);
+#else
+		previous = __sync_val_compare_and_swap(&bctbx_rng_shared_context, NULL, ctx);
+#endif
+		if (previous != NULL) {
+			bctbx_mutex_destroy(ctx->lock);
+			bctbx_free(ctx->lock);
+			ctx->lock = NULL;
+			bctbx_rng_context_free(ctx);
+			ctx = previous;
+		}
+	}
+	return ctx;
+}
+
 int32_t bctbx_rng_get(bctbx_rng_context_t *context, unsigned char*output, size_t output_length) {
-	return ctr_drbg_random(&(context->ctr_drbg), output, output_length);
+	int32_t ret;
+	if (context->lock == NULL) {
+		return ctr_drbg_random(&(context->ctr_drbg), output, output_length);
+	}
+	bctbx_mutex_lock(context->lock);
+	ret = ctr_drbg_random(&(context->ctr_drbg), output, output_length);
+	bctbx_mutex_unlock(context->lock);
+	return ret;
 }
 
 void bctbx_rng_context_free(bctbx_rng_context_t *context) {
+	if (context->lock != NULL) return; /* the shared context lives until the end of the process */
 /* ctr_drg_free function is available from polarssl1.3.8 but we want to support previous versions */
 #ifdef HAVE_CTR_DRGB_FREE
 	ctr_drbg_free(&(context->ctr_drbg));
@@ -836,6 +853,94 @@ const char *bctbx_ssl_get_version(bctbx_ssl_context_t *ssl_ctx){
 	return ssl_get_version(&(ssl_ctx->ssl_ctx));
 }
 
+uint32_t bctbx_ssl_get_verify_result(bctbx_ssl_context_t *ssl_ctx) {
+	return bctbx_x509_certificate_remap_flag(ssl_get_verify_result(&(ssl_ctx->ssl_ctx)));
+}
+
+/* batched record I/O is not supported with polarssl, records are always sent and read one by one */
+int32_t bctbx_ssl_set_write_batching(bctbx_ssl_context_t *ssl_ctx, size_t max_size) {
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+}
+
+int32_t bctbx_ssl_flush(bctbx_ssl_context_t *ssl_ctx) {
+	return 0;
+}
+
+int32_t bctbx_ssl_set_read_ahead(bctbx_ssl_context_t *ssl_ctx, size_t size) {
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+}
+
+bool_t bctbx_ssl_has_pending(bctbx_ssl_context_t *ssl_ctx) {
+	return (ssl_get_bytes_avail(&(ssl_ctx->ssl_ctx)) > 0) ? TRUE : FALSE;
+}
+
+/** Session resumption **/
+struct bctbx_ssl_session_struct {
+	ssl_session session;
+};
+
+bctbx_ssl_session_t *bctbx_ssl_session_new(void) {
+	bctbx_ssl_session_t *session = bctbx_malloc0(sizeof(bctbx_ssl_session_t));
+	ssl_session_init(&(session->session));
+	return session;
+}
+
+void bctbx_ssl_session_free(bctbx_ssl_session_t *session) {
+	if (session == NULL) {
+		return;
+	}
+	ssl_session_free(&(session->session));
+	bctbx_free(session);
+}
+
+int32_t bctbx_ssl_get_session(const bctbx_ssl_context_t *ssl_ctx, bctbx_ssl_session_t *session) {
+	if (ssl_ctx == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	if (session == NULL) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	return ssl_get_session(&(ssl_ctx->ssl_ctx), &(session->session));
+}
+
+int32_t bctbx_ssl_set_session(bctbx_ssl_context_t *ssl_ctx, const bctbx_ssl_session_t *session) {
+	if (ssl_ctx == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONTEXT;
+	}
+	if (session == NULL) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	return ssl_set_session(&(ssl_ctx->ssl_ctx), &(session->session));
+}
+
+/* server side session cache is not supported with polarssl */
+bctbx_ssl_session_cache_t *bctbx_ssl_session_cache_new(size_t max_entries, uint32_t timeout) {
+	return NULL;
+}
+
+void bctbx_ssl_session_cache_free(bctbx_ssl_session_cache_t *cache) {
+}
+
+size_t bctbx_ssl_session_cache_size(bctbx_ssl_session_cache_t *cache) {
+	return 0;
+}
+
+/* certificate verification cache is not supported with polarssl */
+bctbx_x509_verify_cache_t *bctbx_x509_verify_cache_new(size_t max_entries, uint32_t timeout) {
+	return NULL;
+}
+
+void bctbx_x509_verify_cache_free(bctbx_x509_verify_cache_t *cache) {
+}
+
+void bctbx_x509_verify_cache_purge(bctbx_x509_verify_cache_t *cache) {
+}
+
+size_t bctbx_x509_verify_cache_size(bctbx_x509_verify_cache_t *cache) {
+	return 0;
+}
+/** Session resumption **/
+
 int32_t bctbx_ssl_set_hostname(bctbx_ssl_context_t *ssl_ctx, const char *hostname){
 	if (ssl_ctx->cn) bctbx_free(ssl_ctx->cn);
 	if (hostname) ssl_ctx->cn = bctbx_strdup(hostname);
@@ -935,6 +1040,7 @@ struct bctbx_ssl_config_struct {
 	int(*callback_verify_function)(void *, x509_crt *, int, int *); /**< pointer to the verify callback function */
 	void *callback_verify_data; /**< data passed to the verify callback */
 	x509_crt *ca_chain; /**< trusted CA chain */
+	bctbx_x509_ca_store_t *ca_store; /**< shared CA store holding the ca_chain, if any */
 	x509_crt *own_cert;
 	pk_context *own_cert_pk;
 	int(*callback_cli_cert_function)(void *, bctbx_ssl_context_t *, unsigned char *, size_t); /**< pointer to the callback called to update client certificate during handshake
@@ -979,6 +1085,10 @@ int32_t bctbx_ssl_config_set_crypto_library_config(bctbx_ssl_config_t *ssl_confi
 }
 
 void bctbx_ssl_config_free(bctbx_ssl_config_t *ssl_config) {
+	if (ssl_config == NULL) {
+		return;
+	}
+	bctbx_x509_ca_store_unref(ssl_config->ca_store);
 	bctbx_free(ssl_config);
 }
 
@@ -1044,6 +1154,18 @@ int32_t bctbx_ssl_config_set_ciphersuites(bctbx_ssl_config_t *ssl_config, const
 	return BCTBX_ERROR_INVALID_SSL_CONFIG;
 }
 
+int32_t bctbx_ssl_config_set_session_cache(bctbx_ssl_config_t *ssl_config, bctbx_ssl_session_cache_t *cache) {
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+}
+
+int32_t bctbx_ssl_config_set_session_tickets(bctbx_ssl_config_t *ssl_config, bool_t enable, uint32_t lifetime) {
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+}
+
+int32_t bctbx_ssl_config_set_verify_cache(bctbx_ssl_config_t *ssl_config, bctbx_x509_verify_cache_t *cache) {
+	return BCTBX_ERROR_UNAVAILABLE_FUNCTION;
+}
+
 /* unavailable function */
 void *bctbx_ssl_config_get_private_config(bctbx_ssl_config_t *ssl_config) {
 	return NULL;
@@ -1097,10 +1219,27 @@ int32_t bctbx_ssl_config_set_callback_cli_cert(bctbx_ssl_config_t *ssl_config, i
 int32_t bctbx_ssl_config_set_ca_chain(bctbx_ssl_config_t *ssl_config, bctbx_x509_certificate_t *ca_chain) {
 	if (ssl_config != NULL) {
 		ssl_config->ca_chain = (x509_crt *)ca_chain;
+		bctbx_x509_ca_store_unref(ssl_config->ca_store);
+		ssl_config->ca_store = NULL;
 	}
 	return BCTBX_ERROR_INVALID_SSL_CONFIG;
 }
 
+int32_t bctbx_ssl_config_set_ca_store(bctbx_ssl_config_t *ssl_config, bctbx_x509_ca_store_t *ca_store) {
+	if (ssl_config == NULL) {
+		return BCTBX_ERROR_INVALID_SSL_CONFIG;
+	}
+	/* take the new reference first: the store given may be the one already set */
+	if (ca_store != NULL) {
+		bctbx_x509_ca_store_ref(ca_store);
+	}
+	bctbx_x509_ca_store_unref(ssl_config->ca_store);
+	ssl_config->ca_store = ca_store;
+	/* the chain is only read during the handshake */
+	ssl_config->ca_chain = (ca_store != NULL) ? (x509_crt *)bctbx_x509_ca_store_get_certificates(ca_store) : NULL;
+	return 0;
+}
+
 int32_t bctbx_ssl_config_set_own_cert(bctbx_ssl_config_t *ssl_config, bctbx_x509_certificate_t *cert, bctbx_signing_key_t *key) {
 	if (ssl_config != NULL) {
 		ssl_config->own_cert = (x509_crt *)cert;
@@ -1210,7 +1349,7 @@ int32_t bctbx_ssl_context_setup(bctbx_ssl_context_t *ssl_ctx, bctbx_ssl_config_t
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_hmacSha512(const uint8_t *key,
+static void bctbx_polarssl_hmacSha512(const uint8_t *key,
 		size_t keyLength,
 		const uint8_t *input,
 		size_t inputLength,
@@ -1238,7 +1377,7 @@ void bctbx_hmacSha512(const uint8_t *key,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_hmacSha384(const uint8_t *key,
+static void bctbx_polarssl_hmacSha384(const uint8_t *key,
 		size_t keyLength,
 		const uint8_t *input,
 		size_t inputLength,
@@ -1266,7 +1405,7 @@ void bctbx_hmacSha384(const uint8_t *key,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_hmacSha256(const uint8_t *key,
+static void bctbx_polarssl_hmacSha256(const uint8_t *key,
 		size_t keyLength,
 		const uint8_t *input,
 		size_t inputLength,
@@ -1292,7 +1431,7 @@ void bctbx_hmacSha256(const uint8_t *key,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_sha512(const uint8_t *input,
+static void bctbx_polarssl_sha512(const uint8_t *input,
 		size_t inputLength,
 		uint8_t hashLength,
 		uint8_t *output)
@@ -1316,7 +1455,7 @@ void bctbx_sha512(const uint8_t *input,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_sha384(const uint8_t *input,
+static void bctbx_polarssl_sha384(const uint8_t *input,
 		size_t inputLength,
 		uint8_t hashLength,
 		uint8_t *output)
@@ -1340,7 +1479,7 @@ void bctbx_sha384(const uint8_t *input,
  * @param[out]	output		Output data buffer.
  *
  */
-void bctbx_sha256(const uint8_t *input,
+static void bctbx_polarssl_sha256(const uint8_t *input,
 		size_t inputLength,
 		uint8_t hashLength,
 		uint8_t *output)
@@ -1418,7 +1557,7 @@ void bctbx_md5(const uint8_t *input,
  * @param[in]	tagLength					Requested length for the generated tag
  * @param[out]	output						Buffer holding the output, shall be at least the length of plainText buffer
  */
-int32_t bctbx_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
+static int32_t bctbx_polarssl_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
 		const uint8_t *plainText, size_t plainTextLength,
 		const uint8_t *authenticatedData, size_t authenticatedDataLength,
 		const uint8_t *initializationVector, size_t initializationVectorLength,
@@ -1453,7 +1592,7 @@ int32_t bctbx_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
  *
  * @return 0 on succes, BCTBX_ERROR_AUTHENTICATION_FAILED if tag doesn't match or polarssl error code
  */
-int32_t bctbx_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
+static int32_t bctbx_polarssl_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
 		const uint8_t *cipherText, size_t cipherTextLength,
 		const uint8_t *authenticatedData, size_t authenticatedDataLength,
 		const uint8_t *initializationVector, size_t initializationVectorLength,
@@ -1475,6 +1614,22 @@ int32_t bctbx_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
 	return ret;
 }
 
+static const bctbx_crypto_provider_t bctbx_polarssl_provider = {
+	"polarssl",
+	bctbx_polarssl_sha256,
+	bctbx_polarssl_sha384,
+	bctbx_polarssl_sha512,
+	bctbx_polarssl_hmacSha256,
+	bctbx_polarssl_hmacSha384,
+	bctbx_polarssl_hmacSha512,
+	bctbx_polarssl_aes_gcm_encrypt_and_tag,
+	bctbx_polarssl_aes_gcm_decrypt_and_auth
+};
+
+const bctbx_crypto_provider_t *bctbx_crypto_backend_provider(void) {
+	return &bctbx_polarssl_provider;
+}
+
 
 /**
  * @Brief create and initialise an AES-GCM encryption context
@@ -1680,3 +1835,90 @@ void bctbx_aes256CfbDecrypt(const uint8_t key[32],
 	/* decrypt */
 	aes_crypt_cfb128 (&context, AES_DECRYPT, inputLength, &iv_offset, IVbuffer, input, output);
 }
+
+/*** AES in CFB128 mode context ***/
+struct bctbx_aes_cfb_context_struct {
+	bctbx_aesni_key_t aesni; /**< key schedule for the AES-NI code path */
+	aes_context aes; /**< used when the CPU has no AES-NI */
+	bool_t useAesni;
+};
+
+static void bctbx_aes_cfb_crypt(const bctbx_aes_cfb_context_t *context, int mode,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	uint8_t IVbuffer[16];
+	size_t iv_offset=0;
+
+	if (context->useAesni) {
+		if (mode == AES_ENCRYPT) {
+			bctbx_aesni_cfb_encrypt(&context->aesni, IV, input, inputLength, output);
+		} else {
+			bctbx_aesni_cfb_decrypt(&context->aesni, IV, input, inputLength, output);
+		}
+		return;
+	}
+
+	memcpy(IVbuffer, IV, 16*sizeof(uint8_t));
+	/* polarssl only reads the key schedule, the context can be shared */
+	aes_crypt_cfb128((aes_context *)&context->aes, mode, inputLength, &iv_offset, IVbuffer, input, output);
+}
+
+bctbx_aes_cfb_context_t *bctbx_aes_cfb_context_new(const uint8_t *key, size_t keyLength) {
+	bctbx_aes_cfb_context_t *context;
+
+	if (keyLength != 16 && keyLength != 32) {
+		return NULL;
+	}
+	context = bctbx_malloc0(sizeof(bctbx_aes_cfb_context_t));
+	context->useAesni = (bctbx_aesni_setkey(&context->aesni, key, keyLength) == 0);
+	if (!context->useAesni) {
+		aes_setkey_enc(&context->aes, key, (unsigned int)keyLength*8);
+	}
+	return context;
+}
+
+void bctbx_aes_cfb_context_free(bctbx_aes_cfb_context_t *context) {
+	if (context == NULL) return;
+	bctbx_clean(context, sizeof(bctbx_aes_cfb_context_t));
+	bctbx_free(context);
+}
+
+void bctbx_aes_cfb_encrypt(const bctbx_aes_cfb_context_t *context,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	bctbx_aes_cfb_crypt(context, AES_ENCRYPT, IV, input, inputLength, output);
+}
+
+void bctbx_aes_cfb_decrypt(const bctbx_aes_cfb_context_t *context,
+		const uint8_t *IV,
+		const uint8_t *input,
+		size_t inputLength,
+		uint8_t *output) {
+	bctbx_aes_cfb_crypt(context, AES_DECRYPT, IV, input, inputLength, output);
+}
+
+void bctbx_aes_cfb_encrypt_packets(const bctbx_aes_cfb_context_t *context,
+		const bctbx_aes_cfb_packet_t *packets,
+		size_t packetsCount) {
+	size_t i;
+	if (context->useAesni) {
+		bctbx_aesni_cfb_encrypt_packets(&context->aesni, packets, packetsCount);
+		return;
+	}
+	for (i = 0; i < packetsCount; i++) {
+		bctbx_aes_cfb_crypt(context, AES_ENCRYPT, packets[i].IV, packets[i].input, packets[i].inputLength, packets[i].output);
+	}
+}
+
+void bctbx_aes_cfb_decrypt_packets(const bctbx_aes_cfb_context_t *context,
+		const bctbx_aes_cfb_packet_t *packets,
+		size_t packetsCount) {
+	size_t i;
+	for (i = 0; i < packetsCount; i++) {
+		bctbx_aes_cfb_crypt(context, AES_DECRYPT, packets[i].IV, packets[i].input, packets[i].inputLength, packets[i].output);
+	}
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/crypto.h"
+#include "bctoolbox/logging.h"
+#include "provider.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const char *primitiveName(int primitive) {
+	static const char *names[BCTBX_CRYPTO_PRIMITIVES_COUNT] = {"SHA256", "SHA384", "SHA512", "HMAC-SHA256", "HMAC-SHA384", "HMAC-SHA512", "AES-GCM"};
+	return names[primitive];
+}
+
+bool provides(const bctbx_crypto_provider_t *provider, int primitive) {
+	switch (primitive) {
+		case BCTBX_CRYPTO_SHA256: return provider->sha256 != nullptr;
+		case BCTBX_CRYPTO_SHA384: return provider->sha384 != nullptr;
+		case BCTBX_CRYPTO_SHA512: return provider->sha512 != nullptr;
+		case BCTBX_CRYPTO_HMAC_SHA256: return provider->hmacSha256 != nullptr;
+		case BCTBX_CRYPTO_HMAC_SHA384: return provider->hmacSha384 != nullptr;
+		case BCTBX_CRYPTO_HMAC_SHA512: return provider->hmacSha512 != nullptr;
+		case BCTBX_CRYPTO_AES_GCM: return provider->aesGcmEncrypt != nullptr;
+		default: return false;
+	}
+}
+
+/* Known answer tests: hashes of the two blocks message of FIPS 180-2, HMAC from RFC 4231 test case 2 and an AES256-GCM vector with additional data and a partial last block */
+const char hashMessage[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+const uint8_t sha256Answer[32] = {
+	0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1};
+const uint8_t sha384Answer[48] = {
+	0x33, 0x91, 0xfd, 0xdd, 0xfc, 0x8d, 0xc7, 0x39, 0x37, 0x07, 0xa6, 0x5b, 0x1b, 0x47, 0x09, 0x39,
+	0x7c, 0xf8, 0xb1, 0xd1, 0x62, 0xaf, 0x05, 0xab, 0xfe, 0x8f, 0x45, 0x0d, 0xe5, 0xf3, 0x6b, 0xc6,
+	0xb0, 0x45, 0x5a, 0x85, 0x20, 0xbc, 0x4e, 0x6f, 0x5f, 0xe9, 0x5b, 0x1f, 0xe3, 0xc8, 0x45, 0x2b};
+const uint8_t sha512Answer[64] = {
+	0x20, 0x4a, 0x8f, 0xc6, 0xdd, 0xa8, 0x2f, 0x0a, 0x0c, 0xed, 0x7b, 0xeb, 0x8e, 0x08, 0xa4, 0x16,
+	0x57, 0xc1, 0x6e, 0xf4, 0x68, 0xb2, 0x28, 0xa8, 0x27, 0x9b, 0xe3, 0x31, 0xa7, 0x03, 0xc3, 0x35,
+	0x96, 0xfd, 0x15, 0xc1, 0x3b, 0x1b, 0x07, 0xf9, 0xaa, 0x1d, 0x3b, 0xea, 0x57, 0x78, 0x9c, 0xa0,
+	0x31, 0xad, 0x85, 0xc7, 0xa7, 0x1d, 0xd7, 0x03, 0x54, 0xec, 0x63, 0x12, 0x38, 0xca, 0x34, 0x45};
+
+const char hmacKey[] = "Jefe";
+const char hmacMessage[] = "what do ya want for nothing?";
+const uint8_t hmacSha256Answer[32] = {
+	0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+	0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43};
+const uint8_t hmacSha384Answer[48] = {
+	0xaf, 0x45, 0xd2, 0xe3, 0x76, 0x48, 0x40, 0x31, 0x61, 0x7f, 0x78, 0xd2, 0xb5, 0x8a, 0x6b, 0x1b,
+	0x9c, 0x7e, 0xf4, 0x64, 0xf5, 0xa0, 0x1b, 0x47, 0xe4, 0x2e, 0xc3, 0x73, 0x63, 0x22, 0x44, 0x5e,
+	0x8e, 0x22, 0x40, 0xca, 0x5e, 0x69, 0xe2, 0xc7, 0x8b, 0x32, 0x39, 0xec, 0xfa, 0xb2, 0x16, 0x49};
+const uint8_t hmacSha512Answer[64] = {
+	0x16, 0x4b, 0x7a, 0x7b, 0xfc, 0xf8, 0x19, 0xe2, 0xe3, 0x95, 0xfb, 0xe7, 0x3b, 0x56, 0xe0, 0xa3,
+	0x87, 0xbd, 0x64, 0x22, 0x2e, 0x83, 0x1f, 0xd6, 0x10, 0x27, 0x0c, 0xd7, 0xea, 0x25, 0x05, 0x54,
+	0x97, 0x58, 0xbf, 0x75, 0xc0, 0x5a, 0x99, 0x4a, 0x6d, 0x03, 0x4f, 0x65, 0xf8, 0xf0, 0xe6, 0xfd,
+	0xca, 0xea, 0xb1, 0xa3, 0x4d, 0x4a, 0x6b, 0x4b, 0x63, 0x6e, 0x07, 0x0a, 0x38, 0xbc, 0xe7, 0x37};
+
+const char gcmAuthenticatedData[] = "bctoolbox";
+const char gcmPlain[] = "bctoolbox crypto provider self test";
+const uint8_t gcmCipher[35] = {
+	0x25, 0x61, 0xa2, 0x74, 0xaa, 0x89, 0xa0, 0x74, 0xf5, 0x61, 0xf4, 0xf9, 0xc8, 0x99, 0x0c, 0x02,
+	0xa3, 0xa6, 0xf5, 0x5b, 0x86, 0x12, 0x3b, 0x19, 0x4a, 0x47, 0x96, 0xe0, 0x71, 0x0f, 0x20, 0xc6,
+	0x64, 0x63, 0xda};
+const uint8_t gcmTag[16] = {0xc2, 0xe6, 0xbc, 0xf6, 0x23, 0xb1, 0xa9, 0x39, 0x2d, 0x0c, 0x50, 0x1a, 0x75, 0x21, 0xb6, 0x3d};
+
+bool selfTest(const bctbx_crypto_provider_t *provider, int primitive) {
+	const uint8_t *message = (const uint8_t *)hashMessage;
+	const size_t messageLength = sizeof(hashMessage) - 1;
+	const uint8_t *key = (const uint8_t *)hmacKey;
+	const uint8_t *data = (const uint8_t *)hmacMessage;
+	uint8_t output[64];
+
+	switch (primitive) {
+		case BCTBX_CRYPTO_SHA256:
+			provider->sha256(message, messageLength, 32, output);
+			return memcmp(output, sha256Answer, 32) == 0;
+		case BCTBX_CRYPTO_SHA384:
+			provider->sha384(message, messageLength, 48, output);
+			return memcmp(output, sha384Answer, 48) == 0;
+		case BCTBX_CRYPTO_SHA512:
+			provider->sha512(message, messageLength, 64, output);
+			return memcmp(output, sha512Answer, 64) == 0;
+		case BCTBX_CRYPTO_HMAC_SHA256:
+			provider->hmacSha256(key, 4, data, sizeof(hmacMessage) - 1, 32, output);
+			return memcmp(output, hmacSha256Answer, 32) == 0;
+		case BCTBX_CRYPTO_HMAC_SHA384:
+			provider->hmacSha384(key, 4, data, sizeof(hmacMessage) - 1, 48, output);
+			return memcmp(output, hmacSha384Answer, 48) == 0;
+		case BCTBX_CRYPTO_HMAC_SHA512:
+			provider->hmacSha512(key, 4, data, sizeof(hmacMessage) - 1, 64, output);
+			return memcmp(output, hmacSha512Answer, 64) == 0;
+		case BCTBX_CRYPTO_AES_GCM: {
+			uint8_t gcmKey[32], IV[12], tag[16];
+			for (size_t i = 0; i < sizeof(gcmKey); i++) gcmKey[i] = (uint8_t)i;
+			for (size_t i = 0; i < sizeof(IV); i++) IV[i] = (uint8_t)i;
+			if (provider->aesGcmEncrypt(gcmKey, sizeof(gcmKey), (const uint8_t *)gcmPlain, sizeof(gcmCipher), (const uint8_t *)gcmAuthenticatedData,
+					sizeof(gcmAuthenticatedData) - 1, IV, sizeof(IV), tag, sizeof(tag), output) != 0
+				|| memcmp(output, gcmCipher, sizeof(gcmCipher)) != 0 || memcmp(tag, gcmTag, sizeof(tag)) != 0) {
+				return false;
+			}
+			if (provider->aesGcmDecrypt(gcmKey, sizeof(gcmKey), gcmCipher, sizeof(gcmCipher), (const uint8_t *)gcmAuthenticatedData,
+					sizeof(gcmAuthenticatedData) - 1, IV, sizeof(IV), gcmTag, sizeof(gcmTag), output) != 0
+				|| memcmp(output, gcmPlain, sizeof(gcmCipher)) != 0) {
+				return false;
+			}
+			/* a modified tag must be rejected */
+			tag[0] ^= 0x01;
+			return provider->aesGcmDecrypt(gcmKey, sizeof(gcmKey), gcmCipher, sizeof(gcmCipher), (const uint8_t *)gcmAuthenticatedData,
+					sizeof(gcmAuthenticatedData) - 1, IV, sizeof(IV), tag, sizeof(tag), output) != 0;
+		}
+		default:
+			return false;
+	}
+}
+
+/**
+ * Time taken by a provider to process a 1 kB message, best of a few rounds to filter out scheduling noise.
+ */
+std::chrono::nanoseconds benchmark(const bctbx_crypto_provider_t *provider, int primitive) {
+	const int rounds = 3;
+	const int iterations = 32;
+	std::vector<uint8_t> input(1024, 0x5a), output(1024);
+	const uint8_t key[32] = {0};
+	uint8_t tag[16];
+	auto best = std::chrono::nanoseconds::max();
+
+	for (int round = 0; round < rounds; round++) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			switch (primitive) {
+				case BCTBX_CRYPTO_SHA256: provider->sha256(input.data(), input.size(), 32, output.data()); break;
+				case BCTBX_CRYPTO_SHA384: provider->sha384(input.data(), input.size(), 48, output.data()); break;
+				case BCTBX_CRYPTO_SHA512: provider->sha512(input.data(), input.size(), 64, output.data()); break;
+				case BCTBX_CRYPTO_HMAC_SHA256: provider->hmacSha256(key, sizeof(key), input.data(), input.size(), 32, output.data()); break;
+				case BCTBX_CRYPTO_HMAC_SHA384: provider->hmacSha384(key, sizeof(key), input.data(), input.size(), 48, output.data()); break;
+				case BCTBX_CRYPTO_HMAC_SHA512: provider->hmacSha512(key, sizeof(key), input.data(), input.size(), 64, output.data()); break;
+				case BCTBX_CRYPTO_AES_GCM:
+					provider->aesGcmEncrypt(key, sizeof(key), input.data(), input.size(), NULL, 0, key, 12, tag, sizeof(tag), output.data());
+					break;
+			}
+		}
+		best = std::min(best, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start));
+	}
+	return best;
+}
+
+struct Selection {
+	std::array<const bctbx_crypto_provider_t *, BCTBX_CRYPTO_PRIMITIVES_COUNT> providers;
+};
+
+/**
+ * For each primitive, a stack of the providers implementing it: the last one is selected, the previous ones are the fallbacks
+ * when it is unregistered. The dispatch functions read an immutable snapshot of the selection, replaced on every change.
+ */
+class ProviderRegistry {
+public:
+	static ProviderRegistry &instance() {
+		/* never destroyed: crypto functions may still be called while static objects are destroyed at exit */
+		static ProviderRegistry *registry = new ProviderRegistry();
+		return *registry;
+	}
+
+	const Selection &selection() const {
+		return *mSelection.load(std::memory_order_acquire);
+	}
+
+	int add(const bctbx_crypto_provider_t *provider, bool benchmarked, bool builtin) {
+		if (provider == nullptr || provider->name == nullptr || (provider->aesGcmEncrypt == nullptr) != (provider->aesGcmDecrypt == nullptr)) {
+			return BCTBX_ERROR_INVALID_INPUT_DATA;
+		}
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (std::find(mProviders.begin(), mProviders.end(), provider) != mProviders.end()) {
+			return BCTBX_ERROR_INVALID_INPUT_DATA;
+		}
+		mProviders.push_back(provider);
+		if (builtin) mBuiltins.push_back(provider);
+
+		int ret = 0;
+		for (int primitive = 0; primitive < BCTBX_CRYPTO_PRIMITIVES_COUNT; primitive++) {
+			if (!provides(provider, primitive)) continue;
+			auto &stack = mStacks[primitive];
+			if (!selfTest(provider, primitive)) {
+				bctbx_error("Crypto provider [%s]: %s failed its self test", provider->name, primitiveName(primitive));
+				ret = BCTBX_ERROR_SELF_TEST_FAILED;
+				/* the backend is the last resort implementation, never leave a primitive without provider */
+				if (!stack.empty()) continue;
+			}
+			if (benchmarked && !stack.empty() && benchmark(provider, primitive) >= benchmark(stack.back(), primitive)) {
+				stack.insert(stack.end() - 1, provider);
+			} else {
+				stack.push_back(provider);
+			}
+			bctbx_debug("Crypto provider [%s] selected for %s", stack.back()->name, primitiveName(primitive));
+		}
+		publish();
+		return ret;
+	}
+
+	void remove(const bctbx_crypto_provider_t *provider) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (std::find(mBuiltins.begin(), mBuiltins.end(), provider) != mBuiltins.end()) {
+			bctbx_warning("Crypto provider [%s] is built-in, it cannot be unregistered", provider->name);
+			return;
+		}
+		auto it = std::find(mProviders.begin(), mProviders.end(), provider);
+		if (it == mProviders.end()) return;
+		mProviders.erase(it);
+		for (auto &stack : mStacks) {
+			stack.erase(std::remove(stack.begin(), stack.end(), provider), stack.end());
+		}
+		publish();
+	}
+
+private:
+	ProviderRegistry() {
+		add(bctbx_crypto_backend_provider(), false, true);
+		add(bctbx_crypto_sha256_provider(), true, true);
+	}
+
+	void publish() {
+		std::unique_ptr<Selection> selection(new Selection());
+		for (int primitive = 0; primitive < BCTBX_CRYPTO_PRIMITIVES_COUNT; primitive++) {
+			selection->providers[primitive] = mStacks[primitive].back();
+		}
+		mSelection.store(selection.get(), std::memory_order_release);
+		/* previous snapshots are kept: a concurrent call may still be running on them, and on their providers,
+		 * which is why a provider must outlive its unregistration */
+		mSelections.push_back(std::move(selection));
+	}
+
+	std::mutex mMutex;
+	std::vector<const bctbx_crypto_provider_t *> mProviders;
+	std::vector<const bctbx_crypto_provider_t *> mBuiltins;
+	std::array<std::vector<const bctbx_crypto_provider_t *>, BCTBX_CRYPTO_PRIMITIVES_COUNT> mStacks;
+	std::atomic<const Selection *> mSelection{nullptr};
+	std::vector<std::unique_ptr<Selection>> mSelections;
+};
+
+const bctbx_crypto_provider_t *selected(bctbx_crypto_primitive_t primitive) {
+	return ProviderRegistry::instance().selection().providers[primitive];
+}
+
+} // anonymous namespace
+
+extern "C" int bctbx_crypto_provider_register(const bctbx_crypto_provider_t *provider, bool_t benchmark) {
+	return ProviderRegistry::instance().add(provider, benchmark == TRUE, false);
+}
+
+extern "C" void bctbx_crypto_provider_unregister(const bctbx_crypto_provider_t *provider) {
+	ProviderRegistry::instance().remove(provider);
+}
+
+extern "C" const char *bctbx_crypto_provider_get_selected(bctbx_crypto_primitive_t primitive) {
+	if (primitive < 0 || primitive >= BCTBX_CRYPTO_PRIMITIVES_COUNT) return nullptr;
+	return selected(primitive)->name;
+}
+
+/*****************************************************************************/
+/***** Dispatched primitives                                             *****/
+/*****************************************************************************/
+extern "C" void bctbx_sha256(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output) {
+	selected(BCTBX_CRYPTO_SHA256)->sha256(input, inputLength, hashLength, output);
+}
+
+extern "C" void bctbx_sha384(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output) {
+	selected(BCTBX_CRYPTO_SHA384)->sha384(input, inputLength, hashLength, output);
+}
+
+extern "C" void bctbx_sha512(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output) {
+	selected(BCTBX_CRYPTO_SHA512)->sha512(input, inputLength, hashLength, output);
+}
+
+extern "C" void bctbx_hmacSha256(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output) {
+	selected(BCTBX_CRYPTO_HMAC_SHA256)->hmacSha256(key, keyLength, input, inputLength, hmacLength, output);
+}
+
+extern "C" void bctbx_hmacSha384(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output) {
+	selected(BCTBX_CRYPTO_HMAC_SHA384)->hmacSha384(key, keyLength, input, inputLength, hmacLength, output);
+}
+
+extern "C" void bctbx_hmacSha512(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output) {
+	selected(BCTBX_CRYPTO_HMAC_SHA512)->hmacSha512(key, keyLength, input, inputLength, hmacLength, output);
+}
+
+extern "C" int32_t bctbx_aes_gcm_encrypt_and_tag(const uint8_t *key, size_t keyLength,
+		const uint8_t *plainText, size_t plainTextLength,
+		const uint8_t *authenticatedData, size_t authenticatedDataLength,
+		const uint8_t *initializationVector, size_t initializationVectorLength,
+		uint8_t *tag, size_t tagLength,
+		uint8_t *output) {
+	return selected(BCTBX_CRYPTO_AES_GCM)->aesGcmEncrypt(key, keyLength, plainText, plainTextLength, authenticatedData, authenticatedDataLength,
+		initializationVector, initializationVectorLength, tag, tagLength, output);
+}
+
+extern "C" int32_t bctbx_aes_gcm_decrypt_and_auth(const uint8_t *key, size_t keyLength,
+		const uint8_t *cipherText, size_t cipherTextLength,
+		const uint8_t *authenticatedData, size_t authenticatedDataLength,
+		const uint8_t *initializationVector, size_t initializationVectorLength,
+		const uint8_t *tag, size_t tagLength,
+		uint8_t *output) {
+	return selected(BCTBX_CRYPTO_AES_GCM)->aesGcmDecrypt(key, keyLength, cipherText, cipherTextLength, authenticatedData, authenticatedDataLength,
+		initializationVector, initializationVectorLength, tag, tagLength, output);
+}
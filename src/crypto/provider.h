@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BCTBX_CRYPTO_PROVIDER_H
+#define BCTBX_CRYPTO_PROVIDER_H
+
+#include "bctoolbox/crypto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Built-in provider of the crypto backend (mbedtls or polarssl), implementing every primitive.
+ */
+const bctbx_crypto_provider_t *bctbx_crypto_backend_provider(void);
+
+/**
+ * @brief Built-in provider of SHA256 and HMAC-SHA256 on the bctoolbox implementation, using the CPU SHA extensions when available.
+ */
+const bctbx_crypto_provider_t *bctbx_crypto_sha256_provider(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_CRYPTO_PROVIDER_H */
@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SHA-256 and HMAC-SHA256 with reusable contexts and a batch interface.
+ * This is independent of the crypto backend so the block function can be
+ * dispatched at runtime to the x86 SHA extensions when the CPU has them.
+ * Without them, the batch functions hash eight messages at once in the AVX2 lanes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "utils.h"
+#include "bctoolbox/crypto.h"
+#include "provider.h"
+
+#ifdef BCTBX_X86_INTRINSICS
+#include <immintrin.h>
+#endif
+
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HMAC_CHUNK 64 /**< messages whose inner digests are kept on the stack by the multi-lane HMAC */
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t length; /**< total number of bytes hashed */
+	uint8_t buffer[SHA256_BLOCK_SIZE]; /**< pending bytes, less than a block */
+	size_t bufferLength;
+} sha256_state_t;
+
+struct bctbx_sha256_context_struct {
+	sha256_state_t hash;
+};
+
+struct bctbx_hmacSha256_context_struct {
+	sha256_state_t inner; /**< hash of the current message, started from innerPad */
+	uint32_t innerPad[8]; /**< state after (key ^ ipad), computed once per key */
+	uint32_t outerPad[8]; /**< state after (key ^ opad), computed once per key */
+};
+
+static const uint32_t sha256_init_state[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static void sha256_blocks_generic(uint32_t state[8], const uint8_t *data, size_t blocks) {
+	uint32_t W[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	while (blocks-- > 0) {
+		for (i = 0; i < 16; i++) {
+			W[i] = ((uint32_t)data[4*i] << 24) | ((uint32_t)data[4*i+1] << 16) | ((uint32_t)data[4*i+2] << 8) | (uint32_t)data[4*i+3];
+		}
+		for (i = 16; i < 64; i++) {
+			W[i] = SSIG1(W[i-2]) + W[i-7] + SSIG0(W[i-15]) + W[i-16];
+		}
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+		for (i = 0; i < 64; i++) {
+			t1 = h + BSIG1(e) + CH(e, f, g) + K[i] + W[i];
+			t2 = BSIG0(a) + MAJ(a, b, c);
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		data += SHA256_BLOCK_SIZE;
+	}
+}
+
+#ifdef BCTBX_X86_INTRINSICS
+/* SHA extensions: each sha256rnds2 performs two rounds, the state is kept as ABEF/CDGH */
+BCTBX_TARGET("sha,sse4.1,ssse3")
+static void sha256_blocks_shani(uint32_t state[8], const uint8_t *data, size_t blocks) {
+	const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, tmp, msg, abefSave, cdghSave;
+	__m128i W[4];
+	int i;
+
+	tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1); /* CDAB */
+	state1 = _mm_shuffle_epi32(state1, 0x1B); /* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8); /* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0); /* CDGH */
+
+	while (blocks-- > 0) {
+		abefSave = state0;
+		cdghSave = state1;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				W[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16*i)), byteSwap);
+			} else {
+				/* W[i] replaces W[i-4], computed from W[i-4..i-1] */
+				msg = _mm_sha256msg1_epu32(W[i & 3], W[(i + 1) & 3]);
+				msg = _mm_add_epi32(msg, _mm_alignr_epi8(W[(i + 3) & 3], W[(i + 2) & 3], 4));
+				W[i & 3] = _mm_sha256msg2_epu32(msg, W[(i + 3) & 3]);
+			}
+			msg = _mm_add_epi32(W[i & 3], _mm_loadu_si128((const __m128i *)&K[4*i]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, abefSave);
+		state1 = _mm_add_epi32(state1, cdghSave);
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B); /* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xB1); /* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0); /* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8); /* HGFE */
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+/* AVX2: eight independent messages, one per 32-bit lane, a block of each per call. state is stored as [word][lane] */
+#define SHA256_LANES 8
+#define V_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define V_ADD(x, y) _mm256_add_epi32(x, y)
+#define V_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+BCTBX_TARGET("avx2")
+static void sha256_transpose_avx2(__m256i out[8], const uint8_t *data[SHA256_LANES], size_t offset) {
+	const __m256i byteSwap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m256i r[8], t[8], u[8];
+	int l;
+
+	for (l = 0; l < SHA256_LANES; l++) {
+		r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(data[l] + offset)), byteSwap);
+	}
+	for (l = 0; l < 8; l += 2) {
+		t[l] = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+		t[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
+	}
+	for (l = 0; l < 8; l += 4) {
+		u[l] = _mm256_unpacklo_epi64(t[l], t[l + 2]);
+		u[l + 1] = _mm256_unpackhi_epi64(t[l], t[l + 2]);
+		u[l + 2] = _mm256_unpacklo_epi64(t[l + 1], t[l + 3]);
+		u[l + 3] = _mm256_unpackhi_epi64(t[l + 1], t[l + 3]);
+	}
+	for (l = 0; l < 4; l++) {
+		out[l] = _mm256_permute2x128_si256(u[l], u[l + 4], 0x20);
+		out[l + 4] = _mm256_permute2x128_si256(u[l], u[l + 4], 0x31);
+	}
+}
+
+BCTBX_TARGET("avx2")
+static void sha256_block_avx2_x8(uint32_t state[8][SHA256_LANES], const uint8_t *data[SHA256_LANES]) {
+	__m256i W[16], s[8];
+	__m256i a, b, c, d, e, f, g, h, t1, t2, w;
+	int i;
+
+	sha256_transpose_avx2(W, data, 0);
+	sha256_transpose_avx2(W + 8, data, 32);
+	for (i = 0; i < 8; i++) s[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+	a = s[0]; b = s[1]; c = s[2]; d = s[3];
+	e = s[4]; f = s[5]; g = s[6]; h = s[7];
+
+	for (i = 0; i < 64; i++) {
+		if (i < 16) {
+			w = W[i];
+		} else {
+			/* W[i] replaces W[i-16] in the ring */
+			__m256i w2 = W[(i - 2) & 15], w15 = W[(i - 15) & 15];
+			w = V_ADD(V_ADD(V_XOR3(V_ROTR(w2, 17), V_ROTR(w2, 19), _mm256_srli_epi32(w2, 10)), W[(i - 7) & 15]),
+				V_ADD(V_XOR3(V_ROTR(w15, 7), V_ROTR(w15, 18), _mm256_srli_epi32(w15, 3)), W[i & 15]));
+			W[i & 15] = w;
+		}
+		t1 = V_ADD(V_ADD(h, V_XOR3(V_ROTR(e, 6), V_ROTR(e, 11), V_ROTR(e, 25))),
+			V_ADD(_mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)), V_ADD(_mm256_set1_epi32((int)K[i]), w)));
+		t2 = V_ADD(V_XOR3(V_ROTR(a, 2), V_ROTR(a, 13), V_ROTR(a, 22)),
+			_mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b))));
+		h = g; g = f; f = e; e = V_ADD(d, t1);
+		d = c; c = b; b = a; a = V_ADD(t1, t2);
+	}
+
+	s[0] = V_ADD(s[0], a); s[1] = V_ADD(s[1], b); s[2] = V_ADD(s[2], c); s[3] = V_ADD(s[3], d);
+	s[4] = V_ADD(s[4], e); s[5] = V_ADD(s[5], f); s[6] = V_ADD(s[6], g); s[7] = V_ADD(s[7], h);
+	for (i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *)state[i], s[i]);
+}
+#endif /* BCTBX_X86_INTRINSICS */
+
+typedef void (*sha256_blocks_func)(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+static sha256_blocks_func sha256_get_blocks_func(void) {
+#ifdef BCTBX_X86_INTRINSICS
+	const uint32_t required = BCTBX_CPU_FEATURE_SHA | BCTBX_CPU_FEATURE_SSE41 | BCTBX_CPU_FEATURE_SSSE3;
+	if ((bctbx_cpu_features() & required) == required) {
+		return sha256_blocks_shani;
+	}
+#endif
+	return sha256_blocks_generic;
+}
+
+static void sha256_starts(sha256_state_t *ctx) {
+	memcpy(ctx->state, sha256_init_state, sizeof(ctx->state));
+	ctx->length = 0;
+	ctx->bufferLength = 0;
+}
+
+/* resume from a state computed over full blocks (used for the HMAC pads) */
+static void sha256_starts_from(sha256_state_t *ctx, const uint32_t state[8], uint64_t length) {
+	memcpy(ctx->state, state, sizeof(ctx->state));
+	ctx->length = length;
+	ctx->bufferLength = 0;
+}
+
+static void sha256_update(sha256_state_t *ctx, const uint8_t *input, size_t inputLength) {
+	sha256_blocks_func blocks = sha256_get_blocks_func();
+	size_t fullBlocks;
+
+	ctx->length += inputLength;
+	if (ctx->bufferLength > 0) {
+		size_t fill = SHA256_BLOCK_SIZE - ctx->bufferLength;
+		if (inputLength < fill) {
+			memcpy(ctx->buffer + ctx->bufferLength, input, inputLength);
+			ctx->bufferLength += inputLength;
+			return;
+		}
+		memcpy(ctx->buffer + ctx->bufferLength, input, fill);
+		blocks(ctx->state, ctx->buffer, 1);
+		input += fill;
+		inputLength -= fill;
+		ctx->bufferLength = 0;
+	}
+	/* hash directly from the input whatever fills complete blocks */
+	fullBlocks = inputLength / SHA256_BLOCK_SIZE;
+	if (fullBlocks > 0) {
+		blocks(ctx->state, input, fullBlocks);
+		input += fullBlocks * SHA256_BLOCK_SIZE;
+		inputLength -= fullBlocks * SHA256_BLOCK_SIZE;
+	}
+	if (inputLength > 0) {
+		memcpy(ctx->buffer, input, inputLength);
+		ctx->bufferLength = inputLength;
+	}
+}
+
+static void sha256_finish(sha256_state_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE]) {
+	sha256_blocks_func blocks = sha256_get_blocks_func();
+	uint64_t bitLength = ctx->length * 8;
+	int i;
+
+	ctx->buffer[ctx->bufferLength++] = 0x80;
+	if (ctx->bufferLength > SHA256_BLOCK_SIZE - 8) {
+		memset(ctx->buffer + ctx->bufferLength, 0, SHA256_BLOCK_SIZE - ctx->bufferLength);
+		blocks(ctx->state, ctx->buffer, 1);
+		ctx->bufferLength = 0;
+	}
+	memset(ctx->buffer + ctx->bufferLength, 0, SHA256_BLOCK_SIZE - 8 - ctx->bufferLength);
+	for (i = 0; i < 8; i++) {
+		ctx->buffer[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bitLength >> (8 * i));
+	}
+	blocks(ctx->state, ctx->buffer, 1);
+
+	for (i = 0; i < 8; i++) {
+		digest[4*i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4*i+1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4*i+2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4*i+3] = (uint8_t)(ctx->state[i]);
+	}
+}
+
+static void copy_truncated(uint8_t *output, const uint8_t digest[SHA256_DIGEST_SIZE], uint8_t outputLength) {
+	memcpy(output, digest, outputLength > SHA256_DIGEST_SIZE ? SHA256_DIGEST_SIZE : outputLength);
+}
+
+#ifdef BCTBX_X86_INTRINSICS
+/* the multi-lane code pays off where the SHA extensions, faster one message at a time, are missing */
+static int sha256_use_lanes(void) {
+	uint32_t features = bctbx_cpu_features();
+	return (features & BCTBX_CPU_FEATURE_AVX2) && !(features & BCTBX_CPU_FEATURE_SHA);
+}
+
+typedef struct {
+	const uint8_t *input;
+	size_t fullBlocks; /**< read directly from the input */
+	size_t blocks; /**< including the one or two padded blocks of the tail */
+	size_t block; /**< next block to hash */
+	size_t message; /**< index in the batch, SIZE_MAX when the lane is idle */
+	uint8_t tail[2 * SHA256_BLOCK_SIZE];
+} sha256_lane_t;
+
+static void sha256_lane_load(sha256_lane_t *lane, uint32_t state[8][SHA256_LANES], int l, const uint32_t initState[8], uint64_t prefixLength, const uint8_t *input, size_t inputLength, size_t message) {
+	size_t remaining = inputLength % SHA256_BLOCK_SIZE;
+	size_t tailBlocks = remaining + 9 > SHA256_BLOCK_SIZE ? 2 : 1;
+	uint64_t bitLength = (prefixLength + inputLength) * 8;
+	int i;
+
+	lane->input = input;
+	lane->fullBlocks = inputLength / SHA256_BLOCK_SIZE;
+	lane->blocks = lane->fullBlocks + tailBlocks;
+	lane->block = 0;
+	lane->message = message;
+	memset(lane->tail, 0, sizeof(lane->tail));
+	if (remaining > 0) memcpy(lane->tail, input + lane->fullBlocks * SHA256_BLOCK_SIZE, remaining);
+	lane->tail[remaining] = 0x80;
+	for (i = 0; i < 8; i++) {
+		lane->tail[tailBlocks * SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bitLength >> (8 * i));
+	}
+	for (i = 0; i < 8; i++) state[i][l] = initState[i];
+}
+
+/*
+ * Hash count messages, each one following a prefix of prefixLength bytes already hashed into initState, eight at a time.
+ * A lane is given the next message as soon as its own is done, so messages of uneven lengths keep the lanes busy.
+ */
+static void sha256_lanes(const uint32_t initState[8], uint64_t prefixLength, const uint8_t * const *inputs, const size_t *inputLengths, size_t count, uint8_t outputLength, uint8_t *output) {
+	static const uint8_t idleBlock[SHA256_BLOCK_SIZE] = {0};
+	sha256_lane_t lanes[SHA256_LANES];
+	uint32_t state[8][SHA256_LANES];
+	const uint8_t *data[SHA256_LANES];
+	size_t outputStep = outputLength > SHA256_DIGEST_SIZE ? SHA256_DIGEST_SIZE : outputLength;
+	size_t next = 0, active = 0;
+	int l, i;
+
+	for (l = 0; l < SHA256_LANES; l++) {
+		lanes[l].message = SIZE_MAX;
+		if (next < count) {
+			sha256_lane_load(&lanes[l], state, l, initState, prefixLength, inputs[next], inputLengths[next], next);
+			next++;
+			active++;
+		}
+	}
+	while (active > 0) {
+		for (l = 0; l < SHA256_LANES; l++) {
+			sha256_lane_t *lane = &lanes[l];
+			if (lane->message == SIZE_MAX) data[l] = idleBlock;
+			else if (lane->block < lane->fullBlocks) data[l] = lane->input + lane->block * SHA256_BLOCK_SIZE;
+			else data[l] = lane->tail + (lane->block - lane->fullBlocks) * SHA256_BLOCK_SIZE;
+		}
+		sha256_block_avx2_x8(state, data);
+		for (l = 0; l < SHA256_LANES; l++) {
+			sha256_lane_t *lane = &lanes[l];
+			uint8_t digest[SHA256_DIGEST_SIZE];
+			if (lane->message == SIZE_MAX || ++lane->block < lane->blocks) continue;
+			for (i = 0; i < 8; i++) {
+				digest[4*i] = (uint8_t)(state[i][l] >> 24);
+				digest[4*i+1] = (uint8_t)(state[i][l] >> 16);
+				digest[4*i+2] = (uint8_t)(state[i][l] >> 8);
+				digest[4*i+3] = (uint8_t)(state[i][l]);
+			}
+			memcpy(output + lane->message * outputStep, digest, outputStep);
+			lane->message = SIZE_MAX;
+			active--;
+			if (next < count) {
+				sha256_lane_load(lane, state, l, initState, prefixLength, inputs[next], inputLengths[next], next);
+				next++;
+				active++;
+			}
+		}
+	}
+	bctbx_clean(lanes, sizeof(lanes));
+	bctbx_clean(state, sizeof(state));
+}
+#endif /* BCTBX_X86_INTRINSICS */
+
+/*****************************************************************************/
+/***** SHA256 context                                                    *****/
+/*****************************************************************************/
+int bctbx_sha256_hardware_acceleration(void) {
+#ifdef BCTBX_X86_INTRINSICS
+	return sha256_get_blocks_func() == sha256_blocks_shani;
+#else
+	return 0;
+#endif
+}
+
+bctbx_sha256_context_t *bctbx_sha256_context_new(void) {
+	bctbx_sha256_context_t *context = bctbx_new(bctbx_sha256_context_t, 1);
+	sha256_starts(&context->hash);
+	return context;
+}
+
+void bctbx_sha256_update(bctbx_sha256_context_t *context, const uint8_t *input, size_t inputLength) {
+	sha256_update(&context->hash, input, inputLength);
+}
+
+void bctbx_sha256_finish(bctbx_sha256_context_t *context, uint8_t hashLength, uint8_t *output) {
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256_finish(&context->hash, digest);
+	copy_truncated(output, digest, hashLength);
+	sha256_starts(&context->hash);
+}
+
+void bctbx_sha256_context_free(bctbx_sha256_context_t *context) {
+	if (context == NULL) return;
+	bctbx_clean(context, sizeof(bctbx_sha256_context_t));
+	bctbx_free(context);
+}
+
+void bctbx_sha256_batch(const uint8_t * const *inputs, const size_t *inputLengths, size_t count, uint8_t hashLength, uint8_t *output) {
+	sha256_state_t ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	size_t outputStep = hashLength > SHA256_DIGEST_SIZE ? SHA256_DIGEST_SIZE : hashLength;
+	size_t i;
+
+#ifdef BCTBX_X86_INTRINSICS
+	if (count > 1 && sha256_use_lanes()) {
+		sha256_lanes(sha256_init_state, 0, inputs, inputLengths, count, hashLength, output);
+		return;
+	}
+#endif
+	for (i = 0; i < count; i++) {
+		sha256_starts(&ctx);
+		sha256_update(&ctx, inputs[i], inputLengths[i]);
+		sha256_finish(&ctx, digest);
+		memcpy(output + i * outputStep, digest, outputStep);
+	}
+	bctbx_clean(&ctx, sizeof(ctx));
+}
+
+/*****************************************************************************/
+/***** HMAC-SHA256 context                                               *****/
+/*****************************************************************************/
+static void hmac_sha256_init(bctbx_hmacSha256_context_t *context, const uint8_t *key, size_t keyLength) {
+	uint8_t pad[SHA256_BLOCK_SIZE];
+	uint8_t hashedKey[SHA256_DIGEST_SIZE];
+	sha256_state_t ctx;
+	int i;
+
+	/* keys longer than the block size are hashed first (RFC 2104) */
+	if (keyLength > SHA256_BLOCK_SIZE) {
+		sha256_starts(&ctx);
+		sha256_update(&ctx, key, keyLength);
+		sha256_finish(&ctx, hashedKey);
+		key = hashedKey;
+		keyLength = SHA256_DIGEST_SIZE;
+	}
+
+	memset(pad, 0, sizeof(pad));
+	if (keyLength > 0) memcpy(pad, key, keyLength);
+	for (i = 0; i < SHA256_BLOCK_SIZE; i++) pad[i] ^= 0x36;
+	sha256_starts(&ctx);
+	sha256_update(&ctx, pad, SHA256_BLOCK_SIZE);
+	memcpy(context->innerPad, ctx.state, sizeof(context->innerPad));
+
+	for (i = 0; i < SHA256_BLOCK_SIZE; i++) pad[i] ^= 0x36 ^ 0x5c;
+	sha256_starts(&ctx);
+	sha256_update(&ctx, pad, SHA256_BLOCK_SIZE);
+	memcpy(context->outerPad, ctx.state, sizeof(context->outerPad));
+
+	sha256_starts_from(&context->inner, context->innerPad, SHA256_BLOCK_SIZE);
+
+	bctbx_clean(pad, sizeof(pad));
+	bctbx_clean(hashedKey, sizeof(hashedKey));
+	bctbx_clean(&ctx, sizeof(ctx));
+}
+
+bctbx_hmacSha256_context_t *bctbx_hmacSha256_context_new(const uint8_t *key, size_t keyLength) {
+	bctbx_hmacSha256_context_t *context = bctbx_new(bctbx_hmacSha256_context_t, 1);
+	hmac_sha256_init(context, key, keyLength);
+	return context;
+}
+
+void bctbx_hmacSha256_update(bctbx_hmacSha256_context_t *context, const uint8_t *input, size_t inputLength) {
+	sha256_update(&context->inner, input, inputLength);
+}
+
+void bctbx_hmacSha256_finish(bctbx_hmacSha256_context_t *context, uint8_t hmacLength, uint8_t *output) {
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256_state_t outer;
+
+	sha256_finish(&context->inner, digest);
+	sha256_starts_from(&outer, context->outerPad, SHA256_BLOCK_SIZE);
+	sha256_update(&outer, digest, SHA256_DIGEST_SIZE);
+	sha256_finish(&outer, digest);
+	copy_truncated(output, digest, hmacLength);
+
+	/* ready for the next message with the same key */
+	sha256_starts_from(&context->inner, context->innerPad, SHA256_BLOCK_SIZE);
+	bctbx_clean(&outer, sizeof(outer));
+	bctbx_clean(digest, sizeof(digest));
+}
+
+void bctbx_hmacSha256_context_free(bctbx_hmacSha256_context_t *context) {
+	if (context == NULL) return;
+	bctbx_clean(context, sizeof(bctbx_hmacSha256_context_t));
+	bctbx_free(context);
+}
+
+void bctbx_hmacSha256_batch(const uint8_t *key, size_t keyLength,
+		const uint8_t * const *inputs, const size_t *inputLengths, size_t count,
+		uint8_t hmacLength, uint8_t *output) {
+	bctbx_hmacSha256_context_t *context = bctbx_hmacSha256_context_new(key, keyLength);
+	size_t outputStep = hmacLength > SHA256_DIGEST_SIZE ? SHA256_DIGEST_SIZE : hmacLength;
+	size_t i;
+
+#ifdef BCTBX_X86_INTRINSICS
+	if (count > 1 && sha256_use_lanes()) {
+		/* inner hashes of a chunk of messages, then the outer hashes of their digests */
+		uint8_t innerDigests[SHA256_HMAC_CHUNK * SHA256_DIGEST_SIZE];
+		const uint8_t *outerInputs[SHA256_HMAC_CHUNK];
+		size_t outerLengths[SHA256_HMAC_CHUNK];
+		size_t chunk;
+
+		for (i = 0; i < SHA256_HMAC_CHUNK; i++) {
+			outerInputs[i] = innerDigests + i * SHA256_DIGEST_SIZE;
+			outerLengths[i] = SHA256_DIGEST_SIZE;
+		}
+		for (i = 0; i < count; i += chunk) {
+			chunk = count - i < SHA256_HMAC_CHUNK ? count - i : SHA256_HMAC_CHUNK;
+			sha256_lanes(context->innerPad, SHA256_BLOCK_SIZE, inputs + i, inputLengths + i, chunk, SHA256_DIGEST_SIZE, innerDigests);
+			sha256_lanes(context->outerPad, SHA256_BLOCK_SIZE, outerInputs, outerLengths, chunk, hmacLength, output + i * outputStep);
+		}
+		bctbx_clean(innerDigests, sizeof(innerDigests));
+		bctbx_hmacSha256_context_free(context);
+		return;
+	}
+#endif
+	for (i = 0; i < count; i++) {
+		bctbx_hmacSha256_update(context, inputs[i], inputLengths[i]);
+		bctbx_hmacSha256_finish(context, hmacLength, output + i * outputStep);
+	}
+	bctbx_hmacSha256_context_free(context);
+}
+
+/*****************************************************************************/
+/***** Built-in crypto provider                                          *****/
+/*****************************************************************************/
+static void provider_sha256(const uint8_t *input, size_t inputLength, uint8_t hashLength, uint8_t *output) {
+	sha256_state_t ctx;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+
+	sha256_starts(&ctx);
+	sha256_update(&ctx, input, inputLength);
+	sha256_finish(&ctx, digest);
+	copy_truncated(output, digest, hashLength);
+}
+
+static void provider_hmacSha256(const uint8_t *key, size_t keyLength, const uint8_t *input, size_t inputLength, uint8_t hmacLength, uint8_t *output) {
+	bctbx_hmacSha256_context_t context;
+
+	hmac_sha256_init(&context, key, keyLength);
+	bctbx_hmacSha256_update(&context, input, inputLength);
+	bctbx_hmacSha256_finish(&context, hmacLength, output);
+	bctbx_clean(&context, sizeof(context));
+}
+
+static const bctbx_crypto_provider_t sha256_provider = {
+	"bctoolbox",
+	provider_sha256,
+	NULL,
+	NULL,
+	provider_hmacSha256,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+const bctbx_crypto_provider_t *bctbx_crypto_sha256_provider(void) {
+	return &sha256_provider;
+}
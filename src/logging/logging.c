@@ -103,7 +103,7 @@ typedef struct _bctbx_logger_t {
 	bctbx_list_t *log_stored_messages_list;
 	bctbx_list_t *log_domains;
 	bctbx_mutex_t log_stored_messages_mutex;
-	bctbx_mutex_t domains_mutex;
+	bctbx_rwlock_t domains_lock; /* the domain list is read on every log, written once per new domain */
 	bctbx_mutex_t log_mutex;
 	bctbx_log_handler_t * default_handler;
 } bctbx_logger_t;
@@ -147,7 +147,7 @@ static bctbx_logger_t* bctbx_get_logger(void) {
 	if (main_logger.default_log_domain == NULL) {
 		main_logger.default_log_domain =
 		    bctbx_log_domain_new(NULL, BCTBX_LOG_WARNING | BCTBX_LOG_ERROR | BCTBX_LOG_FATAL);
-		bctbx_mutex_init(&main_logger.domains_mutex, NULL);
+		bctbx_rwlock_init(&main_logger.domains_lock, NULL);
 		bctbx_mutex_init(&main_logger.log_mutex, NULL);
 #if ENABLE_DEFAULT_LOG_HANDLER
 		initialize_default_handler();
@@ -175,7 +175,7 @@ void bctbx_uninit_logger(void){
 #if 0
 	bctbx_logger_t * logger = bctbx_get_logger();
 	bctbx_logv_flush();
-	bctbx_mutex_destroy(&logger->domains_mutex);
+	bctbx_rwlock_destroy(&logger->domains_lock);
 	bctbx_mutex_destroy(&logger->log_mutex);
 	bctbx_log_handlers_free();
 	logger->logv_outs = bctbx_list_free(logger->logv_outs);
@@ -300,11 +300,10 @@ bctbx_list_t* bctbx_get_log_handlers(void){
 	return bctbx_get_logger()->logv_outs;
 }
 
-static BctoolboxLogDomain * get_log_domain(const char *domain){
+/*to be called with the domains lock held*/
+static BctoolboxLogDomain * find_log_domain(bctbx_logger_t *logger, const char *domain){
 	bctbx_list_t *it;
-	bctbx_logger_t *logger = bctbx_get_logger();
 
-	if (domain == NULL) return logger->default_log_domain;
 	for (it = logger->log_domains; it != NULL; it = bctbx_list_next(it)) {
 		BctoolboxLogDomain *ld = (BctoolboxLogDomain*)bctbx_list_get_data(it);
 		if (ld->domain && strcmp(ld->domain, domain) == 0 ){
@@ -314,20 +313,31 @@ static BctoolboxLogDomain * get_log_domain(const char *domain){
 	return NULL;
 }
 
+static BctoolboxLogDomain * get_log_domain(const char *domain){
+	BctoolboxLogDomain *ret;
+	bctbx_logger_t *logger = bctbx_get_logger();
+
+	if (domain == NULL) return logger->default_log_domain;
+	bctbx_rwlock_rdlock(&logger->domains_lock);
+	ret = find_log_domain(logger, domain);
+	bctbx_rwlock_rdunlock(&logger->domains_lock);
+	return ret;
+}
+
 static BctoolboxLogDomain *get_log_domain_rw(const char *domain){
 	BctoolboxLogDomain *ret;
 	bctbx_logger_t *logger = bctbx_get_logger();
 	
 	ret = get_log_domain(domain);
 	if (ret) return ret;
-	/*it does not exist, hence create it by taking the mutex*/
-	bctbx_mutex_lock(&logger->domains_mutex);
-	ret = get_log_domain(domain);
+	/*it does not exist, hence create it by taking the lock for writing*/
+	bctbx_rwlock_wrlock(&logger->domains_lock);
+	ret = find_log_domain(logger, domain);
 	if (!ret){
 		ret = bctbx_log_domain_new(domain, logger->default_log_domain->logmask);
 		logger->log_domains = bctbx_list_prepend(logger->log_domains, ret);
 	}
-	bctbx_mutex_unlock(&logger->domains_mutex);
+	bctbx_rwlock_wrunlock(&logger->domains_lock);
 	return ret;
 }
 
@@ -17,4 +17,49 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "bctoolbox/port.h"
\ No newline at end of file
+#ifndef BCTBX_PRIVATE_UTILS_H
+#define BCTBX_PRIVATE_UTILS_H
+
+#include "bctoolbox/port.h"
+#include "bctoolbox/allocator.h"
+
+/* CPU features, probed once at runtime, used to select optimized code paths */
+#define BCTBX_CPU_FEATURE_SSSE3		0x00000001
+#define BCTBX_CPU_FEATURE_SSE41		0x00000002
+#define BCTBX_CPU_FEATURE_AVX2		0x00000004
+#define BCTBX_CPU_FEATURE_AESNI		0x00000008
+#define BCTBX_CPU_FEATURE_PCLMUL	0x00000010
+#define BCTBX_CPU_FEATURE_SHA		0x00000020
+#define BCTBX_CPU_FEATURE_NEON		0x00000040
+#define BCTBX_CPU_FEATURE_INVARIANT_TSC	0x00000080 /* constant rate, synchronized across cores */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BCTBX_X86_INTRINSICS 1
+/* allow the compiler to emit the instructions of an extension in one function only, the caller must check the cpu features first */
+#define BCTBX_TARGET(extensions) __attribute__((target(extensions)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define BCTBX_X86_INTRINSICS 1
+#define BCTBX_TARGET(extensions)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get the CPU features available on the running host.
+ * @return a bitmask of BCTBX_CPU_FEATURE_* flags
+ */
+uint32_t bctbx_cpu_features(void);
+
+/**
+ * @brief Same as bctbx_memory_get_stats(), for the reports made by bctoolbox itself: the allocation rate is computed
+ * since the last call to bctbx_memory_get_stats() and its window is not restarted.
+ */
+void bctbx_memory_peek_stats(bctbx_memory_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BCTBX_PRIVATE_UTILS_H */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/port.h"
+#include "utils.h"
+
+#if defined(BCTBX_X86_INTRINSICS)
+#include <immintrin.h> /* _mm_pause */
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <sched.h>
+#endif
+
+/* upper bound of the spinning, beyond it the holder is likely descheduled or doing real work */
+#define BCTBX_ADAPTIVE_MUTEX_MAX_SPINS 100
+/* fractional bits of the spin average: in whole spins, the 1/8 step of a difference below 8 would round to nothing */
+#define BCTBX_ADAPTIVE_MUTEX_SPINS_SHIFT 4
+
+#if defined(_MSC_VER)
+static int atomic_cas(int *p, int expected, int desired) {
+	return (int)InterlockedCompareExchange((volatile long *)p, desired, expected);
+}
+static int atomic_xchg(int *p, int value) {
+	return (int)InterlockedExchange((volatile long *)p, value);
+}
+static int atomic_load_relaxed(const int *p) {
+	return *(const volatile int *)p;
+}
+static void atomic_store_relaxed(int *p, int value) {
+	*(volatile int *)p = value;
+}
+#else
+/* return the previous value, the exchange took place if it is the expected one */
+static int atomic_cas(int *p, int expected, int desired) {
+	__atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+	return expected;
+}
+static int atomic_xchg(int *p, int value) {
+	return __atomic_exchange_n(p, value, __ATOMIC_ACQ_REL);
+}
+static int atomic_load_relaxed(const int *p) {
+	return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static void atomic_store_relaxed(int *p, int value) {
+	__atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+#endif
+
+static void cpu_relax(void) {
+#if defined(BCTBX_X86_INTRINSICS)
+	_mm_pause();
+#elif (defined(__aarch64__) || defined(__arm__)) && defined(__GNUC__)
+	__asm__ volatile("yield");
+#endif
+}
+
+/* sleep while the state is 2, wake ups may be spurious */
+static void wait_on_state(int *state) {
+#if defined(__linux__)
+	syscall(SYS_futex, state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+#elif defined(_WIN32)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+static void wake_one(int *state) {
+#if defined(__linux__)
+	syscall(SYS_futex, state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+	/* elsewhere the waiters do not sleep, they poll the state */
+}
+
+void bctbx_adaptive_mutex_init(bctbx_adaptive_mutex_t *mutex) {
+	memset(mutex, 0, sizeof(*mutex));
+}
+
+void bctbx_adaptive_mutex_lock(bctbx_adaptive_mutex_t *mutex) {
+	int spins, maxSpins, state, average;
+	uint64_t sleeps = 0;
+
+	if (atomic_cas(&mutex->state, 0, 1) == 0) {
+		mutex->stats.acquisitions++;
+		return;
+	}
+	/* spin a bit more than what it usually takes, so that the estimate can grow */
+	average = atomic_load_relaxed(&mutex->spins);
+	maxSpins = MIN(BCTBX_ADAPTIVE_MUTEX_MAX_SPINS, (average >> BCTBX_ADAPTIVE_MUTEX_SPINS_SHIFT) * 2 + 10);
+	for (spins = 0; spins < maxSpins; spins++) {
+		cpu_relax();
+		if (atomic_load_relaxed(&mutex->state) == 0 && atomic_cas(&mutex->state, 0, 1) == 0) break;
+	}
+	if (spins == maxSpins) {
+		/* mark the mutex as having sleepers, so that the holder wakes one on unlock */
+		state = atomic_xchg(&mutex->state, 2);
+		while (state != 0) {
+			wait_on_state(&mutex->state);
+			sleeps++;
+			state = atomic_xchg(&mutex->state, 2);
+		}
+	}
+	average = atomic_load_relaxed(&mutex->spins);
+	atomic_store_relaxed(&mutex->spins, average + ((spins << BCTBX_ADAPTIVE_MUTEX_SPINS_SHIFT) - average) / 8);
+	mutex->stats.acquisitions++;
+	mutex->stats.contentions++;
+	mutex->stats.sleeps += sleeps;
+}
+
+int bctbx_adaptive_mutex_trylock(bctbx_adaptive_mutex_t *mutex) {
+	if (atomic_cas(&mutex->state, 0, 1) != 0) return -1;
+	mutex->stats.acquisitions++;
+	return 0;
+}
+
+void bctbx_adaptive_mutex_unlock(bctbx_adaptive_mutex_t *mutex) {
+	if (atomic_xchg(&mutex->state, 0) == 2) wake_one(&mutex->state);
+}
+
+void bctbx_adaptive_mutex_destroy(bctbx_adaptive_mutex_t *mutex) {
+}
+
+void bctbx_adaptive_mutex_get_stats(const bctbx_adaptive_mutex_t *mutex, bctbx_lock_stats_t *stats) {
+	*stats = mutex->stats;
+}
+
+void bctbx_adaptive_mutex_reset_stats(bctbx_adaptive_mutex_t *mutex) {
+	memset(&mutex->stats, 0, sizeof(mutex->stats));
+}
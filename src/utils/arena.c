@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include "bctoolbox/allocator.h"
+
+#define BCTBX_ARENA_ALIGNMENT 16
+#define BCTBX_ARENA_ALIGN(size) (((size) + BCTBX_ARENA_ALIGNMENT - 1) & ~(size_t)(BCTBX_ARENA_ALIGNMENT - 1))
+#define BCTBX_ARENA_DEFAULT_BLOCK_SIZE 4096
+
+typedef struct _bctbx_arena_block_t {
+	struct _bctbx_arena_block_t *next;
+	size_t size;
+	size_t used;
+} bctbx_arena_block_t;
+
+/* the data follows the block header, aligned */
+#define BCTBX_ARENA_BLOCK_HEADER_SIZE BCTBX_ARENA_ALIGN(sizeof(bctbx_arena_block_t))
+
+struct _bctbx_arena_t {
+	bctbx_arena_block_t *blocks; /* the block being filled first, the first one allocated last */
+	size_t blockSize;
+	bctbx_arena_stats_t stats;
+};
+
+static bctbx_arena_block_t *arena_block_new(bctbx_arena_t *arena, size_t size) {
+	bctbx_arena_block_t *block;
+	if (size > SIZE_MAX - BCTBX_ARENA_BLOCK_HEADER_SIZE) return NULL;
+	block = (bctbx_arena_block_t *)bctbx_malloc(BCTBX_ARENA_BLOCK_HEADER_SIZE + size);
+	if (block == NULL) return NULL;
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	arena->stats.bytesReserved += size;
+	return block;
+}
+
+bctbx_arena_t *bctbx_arena_new(size_t block_size) {
+	bctbx_arena_t *arena = bctbx_new0(bctbx_arena_t, 1);
+	arena->blockSize = BCTBX_ARENA_ALIGN(block_size > 0 ? block_size : BCTBX_ARENA_DEFAULT_BLOCK_SIZE);
+	return arena;
+}
+
+void bctbx_arena_free(bctbx_arena_t *arena) {
+	bctbx_arena_block_t *block = arena->blocks;
+	while (block) {
+		bctbx_arena_block_t *next = block->next;
+		bctbx_free(block);
+		block = next;
+	}
+	bctbx_free(arena);
+}
+
+void bctbx_arena_reset(bctbx_arena_t *arena) {
+	bctbx_arena_block_t *block = arena->blocks;
+	if (block == NULL) return;
+	while (block->next) {
+		bctbx_arena_block_t *next = block->next;
+		arena->stats.bytesReserved -= block->size;
+		bctbx_free(block);
+		block = next;
+	}
+	block->used = 0;
+	arena->blocks = block;
+	arena->stats.bytesUsed = 0;
+}
+
+void *bctbx_arena_alloc(bctbx_arena_t *arena, size_t size) {
+	bctbx_arena_block_t *block = arena->blocks;
+	void *ret;
+
+	/* neither the alignment nor the block header may wrap around */
+	if (size > SIZE_MAX - BCTBX_ARENA_BLOCK_HEADER_SIZE - BCTBX_ARENA_ALIGNMENT) return NULL;
+	size = BCTBX_ARENA_ALIGN(size > 0 ? size : 1);
+	if (block == NULL || block->size - block->used < size) {
+		if (size > arena->blockSize / 4) {
+			/* a block of its own, behind the current one which may still serve small allocations */
+			block = arena_block_new(arena, size);
+			if (block == NULL) return NULL;
+			if (arena->blocks) {
+				block->next = arena->blocks->next;
+				arena->blocks->next = block;
+			} else {
+				arena->blocks = block;
+			}
+		} else {
+			block = arena_block_new(arena, arena->blockSize);
+			if (block == NULL) return NULL;
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+	}
+	ret = (uint8_t *)block + BCTBX_ARENA_BLOCK_HEADER_SIZE + block->used;
+	block->used += size;
+	arena->stats.bytesUsed += size;
+	if (arena->stats.bytesUsed > arena->stats.peakBytesUsed) arena->stats.peakBytesUsed = arena->stats.bytesUsed;
+	return ret;
+}
+
+void *bctbx_arena_alloc0(bctbx_arena_t *arena, size_t size) {
+	void *ret = bctbx_arena_alloc(arena, size);
+	if (ret) memset(ret, 0, size);
+	return ret;
+}
+
+char *bctbx_arena_strdup(bctbx_arena_t *arena, const char *str) {
+	size_t size;
+	char *ret;
+	if (str == NULL) return NULL;
+	size = strlen(str) + 1;
+	ret = (char *)bctbx_arena_alloc(arena, size);
+	if (ret) memcpy(ret, str, size);
+	return ret;
+}
+
+char *bctbx_arena_strdup_printf(bctbx_arena_t *arena, const char *fmt, ...) {
+	va_list args;
+	char *tmp, *ret;
+	va_start(args, fmt);
+	tmp = bctbx_strdup_vprintf(fmt, args);
+	va_end(args);
+	if (tmp == NULL) return NULL;
+	ret = bctbx_arena_strdup(arena, tmp);
+	bctbx_free(tmp);
+	return ret;
+}
+
+void bctbx_arena_get_stats(const bctbx_arena_t *arena, bctbx_arena_stats_t *stats) {
+	*stats = arena->stats;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#define BCTBX_CPU_FEATURES_UNKNOWN 0x80000000
+
+static volatile uint32_t cpu_features = BCTBX_CPU_FEATURES_UNKNOWN;
+
+#if defined(BCTBX_X86_INTRINSICS)
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, (int)leaf, (int)subleaf);
+	regs[0] = (uint32_t)info[0]; regs[1] = (uint32_t)info[1]; regs[2] = (uint32_t)info[2]; regs[3] = (uint32_t)info[3];
+#else
+	if (__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]) == 0) {
+		regs[0] = regs[1] = regs[2] = regs[3] = 0;
+	}
+#endif
+}
+
+/* AVX registers are usable only if the OS saves them on context switch */
+static int os_saves_ymm(void) {
+#ifdef _MSC_VER
+	return (_xgetbv(0) & 0x6) == 0x6;
+#else
+	uint32_t eax, edx;
+	__asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (eax & 0x6) == 0x6;
+#endif
+}
+
+static uint32_t probe_cpu_features(void) {
+	uint32_t regs[4];
+	uint32_t features = 0;
+	uint32_t max_leaf;
+
+	cpuid(0, 0, regs);
+	max_leaf = regs[0];
+	if (max_leaf < 1) return 0;
+
+	cpuid(1, 0, regs);
+	if (regs[2] & (1 << 9)) features |= BCTBX_CPU_FEATURE_SSSE3;
+	if (regs[2] & (1 << 19)) features |= BCTBX_CPU_FEATURE_SSE41;
+	if (regs[2] & (1 << 25)) features |= BCTBX_CPU_FEATURE_AESNI;
+	if (regs[2] & (1 << 1)) features |= BCTBX_CPU_FEATURE_PCLMUL;
+	if (max_leaf >= 7) {
+		int has_avx = (regs[2] & (1 << 28)) && (regs[2] & (1 << 27)) && os_saves_ymm(); /* AVX and OSXSAVE */
+		cpuid(7, 0, regs);
+		if (has_avx && (regs[1] & (1 << 5))) features |= BCTBX_CPU_FEATURE_AVX2;
+		if (regs[1] & (1 << 29)) features |= BCTBX_CPU_FEATURE_SHA;
+	}
+	cpuid(0x80000000, 0, regs);
+	if (regs[0] >= 0x80000007) {
+		cpuid(0x80000007, 0, regs);
+		if (regs[3] & (1 << 8)) features |= BCTBX_CPU_FEATURE_INVARIANT_TSC;
+	}
+	return features;
+}
+#else
+static uint32_t probe_cpu_features(void) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	return BCTBX_CPU_FEATURE_NEON; /* NEON is part of the target ABI when the compiler defines it */
+#else
+	return 0;
+#endif
+}
+#endif
+
+uint32_t bctbx_cpu_features(void) {
+	uint32_t features = cpu_features;
+	if (features == BCTBX_CPU_FEATURES_UNKNOWN) {
+		/* concurrent first calls all compute and store the same value */
+		features = probe_cpu_features();
+		cpu_features = features;
+	}
+	return features;
+}
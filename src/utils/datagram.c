@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Batched datagram I/O.
+ * On Linux, sendmmsg()/recvmmsg() move up to BCTBX_DATAGRAM_BATCH datagrams per system call, with UDP GSO/GRO
+ * when requested. Elsewhere, one sendto()/recvfrom() is done per datagram.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* sendmmsg, recvmmsg */
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/port.h"
+
+#if defined(__linux__)
+#include <netinet/udp.h>
+#ifdef MSG_WAITFORONE
+#define BCTBX_HAVE_MMSG 1
+/* not exported by older C libraries, the kernel rejects them when it does not support segmentation offload */
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+#endif
+
+/* number of datagrams per system call, the message headers are on the stack */
+#define BCTBX_DATAGRAM_BATCH 64
+
+static bool_t is_segmented(const bctbx_datagram_t *datagram) {
+	return datagram->segmentSize > 0 && datagram->segmentSize < datagram->length;
+}
+
+/* the segment size is 16 bits wide in UDP GSO: larger ones are rejected on every platform, segmented here or not */
+static bool_t is_valid(const bctbx_datagram_t *datagram) {
+	return !is_segmented(datagram) || datagram->segmentSize <= UINT16_MAX;
+}
+
+static void set_invalid_argument(void) {
+#ifdef _WIN32
+	WSASetLastError(WSAEINVAL);
+#else
+	errno = EINVAL;
+#endif
+}
+
+/* segments the datagram in user space if needed: it may fail after some of its segments were sent */
+static int send_one(bctbx_socket_t socket, const bctbx_datagram_t *datagram, int flags) {
+	const uint8_t *data = (const uint8_t *)datagram->buffer;
+	size_t offset = 0;
+
+	if (!is_valid(datagram)) {
+		set_invalid_argument();
+		return -1;
+	}
+	if (!is_segmented(datagram)) {
+		return bctbx_sendto(socket, data, datagram->length, flags, (const struct sockaddr *)&datagram->address, datagram->addressLength) < 0 ? -1 : 0;
+	}
+	while (offset < datagram->length) {
+		size_t length = datagram->length - offset;
+		if (length > datagram->segmentSize) length = datagram->segmentSize;
+		if (bctbx_sendto(socket, data + offset, length, flags, (const struct sockaddr *)&datagram->address, datagram->addressLength) < 0) return -1;
+		offset += length;
+	}
+	return 0;
+}
+
+#ifdef BCTBX_HAVE_MMSG
+
+int bctbx_sendmmsg(bctbx_socket_t socket, const bctbx_datagram_t *datagrams, unsigned int count, int flags) {
+	struct mmsghdr msgs[BCTBX_DATAGRAM_BATCH];
+	struct iovec iovs[BCTBX_DATAGRAM_BATCH];
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} controls[BCTBX_DATAGRAM_BATCH];
+	unsigned int sent = 0;
+
+	while (sent < count) {
+		unsigned int n = count - sent;
+		unsigned int i;
+		int ret;
+
+		if (n > BCTBX_DATAGRAM_BATCH) n = BCTBX_DATAGRAM_BATCH;
+		memset(msgs, 0, n * sizeof(msgs[0]));
+		for (i = 0; i < n; i++) {
+			const bctbx_datagram_t *datagram = &datagrams[sent + i];
+			iovs[i].iov_base = datagram->buffer;
+			iovs[i].iov_len = datagram->length;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = (void *)&datagram->address;
+			msgs[i].msg_hdr.msg_namelen = datagram->addressLength;
+			if (is_segmented(datagram)) {
+				struct cmsghdr *cmsg;
+				uint16_t segmentSize;
+				/* send the datagrams before this one, then fail on it */
+				if (!is_valid(datagram)) break;
+				segmentSize = (uint16_t)datagram->segmentSize;
+				msgs[i].msg_hdr.msg_control = controls[i].buf;
+				msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+				cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+				cmsg->cmsg_level = IPPROTO_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+			}
+		}
+		if (i == 0) {
+			set_invalid_argument();
+			break;
+		}
+		n = i;
+		ret = sendmmsg(socket, msgs, n, flags);
+		if (ret < 0) {
+			/* the kernel or the device may not do the segmentation, or not of that many segments: do it here */
+			if ((errno == EINVAL || errno == EIO) && is_segmented(&datagrams[sent]) && send_one(socket, &datagrams[sent], flags) == 0) {
+				sent++;
+				continue;
+			}
+			break;
+		}
+		sent += (unsigned int)ret;
+		if ((unsigned int)ret < n) break;
+	}
+	return (sent == 0 && count > 0) ? -1 : (int)sent;
+}
+
+int bctbx_recvmmsg(bctbx_socket_t socket, bctbx_datagram_t *datagrams, unsigned int count, int flags) {
+	struct mmsghdr msgs[BCTBX_DATAGRAM_BATCH];
+	struct iovec iovs[BCTBX_DATAGRAM_BATCH];
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} controls[BCTBX_DATAGRAM_BATCH];
+	unsigned int received = 0;
+
+	while (received < count) {
+		unsigned int n = count - received;
+		unsigned int i;
+		int ret;
+
+		if (n > BCTBX_DATAGRAM_BATCH) n = BCTBX_DATAGRAM_BATCH;
+		memset(msgs, 0, n * sizeof(msgs[0]));
+		for (i = 0; i < n; i++) {
+			bctbx_datagram_t *datagram = &datagrams[received + i];
+			iovs[i].iov_base = datagram->buffer;
+			iovs[i].iov_len = datagram->size;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &datagram->address;
+			msgs[i].msg_hdr.msg_namelen = sizeof(datagram->address);
+			msgs[i].msg_hdr.msg_control = controls[i].buf;
+			msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+		}
+		/* only the first batch may wait, the next ones take what is already queued */
+		ret = recvmmsg(socket, msgs, n, received == 0 ? (flags | MSG_WAITFORONE) : (flags | MSG_DONTWAIT), NULL);
+		if (ret < 0) break;
+		for (i = 0; i < (unsigned int)ret; i++) {
+			bctbx_datagram_t *datagram = &datagrams[received + i];
+			struct cmsghdr *cmsg;
+			datagram->length = msgs[i].msg_len;
+			datagram->addressLength = msgs[i].msg_hdr.msg_namelen;
+			datagram->segmentSize = datagram->length;
+			for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+				if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+					int segmentSize;
+					memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+					if (segmentSize > 0) datagram->segmentSize = (size_t)segmentSize;
+				}
+			}
+		}
+		received += (unsigned int)ret;
+		if ((unsigned int)ret < n) break;
+	}
+	return (received == 0 && count > 0) ? -1 : (int)received;
+}
+
+int bctbx_socket_enable_udp_gro(bctbx_socket_t socket) {
+	int on = 1;
+	return setsockopt(socket, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0 ? 0 : -1;
+}
+
+#else
+
+int bctbx_sendmmsg(bctbx_socket_t socket, const bctbx_datagram_t *datagrams, unsigned int count, int flags) {
+	unsigned int sent;
+
+	for (sent = 0; sent < count; sent++) {
+		if (send_one(socket, &datagrams[sent], flags) != 0) break;
+	}
+	return (sent == 0 && count > 0) ? -1 : (int)sent;
+}
+
+int bctbx_recvmmsg(bctbx_socket_t socket, bctbx_datagram_t *datagrams, unsigned int count, int flags) {
+	unsigned int received;
+
+	for (received = 0; received < count; received++) {
+		bctbx_datagram_t *datagram = &datagrams[received];
+		socklen_t addressLength = sizeof(datagram->address);
+		ssize_t ret;
+#ifdef MSG_DONTWAIT
+		ret = bctbx_recvfrom(socket, datagram->buffer, datagram->size, received == 0 ? flags : (flags | MSG_DONTWAIT), (struct sockaddr *)&datagram->address, &addressLength);
+#else
+		/* no way to take only what is already queued without changing the socket mode */
+		if (received > 0) break;
+		ret = bctbx_recvfrom(socket, datagram->buffer, datagram->size, flags, (struct sockaddr *)&datagram->address, &addressLength);
+#endif
+		if (ret < 0) break;
+		datagram->length = (size_t)ret;
+		datagram->segmentSize = (size_t)ret;
+		datagram->addressLength = addressLength;
+	}
+	return (received == 0 && count > 0) ? -1 : (int)received;
+}
+
+int bctbx_socket_enable_udp_gro(bctbx_socket_t socket) {
+	return -1;
+}
+
+#endif
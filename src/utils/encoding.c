@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hexadecimal and base64 codecs.
+ * The bulk of the data is processed by vector code selected at runtime (SSSE3/AVX2 on x86, NEON on aarch64),
+ * the tails and the base64 padding by the scalar code.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "utils.h"
+#include "bctoolbox/port.h"
+
+#ifdef BCTBX_X86_INTRINSICS
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BCTBX_NEON_CODECS 1
+#endif
+
+static const char hex_chars[16] = {'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'};
+
+static const char base64_chars[64] = {
+	'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P','Q','R','S','T','U','V','W','X','Y','Z',
+	'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v','w','x','y','z',
+	'0','1','2','3','4','5','6','7','8','9','+','/'
+};
+
+/* base64 char -> value, 0xFF for the chars out of the alphabet (including the padding '=') */
+static const uint8_t base64_values[256] = {
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,  62,0xFF,0xFF,0xFF,  63,
+	  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,
+	0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF
+};
+
+/* hex char -> value, 0xFF for the non hexadecimal chars */
+static uint8_t hex_value(uint8_t c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	c |= 0x20; /* lower case */
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return 0xFF;
+}
+
+/*****************************************************************************/
+/***** Hexadecimal                                                       *****/
+/*****************************************************************************/
+/* all the block functions process a prefix of the input and return its length, the scalar code finishes the job */
+
+#ifdef BCTBX_X86_INTRINSICS
+BCTBX_TARGET("ssse3")
+static size_t hex_encode_ssse3(uint8_t *output, const uint8_t *input, size_t input_length) {
+	const __m128i lut = _mm_loadu_si128((const __m128i *)hex_chars);
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	size_t i;
+	for (i = 0; i + 16 <= input_length; i += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *)(input + i));
+		__m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+		__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(in, mask));
+		_mm_storeu_si128((__m128i *)(output + 2*i), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(output + 2*i + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return i;
+}
+
+BCTBX_TARGET("avx2")
+static size_t hex_encode_avx2(uint8_t *output, const uint8_t *input, size_t input_length) {
+	const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hex_chars));
+	const __m256i mask = _mm256_set1_epi8(0x0F);
+	size_t i;
+	for (i = 0; i + 32 <= input_length; i += 32) {
+		__m256i in = _mm256_loadu_si256((const __m256i *)(input + i));
+		__m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+		__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, mask));
+		/* unpack works inside each 128 bits lane: put the lanes back in order */
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i *)(output + 2*i), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(output + 2*i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	return i;
+}
+
+/* nibble values of 16 hex chars, the valid mask gets 0xFF for the hexadecimal chars */
+BCTBX_TARGET("ssse3")
+static __m128i hex_nibbles_ssse3(__m128i in, __m128i *valid) {
+	__m128i digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+	__m128i alpha = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	__m128i isAlpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+	*valid = _mm_or_si128(isDigit, isAlpha);
+	return _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+BCTBX_TARGET("ssse3")
+static size_t hex_decode_ssse3(uint8_t *output, const uint8_t *input, size_t output_length, int *invalid) {
+	/* each 16 bits: high nibble in the first byte, low nibble in the second one */
+	const __m128i weights = _mm_set1_epi16(0x0110);
+	size_t i;
+	for (i = 0; i + 16 <= output_length; i += 16) {
+		__m128i valid0, valid1;
+		__m128i n0 = hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *)(input + 2*i)), &valid0);
+		__m128i n1 = hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *)(input + 2*i + 16)), &valid1);
+		if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xFFFF) {
+			*invalid = 1;
+			return i;
+		}
+		_mm_storeu_si128((__m128i *)(output + i), _mm_packus_epi16(_mm_maddubs_epi16(n0, weights), _mm_maddubs_epi16(n1, weights)));
+	}
+	return i;
+}
+
+BCTBX_TARGET("avx2")
+static __m256i hex_nibbles_avx2(__m256i in, __m256i *valid) {
+	__m256i digit = _mm256_sub_epi8(in, _mm256_set1_epi8('0'));
+	__m256i alpha = _mm256_sub_epi8(_mm256_or_si256(in, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+	__m256i isAlpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+	*valid = _mm256_or_si256(isDigit, isAlpha);
+	return _mm256_or_si256(_mm256_and_si256(isDigit, digit), _mm256_and_si256(isAlpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+}
+
+BCTBX_TARGET("avx2")
+static size_t hex_decode_avx2(uint8_t *output, const uint8_t *input, size_t output_length, int *invalid) {
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	size_t i;
+	for (i = 0; i + 32 <= output_length; i += 32) {
+		__m256i valid0, valid1;
+		__m256i n0 = hex_nibbles_avx2(_mm256_loadu_si256((const __m256i *)(input + 2*i)), &valid0);
+		__m256i n1 = hex_nibbles_avx2(_mm256_loadu_si256((const __m256i *)(input + 2*i + 32)), &valid1);
+		if (_mm256_movemask_epi8(_mm256_and_si256(valid0, valid1)) != -1) {
+			*invalid = 1;
+			return i;
+		}
+		/* pack works inside each 128 bits lane: put the 64 bits quarters back in order */
+		__m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(n0, weights), _mm256_maddubs_epi16(n1, weights));
+		_mm256_storeu_si256((__m256i *)(output + i), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+	return i;
+}
+#endif /* BCTBX_X86_INTRINSICS */
+
+#ifdef BCTBX_NEON_CODECS
+static size_t hex_encode_neon(uint8_t *output, const uint8_t *input, size_t input_length) {
+	const uint8x16_t lut = vld1q_u8((const uint8_t *)hex_chars);
+	size_t i;
+	for (i = 0; i + 16 <= input_length; i += 16) {
+		uint8x16_t in = vld1q_u8(input + i);
+		uint8x16x2_t chars;
+		chars.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(in, 4));
+		chars.val[1] = vqtbl1q_u8(lut, vandq_u8(in, vdupq_n_u8(0x0F)));
+		vst2q_u8(output + 2*i, chars); /* interleaved store: high nibble char then low nibble char */
+	}
+	return i;
+}
+
+static uint8x16_t hex_nibbles_neon(uint8x16_t in, uint8x16_t *valid) {
+	uint8x16_t digit = vsubq_u8(in, vdupq_n_u8('0'));
+	uint8x16_t alpha = vsubq_u8(vorrq_u8(in, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+	uint8x16_t isDigit = vcleq_u8(digit, vdupq_n_u8(9));
+	*valid = vorrq_u8(isDigit, vcleq_u8(alpha, vdupq_n_u8(5)));
+	return vbslq_u8(isDigit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+
+static size_t hex_decode_neon(uint8_t *output, const uint8_t *input, size_t output_length, int *invalid) {
+	size_t i;
+	for (i = 0; i + 16 <= output_length; i += 16) {
+		uint8x16x2_t chars = vld2q_u8(input + 2*i); /* deinterleaved load: high nibble chars, low nibble chars */
+		uint8x16_t validHi, validLo;
+		uint8x16_t hi = hex_nibbles_neon(chars.val[0], &validHi);
+		uint8x16_t lo = hex_nibbles_neon(chars.val[1], &validLo);
+		if (vminvq_u8(vandq_u8(validHi, validLo)) == 0) {
+			*invalid = 1;
+			return i;
+		}
+		vst1q_u8(output + i, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
+	return i;
+}
+#endif /* BCTBX_NEON_CODECS */
+
+static void hex_encode(uint8_t *output, const uint8_t *input, size_t input_length) {
+	size_t i = 0;
+#ifdef BCTBX_X86_INTRINSICS
+	uint32_t features = bctbx_cpu_features();
+	if (features & BCTBX_CPU_FEATURE_AVX2) {
+		i = hex_encode_avx2(output, input, input_length);
+	} else if (features & BCTBX_CPU_FEATURE_SSSE3) {
+		i = hex_encode_ssse3(output, input, input_length);
+	}
+#elif defined(BCTBX_NEON_CODECS)
+	i = hex_encode_neon(output, input, input_length);
+#endif
+	for (; i < input_length; i++) {
+		output[2*i] = hex_chars[input[i] >> 4];
+		output[2*i+1] = hex_chars[input[i] & 0x0F];
+	}
+}
+
+/* decode output_length bytes from 2*output_length hex chars, return 0 or -1 if a char is not hexadecimal */
+static int hex_decode(uint8_t *output, const uint8_t *input, size_t output_length) {
+	size_t i = 0;
+	int invalid = 0;
+#ifdef BCTBX_X86_INTRINSICS
+	uint32_t features = bctbx_cpu_features();
+	if (features & BCTBX_CPU_FEATURE_AVX2) {
+		i = hex_decode_avx2(output, input, output_length, &invalid);
+	} else if (features & BCTBX_CPU_FEATURE_SSSE3) {
+		i = hex_decode_ssse3(output, input, output_length, &invalid);
+	}
+#elif defined(BCTBX_NEON_CODECS)
+	i = hex_decode_neon(output, input, output_length, &invalid);
+#endif
+	if (invalid) return -1;
+	for (; i < output_length; i++) {
+		uint8_t hi = hex_value(input[2*i]);
+		uint8_t lo = hex_value(input[2*i+1]);
+		if ((hi | lo) == 0xFF) return -1;
+		output[i] = (uint8_t)(hi << 4 | lo);
+	}
+	return 0;
+}
+
+int32_t bctbx_hex_encode(char *output, size_t *output_length, const uint8_t *input, size_t input_length) {
+	if (input_length > (SIZE_MAX - 1) / 2) {
+		*output_length = SIZE_MAX;
+		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	if (output == NULL || *output_length < 2*input_length + 1) {
+		*output_length = 2*input_length + 1;
+		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	hex_encode((uint8_t *)output, input, input_length);
+	output[2*input_length] = '\0';
+	*output_length = 2*input_length;
+	return 0;
+}
+
+int32_t bctbx_hex_decode(uint8_t *output, size_t *output_length, const char *input, size_t input_length) {
+	if (input_length % 2 != 0) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	if (output == NULL || *output_length < input_length / 2) {
+		*output_length = input_length / 2;
+		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	if (hex_decode(output, (const uint8_t *)input, input_length / 2) != 0) {
+		return BCTBX_ERROR_INVALID_INPUT_DATA;
+	}
+	*output_length = input_length / 2;
+	return 0;
+}
+
+void bctbx_str_to_uint8(uint8_t *output_bytes, const uint8_t *input_string, size_t input_string_length) {
+	size_t i;
+	if (hex_decode(output_bytes, input_string, input_string_length / 2) == 0) {
+		return;
+	}
+	/* not hexadecimal: keep the historical behaviour, invalid chars are read as 0 */
+	for (i=0; i<input_string_length/2; i++) {
+		output_bytes[i] = (bctbx_char_to_byte(input_string[2*i]))<<4 | bctbx_char_to_byte(input_string[2*i+1]);
+	}
+}
+
+void bctbx_int8_to_str(uint8_t *output_string, const uint8_t *input_bytes, size_t input_bytes_length) {
+	hex_encode(output_string, input_bytes, input_bytes_length);
+}
+
+/*****************************************************************************/
+/***** Base64                                                            *****/
+/*****************************************************************************/
+#ifdef BCTBX_X86_INTRINSICS
+/* 12 bytes -> 16 chars per iteration, reading 16 bytes */
+BCTBX_TARGET("ssse3")
+static size_t base64_encode_ssse3(uint8_t *output, const uint8_t *input, size_t input_length) {
+	/* offset to add to each 6 bits value, selected by range: A-Z, a-z, 0-9, '+', '/' */
+	const __m128i offsets = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	size_t i, j;
+	for (i = 0, j = 0; i + 16 <= input_length; i += 12, j += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i *)(input + i));
+		/* spread each 3 bytes on 4 bytes then move each 6 bits group to its own byte */
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+		__m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+		__m128i values = _mm_or_si128(t0, t1);
+		/* range index: 0 for A-Z, 1 for a-z, 2-11 for 0-9, 12 for '+', 13 for '/' */
+		__m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+		range = _mm_sub_epi8(range, _mm_cmpgt_epi8(values, _mm_set1_epi8(25)));
+		_mm_storeu_si128((__m128i *)(output + j), _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range)));
+	}
+	return i;
+}
+
+/* 16 chars -> 12 bytes per iteration, writing 16 bytes. Stops at the first char out of the alphabet */
+BCTBX_TARGET("ssse3")
+static size_t base64_decode_ssse3(uint8_t *output, const uint8_t *input, size_t input_length, size_t output_size) {
+	/* a char is in the alphabet when the flags selected by its low and high nibbles have no bit in common */
+	const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask2F = _mm_set1_epi8(0x2F);
+	size_t i, j;
+	for (i = 0, j = 0; i + 16 <= input_length && j + 16 <= output_size; i += 16, j += 12) {
+		__m128i in = _mm_loadu_si128((const __m128i *)(input + i));
+		__m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+		__m128i flags = _mm_and_si128(_mm_shuffle_epi8(lutLo, _mm_and_si128(in, mask2F)), _mm_shuffle_epi8(lutHi, hiNibbles));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(flags, _mm_setzero_si128())) != 0xFFFF) {
+			break;
+		}
+		/* char -> 6 bits value, '/' shares its high nibble with '+' and needs its own offset */
+		__m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask2F), hiNibbles));
+		__m128i values = _mm_add_epi8(in, roll);
+		/* pack 4 x 6 bits in 3 bytes */
+		__m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+		merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storeu_si128((__m128i *)(output + j), merged);
+	}
+	return i;
+}
+#endif /* BCTBX_X86_INTRINSICS */
+
+static void base64_encode(uint8_t *output, const uint8_t *input, size_t input_length) {
+	size_t i = 0, j;
+#ifdef BCTBX_X86_INTRINSICS
+	if (bctbx_cpu_features() & BCTBX_CPU_FEATURE_SSSE3) {
+		i = base64_encode_ssse3(output, input, input_length);
+	}
+#endif
+	for (j = i / 3 * 4; i + 3 <= input_length; i += 3, j += 4) {
+		uint32_t block = (uint32_t)input[i] << 16 | (uint32_t)input[i+1] << 8 | input[i+2];
+		output[j] = base64_chars[block >> 18];
+		output[j+1] = base64_chars[(block >> 12) & 0x3F];
+		output[j+2] = base64_chars[(block >> 6) & 0x3F];
+		output[j+3] = base64_chars[block & 0x3F];
+	}
+	if (i < input_length) {
+		uint32_t block = (uint32_t)input[i] << 16 | ((i + 1 < input_length) ? (uint32_t)input[i+1] << 8 : 0);
+		output[j] = base64_chars[block >> 18];
+		output[j+1] = base64_chars[(block >> 12) & 0x3F];
+		output[j+2] = (i + 1 < input_length) ? base64_chars[(block >> 6) & 0x3F] : '=';
+		output[j+3] = '=';
+	}
+}
+
+/*
+ * Decode a padded base64 string without line breaks, input_length is a non zero multiple of 4.
+ * output may be NULL to only validate the input. Return the decoded length or -1 if the input is not valid.
+ */
+static long long base64_decode(uint8_t *output, const uint8_t *input, size_t input_length) {
+	size_t padding = (input[input_length-1] == '=') ? ((input[input_length-2] == '=') ? 2 : 1) : 0;
+	size_t decoded_length = input_length / 4 * 3 - padding;
+	size_t i = 0, j = 0;
+	uint8_t scratch[16];
+
+#ifdef BCTBX_X86_INTRINSICS
+	/* the last quartet may hold padding and is always done by the scalar code */
+	if (output != NULL && (bctbx_cpu_features() & BCTBX_CPU_FEATURE_SSSE3)) {
+		i = base64_decode_ssse3(output, input, input_length - 4, decoded_length);
+		j = i / 4 * 3;
+	}
+#endif
+	for (; i < input_length; i += 4) {
+		uint8_t a = base64_values[input[i]], b = base64_values[input[i+1]];
+		uint8_t c = base64_values[input[i+2]], d = base64_values[input[i+3]];
+		uint8_t *out = (output != NULL) ? output + j : scratch;
+		if (i + 4 == input_length && padding > 0) { /* the padding is only allowed in the last quartet */
+			if ((a | b) == 0xFF || (padding == 1 && c == 0xFF)) return -1;
+			out[0] = (uint8_t)(a << 2 | b >> 4);
+			if (padding == 1) out[1] = (uint8_t)(b << 4 | c >> 2);
+			break;
+		}
+		if ((a | b | c | d) == 0xFF) return -1;
+		out[0] = (uint8_t)(a << 2 | b >> 4);
+		out[1] = (uint8_t)(b << 4 | c >> 2);
+		out[2] = (uint8_t)(c << 6 | d);
+		j += 3;
+	}
+	return (long long)decoded_length;
+}
+
+int32_t bctbx_base64_encode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length) {
+	size_t encoded_length;
+	if (input_length > (SIZE_MAX - 1) / 4 * 3) {
+		*output_length = SIZE_MAX;
+		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	encoded_length = (input_length + 2) / 3 * 4;
+	if (output == NULL || *output_length < encoded_length + 1) {
+		*output_length = encoded_length + 1;
+		return BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	base64_encode(output, input, input_length);
+	output[encoded_length] = '\0';
+	*output_length = encoded_length;
+	return 0;
+}
+
+int32_t bctbx_base64_decode(unsigned char *output, size_t *output_length, const unsigned char *input, size_t input_length) {
+	unsigned char *stripped = NULL;
+	long long decoded_length;
+	int32_t ret = 0;
+
+	/* PEM payloads are split in lines: work on a copy without the line breaks */
+	if (memchr(input, '\n', input_length) != NULL || memchr(input, '\r', input_length) != NULL) {
+		size_t i, stripped_length = 0;
+		stripped = bctbx_malloc(input_length);
+		for (i = 0; i < input_length; i++) {
+			if (input[i] != '\n' && input[i] != '\r') {
+				stripped[stripped_length++] = input[i];
+			}
+		}
+		input = stripped;
+		input_length = stripped_length;
+	}
+
+	if (input_length == 0) {
+		*output_length = 0;
+		goto end;
+	}
+	if (input_length % 4 != 0) {
+		ret = BCTBX_ERROR_INVALID_BASE64_INPUT;
+		goto end;
+	}
+	/* validate before reporting the required length, so it is exact */
+	if (output == NULL || *output_length < input_length / 4 * 3) {
+		decoded_length = base64_decode(NULL, input, input_length);
+		if (decoded_length < 0) {
+			ret = BCTBX_ERROR_INVALID_BASE64_INPUT;
+		} else if (output == NULL || *output_length < (size_t)decoded_length) {
+			*output_length = (size_t)decoded_length;
+			ret = BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+		}
+		if (ret != 0) goto end;
+	}
+	decoded_length = base64_decode(output, input, input_length);
+	if (decoded_length < 0) {
+		ret = BCTBX_ERROR_INVALID_BASE64_INPUT;
+		goto end;
+	}
+	*output_length = (size_t)decoded_length;
+
+end:
+	if (stripped != NULL) bctbx_free(stripped);
+	return ret;
+}
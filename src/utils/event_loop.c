@@ -0,0 +1,676 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/event_loop.h"
+#include "bctoolbox/logging.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define BCTBX_EVENT_LOOP_EPOLL 1
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+#ifdef _WIN32
+#define bctbx_poll WSAPoll
+typedef WSAPOLLFD bctbx_pollfd_t;
+#elif !defined(BCTBX_EVENT_LOOP_EPOLL)
+#define bctbx_poll poll
+typedef struct pollfd bctbx_pollfd_t;
+#endif
+
+/* wheel of 1ms slots, a timer further away than one revolution is visited once per revolution until it expires */
+#define BCTBX_TIMER_WHEEL_SLOTS 1024
+#define BCTBX_TIMER_WHEEL_MASK (BCTBX_TIMER_WHEEL_SLOTS - 1)
+#define BCTBX_TIMER_STOPPED -1
+#define BCTBX_TIMER_EXPIRED -2
+
+#define BCTBX_EVENT_LOOP_MAX_EVENTS 256
+
+/* circular doubly linked list, the slots heads are sentinels so that a timer is unlinked without knowing its list */
+typedef struct _bctbx_timer_link_t {
+	struct _bctbx_timer_link_t *prev;
+	struct _bctbx_timer_link_t *next;
+} bctbx_timer_link_t;
+
+struct _bctbx_event_timer_t {
+	bctbx_timer_link_t link; /* first member: a link is cast back to its timer */
+	bctbx_event_loop_t *loop;
+	bctbx_event_timer_callback_t callback;
+	void *userData;
+	uint64_t expiry;
+	uint64_t interval;
+	int slot; /* index in the wheel, or BCTBX_TIMER_STOPPED/BCTBX_TIMER_EXPIRED */
+};
+
+struct _bctbx_event_source_t {
+	bctbx_event_loop_t *loop;
+	bctbx_socket_t fd;
+	int events;
+	bctbx_event_source_callback_t callback;
+	void *userData;
+	bool_t removed;
+	struct _bctbx_event_source_t *nextRemoved;
+#ifndef BCTBX_EVENT_LOOP_EPOLL
+	size_t index; /* in loop->sources */
+#endif
+};
+
+typedef struct _bctbx_event_task_t {
+	bctbx_event_loop_task_t task;
+	void *userData;
+	struct _bctbx_event_task_t *next;
+} bctbx_event_task_t;
+
+struct _bctbx_event_loop_t {
+	uint64_t now; /* ms, monotonic, updated after each wait */
+
+	bctbx_timer_link_t wheel[BCTBX_TIMER_WHEEL_SLOTS];
+	uint64_t wheelBitmap[BCTBX_TIMER_WHEEL_SLOTS / 64]; /* non empty slots */
+	uint64_t wheelTime; /* last tick processed */
+	size_t runningTimers;
+
+	bctbx_mutex_t lock; /* protects the posted tasks and the stop request */
+	bctbx_event_task_t *tasksHead;
+	bctbx_event_task_t *tasksTail;
+	bool_t stopRequested;
+
+	bool_t dispatching;
+	bctbx_event_source_t *removedSources; /* freed at the end of the iteration that removed them */
+
+#ifdef BCTBX_EVENT_LOOP_EPOLL
+	int epollFd;
+	int wakeupFd; /* eventfd */
+#else
+	bctbx_event_source_t **sources;
+	size_t sourcesCount;
+	size_t sourcesSize;
+	bctbx_pollfd_t *pollFds; /* rebuilt at each iteration, with the matching sources snapshot */
+	bctbx_event_source_t **pollSources;
+	size_t pollSize;
+	bctbx_socket_t wakeupFds[2]; /* pipe, or a loopback UDP socket sending to itself on Windows */
+#endif
+};
+
+static uint64_t event_loop_time(void) {
+	bctoolboxTimeSpec ts;
+	bctbx_get_cur_time(&ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*
+ * Timer wheel
+ */
+
+static void timer_link_init(bctbx_timer_link_t *link) {
+	link->prev = link->next = link;
+}
+
+static void timer_link_insert(bctbx_timer_link_t *head, bctbx_timer_link_t *link) {
+	link->prev = head->prev;
+	link->next = head;
+	head->prev->next = link;
+	head->prev = link;
+}
+
+static void timer_link_remove(bctbx_timer_link_t *link) {
+	link->prev->next = link->next;
+	link->next->prev = link->prev;
+	timer_link_init(link);
+}
+
+static void timer_unlink(bctbx_event_timer_t *timer) {
+	bctbx_event_loop_t *loop = timer->loop;
+	if (timer->slot == BCTBX_TIMER_STOPPED) return;
+	timer_link_remove(&timer->link);
+	if (timer->slot >= 0) {
+		bctbx_timer_link_t *head = &loop->wheel[timer->slot];
+		if (head->next == head) loop->wheelBitmap[timer->slot / 64] &= ~((uint64_t)1 << (timer->slot % 64));
+	}
+	timer->slot = BCTBX_TIMER_STOPPED;
+	loop->runningTimers--;
+}
+
+static void timer_link_in_wheel(bctbx_event_timer_t *timer) {
+	bctbx_event_loop_t *loop = timer->loop;
+	/* a timer already due goes in the next slot visited */
+	if (timer->expiry <= loop->wheelTime) timer->expiry = loop->wheelTime + 1;
+	timer->slot = (int)(timer->expiry & BCTBX_TIMER_WHEEL_MASK);
+	timer_link_insert(&loop->wheel[timer->slot], &timer->link);
+	loop->wheelBitmap[timer->slot / 64] |= (uint64_t)1 << (timer->slot % 64);
+	loop->runningTimers++;
+}
+
+static int event_loop_process_timers(bctbx_event_loop_t *loop) {
+	bctbx_timer_link_t expired;
+	uint64_t ticks;
+	uint64_t tick;
+	int dispatched = 0;
+
+	if (loop->now <= loop->wheelTime) return 0;
+	if (loop->runningTimers == 0) {
+		loop->wheelTime = loop->now;
+		return 0;
+	}
+	timer_link_init(&expired);
+	/* past one revolution, every slot has been visited */
+	ticks = loop->now - loop->wheelTime;
+	if (ticks > BCTBX_TIMER_WHEEL_SLOTS) ticks = BCTBX_TIMER_WHEEL_SLOTS;
+	for (tick = loop->wheelTime + 1; tick <= loop->wheelTime + ticks; tick++) {
+		int slot = (int)(tick & BCTBX_TIMER_WHEEL_MASK);
+		bctbx_timer_link_t *head = &loop->wheel[slot];
+		bctbx_timer_link_t *link;
+		if ((loop->wheelBitmap[slot / 64] & ((uint64_t)1 << (slot % 64))) == 0) continue;
+		for (link = head->next; link != head;) {
+			bctbx_event_timer_t *timer = (bctbx_event_timer_t *)link;
+			link = link->next;
+			if (timer->expiry <= loop->now) {
+				timer_unlink(timer);
+				timer_link_insert(&expired, &timer->link);
+				timer->slot = BCTBX_TIMER_EXPIRED;
+				loop->runningTimers++;
+			}
+		}
+	}
+	loop->wheelTime = loop->now;
+
+	/* callbacks may stop, restart or free any timer, including the ones still in the expired list */
+	while (expired.next != &expired) {
+		bctbx_event_timer_t *timer = (bctbx_event_timer_t *)expired.next;
+		timer_unlink(timer);
+		if (timer->interval > 0) {
+			timer->expiry += timer->interval;
+			/* late by more than a period: skip the missed expiries */
+			if (timer->expiry <= loop->now) timer->expiry = loop->now + timer->interval;
+			timer_link_in_wheel(timer);
+		}
+		timer->callback(timer->userData, timer);
+		dispatched++;
+	}
+	return dispatched;
+}
+
+/* delay until the next timer expiry, -1 if there is none */
+static int event_loop_next_timer(bctbx_event_loop_t *loop) {
+	uint64_t tick;
+
+	if (loop->runningTimers == 0) return -1;
+	for (tick = loop->wheelTime + 1; tick <= loop->wheelTime + BCTBX_TIMER_WHEEL_SLOTS; tick++) {
+		int slot = (int)(tick & BCTBX_TIMER_WHEEL_MASK);
+		bctbx_timer_link_t *head = &loop->wheel[slot];
+		bctbx_timer_link_t *link;
+		if (loop->wheelBitmap[slot / 64] == 0) {
+			tick |= 63; /* skip the rest of the empty word */
+			continue;
+		}
+		if ((loop->wheelBitmap[slot / 64] & ((uint64_t)1 << (slot % 64))) == 0) continue;
+		for (link = head->next; link != head; link = link->next) {
+			if (((bctbx_event_timer_t *)link)->expiry == tick) {
+				return tick <= loop->now ? 0 : (int)(tick - loop->now);
+			}
+		}
+	}
+	/* everything is at least one revolution away */
+	return BCTBX_TIMER_WHEEL_SLOTS;
+}
+
+bctbx_event_timer_t *bctbx_event_timer_new(bctbx_event_loop_t *loop, bctbx_event_timer_callback_t callback, void *user_data) {
+	bctbx_event_timer_t *timer = bctbx_new0(bctbx_event_timer_t, 1);
+	timer_link_init(&timer->link);
+	timer->loop = loop;
+	timer->callback = callback;
+	timer->userData = user_data;
+	timer->slot = BCTBX_TIMER_STOPPED;
+	return timer;
+}
+
+void bctbx_event_timer_start(bctbx_event_timer_t *timer, uint64_t delay_ms, uint64_t interval_ms) {
+	timer_unlink(timer);
+	timer->expiry = timer->loop->now + delay_ms;
+	timer->interval = interval_ms;
+	timer_link_in_wheel(timer);
+}
+
+void bctbx_event_timer_stop(bctbx_event_timer_t *timer) {
+	timer_unlink(timer);
+}
+
+bool_t bctbx_event_timer_is_running(const bctbx_event_timer_t *timer) {
+	return timer->slot != BCTBX_TIMER_STOPPED;
+}
+
+void bctbx_event_timer_free(bctbx_event_timer_t *timer) {
+	timer_unlink(timer);
+	bctbx_free(timer);
+}
+
+/*
+ * Posted tasks
+ */
+
+static int event_loop_run_tasks(bctbx_event_loop_t *loop) {
+	bctbx_event_task_t *tasks;
+	int dispatched = 0;
+
+	bctbx_mutex_lock(&loop->lock);
+	tasks = loop->tasksHead;
+	loop->tasksHead = loop->tasksTail = NULL;
+	bctbx_mutex_unlock(&loop->lock);
+	while (tasks) {
+		bctbx_event_task_t *next = tasks->next;
+		tasks->task(tasks->userData);
+		bctbx_free(tasks);
+		tasks = next;
+		dispatched++;
+	}
+	return dispatched;
+}
+
+static bool_t event_loop_has_tasks(bctbx_event_loop_t *loop) {
+	bool_t ret;
+	bctbx_mutex_lock(&loop->lock);
+	ret = loop->tasksHead != NULL || loop->stopRequested;
+	bctbx_mutex_unlock(&loop->lock);
+	return ret;
+}
+
+void bctbx_event_loop_post(bctbx_event_loop_t *loop, bctbx_event_loop_task_t task, void *user_data) {
+	bctbx_event_task_t *t = bctbx_new0(bctbx_event_task_t, 1);
+	t->task = task;
+	t->userData = user_data;
+	bctbx_mutex_lock(&loop->lock);
+	if (loop->tasksTail) loop->tasksTail->next = t;
+	else loop->tasksHead = t;
+	loop->tasksTail = t;
+	bctbx_mutex_unlock(&loop->lock);
+	bctbx_event_loop_wakeup(loop);
+}
+
+void bctbx_event_loop_stop(bctbx_event_loop_t *loop) {
+	bctbx_mutex_lock(&loop->lock);
+	loop->stopRequested = TRUE;
+	bctbx_mutex_unlock(&loop->lock);
+	bctbx_event_loop_wakeup(loop);
+}
+
+/*
+ * Sources, epoll
+ */
+
+#ifdef BCTBX_EVENT_LOOP_EPOLL
+
+static uint32_t to_epoll_events(int events) {
+	uint32_t ret = EPOLLET;
+	if (events & BCTBX_EVENT_READ) ret |= EPOLLIN;
+	if (events & BCTBX_EVENT_WRITE) ret |= EPOLLOUT;
+	return ret;
+}
+
+static int event_loop_init_backend(bctbx_event_loop_t *loop) {
+	struct epoll_event event = {0};
+
+	loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epollFd == -1) {
+		bctbx_error("bctbx_event_loop: epoll_create1() failed: %s", strerror(errno));
+		return -1;
+	}
+	loop->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (loop->wakeupFd == -1) {
+		bctbx_error("bctbx_event_loop: eventfd() failed: %s", strerror(errno));
+		close(loop->epollFd);
+		return -1;
+	}
+	/* a NULL data pointer designates the wake up descriptor */
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = NULL;
+	epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeupFd, &event);
+	return 0;
+}
+
+static void event_loop_uninit_backend(bctbx_event_loop_t *loop) {
+	close(loop->wakeupFd);
+	close(loop->epollFd);
+}
+
+void bctbx_event_loop_wakeup(bctbx_event_loop_t *loop) {
+	uint64_t one = 1;
+	if (write(loop->wakeupFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		bctbx_error("bctbx_event_loop: cannot wake up: %s", strerror(errno));
+	}
+}
+
+static int event_loop_add_backend(bctbx_event_loop_t *loop, bctbx_event_source_t *source) {
+	struct epoll_event event = {0};
+	event.events = to_epoll_events(source->events);
+	event.data.ptr = source;
+	if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, source->fd, &event) == -1) {
+		bctbx_error("bctbx_event_loop: cannot watch fd %d: %s", source->fd, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int event_loop_modify_backend(bctbx_event_loop_t *loop, bctbx_event_source_t *source) {
+	struct epoll_event event = {0};
+	event.events = to_epoll_events(source->events);
+	event.data.ptr = source;
+	return epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, source->fd, &event) == -1 ? -1 : 0;
+}
+
+static void event_loop_remove_backend(bctbx_event_loop_t *loop, bctbx_event_source_t *source) {
+	/* the kernel may drop the registration by itself when the fd was closed: ignore errors */
+	epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, source->fd, NULL);
+}
+
+static int event_loop_wait(bctbx_event_loop_t *loop, int timeout) {
+	struct epoll_event events[BCTBX_EVENT_LOOP_MAX_EVENTS];
+	int dispatched = 0;
+	int count;
+	int i;
+
+	count = epoll_wait(loop->epollFd, events, BCTBX_EVENT_LOOP_MAX_EVENTS, timeout);
+	if (count < 0) {
+		if (errno == EINTR) return 0;
+		bctbx_error("bctbx_event_loop: epoll_wait() failed: %s", strerror(errno));
+		return -1;
+	}
+	loop->now = event_loop_time();
+	for (i = 0; i < count; i++) {
+		bctbx_event_source_t *source = (bctbx_event_source_t *)events[i].data.ptr;
+		int ready = 0;
+		if (source == NULL) {
+			uint64_t value;
+			if (read(loop->wakeupFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+				bctbx_error("bctbx_event_loop: cannot read wake up: %s", strerror(errno));
+			}
+			continue;
+		}
+		if (source->removed) continue;
+		if (events[i].events & EPOLLIN) ready |= BCTBX_EVENT_READ;
+		if (events[i].events & EPOLLOUT) ready |= BCTBX_EVENT_WRITE;
+		if (events[i].events & (EPOLLERR | EPOLLHUP)) ready |= BCTBX_EVENT_ERROR;
+		source->callback(source->userData, source->fd, ready);
+		dispatched++;
+	}
+	return dispatched;
+}
+
+#else /* BCTBX_EVENT_LOOP_EPOLL */
+
+/*
+ * Sources, poll
+ */
+
+static int event_loop_init_backend(bctbx_event_loop_t *loop) {
+#ifdef _WIN32
+	struct sockaddr_in address = {0};
+	int addressLength = sizeof(address);
+	u_long nonBlock = 1;
+
+	loop->wakeupFds[0] = loop->wakeupFds[1] = socket(AF_INET, SOCK_DGRAM, 0);
+	if (loop->wakeupFds[0] == INVALID_SOCKET) return -1;
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(loop->wakeupFds[0], (struct sockaddr *)&address, sizeof(address)) != 0
+		|| getsockname(loop->wakeupFds[0], (struct sockaddr *)&address, &addressLength) != 0
+		|| connect(loop->wakeupFds[0], (struct sockaddr *)&address, addressLength) != 0) {
+		bctbx_error("bctbx_event_loop: cannot create the wake up socket: %s", getSocketError());
+		closesocket(loop->wakeupFds[0]);
+		return -1;
+	}
+	ioctlsocket(loop->wakeupFds[0], FIONBIO, &nonBlock);
+#else
+	if (pipe(loop->wakeupFds) != 0) {
+		bctbx_error("bctbx_event_loop: pipe() failed: %s", strerror(errno));
+		return -1;
+	}
+	fcntl(loop->wakeupFds[0], F_SETFL, O_NONBLOCK);
+	fcntl(loop->wakeupFds[1], F_SETFL, O_NONBLOCK);
+#endif
+	return 0;
+}
+
+static void event_loop_uninit_backend(bctbx_event_loop_t *loop) {
+#ifdef _WIN32
+	closesocket(loop->wakeupFds[0]);
+#else
+	close(loop->wakeupFds[0]);
+	close(loop->wakeupFds[1]);
+#endif
+	bctbx_free(loop->sources);
+	bctbx_free(loop->pollFds);
+	bctbx_free(loop->pollSources);
+}
+
+void bctbx_event_loop_wakeup(bctbx_event_loop_t *loop) {
+	char c = 0;
+	/* a full pipe already wakes the loop up */
+#ifdef _WIN32
+	send(loop->wakeupFds[1], &c, 1, 0);
+#else
+	if (write(loop->wakeupFds[1], &c, 1) < 0 && errno != EAGAIN) {
+		bctbx_error("bctbx_event_loop: cannot wake up: %s", strerror(errno));
+	}
+#endif
+}
+
+static short to_poll_events(int events) {
+	short ret = 0;
+	if (events & BCTBX_EVENT_READ) ret |= POLLIN;
+	if (events & BCTBX_EVENT_WRITE) ret |= POLLOUT;
+	return ret;
+}
+
+static int event_loop_add_backend(bctbx_event_loop_t *loop, bctbx_event_source_t *source) {
+	if (loop->sourcesCount == loop->sourcesSize) {
+		loop->sourcesSize = loop->sourcesSize ? 2 * loop->sourcesSize : 16;
+		loop->sources = (bctbx_event_source_t **)bctbx_realloc(loop->sources, loop->sourcesSize * sizeof(bctbx_event_source_t *));
+	}
+	source->index = loop->sourcesCount;
+	loop->sources[loop->sourcesCount++] = source;
+	return 0;
+}
+
+static int event_loop_modify_backend(bctbx_event_loop_t *loop, bctbx_event_source_t *source) {
+	return 0;
+}
+
+static void event_loop_remove_backend(bctbx_event_loop_t *loop, bctbx_event_source_t *source) {
+	bctbx_event_source_t *last = loop->sources[--loop->sourcesCount];
+	last->index = source->index;
+	loop->sources[source->index] = last;
+}
+
+static int event_loop_wait(bctbx_event_loop_t *loop, int timeout) {
+	size_t count = loop->sourcesCount + 1;
+	int dispatched = 0;
+	int ret;
+	size_t i;
+
+	if (count > loop->pollSize) {
+		loop->pollSize = count;
+		loop->pollFds = (bctbx_pollfd_t *)bctbx_realloc(loop->pollFds, count * sizeof(bctbx_pollfd_t));
+		loop->pollSources = (bctbx_event_source_t **)bctbx_realloc(loop->pollSources, count * sizeof(bctbx_event_source_t *));
+	}
+	loop->pollFds[0].fd = loop->wakeupFds[0];
+	loop->pollFds[0].events = POLLIN;
+	loop->pollFds[0].revents = 0;
+	for (i = 1; i < count; i++) {
+		bctbx_event_source_t *source = loop->sources[i - 1];
+		loop->pollSources[i] = source;
+		loop->pollFds[i].fd = source->fd;
+		loop->pollFds[i].events = to_poll_events(source->events);
+		loop->pollFds[i].revents = 0;
+	}
+	ret = bctbx_poll(loop->pollFds, (unsigned long)count, timeout);
+	if (ret < 0) {
+#ifndef _WIN32
+		if (errno == EINTR) return 0;
+#endif
+		bctbx_error("bctbx_event_loop: poll() failed: %s", getSocketError());
+		return -1;
+	}
+	loop->now = event_loop_time();
+	if (loop->pollFds[0].revents) {
+		char buf[64];
+		/* non blocking: empty the wake up descriptor */
+#ifdef _WIN32
+		while (recv(loop->wakeupFds[0], buf, sizeof(buf), 0) > 0);
+#else
+		while (read(loop->wakeupFds[0], buf, sizeof(buf)) > 0);
+#endif
+	}
+	for (i = 1; i < count && ret > 0; i++) {
+		bctbx_event_source_t *source = loop->pollSources[i];
+		short revents = loop->pollFds[i].revents;
+		int ready = 0;
+		if (revents == 0) continue;
+		ret--;
+		if (source->removed) continue;
+		if (revents & POLLIN) ready |= BCTBX_EVENT_READ;
+		if (revents & POLLOUT) ready |= BCTBX_EVENT_WRITE;
+		if (revents & (POLLERR | POLLHUP | POLLNVAL)) ready |= BCTBX_EVENT_ERROR;
+		source->callback(source->userData, source->fd, ready);
+		dispatched++;
+	}
+	return dispatched;
+}
+
+#endif /* BCTBX_EVENT_LOOP_EPOLL */
+
+bctbx_event_source_t *bctbx_event_loop_add_source(bctbx_event_loop_t *loop, bctbx_socket_t fd, int events, bctbx_event_source_callback_t callback, void *user_data) {
+	bctbx_event_source_t *source = bctbx_new0(bctbx_event_source_t, 1);
+	source->loop = loop;
+	source->fd = fd;
+	source->events = events;
+	source->callback = callback;
+	source->userData = user_data;
+	if (event_loop_add_backend(loop, source) != 0) {
+		bctbx_free(source);
+		return NULL;
+	}
+	return source;
+}
+
+int bctbx_event_source_set_events(bctbx_event_source_t *source, int events) {
+	source->events = events;
+	return event_loop_modify_backend(source->loop, source);
+}
+
+void bctbx_event_source_remove(bctbx_event_source_t *source) {
+	bctbx_event_loop_t *loop = source->loop;
+	event_loop_remove_backend(loop, source);
+	if (loop->dispatching) {
+		/* events for it may still be pending in this iteration */
+		source->removed = TRUE;
+		source->nextRemoved = loop->removedSources;
+		loop->removedSources = source;
+	} else {
+		bctbx_free(source);
+	}
+}
+
+/*
+ * Loop
+ */
+
+bctbx_event_loop_t *bctbx_event_loop_new(void) {
+	bctbx_event_loop_t *loop = bctbx_new0(bctbx_event_loop_t, 1);
+	int i;
+
+	if (event_loop_init_backend(loop) != 0) {
+		bctbx_free(loop);
+		return NULL;
+	}
+	for (i = 0; i < BCTBX_TIMER_WHEEL_SLOTS; i++) {
+		timer_link_init(&loop->wheel[i]);
+	}
+	loop->now = event_loop_time();
+	loop->wheelTime = loop->now;
+	bctbx_mutex_init(&loop->lock, NULL);
+	return loop;
+}
+
+void bctbx_event_loop_free(bctbx_event_loop_t *loop) {
+	bctbx_event_task_t *task = loop->tasksHead;
+	if (loop->runningTimers > 0) bctbx_warning("bctbx_event_loop: freed with %d timers running", (int)loop->runningTimers);
+	while (task) {
+		bctbx_event_task_t *next = task->next;
+		bctbx_free(task);
+		task = next;
+	}
+	event_loop_uninit_backend(loop);
+	bctbx_mutex_destroy(&loop->lock);
+	bctbx_free(loop);
+}
+
+int bctbx_event_loop_run_once(bctbx_event_loop_t *loop, int timeout_ms) {
+	int dispatched = 0;
+	int nextTimer;
+	int ret;
+
+	loop->dispatching = TRUE;
+	loop->now = event_loop_time();
+	dispatched += event_loop_process_timers(loop);
+	dispatched += event_loop_run_tasks(loop);
+
+	nextTimer = event_loop_next_timer(loop);
+	if (dispatched > 0 || event_loop_has_tasks(loop)) timeout_ms = 0;
+	else if (nextTimer >= 0 && (timeout_ms < 0 || nextTimer < timeout_ms)) timeout_ms = nextTimer;
+
+	ret = event_loop_wait(loop, timeout_ms);
+	if (ret >= 0) {
+		dispatched += ret;
+		dispatched += event_loop_process_timers(loop);
+		dispatched += event_loop_run_tasks(loop);
+	}
+
+	loop->dispatching = FALSE;
+	while (loop->removedSources) {
+		bctbx_event_source_t *next = loop->removedSources->nextRemoved;
+		bctbx_free(loop->removedSources);
+		loop->removedSources = next;
+	}
+	return ret < 0 ? -1 : dispatched;
+}
+
+uint64_t bctbx_event_loop_get_time_ms(const bctbx_event_loop_t *loop) {
+	return loop->now;
+}
+
+void bctbx_event_loop_update_time(bctbx_event_loop_t *loop) {
+	loop->now = event_loop_time();
+}
+
+void bctbx_event_loop_run(bctbx_event_loop_t *loop) {
+	while (TRUE) {
+		bool_t stop;
+		bctbx_mutex_lock(&loop->lock);
+		stop = loop->stopRequested;
+		loop->stopRequested = FALSE;
+		bctbx_mutex_unlock(&loop->lock);
+		if (stop) break;
+		if (bctbx_event_loop_run_once(loop, -1) < 0) break;
+	}
+}
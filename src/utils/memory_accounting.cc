@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/allocator.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+/* keeps the blocks aligned like malloc does */
+constexpr size_t headerSize = 16;
+
+/* a thread publishes its share of the live bytes when it moved by this much, to maintain the peak */
+constexpr int64_t flushThreshold = 64 * 1024;
+
+struct Header {
+	size_t size;
+	size_t sampled;
+};
+static_assert(sizeof(Header) <= headerSize, "the block header does not fit");
+
+void *libcMalloc(size_t size) {
+	return malloc(size);
+}
+void *libcRealloc(void *ptr, size_t size) {
+	return realloc(ptr, size);
+}
+void libcFree(void *ptr) {
+	free(ptr);
+}
+
+/* written by their thread only, read when gathering the statistics */
+struct ThreadCounters {
+	std::atomic<uint64_t> allocations{0};
+	std::atomic<uint64_t> frees{0};
+	std::atomic<uint64_t> bytesAllocated{0};
+	std::atomic<uint64_t> bytesFreed{0};
+	int64_t pendingBytes = 0; /* not yet published to the live bytes */
+	unsigned int sampleCountdown = 0;
+	ThreadCounters *prev = nullptr;
+	ThreadCounters *next = nullptr;
+
+	static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+};
+
+struct Sample {
+	size_t size;
+	const char *tag;
+	uint64_t time;
+};
+
+class Accounting {
+public:
+	Accounting(const BctoolboxMemoryFunctions *underlying, unsigned int samplingInterval) : mSamplingInterval(samplingInterval) {
+		if (underlying) {
+			mUnderlying = *underlying;
+		} else {
+			mUnderlying.malloc_fun = libcMalloc;
+			mUnderlying.realloc_fun = libcRealloc;
+			mUnderlying.free_fun = libcFree;
+		}
+		mLastStatsTime = bctbx_get_cur_time_ms();
+	}
+
+	const BctoolboxMemoryFunctions &underlying() const {
+		return mUnderlying;
+	}
+
+	void registerCounters(ThreadCounters *counters) {
+		std::lock_guard<std::mutex> guard(mRegistryLock);
+		counters->next = mThreads;
+		if (mThreads) mThreads->prev = counters;
+		mThreads = counters;
+	}
+
+	void unregisterCounters(ThreadCounters *counters) {
+		std::lock_guard<std::mutex> guard(mRegistryLock);
+		accumulate(mRetired, *counters);
+		if (counters->prev) counters->prev->next = counters->next;
+		else mThreads = counters->next;
+		if (counters->next) counters->next->prev = counters->prev;
+	}
+
+	std::mutex &sharedLock() {
+		return mSharedLock;
+	}
+	ThreadCounters &sharedCounters() {
+		return mShared;
+	}
+
+	void allocated(ThreadCounters &counters, Header *header, void *ptr, size_t size, const char *tag) {
+		ThreadCounters::add(counters.allocations, 1);
+		ThreadCounters::add(counters.bytesAllocated, size);
+		moveLiveBytes(counters, (int64_t)size);
+		header->size = size;
+		header->sampled = 0;
+		if (mSamplingInterval == 0) return;
+		if (counters.sampleCountdown == 0) {
+			counters.sampleCountdown = mSamplingInterval;
+			header->sampled = 1;
+			std::lock_guard<std::mutex> guard(mSamplesLock);
+			mSamples[ptr] = {size, tag, bctbx_get_cur_time_ms()};
+		}
+		counters.sampleCountdown--;
+	}
+
+	void freed(ThreadCounters &counters, Header *header, void *ptr) {
+		ThreadCounters::add(counters.frees, 1);
+		ThreadCounters::add(counters.bytesFreed, header->size);
+		moveLiveBytes(counters, -(int64_t)header->size);
+		if (header->sampled) {
+			std::lock_guard<std::mutex> guard(mSamplesLock);
+			mSamples.erase(ptr);
+		}
+	}
+
+	/* a realloc is accounted as a free and an allocation, the recorded sample follows the block */
+	void reallocated(ThreadCounters &counters, Header *header, void *oldPtr, void *ptr, size_t oldSize, size_t size) {
+		ThreadCounters::add(counters.frees, 1);
+		ThreadCounters::add(counters.bytesFreed, oldSize);
+		ThreadCounters::add(counters.allocations, 1);
+		ThreadCounters::add(counters.bytesAllocated, size);
+		moveLiveBytes(counters, (int64_t)size - (int64_t)oldSize);
+		header->size = size;
+		if (header->sampled) {
+			std::lock_guard<std::mutex> guard(mSamplesLock);
+			auto it = mSamples.find(oldPtr);
+			if (it != mSamples.end()) {
+				Sample sample = it->second;
+				sample.size = size;
+				mSamples.erase(it);
+				mSamples[ptr] = sample;
+			}
+		}
+	}
+
+	void flush(ThreadCounters &counters) {
+		publish(counters.pendingBytes);
+		counters.pendingBytes = 0;
+	}
+
+	/* the rate window restarts only when resetRate is set, the other readers leave it to the application */
+	void getStats(bctbx_memory_stats_t *stats, bool resetRate) {
+		ThreadCounters total;
+		{
+			std::lock_guard<std::mutex> guard(mRegistryLock);
+			accumulate(total, mRetired);
+			accumulate(total, mShared);
+			for (ThreadCounters *counters = mThreads; counters; counters = counters->next) {
+				accumulate(total, *counters);
+			}
+		}
+		stats->allocations = total.allocations.load(std::memory_order_relaxed);
+		stats->frees = total.frees.load(std::memory_order_relaxed);
+		stats->bytesAllocated = total.bytesAllocated.load(std::memory_order_relaxed);
+		stats->liveBytes = (int64_t)(stats->bytesAllocated - total.bytesFreed.load(std::memory_order_relaxed));
+		stats->peakLiveBytes = std::max(mPeakLiveBytes.load(std::memory_order_relaxed), stats->liveBytes);
+
+		std::lock_guard<std::mutex> guard(mRateLock);
+		uint64_t now = bctbx_get_cur_time_ms();
+		stats->allocationsPerSecond = now > mLastStatsTime ? (double)(stats->allocations - mLastAllocations) * 1000.0 / (double)(now - mLastStatsTime) : 0.0;
+		if (!resetRate) return;
+		mLastStatsTime = now;
+		mLastAllocations = stats->allocations;
+	}
+
+	std::string getLeakReport(size_t maxEntries) {
+		struct TagUsage {
+			size_t count = 0;
+			uint64_t bytes = 0;
+			uint64_t oldest = UINT64_MAX;
+		};
+		std::map<std::string, TagUsage> usages;
+		size_t count = 0;
+		uint64_t bytes = 0;
+		{
+			std::lock_guard<std::mutex> guard(mSamplesLock);
+			for (const auto &sample : mSamples) {
+				TagUsage &usage = usages[sample.second.tag ? sample.second.tag : "(untagged)"];
+				usage.count++;
+				usage.bytes += sample.second.size;
+				usage.oldest = std::min(usage.oldest, sample.second.time);
+				count++;
+				bytes += sample.second.size;
+			}
+		}
+		std::vector<std::pair<std::string, TagUsage>> sorted(usages.begin(), usages.end());
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, TagUsage> &a, const std::pair<std::string, TagUsage> &b) {
+			return a.second.bytes > b.second.bytes;
+		});
+
+		std::ostringstream report;
+		uint64_t now = bctbx_get_cur_time_ms();
+		report << "Memory leak report: " << count << " recorded allocations alive, about " << bytes * mSamplingInterval << " bytes";
+		for (size_t i = 0; i < sorted.size() && i < maxEntries; i++) {
+			const TagUsage &usage = sorted[i].second;
+			report << "\n  " << sorted[i].first << ": " << usage.count << " allocations, about " << usage.bytes * mSamplingInterval
+			       << " bytes, oldest " << (now - usage.oldest) / 1000 << "s old";
+		}
+		return report.str();
+	}
+
+private:
+	void moveLiveBytes(ThreadCounters &counters, int64_t bytes) {
+		counters.pendingBytes += bytes;
+		if (counters.pendingBytes >= flushThreshold || counters.pendingBytes <= -flushThreshold) flush(counters);
+	}
+
+	void publish(int64_t bytes) {
+		if (bytes == 0) return;
+		int64_t live = mLiveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		int64_t peak = mPeakLiveBytes.load(std::memory_order_relaxed);
+		while (live > peak && !mPeakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+			;
+	}
+
+	static void accumulate(ThreadCounters &total, const ThreadCounters &counters) {
+		ThreadCounters::add(total.allocations, counters.allocations.load(std::memory_order_relaxed));
+		ThreadCounters::add(total.frees, counters.frees.load(std::memory_order_relaxed));
+		ThreadCounters::add(total.bytesAllocated, counters.bytesAllocated.load(std::memory_order_relaxed));
+		ThreadCounters::add(total.bytesFreed, counters.bytesFreed.load(std::memory_order_relaxed));
+	}
+
+	BctoolboxMemoryFunctions mUnderlying;
+	const unsigned int mSamplingInterval;
+
+	std::mutex mRegistryLock;
+	ThreadCounters *mThreads = nullptr;
+	ThreadCounters mRetired;
+	/* for the threads exiting, see CountersAccess */
+	std::mutex mSharedLock;
+	ThreadCounters mShared;
+
+	std::atomic<int64_t> mLiveBytes{0};
+	std::atomic<int64_t> mPeakLiveBytes{0};
+
+	std::mutex mSamplesLock;
+	std::unordered_map<void *, Sample> mSamples;
+
+	std::mutex mRateLock;
+	uint64_t mLastStatsTime;
+	uint64_t mLastAllocations = 0;
+};
+
+/* set up once, never destroyed: blocks may be freed until the very end of the process.
+ * Atomic because the statistics may be read by a thread that did not set it up. */
+std::atomic<Accounting *> accounting{nullptr};
+std::once_flag accountingOnce;
+
+struct CountersGuard {
+	~CountersGuard();
+};
+
+thread_local ThreadCounters *tlsCounters = nullptr;
+/* set once the thread is exiting, the allocations made by later thread_local destructors use the shared counters */
+thread_local bool tlsCountersDestroyed = false;
+thread_local const char *tlsTag = nullptr;
+
+CountersGuard::~CountersGuard() {
+	ThreadCounters *counters = tlsCounters;
+	tlsCounters = nullptr;
+	tlsCountersDestroyed = true;
+	if (counters) {
+		Accounting *a = accounting.load(std::memory_order_acquire);
+		a->flush(*counters);
+		a->unregisterCounters(counters);
+		delete counters;
+	}
+}
+
+class CountersAccess {
+public:
+	CountersAccess() {
+		if (!tlsCounters && !tlsCountersDestroyed) {
+			static thread_local CountersGuard guard;
+			(void)guard;
+			tlsCounters = new ThreadCounters();
+			accounting.load(std::memory_order_acquire)->registerCounters(tlsCounters);
+		}
+		if (!tlsCounters) mLock = std::unique_lock<std::mutex>(accounting.load(std::memory_order_acquire)->sharedLock());
+	}
+	ThreadCounters &get() {
+		return tlsCounters ? *tlsCounters : accounting.load(std::memory_order_acquire)->sharedCounters();
+	}
+
+private:
+	std::unique_lock<std::mutex> mLock;
+};
+
+void *accountingMalloc(size_t size) {
+	if (size > SIZE_MAX - headerSize) return nullptr;
+	Accounting *a = accounting.load(std::memory_order_acquire);
+	Header *header = (Header *)a->underlying().malloc_fun(headerSize + size);
+	if (!header) return nullptr;
+	void *ptr = (char *)header + headerSize;
+	CountersAccess counters;
+	a->allocated(counters.get(), header, ptr, size, tlsTag);
+	return ptr;
+}
+
+void accountingFree(void *ptr) {
+	if (!ptr) return;
+	Accounting *a = accounting.load(std::memory_order_acquire);
+	Header *header = (Header *)((char *)ptr - headerSize);
+	{
+		CountersAccess counters;
+		a->freed(counters.get(), header, ptr);
+	}
+	a->underlying().free_fun(header);
+}
+
+void *accountingRealloc(void *ptr, size_t size) {
+	if (!ptr) return accountingMalloc(size);
+	if (size > SIZE_MAX - headerSize) return nullptr;
+	Accounting *a = accounting.load(std::memory_order_acquire);
+	Header *header = (Header *)((char *)ptr - headerSize);
+	size_t oldSize = header->size;
+	Header *moved = (Header *)a->underlying().realloc_fun(header, headerSize + size);
+	if (!moved) return nullptr;
+	void *ret = (char *)moved + headerSize;
+	CountersAccess counters;
+	a->reallocated(counters.get(), moved, ptr, ret, oldSize, size);
+	return ret;
+}
+
+} // namespace
+
+void bctbx_memory_accounting_get_memory_functions(const BctoolboxMemoryFunctions *underlying, unsigned int sampling_interval, BctoolboxMemoryFunctions *functions) {
+	std::call_once(accountingOnce, [underlying, sampling_interval]() {
+		accounting.store(new Accounting(underlying, sampling_interval), std::memory_order_release);
+	});
+	functions->malloc_fun = accountingMalloc;
+	functions->realloc_fun = accountingRealloc;
+	functions->free_fun = accountingFree;
+}
+
+bool_t bctbx_memory_accounting_enabled(void) {
+	return accounting.load(std::memory_order_acquire) != nullptr;
+}
+
+const char *bctbx_memory_set_tag(const char *tag) {
+	const char *previous = tlsTag;
+	tlsTag = tag;
+	return previous;
+}
+
+static void getStats(bctbx_memory_stats_t *stats, bool resetRate) {
+	Accounting *a = accounting.load(std::memory_order_acquire);
+	if (!a) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	a->getStats(stats, resetRate);
+}
+
+void bctbx_memory_get_stats(bctbx_memory_stats_t *stats) {
+	getStats(stats, true);
+}
+
+void bctbx_memory_peek_stats(bctbx_memory_stats_t *stats) {
+	getStats(stats, false);
+}
+
+char *bctbx_memory_get_leak_report(size_t max_entries) {
+	Accounting *a = accounting.load(std::memory_order_acquire);
+	if (!a) return bctbx_strdup("Memory accounting is not enabled");
+	return bctbx_strdup(a->getLeakReport(max_entries).c_str());
+}
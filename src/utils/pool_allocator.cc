@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+/* usable sizes, a block also has a header in front */
+constexpr size_t classSizes[BCTBX_POOL_ALLOCATOR_CLASS_COUNT] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, BCTBX_POOL_ALLOCATOR_MAX_SIZE};
+
+/* the header keeps the blocks aligned like malloc does */
+constexpr size_t headerSize = 16;
+constexpr size_t bigClass = BCTBX_POOL_ALLOCATOR_CLASS_COUNT;
+
+constexpr size_t slabSize = 64 * 1024;
+/* a thread cache holds at most this many free blocks per class, and exchanges half of it with the central lists */
+constexpr unsigned int cacheMax = 64;
+constexpr unsigned int transferCount = cacheMax / 2;
+
+struct Header {
+	size_t sizeClass;
+	size_t size; /* requested size of big allocations */
+};
+static_assert(sizeof(Header) <= headerSize, "the block header does not fit");
+
+struct FreeBlock {
+	FreeBlock *next;
+};
+
+size_t sizeToClass(size_t size) {
+	/* the table is short, a binary search would not be faster */
+	for (size_t i = 0; i < BCTBX_POOL_ALLOCATOR_CLASS_COUNT; i++) {
+		if (size <= classSizes[i]) return i;
+	}
+	return bigClass;
+}
+
+Header *headerOf(void *ptr) {
+	return (Header *)((char *)ptr - headerSize);
+}
+
+void *userPointer(void *block) {
+	return (char *)block + headerSize;
+}
+
+/* counters are written by their thread only, and read by bctbx_pool_allocator_get_stats() */
+struct Counters {
+	std::atomic<uint64_t> allocations[BCTBX_POOL_ALLOCATOR_CLASS_COUNT + 1];
+	std::atomic<int64_t> blocksInUse[BCTBX_POOL_ALLOCATOR_CLASS_COUNT + 1];
+	std::atomic<int64_t> bigBytesInUse;
+
+	Counters() {
+		for (size_t i = 0; i <= BCTBX_POOL_ALLOCATOR_CLASS_COUNT; i++) {
+			allocations[i].store(0, std::memory_order_relaxed);
+			blocksInUse[i].store(0, std::memory_order_relaxed);
+		}
+		bigBytesInUse.store(0, std::memory_order_relaxed);
+	}
+
+	static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+	static void add(std::atomic<int64_t> &counter, int64_t value) {
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+};
+
+struct ThreadCache {
+	FreeBlock *lists[BCTBX_POOL_ALLOCATOR_CLASS_COUNT] = {};
+	unsigned int counts[BCTBX_POOL_ALLOCATOR_CLASS_COUNT] = {};
+	Counters counters;
+	ThreadCache *prev = nullptr;
+	ThreadCache *next = nullptr;
+};
+
+class Pool {
+public:
+	void *allocate(ThreadCache *cache, size_t sizeClass) {
+		FreeBlock *block;
+		if (cache) {
+			if (cache->counts[sizeClass] == 0) refill(cache, sizeClass);
+			block = cache->lists[sizeClass];
+			if (!block) return nullptr;
+			cache->lists[sizeClass] = block->next;
+			cache->counts[sizeClass]--;
+		} else {
+			std::lock_guard<std::mutex> guard(mCentral[sizeClass].lock);
+			if (!mCentral[sizeClass].list && !grow(sizeClass)) return nullptr;
+			block = mCentral[sizeClass].list;
+			mCentral[sizeClass].list = block->next;
+			mCentral[sizeClass].count--;
+		}
+		return block;
+	}
+
+	void release(ThreadCache *cache, size_t sizeClass, FreeBlock *block) {
+		if (cache) {
+			block->next = cache->lists[sizeClass];
+			cache->lists[sizeClass] = block;
+			if (++cache->counts[sizeClass] > cacheMax) drain(cache, sizeClass, transferCount);
+		} else {
+			std::lock_guard<std::mutex> guard(mCentral[sizeClass].lock);
+			block->next = mCentral[sizeClass].list;
+			mCentral[sizeClass].list = block;
+			mCentral[sizeClass].count++;
+		}
+	}
+
+	/* give every cached block back to the central lists */
+	void drainAll(ThreadCache *cache) {
+		for (size_t i = 0; i < BCTBX_POOL_ALLOCATOR_CLASS_COUNT; i++) {
+			drain(cache, i, cache->counts[i]);
+		}
+	}
+
+	void registerCache(ThreadCache *cache) {
+		std::lock_guard<std::mutex> guard(mRegistryLock);
+		cache->next = mCaches;
+		if (mCaches) mCaches->prev = cache;
+		mCaches = cache;
+	}
+
+	/* the counters of exited threads are kept in mRetired */
+	void unregisterCache(ThreadCache *cache) {
+		std::lock_guard<std::mutex> guard(mRegistryLock);
+		accumulate(mRetired, cache->counters);
+		if (cache->prev) cache->prev->next = cache->next;
+		else mCaches = cache->next;
+		if (cache->next) cache->next->prev = cache->prev;
+	}
+
+	Counters &sharedCounters() {
+		return mShared;
+	}
+
+	void addReserved(int64_t bytes) {
+		uint64_t reserved = (uint64_t)((int64_t)mReserved.fetch_add((uint64_t)bytes, std::memory_order_relaxed) + bytes);
+		uint64_t peak = mPeakReserved.load(std::memory_order_relaxed);
+		while (reserved > peak && !mPeakReserved.compare_exchange_weak(peak, reserved, std::memory_order_relaxed))
+			;
+	}
+
+	void getStats(bctbx_pool_allocator_stats_t *stats) {
+		Counters total;
+		{
+			std::lock_guard<std::mutex> guard(mRegistryLock);
+			accumulate(total, mRetired);
+			accumulate(total, mShared);
+			for (ThreadCache *cache = mCaches; cache; cache = cache->next) {
+				accumulate(total, cache->counters);
+			}
+		}
+		memset(stats, 0, sizeof(*stats));
+		stats->bytesInUse = total.bigBytesInUse.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < BCTBX_POOL_ALLOCATOR_CLASS_COUNT; i++) {
+			stats->classes[i].blockSize = classSizes[i];
+			stats->classes[i].allocations = total.allocations[i].load(std::memory_order_relaxed);
+			stats->classes[i].blocksInUse = total.blocksInUse[i].load(std::memory_order_relaxed);
+			stats->bytesInUse += stats->classes[i].blocksInUse * (int64_t)classSizes[i];
+		}
+		stats->bytesReserved = mReserved.load(std::memory_order_relaxed);
+		stats->peakBytesReserved = mPeakReserved.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Central {
+		std::mutex lock;
+		FreeBlock *list = nullptr;
+		size_t count = 0;
+	};
+
+	void refill(ThreadCache *cache, size_t sizeClass) {
+		Central &central = mCentral[sizeClass];
+		std::lock_guard<std::mutex> guard(central.lock);
+		if (!central.list && !grow(sizeClass)) return;
+		for (unsigned int i = 0; i < transferCount && central.list; i++) {
+			FreeBlock *block = central.list;
+			central.list = block->next;
+			central.count--;
+			block->next = cache->lists[sizeClass];
+			cache->lists[sizeClass] = block;
+			cache->counts[sizeClass]++;
+		}
+	}
+
+	void drain(ThreadCache *cache, size_t sizeClass, unsigned int count) {
+		if (count == 0) return;
+		Central &central = mCentral[sizeClass];
+		std::lock_guard<std::mutex> guard(central.lock);
+		for (unsigned int i = 0; i < count && cache->lists[sizeClass]; i++) {
+			FreeBlock *block = cache->lists[sizeClass];
+			cache->lists[sizeClass] = block->next;
+			cache->counts[sizeClass]--;
+			block->next = central.list;
+			central.list = block;
+			central.count++;
+		}
+	}
+
+	/* carve a new slab, with the central list lock held */
+	bool grow(size_t sizeClass) {
+		size_t blockSize = headerSize + classSizes[sizeClass];
+		size_t size = std::max(slabSize, 8 * blockSize);
+		char *slab = (char *)malloc(size);
+		if (!slab) return false;
+		addReserved((int64_t)size);
+		Central &central = mCentral[sizeClass];
+		for (size_t offset = 0; offset + blockSize <= size; offset += blockSize) {
+			FreeBlock *block = (FreeBlock *)(slab + offset);
+			block->next = central.list;
+			central.list = block;
+			central.count++;
+		}
+		return true;
+	}
+
+	static void accumulate(Counters &total, const Counters &counters) {
+		for (size_t i = 0; i <= BCTBX_POOL_ALLOCATOR_CLASS_COUNT; i++) {
+			Counters::add(total.allocations[i], counters.allocations[i].load(std::memory_order_relaxed));
+			Counters::add(total.blocksInUse[i], counters.blocksInUse[i].load(std::memory_order_relaxed));
+		}
+		Counters::add(total.bigBytesInUse, counters.bigBytesInUse.load(std::memory_order_relaxed));
+	}
+
+	Central mCentral[BCTBX_POOL_ALLOCATOR_CLASS_COUNT];
+	std::mutex mRegistryLock;
+	ThreadCache *mCaches = nullptr;
+	Counters mRetired;
+	/* for the threads without a cache, see CountersAccess */
+	Counters mShared;
+	std::atomic<uint64_t> mReserved{0};
+	std::atomic<uint64_t> mPeakReserved{0};
+};
+
+/* never destroyed, blocks may be freed until the very end of the process */
+Pool &getPool() {
+	static Pool *pool = new Pool();
+	return *pool;
+}
+
+/* gives the cache back when the thread exits */
+struct CacheGuard {
+	~CacheGuard();
+};
+
+thread_local ThreadCache *tlsCache = nullptr;
+/* set once the thread is exiting: allocations made by later thread_local destructors go to the central lists */
+thread_local bool tlsCacheDestroyed = false;
+
+CacheGuard::~CacheGuard() {
+	ThreadCache *cache = tlsCache;
+	tlsCache = nullptr;
+	tlsCacheDestroyed = true;
+	if (cache) {
+		getPool().drainAll(cache);
+		getPool().unregisterCache(cache);
+		delete cache;
+	}
+}
+
+ThreadCache *getCache() {
+	if (tlsCache || tlsCacheDestroyed) return tlsCache;
+	static thread_local CacheGuard guard;
+	(void)guard;
+	tlsCache = new ThreadCache();
+	getPool().registerCache(tlsCache);
+	return tlsCache;
+}
+
+/* counters of the threads without a cache are shared, they need the registry lock */
+class CountersAccess {
+public:
+	explicit CountersAccess(ThreadCache *cache) : mCache(cache) {
+		if (!mCache) mLock = std::unique_lock<std::mutex>(sharedLock());
+	}
+	Counters &get() {
+		return mCache ? mCache->counters : getPool().sharedCounters();
+	}
+
+private:
+	static std::mutex &sharedLock() {
+		static std::mutex *lock = new std::mutex();
+		return *lock;
+	}
+
+	ThreadCache *mCache;
+	std::unique_lock<std::mutex> mLock;
+};
+
+} // namespace
+
+void *bctbx_pool_malloc(size_t size) {
+	size_t sizeClass = sizeToClass(size);
+	ThreadCache *cache = getCache();
+	void *block;
+
+	if (sizeClass == bigClass) {
+		if (size > SIZE_MAX - headerSize) return NULL;
+		block = malloc(headerSize + size);
+		if (!block) return NULL;
+		getPool().addReserved((int64_t)(headerSize + size));
+		CountersAccess counters(cache);
+		Counters::add(counters.get().allocations[bigClass], 1);
+		Counters::add(counters.get().bigBytesInUse, (int64_t)size);
+	} else {
+		block = getPool().allocate(cache, sizeClass);
+		if (!block) return NULL;
+		CountersAccess counters(cache);
+		Counters::add(counters.get().allocations[sizeClass], 1);
+		Counters::add(counters.get().blocksInUse[sizeClass], 1);
+	}
+	Header *header = (Header *)block;
+	header->sizeClass = sizeClass;
+	header->size = size;
+	return userPointer(block);
+}
+
+void bctbx_pool_free(void *ptr) {
+	if (!ptr) return;
+	Header *header = headerOf(ptr);
+	size_t sizeClass = header->sizeClass;
+	ThreadCache *cache = getCache();
+
+	if (sizeClass == bigClass) {
+		size_t size = header->size;
+		{
+			CountersAccess counters(cache);
+			Counters::add(counters.get().bigBytesInUse, -(int64_t)size);
+		}
+		getPool().addReserved(-(int64_t)(headerSize + size));
+		free(header);
+	} else {
+		{
+			CountersAccess counters(cache);
+			Counters::add(counters.get().blocksInUse[sizeClass], -1);
+		}
+		getPool().release(cache, sizeClass, (FreeBlock *)header);
+	}
+}
+
+void *bctbx_pool_realloc(void *ptr, size_t size) {
+	if (!ptr) return bctbx_pool_malloc(size);
+	Header *header = headerOf(ptr);
+	size_t oldSize = header->sizeClass == bigClass ? header->size : classSizes[header->sizeClass];
+
+	/* stay in place while the block is big enough and not way too big */
+	if (header->sizeClass != bigClass && size <= oldSize && sizeToClass(size) == header->sizeClass) {
+		header->size = size;
+		return ptr;
+	}
+	if (header->sizeClass == bigClass && sizeToClass(size) == bigClass) {
+		if (size > SIZE_MAX - headerSize) return NULL;
+		Header *moved = (Header *)realloc(header, headerSize + size);
+		if (!moved) return NULL;
+		getPool().addReserved((int64_t)size - (int64_t)oldSize);
+		CountersAccess counters(getCache());
+		Counters::add(counters.get().bigBytesInUse, (int64_t)size - (int64_t)oldSize);
+		moved->size = size;
+		return userPointer(moved);
+	}
+	void *ret = bctbx_pool_malloc(size);
+	if (!ret) return NULL;
+	memcpy(ret, ptr, std::min(oldSize, size));
+	bctbx_pool_free(ptr);
+	return ret;
+}
+
+void bctbx_pool_allocator_get_memory_functions(BctoolboxMemoryFunctions *functions) {
+	functions->malloc_fun = bctbx_pool_malloc;
+	functions->realloc_fun = bctbx_pool_realloc;
+	functions->free_fun = bctbx_pool_free;
+}
+
+void bctbx_pool_allocator_get_stats(bctbx_pool_allocator_stats_t *stats) {
+	getPool().getStats(stats);
+}
@@ -29,6 +29,12 @@
 #include "bctoolbox/charconv.h"
 #include "utils.h"
 
+#if defined(BCTBX_X86_INTRINSICS) && defined(_MSC_VER)
+#include <intrin.h> /* __rdtsc */
+#elif defined(BCTBX_X86_INTRINSICS)
+#include <x86intrin.h> /* __rdtsc */
+#endif
+
 #ifdef __APPLE__
    #include "TargetConditionals.h"
 #endif
@@ -416,6 +422,41 @@ int __bctbx_WIN_mutex_destroy(bctbx_mutex_t * hMutex)
 	return 0;
 }
 
+int __bctbx_WIN_rwlock_init(bctbx_rwlock_t *lock, void *attr)
+{
+	InitializeSRWLock(lock);
+	return 0;
+}
+
+int __bctbx_WIN_rwlock_rdlock(bctbx_rwlock_t *lock)
+{
+	AcquireSRWLockShared(lock);
+	return 0;
+}
+
+int __bctbx_WIN_rwlock_wrlock(bctbx_rwlock_t *lock)
+{
+	AcquireSRWLockExclusive(lock);
+	return 0;
+}
+
+int __bctbx_WIN_rwlock_rdunlock(bctbx_rwlock_t *lock)
+{
+	ReleaseSRWLockShared(lock);
+	return 0;
+}
+
+int __bctbx_WIN_rwlock_wrunlock(bctbx_rwlock_t *lock)
+{
+	ReleaseSRWLockExclusive(lock);
+	return 0;
+}
+
+int __bctbx_WIN_rwlock_destroy(bctbx_rwlock_t *lock)
+{
+	return 0;
+}
+
 void bctbx_set_self_thread_name(const char *name){
 	wchar_t *unicode_name = bctbx_string_to_wide_string(name);
 	SetThreadDescription(GetCurrentThread(), unicode_name);
@@ -956,6 +997,94 @@ uint64_t bctbx_get_cur_time_ms(void) {
 	return (ts.tv_sec * 1000LL) + ((ts.tv_nsec + 500000LL) / 1000000LL);
 }
 
+uint64_t bctbx_get_coarse_time_ms(void) {
+#if defined(_WIN32)
+	return (uint64_t)GetTickCount64();
+#elif defined(CLOCK_MONOTONIC_COARSE)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#elif defined(__APPLE__) && defined(CLOCK_MONOTONIC_RAW_APPROX)
+	return clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW_APPROX) / 1000000;
+#else
+	bctoolboxTimeSpec ts;
+	_bctbx_get_cur_time(&ts, FALSE);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+static uint64_t monotonic_ns(void) {
+	bctoolboxTimeSpec ts;
+	_bctbx_get_cur_time(&ts, FALSE);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t bctbx_tsc_read(void) {
+#if defined(BCTBX_X86_INTRINSICS)
+	if (bctbx_cpu_features() & BCTBX_CPU_FEATURE_INVARIANT_TSC) return __rdtsc();
+	return monotonic_ns();
+#elif defined(__aarch64__) && defined(__GNUC__)
+	uint64_t ticks;
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return monotonic_ns();
+#endif
+}
+
+/* written once by tsc_calibrate, the once call orders it before any read */
+static uint64_t tsc_frequency = 0;
+
+static void tsc_calibrate(void) {
+	uint64_t frequency;
+#if defined(BCTBX_X86_INTRINSICS)
+	if (bctbx_cpu_features() & BCTBX_CPU_FEATURE_INVARIANT_TSC) {
+		uint64_t t0, t1, c0, c1;
+		t0 = monotonic_ns();
+		c0 = __rdtsc();
+		bctbx_sleep_ms(10);
+		t1 = monotonic_ns();
+		c1 = __rdtsc();
+		frequency = (uint64_t)((double)(c1 - c0) * 1e9 / (double)(t1 - t0));
+	} else {
+		frequency = 1000000000ULL;
+	}
+#elif defined(__aarch64__) && defined(__GNUC__)
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+#else
+	frequency = 1000000000ULL;
+#endif
+	if (frequency == 0) frequency = 1;
+	tsc_frequency = frequency;
+}
+
+#ifdef _WIN32
+static INIT_ONCE tsc_calibration = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK tsc_calibrate_once(PINIT_ONCE once, PVOID parameter, PVOID *context) {
+	tsc_calibrate();
+	return TRUE;
+}
+#else
+static pthread_once_t tsc_calibration = PTHREAD_ONCE_INIT;
+#endif
+
+uint64_t bctbx_tsc_frequency(void) {
+	/* concurrent first calls wait for a single calibration */
+#ifdef _WIN32
+	InitOnceExecuteOnce(&tsc_calibration, tsc_calibrate_once, NULL, NULL);
+#else
+	pthread_once(&tsc_calibration, tsc_calibrate);
+#endif
+	return tsc_frequency;
+}
+
+uint64_t bctbx_tsc_to_ns(uint64_t ticks) {
+	uint64_t frequency = bctbx_tsc_frequency();
+	/* split to avoid overflowing 64 bits */
+	return (ticks / frequency) * 1000000000ULL + ((ticks % frequency) * 1000000000ULL) / frequency;
+}
+
 void bctbx_sleep_ms(int ms){
 #ifdef _WIN32
 #ifdef BCTBX_WINDOWS_DESKTOP
@@ -1903,20 +2032,7 @@ uint8_t bctbx_byte_to_char(uint8_t input_byte) {
 	return input_byte_crop + 0x57;
 }
 
-void bctbx_str_to_uint8(uint8_t *output_bytes, const uint8_t *input_string, size_t input_string_length) {
-	size_t i;
-	for (i=0; i<input_string_length/2; i++) {
-		output_bytes[i] = (bctbx_char_to_byte(input_string[2*i]))<<4 | bctbx_char_to_byte(input_string[2*i+1]);
-	}
-}
-
-void bctbx_int8_to_str(uint8_t *output_string, const uint8_t *input_bytes, size_t input_bytes_length) {
-	size_t i;
-	for (i=0; i<input_bytes_length; i++) {
-		output_string[2*i] = bctbx_byte_to_char((input_bytes[i]>>4)&0x0F);
-		output_string[2*i+1] = bctbx_byte_to_char(input_bytes[i]&0x0F);
-	}
-}
+/* bctbx_str_to_uint8 and bctbx_int8_to_str are in encoding.c, with the other codecs */
 
 void bctbx_uint32_to_str(uint8_t output_string[9], uint32_t input_uint32) {
 
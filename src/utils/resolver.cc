@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/resolver.h"
+#include "bctoolbox/logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* beyond this, expired entries are purged then the entry closest to expiry is evicted to make room */
+constexpr size_t maxCacheEntries = 1024;
+
+/* the outcome of one lookup, shared by the cache and by every query it answered */
+struct Result {
+	Result(int err, struct addrinfo *addresses) : error(err), ai(addresses) {
+	}
+	~Result() {
+		if (ai) bctbx_freeaddrinfo(ai);
+	}
+	Result(const Result &) = delete;
+	Result &operator=(const Result &) = delete;
+
+	const int error;
+	struct addrinfo *const ai;
+};
+
+bool isNegativeError(int error) {
+	/* the name does not exist, as opposed to failures that may not happen again on the next attempt */
+	if (error == EAI_NONAME) return true;
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+	if (error == EAI_NODATA) return true;
+#endif
+	return false;
+}
+
+} // namespace
+
+struct _bctbx_resolver_query_t {
+	std::atomic<int> refCount{1};
+	bctbx_resolver_callback_t callback = nullptr;
+	void *userData = nullptr;
+
+	mutable std::mutex lock;
+	std::condition_variable completed;
+	bool done = false; /* the result is available */
+	bool finished = false; /* the callback, if any, returned: what waiting is for */
+	std::shared_ptr<const Result> result;
+
+	/* held while the callback runs, so that freeing the query waits for it; recursive to allow freeing from the callback */
+	std::recursive_mutex callbackLock;
+	bool cancelled = false;
+
+	void ref() {
+		refCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void unref() {
+		if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+	}
+
+	/* the caller must hold a reference: the callback may free the query */
+	void complete(const std::shared_ptr<const Result> &res) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			result = res;
+			done = true;
+		}
+		{
+			std::lock_guard<std::recursive_mutex> guard(callbackLock);
+			if (!cancelled && callback) callback(userData, res->error, res->ai);
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			finished = true;
+		}
+		completed.notify_all();
+	}
+};
+
+struct _bctbx_resolver_t {
+	struct CacheEntry {
+		std::shared_ptr<const Result> result;
+		Clock::time_point expiry;
+	};
+
+	/* a lookup queued or in progress, with the queries waiting for it */
+	struct Pending {
+		std::string name;
+		std::string service;
+		struct addrinfo hints;
+		std::vector<bctbx_resolver_query_t *> waiters;
+	};
+
+	explicit _bctbx_resolver_t(int threadCount) {
+		if (threadCount <= 0) threadCount = 2;
+		for (int i = 0; i < threadCount; i++) {
+			mThreads.emplace_back(&_bctbx_resolver_t::run, this);
+		}
+	}
+
+	~_bctbx_resolver_t() {
+		{
+			std::lock_guard<std::mutex> guard(mLock);
+			mStopping = true;
+		}
+		mWakeUp.notify_all();
+		for (auto &thread : mThreads) {
+			thread.join();
+		}
+		/* nobody is left to run the lookups still queued */
+		for (auto &ready : mReady) {
+			ready.first->complete(ready.second);
+			ready.first->unref();
+		}
+		auto aborted = std::make_shared<const Result>(EAI_AGAIN, nullptr);
+		for (auto &pending : mPending) {
+			for (auto query : pending.second.waiters) {
+				query->complete(aborted);
+				query->unref();
+			}
+		}
+	}
+
+	void setTtls(uint32_t positiveTtl, uint32_t negativeTtl) {
+		std::lock_guard<std::mutex> guard(mLock);
+		mPositiveTtl = positiveTtl;
+		mNegativeTtl = negativeTtl;
+	}
+
+	void setLookupFunc(bctbx_resolver_lookup_func_t func, void *userData) {
+		std::lock_guard<std::mutex> guard(mLock);
+		mLookupFunc = func;
+		mLookupUserData = userData;
+	}
+
+	void clearCache() {
+		std::lock_guard<std::mutex> guard(mLock);
+		mCache.clear();
+	}
+
+	bctbx_resolver_query_t *resolve(int family, int socktype, const char *name, int port, bctbx_resolver_callback_t callback, void *userData) {
+		bctbx_resolver_query_t *query = new bctbx_resolver_query_t();
+		query->callback = callback;
+		query->userData = userData;
+
+		std::string key = makeKey(family, socktype, name, port);
+		std::shared_ptr<const Result> cached;
+		{
+			std::lock_guard<std::mutex> guard(mLock);
+			auto it = mCache.find(key);
+			if (it != mCache.end()) {
+				if (it->second.expiry > Clock::now()) {
+					cached = it->second.result;
+				} else {
+					mCache.erase(it);
+				}
+			}
+			/* the query reference held by the lookup threads is released once it completes */
+			query->ref();
+			if (cached) {
+				/* completed by a lookup thread as well, so that the callback never runs before resolve() returns */
+				mReady.emplace_back(query, cached);
+				mWakeUp.notify_one();
+			} else {
+				auto pending = mPending.find(key);
+				if (pending == mPending.end()) {
+					Pending &p = mPending[key];
+					p.name = name ? name : "";
+					p.service = std::to_string(port);
+					p.hints = {};
+					p.hints.ai_family = family;
+					p.hints.ai_socktype = socktype;
+					if (family == AF_INET6) p.hints.ai_flags = AI_V4MAPPED | AI_ALL;
+					p.waiters.push_back(query);
+					mQueue.push_back(key);
+					mWakeUp.notify_one();
+				} else {
+					pending->second.waiters.push_back(query);
+				}
+			}
+		}
+		return query;
+	}
+
+private:
+	static std::string makeKey(int family, int socktype, const char *name, int port) {
+		std::string key = std::to_string(family) + '/' + std::to_string(socktype) + '/' + std::to_string(port) + '/';
+		if (name) {
+			/* host names are case insensitive */
+			for (const char *c = name; *c; c++) {
+				key += (char)std::tolower((unsigned char)*c);
+			}
+		}
+		return key;
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> guard(mLock);
+		while (true) {
+			mWakeUp.wait(guard, [this] { return mStopping || !mQueue.empty() || !mReady.empty(); });
+			if (mStopping) return;
+			if (!mReady.empty()) {
+				std::pair<bctbx_resolver_query_t *, std::shared_ptr<const Result>> ready = std::move(mReady.front());
+				mReady.pop_front();
+				guard.unlock();
+				ready.first->complete(ready.second);
+				ready.first->unref();
+				guard.lock();
+				continue;
+			}
+			std::string key = std::move(mQueue.front());
+			mQueue.pop_front();
+			Pending &pending = mPending[key];
+			std::string name = pending.name;
+			std::string service = pending.service;
+			struct addrinfo hints = pending.hints;
+			bctbx_resolver_lookup_func_t lookupFunc = mLookupFunc;
+			void *lookupUserData = mLookupUserData;
+			uint32_t positiveTtl = mPositiveTtl;
+			uint32_t negativeTtl = mNegativeTtl;
+			guard.unlock();
+
+			struct addrinfo *ai = nullptr;
+			int error;
+			uint32_t ttl = positiveTtl;
+			if (lookupFunc) {
+				error = lookupFunc(lookupUserData, name.c_str(), service.c_str(), &hints, &ai, &ttl);
+			} else {
+				error = bctbx_getaddrinfo(name.c_str(), service.c_str(), &hints, &ai);
+			}
+			if (error != 0) {
+				if (ai) bctbx_freeaddrinfo(ai);
+				ai = nullptr;
+				/* the lookup function only reports the TTL of found records */
+				ttl = isNegativeError(error) ? negativeTtl : 0;
+				bctbx_message("bctbx_resolver: %s failed: %s", name.c_str(), gai_strerror(error));
+			} else if (ai) {
+				ai = bctbx_addrinfo_sort(ai);
+			}
+			auto result = std::make_shared<const Result>(error, ai);
+
+			guard.lock();
+			if (ttl > 0) insertInCache(key, result, ttl);
+			auto it = mPending.find(key);
+			std::vector<bctbx_resolver_query_t *> waiters = std::move(it->second.waiters);
+			mPending.erase(it);
+			guard.unlock();
+
+			for (auto query : waiters) {
+				query->complete(result);
+				query->unref();
+			}
+			guard.lock();
+		}
+	}
+
+	void insertInCache(const std::string &key, const std::shared_ptr<const Result> &result, uint32_t ttl) {
+		Clock::time_point now = Clock::now();
+		if (mCache.size() >= maxCacheEntries && mCache.find(key) == mCache.end()) {
+			for (auto it = mCache.begin(); it != mCache.end();) {
+				if (it->second.expiry <= now) it = mCache.erase(it);
+				else ++it;
+			}
+			if (mCache.size() >= maxCacheEntries) {
+				auto soonest = std::min_element(mCache.begin(), mCache.end(), [](const std::pair<const std::string, CacheEntry> &a, const std::pair<const std::string, CacheEntry> &b) {
+					return a.second.expiry < b.second.expiry;
+				});
+				mCache.erase(soonest);
+			}
+		}
+		CacheEntry &entry = mCache[key];
+		entry.result = result;
+		entry.expiry = now + std::chrono::seconds(ttl);
+	}
+
+	std::mutex mLock;
+	std::condition_variable mWakeUp;
+	bool mStopping = false;
+	std::vector<std::thread> mThreads;
+	std::deque<std::string> mQueue;
+	/* queries answered from the cache, waiting for a thread to invoke their callback */
+	std::deque<std::pair<bctbx_resolver_query_t *, std::shared_ptr<const Result>>> mReady;
+	std::map<std::string, Pending> mPending;
+	std::map<std::string, CacheEntry> mCache;
+	uint32_t mPositiveTtl = 60;
+	uint32_t mNegativeTtl = 10;
+	bctbx_resolver_lookup_func_t mLookupFunc = nullptr;
+	void *mLookupUserData = nullptr;
+};
+
+bctbx_resolver_t *bctbx_resolver_new(int thread_count) {
+	return new bctbx_resolver_t(thread_count);
+}
+
+void bctbx_resolver_free(bctbx_resolver_t *resolver) {
+	delete resolver;
+}
+
+void bctbx_resolver_set_ttls(bctbx_resolver_t *resolver, uint32_t positive_ttl, uint32_t negative_ttl) {
+	resolver->setTtls(positive_ttl, negative_ttl);
+}
+
+void bctbx_resolver_set_lookup_func(bctbx_resolver_t *resolver, bctbx_resolver_lookup_func_t func, void *user_data) {
+	resolver->setLookupFunc(func, user_data);
+}
+
+void bctbx_resolver_clear_cache(bctbx_resolver_t *resolver) {
+	resolver->clearCache();
+}
+
+bctbx_resolver_query_t *bctbx_resolver_resolve(bctbx_resolver_t *resolver, int family, int socktype, const char *name, int port, bctbx_resolver_callback_t callback, void *user_data) {
+	return resolver->resolve(family, socktype, name, port, callback, user_data);
+}
+
+bool_t bctbx_resolver_query_wait(bctbx_resolver_query_t *query, int timeout_ms) {
+	std::unique_lock<std::mutex> guard(query->lock);
+	if (timeout_ms < 0) {
+		query->completed.wait(guard, [query] { return query->finished; });
+		return TRUE;
+	}
+	return query->completed.wait_for(guard, std::chrono::milliseconds(timeout_ms), [query] { return query->finished; }) ? TRUE : FALSE;
+}
+
+int bctbx_resolver_query_get_result(const bctbx_resolver_query_t *query, const struct addrinfo **result) {
+	std::lock_guard<std::mutex> guard(query->lock);
+	if (!query->done) {
+		if (result) *result = nullptr;
+		return EAI_AGAIN;
+	}
+	if (result) *result = query->result->ai;
+	return query->result->error;
+}
+
+void bctbx_resolver_query_free(bctbx_resolver_query_t *query) {
+	{
+		std::lock_guard<std::recursive_mutex> guard(query->callbackLock);
+		query->cancelled = true;
+	}
+	query->unref();
+}
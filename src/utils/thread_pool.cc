@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bctoolbox/thread_pool.hh"
+#include "bctoolbox/logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+using Job = std::function<void()>;
+
+struct Worker {
+	std::mutex lock;
+	std::deque<Job> jobs; /* the owner works at the back, thieves take from the front */
+	std::thread thread;
+};
+
+/* the worker running on this thread and its pool, to send the jobs it submits to its own deque */
+thread_local bctbx_thread_pool_t *currentPool = nullptr;
+thread_local Worker *currentWorker = nullptr;
+
+int bindThread(std::thread &thread, int cpu) {
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0 ? 0 : -1;
+#elif defined(_WIN32) && defined(_MSC_VER)
+	if (cpu >= (int)(sizeof(DWORD_PTR) * 8)) return -1;
+	return SetThreadAffinityMask((HANDLE)thread.native_handle(), (DWORD_PTR)1 << cpu) != 0 ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+int processorCount() {
+	return (int)std::max<unsigned int>(std::thread::hardware_concurrency(), 1);
+}
+
+} // namespace
+
+struct _bctbx_thread_pool_task_t {
+	std::atomic<int> refCount{2}; /* the caller's handle and the queued job */
+	bctbx_thread_pool_t *pool = nullptr;
+	std::mutex lock;
+	std::condition_variable completed;
+	bool done = false;
+
+	void unref() {
+		if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+	}
+
+	void complete() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			done = true;
+		}
+		completed.notify_all();
+	}
+};
+
+struct _bctbx_thread_pool_t {
+	_bctbx_thread_pool_t(int threadCount, int flags) {
+		if (threadCount <= 0) threadCount = processorCount();
+		for (int i = 0; i < threadCount; i++) {
+			mWorkers.emplace_back(new Worker());
+		}
+		/* the deques all exist before any worker may look into them to steal */
+		for (int i = 0; i < threadCount; i++) {
+			mWorkers[i]->thread = std::thread(&_bctbx_thread_pool_t::run, this, mWorkers[i].get());
+			if (flags & BCTBX_THREAD_POOL_PIN_WORKERS) setWorkerAffinity(i, i % processorCount());
+		}
+	}
+
+	~_bctbx_thread_pool_t() {
+		{
+			std::lock_guard<std::mutex> guard(mSleepLock);
+			mStopping = true;
+		}
+		mWakeUp.notify_all();
+		for (auto &worker : mWorkers) {
+			worker->thread.join();
+		}
+	}
+
+	int getThreadCount() const {
+		return (int)mWorkers.size();
+	}
+
+	int setWorkerAffinity(int index, int cpu) {
+		if (index < 0 || index >= (int)mWorkers.size() || cpu < 0) return -1;
+		int ret = bindThread(mWorkers[index]->thread, cpu);
+		if (ret != 0) bctbx_warning("bctbx_thread_pool: cannot bind worker %d to processor %d", index, cpu);
+		return ret;
+	}
+
+	void post(Job &&job) {
+		/* counted before being queued, so that the count never goes below the number of queued jobs */
+		mPending.fetch_add(1);
+		if (currentPool == this) {
+			std::lock_guard<std::mutex> guard(currentWorker->lock);
+			currentWorker->jobs.push_back(std::move(job));
+		} else {
+			std::lock_guard<std::mutex> guard(mInjectedLock);
+			mInjected.push_back(std::move(job));
+		}
+		if (mIdle.load() > 0) {
+			/* taking the lock orders the notification after a worker going to sleep has checked the pending count */
+			{ std::lock_guard<std::mutex> guard(mSleepLock); }
+			mWakeUp.notify_one();
+		}
+	}
+
+	/* run one job from the worker's deque, the shared queue or another worker, return false if there was none */
+	bool runOne(Worker *self) {
+		Job job;
+		if (!take(self, job)) return false;
+		mPending.fetch_sub(1);
+		try {
+			job();
+		} catch (const std::exception &e) {
+			bctbx_error("bctbx_thread_pool: task failed with exception: %s", e.what());
+		} catch (...) {
+			bctbx_error("bctbx_thread_pool: task failed with unknown exception");
+		}
+		return true;
+	}
+
+	bool isWorkerThread() const {
+		return currentPool == this;
+	}
+
+private:
+	bool take(Worker *self, Job &job) {
+		if (self) {
+			std::lock_guard<std::mutex> guard(self->lock);
+			if (!self->jobs.empty()) {
+				job = std::move(self->jobs.back());
+				self->jobs.pop_back();
+				return true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> guard(mInjectedLock);
+			if (!mInjected.empty()) {
+				job = std::move(mInjected.front());
+				mInjected.pop_front();
+				return true;
+			}
+		}
+		/* steal, starting after ourselves so that thieves spread over the victims */
+		size_t start = 0;
+		if (self) {
+			for (; start < mWorkers.size() && mWorkers[start].get() != self; start++)
+				;
+		}
+		for (size_t i = 1; i <= mWorkers.size(); i++) {
+			Worker *victim = mWorkers[(start + i) % mWorkers.size()].get();
+			if (victim == self) continue;
+			std::lock_guard<std::mutex> guard(victim->lock);
+			if (!victim->jobs.empty()) {
+				job = std::move(victim->jobs.front());
+				victim->jobs.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(Worker *self) {
+		currentPool = this;
+		currentWorker = self;
+		while (true) {
+			if (runOne(self)) continue;
+			std::unique_lock<std::mutex> guard(mSleepLock);
+			mIdle.fetch_add(1);
+			mWakeUp.wait(guard, [this] { return mPending.load() > 0 || mStopping; });
+			mIdle.fetch_sub(1);
+			/* jobs still queued at destruction are run before leaving */
+			if (mStopping && mPending.load() == 0) break;
+		}
+		currentPool = nullptr;
+		currentWorker = nullptr;
+	}
+
+	std::vector<std::unique_ptr<Worker>> mWorkers;
+	std::mutex mInjectedLock;
+	std::deque<Job> mInjected;
+	std::atomic<size_t> mPending{0};
+	std::atomic<int> mIdle{0};
+	std::mutex mSleepLock;
+	std::condition_variable mWakeUp;
+	bool mStopping = false;
+};
+
+bctbx_thread_pool_t *bctbx_thread_pool_new(int thread_count, int flags) {
+	return new bctbx_thread_pool_t(thread_count, flags);
+}
+
+/* set once the default pool is created, so that it can be recognized without creating it */
+static std::atomic<bctbx_thread_pool_t *> defaultPool{nullptr};
+
+void bctbx_thread_pool_free(bctbx_thread_pool_t *pool) {
+	if (pool == nullptr) return;
+	if (pool == defaultPool.load(std::memory_order_acquire)) {
+		bctbx_error("bctbx_thread_pool_free(): the default pool cannot be destroyed");
+		return;
+	}
+	delete pool;
+}
+
+bctbx_thread_pool_t *bctbx_thread_pool_get_default(void) {
+	static bctbx_thread_pool_t *pool = [] {
+		bctbx_thread_pool_t *created = new bctbx_thread_pool_t(0, 0);
+		defaultPool.store(created, std::memory_order_release);
+		return created;
+	}();
+	return pool;
+}
+
+int bctbx_thread_pool_get_thread_count(const bctbx_thread_pool_t *pool) {
+	return pool->getThreadCount();
+}
+
+int bctbx_thread_pool_set_worker_affinity(bctbx_thread_pool_t *pool, int worker_index, int cpu) {
+	return pool->setWorkerAffinity(worker_index, cpu);
+}
+
+void bctbx_thread_pool_post(bctbx_thread_pool_t *pool, bctbx_thread_pool_func_t func, void *user_data) {
+	pool->post([func, user_data]() { func(user_data); });
+}
+
+bctbx_thread_pool_task_t *bctbx_thread_pool_submit(bctbx_thread_pool_t *pool, bctbx_thread_pool_func_t func, void *user_data) {
+	bctbx_thread_pool_task_t *task = new bctbx_thread_pool_task_t();
+	task->pool = pool;
+	pool->post([task, func, user_data]() {
+		func(user_data);
+		task->complete();
+		task->unref();
+	});
+	return task;
+}
+
+bool_t bctbx_thread_pool_task_wait(bctbx_thread_pool_task_t *task, int timeout_ms) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0));
+	if (task->pool->isWorkerThread()) {
+		/* help instead of holding the worker, the task may well be queued behind us */
+		while (true) {
+			{
+				std::lock_guard<std::mutex> guard(task->lock);
+				if (task->done) return TRUE;
+			}
+			if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline) return FALSE;
+			if (task->pool->runOne(currentWorker)) continue;
+			/* the task runs on another worker, new jobs are not signalled to us so wait a little only */
+			std::unique_lock<std::mutex> guard(task->lock);
+			task->completed.wait_for(guard, std::chrono::milliseconds(1), [task] { return task->done; });
+		}
+	}
+	std::unique_lock<std::mutex> guard(task->lock);
+	if (timeout_ms < 0) {
+		task->completed.wait(guard, [task] { return task->done; });
+		return TRUE;
+	}
+	return task->completed.wait_until(guard, deadline, [task] { return task->done; }) ? TRUE : FALSE;
+}
+
+void bctbx_thread_pool_task_free(bctbx_thread_pool_task_t *task) {
+	task->unref();
+}
+
+namespace bctoolbox {
+
+ThreadPool::ThreadPool(int threadCount, int flags) : mPool(bctbx_thread_pool_new(threadCount, flags)), mOwned(true) {
+}
+
+ThreadPool::ThreadPool(bctbx_thread_pool_t *pool) : mPool(pool), mOwned(false) {
+}
+
+ThreadPool::~ThreadPool() {
+	if (mOwned) bctbx_thread_pool_free(mPool);
+}
+
+ThreadPool &ThreadPool::getDefault() {
+	static ThreadPool *pool = new ThreadPool(bctbx_thread_pool_get_default());
+	return *pool;
+}
+
+int ThreadPool::getThreadCount() const {
+	return mPool->getThreadCount();
+}
+
+void ThreadPool::post(std::function<void()> job) {
+	mPool->post(std::move(job));
+}
+
+} // namespace bctoolbox
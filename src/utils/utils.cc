@@ -18,6 +18,9 @@
  */
 
 #include "bctoolbox/utils.hh"
+#include "bctoolbox/allocator.h"
+#include "utils.h"
+#include<fstream>
 #include<sstream> 
 
 using namespace std;
@@ -114,6 +117,31 @@ std::string bctoolbox::Utils::getMemoryReportAsString() {
 				<< ", Expected usage limit=" << MemoryManager::ExpectedAppMemoryUsageLimit/division
 				<< ", Free=" << (long)( MemoryManager::AppMemoryUsageLimit - MemoryManager::AppMemoryUsage )/division;
 #endif
+#elif defined(__linux__)
+	// Resident, peak resident and virtual sizes, reported in kB by the kernel
+	ifstream status("/proc/self/status");
+	string line, rss, hwm, size;
+	while (getline(status, line)) {
+		istringstream fields(line);
+		string name, value;
+		fields >> name >> value;
+		if (name == "VmRSS:") rss = value;
+		else if (name == "VmHWM:") hwm = value;
+		else if (name == "VmSize:") size = value;
+	}
+	ossReport << "Memory stats (kB): Resident=" << rss
+				<< ", Peak resident=" << hwm
+				<< ", Virtual=" << size;
 #endif
+	if (bctbx_memory_accounting_enabled()) {
+		bctbx_memory_stats_t stats;
+		bctbx_memory_peek_stats(&stats);
+		if (ossReport.tellp() > 0) ossReport << " | ";
+		ossReport << "Allocations: Live bytes=" << stats.liveBytes
+				<< ", Peak live bytes=" << stats.peakLiveBytes
+				<< ", Count=" << stats.allocations
+				<< ", Frees=" << stats.frees
+				<< ", Rate=" << (uint64_t)stats.allocationsPerSecond << "/s";
+	}
 	return ossReport.str();
 }
@@ -30,6 +30,23 @@
 #include <stdarg.h>
 #include <errno.h>
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+/* not exported by older C libraries */
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+#endif
+
+/* WSABUF are built on the stack */
+#define BCTBX_VSOCKET_IOV_MAX 64
+
 
 
 
@@ -103,7 +120,63 @@ static int vsocket_shutdown(bctbx_socket_t sock, int how){
 	return shutdown(sock, how);
 }
 
-	
+#ifndef _WIN32
+
+static ssize_t vsocket_sendmsg(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, const struct sockaddr *address, socklen_t address_len, int flags){
+	struct msghdr msg = {0};
+	msg.msg_name = (void *)address;
+	msg.msg_namelen = address ? address_len : 0;
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+	return sendmsg(sock, &msg, flags);
+}
+
+static ssize_t vsocket_recvmsg(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, struct sockaddr *address, socklen_t *address_len, int flags){
+	struct msghdr msg = {0};
+	ssize_t ret;
+	msg.msg_name = address;
+	msg.msg_namelen = address ? *address_len : 0;
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+	ret = recvmsg(sock, &msg, flags);
+	if (ret >= 0 && address) *address_len = msg.msg_namelen;
+	return ret;
+}
+
+#else
+
+static int vsocket_to_wsabuf(const bctbx_iovec_t *iov, int iovcnt, WSABUF *buffers){
+	int i;
+	if (iovcnt > BCTBX_VSOCKET_IOV_MAX) {
+		WSASetLastError(WSAEMSGSIZE);
+		return -1;
+	}
+	for (i = 0; i < iovcnt; i++) {
+		buffers[i].buf = (CHAR *)iov[i].iov_base;
+		buffers[i].len = (ULONG)iov[i].iov_len;
+	}
+	return 0;
+}
+
+static ssize_t vsocket_sendmsg(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, const struct sockaddr *address, socklen_t address_len, int flags){
+	WSABUF buffers[BCTBX_VSOCKET_IOV_MAX];
+	DWORD sent = 0;
+	if (vsocket_to_wsabuf(iov, iovcnt, buffers) != 0) return -1;
+	if (WSASendTo(sock, buffers, (DWORD)iovcnt, &sent, (DWORD)flags, address, address ? (int)address_len : 0, NULL, NULL) != 0) return -1;
+	return (ssize_t)sent;
+}
+
+static ssize_t vsocket_recvmsg(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, struct sockaddr *address, socklen_t *address_len, int flags){
+	WSABUF buffers[BCTBX_VSOCKET_IOV_MAX];
+	DWORD received = 0;
+	DWORD dwFlags = (DWORD)flags;
+	if (vsocket_to_wsabuf(iov, iovcnt, buffers) != 0) return -1;
+	if (WSARecvFrom(sock, buffers, (DWORD)iovcnt, &received, &dwFlags, address, (int *)address_len, NULL, NULL) != 0) return -1;
+	return (ssize_t)received;
+}
+
+#endif
+
 #if	!defined(_WIN32) && !defined(_WIN32_WCE) 	 
 static char* vsocket_error(int err){  
 	 return strerror (err);
@@ -143,6 +216,9 @@ static bctbx_vsocket_api_t bcvSocket = {
 /* Pointer to default socket methods initialized to standard libc implementation here.*/
 static  bctbx_vsocket_api_t *pDefaultvSocket = &bcvSocket;
 
+/* scatter/gather methods, NULL for the standard libc implementation */
+static const bctbx_vsocket_msg_methods_t *pMsgMethods = NULL;
+
 
 bctbx_socket_t bctbx_socket(int socket_family, int socket_type, int protocol){
 	return pDefaultvSocket->pSocketMethods->pFuncSocket( socket_family, socket_type, protocol);
@@ -187,6 +263,59 @@ int bctbx_shutdown(bctbx_socket_t sock, int how){
 }
 
 
+ssize_t bctbx_sendmsg(bctbx_socket_t sockfd, const bctbx_iovec_t *iov, int iovcnt, const struct sockaddr *address, socklen_t address_len, int flags){
+	if (pMsgMethods == NULL || pMsgMethods->pFuncSendMsg == NULL) return vsocket_sendmsg(sockfd, iov, iovcnt, address, address_len, flags);
+	return pMsgMethods->pFuncSendMsg(sockfd, iov, iovcnt, address, address_len, flags);
+}
+
+ssize_t bctbx_recvmsg(bctbx_socket_t sockfd, const bctbx_iovec_t *iov, int iovcnt, struct sockaddr *address, socklen_t *address_len, int flags){
+	if (pMsgMethods == NULL || pMsgMethods->pFuncRecvMsg == NULL) return vsocket_recvmsg(sockfd, iov, iovcnt, address, address_len, flags);
+	return pMsgMethods->pFuncRecvMsg(sockfd, iov, iovcnt, address, address_len, flags);
+}
+
+int bctbx_socket_enable_zerocopy(bctbx_socket_t sockfd){
+#ifdef __linux__
+	int on = 1;
+	return bctbx_setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0 ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+int bctbx_socket_get_zerocopy_completions(bctbx_socket_t sockfd, bctbx_zerocopy_completion_t *completions, int count){
+#ifdef __linux__
+	int n = 0;
+	/* completions may be merged by the kernel in a single range, there is one per message */
+	while (n < count) {
+		union {
+			char buf[CMSG_SPACE(sizeof(struct sock_extended_err))];
+			struct cmsghdr align;
+		} control;
+		struct msghdr msg = {0};
+		struct cmsghdr *cmsg;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			return n > 0 ? n : -1;
+		}
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			struct sock_extended_err serr;
+			if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) continue;
+			memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+			if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+			completions[n].first = serr.ee_info;
+			completions[n].last = serr.ee_data;
+			completions[n].copied = (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) ? TRUE : FALSE;
+			n++;
+		}
+	}
+	return n;
+#else
+	return 0;
+#endif
+}
+
 char* bctbx_socket_error(int err){
 	return pDefaultvSocket->pSocketMethods->pFuncGetError(err);
 }
@@ -202,6 +331,10 @@ void bctbx_vsocket_api_set_default(bctbx_vsocket_api_t *my_vsocket_api) {
 
 }
 
+void bctbx_vsocket_api_set_msg_methods(const bctbx_vsocket_msg_methods_t *methods) {
+	pMsgMethods = methods;
+}
+
 bctbx_vsocket_api_t* bctbx_vsocket_api_get_default(void) {
 	return pDefaultvSocket;	
 }
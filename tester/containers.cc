@@ -21,6 +21,10 @@
 #include "bctoolbox_tester.h"
 #include "bctoolbox/map.h"
 #include "bctoolbox/list.h"
+#include "bctoolbox/concurrent_map.h"
+#include "bctoolbox/ring_queue.h"
+#include <thread>
+#include <vector>
 
 static void multimap_insert(void) {
 	bctbx_map_t *mmap = bctbx_mmap_ullong_new();
@@ -198,6 +202,161 @@ static void multimap_find_custom_cchar(void) {
 }
 
 
+static void concurrent_map_insert_erase(void) {
+	bctbx_concurrent_map_t *cmap = bctbx_concurrent_map_ullong_new(0);
+	void *value = NULL;
+	long i=0;
+	int N = 100;
+
+	for(i=0;i<N;i++) {
+		bctbx_concurrent_map_ullong_insert(cmap, i, (void*)i);
+	}
+	BC_ASSERT_EQUAL(bctbx_concurrent_map_ullong_size(cmap),N, int, "%i");
+	for(i=0;i<N;i++) {
+		BC_ASSERT_TRUE(bctbx_concurrent_map_ullong_find_key(cmap, i, &value));
+		BC_ASSERT_EQUAL((long)value, i, long, "%lu");
+	}
+	BC_ASSERT_FALSE(bctbx_concurrent_map_ullong_find_key(cmap, N, NULL));
+	BC_ASSERT_EQUAL((long)bctbx_concurrent_map_ullong_find_custom(cmap, compare_func, (void*)10l), 0, long, "%lu");
+
+	for(i=0;i<N/2;i++) {
+		BC_ASSERT_TRUE(bctbx_concurrent_map_ullong_erase(cmap, i, &value));
+		BC_ASSERT_EQUAL((long)value, i, long, "%lu");
+	}
+	BC_ASSERT_FALSE(bctbx_concurrent_map_ullong_erase(cmap, 0, NULL));
+	BC_ASSERT_EQUAL(bctbx_concurrent_map_ullong_size(cmap),N/2, int, "%i");
+	bctbx_concurrent_map_ullong_delete(cmap);
+}
+
+static void concurrent_map_cchar_sum(const char *key, void *value, void *user_data) {
+	*(long *)user_data += (long)value;
+}
+
+static void concurrent_map_insert_erase_cchar(void) {
+	bctbx_concurrent_map_t *cmap = bctbx_concurrent_map_cchar_new(4);
+	void *value = NULL;
+	long i=0, sum=0;
+	int N = 100;
+
+	for(i=0;i<N;i++) {
+		char str[32];
+		snprintf(str, sizeof(str), "%ld", i);
+		bctbx_concurrent_map_cchar_insert(cmap, str, (void*)i);
+	}
+	BC_ASSERT_EQUAL(bctbx_concurrent_map_cchar_size(cmap),N, int, "%i");
+	BC_ASSERT_TRUE(bctbx_concurrent_map_cchar_find_key(cmap, "42", &value));
+	BC_ASSERT_EQUAL((long)value, 42, long, "%lu");
+	BC_ASSERT_TRUE(bctbx_concurrent_map_cchar_erase(cmap, "42", NULL));
+	BC_ASSERT_FALSE(bctbx_concurrent_map_cchar_find_key(cmap, "42", NULL));
+
+	bctbx_concurrent_map_cchar_for_each(cmap, concurrent_map_cchar_sum, &sum);
+	BC_ASSERT_EQUAL(sum, (long)(N*(N-1)/2 - 42), long, "%lu");
+	bctbx_concurrent_map_cchar_delete(cmap);
+}
+
+static void concurrent_map_multithread(void) {
+	bctbx_concurrent_map_t *cmap = bctbx_concurrent_map_ullong_new(0);
+	const int nbThreads = 8;
+	const long N = 1000;
+	std::vector<std::thread> threads;
+	std::vector<long> misses(nbThreads, 0);
+
+	for (int t = 0; t < nbThreads; t++) {
+		threads.emplace_back([cmap, t, nbThreads, N, &misses]() {
+			/* each thread inserts its own key range and reads every range, the other ones being filled meanwhile:
+			 * its own keys must all be found, a key of another range may be missing but never hold a wrong value */
+			for (long i = 0; i < N; i++) {
+				bctbx_concurrent_map_ullong_insert(cmap, t * N + i, (void *)(t * N + i));
+			}
+			for (long key = 0; key < nbThreads * N; key++) {
+				void *value = NULL;
+				bool_t found = bctbx_concurrent_map_ullong_find_key(cmap, key, &value);
+				if (found ? (long)value != key : key / N == t) misses[t]++;
+			}
+		});
+	}
+	for (auto &thread : threads) thread.join();
+	for (int t = 0; t < nbThreads; t++) {
+		BC_ASSERT_EQUAL(misses[t], 0, long, "%ld");
+	}
+	BC_ASSERT_EQUAL(bctbx_concurrent_map_ullong_size(cmap), (size_t)(nbThreads * N), size_t, "%zu");
+	bctbx_concurrent_map_ullong_delete(cmap);
+}
+
+static void spsc_queue_push_pop(void) {
+	bctbx_spsc_queue_t *queue = bctbx_spsc_queue_new(6);
+	void *value = NULL;
+	long i;
+
+	BC_ASSERT_EQUAL(bctbx_spsc_queue_capacity(queue), 8, size_t, "%zu");
+	BC_ASSERT_FALSE(bctbx_spsc_queue_pop(queue, &value));
+	for (i = 0; i < 8; i++) {
+		BC_ASSERT_TRUE(bctbx_spsc_queue_push(queue, (void *)i));
+	}
+	BC_ASSERT_FALSE(bctbx_spsc_queue_push(queue, (void *)i));
+	BC_ASSERT_EQUAL(bctbx_spsc_queue_size(queue), 8, size_t, "%zu");
+	for (i = 0; i < 8; i++) {
+		BC_ASSERT_TRUE(bctbx_spsc_queue_pop(queue, &value));
+		BC_ASSERT_EQUAL((long)value, i, long, "%ld");
+	}
+	BC_ASSERT_FALSE(bctbx_spsc_queue_pop(queue, NULL));
+	bctbx_spsc_queue_wakeup(queue);
+	BC_ASSERT_FALSE(bctbx_spsc_queue_pop_wait(queue, &value));
+	bctbx_spsc_queue_delete(queue);
+}
+
+static void spsc_queue_multithread(void) {
+	bctbx_spsc_queue_t *queue = bctbx_spsc_queue_new(64);
+	const long N = 100000;
+	long expected = 0, misordered = 0;
+	void *value = NULL;
+
+	std::thread producer([queue, N]() {
+		for (long i = 0; i < N; i++) {
+			while (!bctbx_spsc_queue_push(queue, (void *)i)) std::this_thread::yield();
+		}
+	});
+	while (expected < N && bctbx_spsc_queue_pop_wait(queue, &value)) {
+		if ((long)value != expected) misordered++;
+		expected++;
+	}
+	producer.join();
+	BC_ASSERT_EQUAL(expected, N, long, "%ld");
+	BC_ASSERT_EQUAL(misordered, 0, long, "%ld");
+	bctbx_spsc_queue_delete(queue);
+}
+
+static void mpsc_queue_multithread(void) {
+	bctbx_mpsc_queue_t *queue = bctbx_mpsc_queue_new(256);
+	const int nbThreads = 4;
+	const long N = 50000;
+	std::vector<std::thread> producers;
+	std::vector<long> next(nbThreads, 0);
+	long received = 0, misordered = 0;
+	void *value = NULL;
+
+	for (int t = 0; t < nbThreads; t++) {
+		producers.emplace_back([queue, t, N]() {
+			/* each producer sends its own range, in order */
+			for (long i = 0; i < N; i++) {
+				while (!bctbx_mpsc_queue_push(queue, (void *)(t * N + i))) std::this_thread::yield();
+			}
+		});
+	}
+	while (received < nbThreads * N && bctbx_mpsc_queue_pop_wait(queue, &value)) {
+		long v = (long)value;
+		int t = (int)(v / N);
+		if (v % N != next[t]) misordered++;
+		next[t] = v % N + 1;
+		received++;
+	}
+	for (auto &producer : producers) producer.join();
+	BC_ASSERT_EQUAL(received, nbThreads * N, long, "%ld");
+	BC_ASSERT_EQUAL(misordered, 0, long, "%ld");
+	BC_ASSERT_FALSE(bctbx_mpsc_queue_pop(queue, NULL));
+	bctbx_mpsc_queue_delete(queue);
+}
+
 static test_t container_tests[] = {
 	TEST_NO_TAG("mmap insert", multimap_insert),
 	TEST_NO_TAG("mmap erase", multimap_erase),
@@ -205,6 +364,12 @@ static test_t container_tests[] = {
 	TEST_NO_TAG("mmap insert cchar", multimap_insert_cchar),
 	TEST_NO_TAG("mmap erase cchar", multimap_erase_cchar),
 	TEST_NO_TAG("mmap find custom cchar", multimap_find_custom_cchar),
+	TEST_NO_TAG("concurrent map insert erase", concurrent_map_insert_erase),
+	TEST_NO_TAG("concurrent map insert erase cchar", concurrent_map_insert_erase_cchar),
+	TEST_NO_TAG("concurrent map multithread", concurrent_map_multithread),
+	TEST_NO_TAG("spsc queue push pop", spsc_queue_push_pop),
+	TEST_NO_TAG("spsc queue multithread", spsc_queue_multithread),
+	TEST_NO_TAG("mpsc queue multithread", mpsc_queue_multithread),
 };
 
 test_suite_t containers_test_suite = {"Containers", NULL, NULL, NULL, NULL,
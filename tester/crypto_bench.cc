@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2016-2020 Belledonne Communications SARL.
+ *
+ * This file is part of bctoolbox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Micro benchmark of the crypto primitives exposed by bctoolbox.
+ * Every primitive is run for a fixed duration on each message size and thread count,
+ * the throughput is reported in operations and bytes per second and the cost in
+ * cycles (time stamp counter ticks) per byte, or per operation for the public key ones.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bctoolbox/crypto.h"
+#ifdef HAVE_MBEDTLS
+#include "bctoolbox/crypto.hh"
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAVE_TSC 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+namespace {
+
+static uint64_t readCycles() {
+#ifdef BENCH_HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* One instance of an operation, owning its buffers and contexts so that each thread gets its own */
+typedef std::function<void()> Operation;
+/* Build an operation processing messages of the given size, or an empty one if the primitive cannot process that size */
+typedef std::function<Operation(size_t size)> OperationFactory;
+
+struct Benchmark {
+	std::string name;
+	bool sized; /* throughput depends on the message size, report per byte */
+	OperationFactory factory;
+};
+
+struct Options {
+	std::vector<size_t> sizes{16, 64, 256, 1024, 4096, 16384, 65536, 1048576};
+	std::vector<unsigned int> threads;
+	unsigned int durationMs = 200;
+	std::string filter;
+	bool list = false;
+};
+
+struct Result {
+	uint64_t operations = 0;
+	double seconds = 0;
+	uint64_t cycles = 0;
+};
+
+int rngGet(void *context, uint8_t *output, size_t length) {
+	return bctbx_rng_get((bctbx_rng_context_t *)context, output, length);
+}
+
+/* Shared pseudo random filler for the input buffers, content does not matter much */
+std::vector<uint8_t> makeBuffer(size_t size) {
+	std::vector<uint8_t> buffer(size);
+	for (size_t i = 0; i < size; i++) buffer[i] = (uint8_t)(i * 131 + 7);
+	return buffer;
+}
+
+void addHashBenchmarks(std::vector<Benchmark> &benchmarks) {
+	typedef void (*hashFunc)(const uint8_t *, size_t, uint8_t, uint8_t *);
+	typedef void (*hmacFunc)(const uint8_t *, size_t, const uint8_t *, size_t, uint8_t, uint8_t *);
+	const struct { const char *name; hashFunc func; uint8_t length; } hashes[] = {
+		{"sha256", bctbx_sha256, 32},
+		{"sha384", bctbx_sha384, 48},
+		{"sha512", bctbx_sha512, 64},
+	};
+	const struct { const char *name; hmacFunc func; uint8_t length; } hmacs[] = {
+		{"hmac-sha1", bctbx_hmacSha1, 20},
+		{"hmac-sha256", bctbx_hmacSha256, 32},
+		{"hmac-sha384", bctbx_hmacSha384, 48},
+		{"hmac-sha512", bctbx_hmacSha512, 64},
+	};
+
+	benchmarks.push_back({"md5", true, [](size_t size) -> Operation {
+		auto input = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		return [input]() {
+			uint8_t output[16];
+			bctbx_md5(input->data(), input->size(), output);
+		};
+	}});
+	for (const auto &hash : hashes) {
+		hashFunc func = hash.func;
+		uint8_t length = hash.length;
+		benchmarks.push_back({hash.name, true, [func, length](size_t size) -> Operation {
+			auto input = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+			return [func, length, input]() {
+				uint8_t output[64];
+				func(input->data(), input->size(), length, output);
+			};
+		}});
+	}
+	for (const auto &hmac : hmacs) {
+		hmacFunc func = hmac.func;
+		uint8_t length = hmac.length;
+		benchmarks.push_back({hmac.name, true, [func, length](size_t size) -> Operation {
+			auto input = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+			return [func, length, input]() {
+				static const uint8_t key[32] = {0};
+				uint8_t output[64];
+				func(key, sizeof(key), input->data(), input->size(), length, output);
+			};
+		}});
+	}
+
+	benchmarks.push_back({"sha256-context", true, [](size_t size) -> Operation {
+		auto input = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		std::shared_ptr<bctbx_sha256_context_t> context(bctbx_sha256_context_new(), bctbx_sha256_context_free);
+		return [input, context]() {
+			uint8_t output[32];
+			bctbx_sha256_update(context.get(), input->data(), input->size());
+			bctbx_sha256_finish(context.get(), 32, output);
+		};
+	}});
+	benchmarks.push_back({"hmac-sha256-context", true, [](size_t size) -> Operation {
+		static const uint8_t key[32] = {0};
+		auto input = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		std::shared_ptr<bctbx_hmacSha256_context_t> context(bctbx_hmacSha256_context_new(key, sizeof(key)), bctbx_hmacSha256_context_free);
+		return [input, context]() {
+			uint8_t output[32];
+			bctbx_hmacSha256_update(context.get(), input->data(), input->size());
+			bctbx_hmacSha256_finish(context.get(), 32, output);
+		};
+	}});
+	/* one operation hashes a single message of the batch so the figures compare with sha256 */
+	benchmarks.push_back({"sha256-batch16", true, [](size_t size) -> Operation {
+		const size_t count = 16;
+		auto input = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		auto output = std::make_shared<std::vector<uint8_t>>(32 * count);
+		auto counter = std::make_shared<size_t>(0);
+		return [input, output, counter]() {
+			if ((*counter)++ % count != 0) return;
+			std::vector<const uint8_t *> inputs(count, input->data());
+			std::vector<size_t> lengths(count, input->size());
+			bctbx_sha256_batch(inputs.data(), lengths.data(), count, 32, output->data());
+		};
+	}});
+}
+
+void addCipherBenchmarks(std::vector<Benchmark> &benchmarks) {
+	typedef void (*cfbFunc)(const uint8_t *, const uint8_t *, const uint8_t *, size_t, uint8_t *);
+	const struct { const char *name; cfbFunc func; } cfbs[] = {
+		{"aes128-cfb-encrypt", bctbx_aes128CfbEncrypt},
+		{"aes128-cfb-decrypt", bctbx_aes128CfbDecrypt},
+		{"aes256-cfb-encrypt", bctbx_aes256CfbEncrypt},
+		{"aes256-cfb-decrypt", bctbx_aes256CfbDecrypt},
+	};
+	for (const auto &cfb : cfbs) {
+		cfbFunc func = cfb.func;
+		benchmarks.push_back({cfb.name, true, [func](size_t size) -> Operation {
+			auto buffer = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+			return [func, buffer]() {
+				static const uint8_t key[32] = {0};
+				static const uint8_t IV[16] = {0};
+				func(key, IV, buffer->data(), buffer->size(), buffer->data());
+			};
+		}});
+	}
+
+	benchmarks.push_back({"aes128-cfb-context", true, [](size_t size) -> Operation {
+		static const uint8_t key[16] = {0};
+		auto buffer = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		std::shared_ptr<bctbx_aes_cfb_context_t> context(bctbx_aes_cfb_context_new(key, sizeof(key)), bctbx_aes_cfb_context_free);
+		return [buffer, context]() {
+			static const uint8_t IV[16] = {0};
+			bctbx_aes_cfb_encrypt(context.get(), IV, buffer->data(), buffer->size(), buffer->data());
+		};
+	}});
+	/* one operation encrypts a single packet of the batch so the figures compare with aes128-cfb-context */
+	benchmarks.push_back({"aes128-cfb-packets16", true, [](size_t size) -> Operation {
+		const size_t count = 16;
+		static const uint8_t key[16] = {0};
+		static const uint8_t IV[16] = {0};
+		auto buffer = std::make_shared<std::vector<uint8_t>>(makeBuffer(size * count));
+		auto packets = std::make_shared<std::vector<bctbx_aes_cfb_packet_t>>();
+		for (size_t i = 0; i < count; i++) {
+			packets->push_back({IV, buffer->data() + i * size, size, buffer->data() + i * size});
+		}
+		std::shared_ptr<bctbx_aes_cfb_context_t> context(bctbx_aes_cfb_context_new(key, sizeof(key)), bctbx_aes_cfb_context_free);
+		auto counter = std::make_shared<size_t>(0);
+		return [buffer, packets, context, counter]() {
+			if ((*counter)++ % packets->size() != 0) return;
+			bctbx_aes_cfb_encrypt_packets(context.get(), packets->data(), packets->size());
+		};
+	}});
+
+	benchmarks.push_back({"aes256-gcm-encrypt", true, [](size_t size) -> Operation {
+		auto buffer = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		return [buffer]() {
+			static const uint8_t key[32] = {0};
+			static const uint8_t IV[12] = {0};
+			uint8_t tag[16];
+			bctbx_aes_gcm_encrypt_and_tag(key, sizeof(key), buffer->data(), buffer->size(), NULL, 0, IV, sizeof(IV), tag, sizeof(tag), buffer->data());
+		};
+	}});
+	benchmarks.push_back({"aes256-gcm-stream", true, [](size_t size) -> Operation {
+		auto buffer = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		return [buffer]() {
+			static const uint8_t key[32] = {0};
+			static const uint8_t IV[12] = {0};
+			uint8_t tag[16];
+			bctbx_aes_gcm_context_t *context = bctbx_aes_gcm_context_new(key, sizeof(key), NULL, 0, IV, sizeof(IV), BCTBX_GCM_ENCRYPT);
+			bctbx_aes_gcm_process_chunk(context, buffer->data(), buffer->size(), buffer->data());
+			bctbx_aes_gcm_finish(context, tag, sizeof(tag));
+		};
+	}});
+
+#ifdef HAVE_MBEDTLS
+	benchmarks.push_back({"AEADEncrypt<AES256GCM128>", true, [](size_t size) -> Operation {
+		auto plain = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		return [plain]() {
+			static const std::vector<uint8_t> key(32, 0), IV(12, 0), AD;
+			std::vector<uint8_t> tag;
+			bctoolbox::AEADEncrypt<bctoolbox::AES256GCM128>(key, IV, *plain, AD, tag);
+		};
+	}});
+	benchmarks.push_back({"AEAD<AES256GCM128>", true, [](size_t size) -> Operation {
+		auto buffer = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+		auto aead = std::make_shared<bctoolbox::AEAD<bctoolbox::AES256GCM128>>(std::vector<uint8_t>(32, 0));
+		return [buffer, aead]() {
+			static const uint8_t IV[12] = {0};
+			uint8_t tag[16];
+			aead->encrypt(IV, sizeof(IV), NULL, 0, buffer->data(), buffer->size(), buffer->data(), tag);
+		};
+	}});
+#endif /* HAVE_MBEDTLS */
+}
+
+void addRandomBenchmarks(std::vector<Benchmark> &benchmarks) {
+	benchmarks.push_back({"bctbx_rng_get", true, [](size_t size) -> Operation {
+		auto output = std::make_shared<std::vector<uint8_t>>(size);
+		std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+		return [output, rng]() {
+			/* ctr_drbg serves at most 1024 bytes per request */
+			for (size_t offset = 0; offset < output->size(); offset += 1024) {
+				bctbx_rng_get(rng.get(), output->data() + offset, std::min<size_t>(1024, output->size() - offset));
+			}
+		};
+	}});
+#ifdef HAVE_MBEDTLS
+	benchmarks.push_back({"RNG::cRandomize", true, [](size_t size) -> Operation {
+		auto output = std::make_shared<std::vector<uint8_t>>(size);
+		return [output]() {
+			for (size_t offset = 0; offset < output->size(); offset += 1024) {
+				bctoolbox::RNG::cRandomize(output->data() + offset, std::min<size_t>(1024, output->size() - offset));
+			}
+		};
+	}});
+	benchmarks.push_back({"RNG-seed", false, [](size_t) -> Operation {
+		return []() {
+			bctoolbox::RNG rng;
+		};
+	}});
+#endif /* HAVE_MBEDTLS */
+}
+
+void addKeyDerivationBenchmarks(std::vector<Benchmark> &benchmarks) {
+#ifdef HAVE_MBEDTLS
+	/* the output size is the message size, at most 255 hash lengths */
+	benchmarks.push_back({"HKDF<SHA256>", true, [](size_t size) -> Operation {
+		if (size > 255 * 32) return nullptr;
+		return [size]() {
+			static const std::vector<uint8_t> salt(16, 1), ikm(32, 2);
+			bctoolbox::HKDF<bctoolbox::SHA256>(salt, ikm, std::string("bench"), size);
+		};
+	}});
+	benchmarks.push_back({"AES_key_wrap(AES256)", false, [](size_t) -> Operation {
+		return []() {
+			static const std::vector<uint8_t> plain(32, 3), key(32, 4);
+			std::vector<uint8_t> cipher;
+			bctoolbox::AES_key_wrap(plain, key, cipher, bctoolbox::AesId::AES256);
+		};
+	}});
+#endif /* HAVE_MBEDTLS */
+}
+
+void addPublicKeyBenchmarks(std::vector<Benchmark> &benchmarks) {
+	const struct { const char *name; uint8_t algo; uint8_t secretSize; uint16_t keySize; } dhms[] = {
+		{"DHM-2048", BCTBX_DHM_2048, 32, 256},
+		{"DHM-3072", BCTBX_DHM_3072, 32, 384},
+	};
+	for (const auto &dhm : dhms) {
+		uint8_t algo = dhm.algo, secretSize = dhm.secretSize;
+		uint16_t keySize = dhm.keySize;
+		benchmarks.push_back({std::string(dhm.name) + "-keygen", false, [algo, secretSize](size_t) -> Operation {
+			std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+			return [algo, secretSize, rng]() {
+				bctbx_DHMContext_t *context = bctbx_CreateDHMContext(algo, secretSize);
+				bctbx_DHMCreatePublic(context, rngGet, rng.get());
+				bctbx_DestroyDHMContext(context);
+			};
+		}});
+		benchmarks.push_back({std::string(dhm.name) + "-secret", false, [algo, secretSize, keySize](size_t) -> Operation {
+			std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+			std::shared_ptr<bctbx_DHMContext_t> self(bctbx_CreateDHMContext(algo, secretSize), bctbx_DestroyDHMContext);
+			bctbx_DHMContext_t *peer = bctbx_CreateDHMContext(algo, secretSize);
+			bctbx_DHMCreatePublic(self.get(), rngGet, rng.get());
+			bctbx_DHMCreatePublic(peer, rngGet, rng.get());
+			self->peer = (uint8_t *)malloc(keySize);
+			memcpy(self->peer, peer->self, keySize);
+			bctbx_DestroyDHMContext(peer);
+			return [self, rng]() {
+				bctbx_DHMComputeSecret(self.get(), rngGet, rng.get());
+			};
+		}});
+	}
+
+	if (!bctbx_crypto_have_ecc()) return;
+
+	const struct { const char *name; uint8_t algo; } ecdhs[] = {
+		{"X25519", BCTBX_ECDH_X25519},
+		{"X448", BCTBX_ECDH_X448},
+	};
+	for (const auto &ecdh : ecdhs) {
+		uint8_t algo = ecdh.algo;
+		benchmarks.push_back({std::string(ecdh.name) + "-keygen", false, [algo](size_t) -> Operation {
+			std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+			std::shared_ptr<bctbx_ECDHContext_t> context(bctbx_CreateECDHContext(algo), bctbx_DestroyECDHContext);
+			return [rng, context]() {
+				bctbx_ECDHCreateKeyPair(context.get(), rngGet, rng.get());
+			};
+		}});
+		benchmarks.push_back({std::string(ecdh.name) + "-secret", false, [algo](size_t) -> Operation {
+			std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+			std::shared_ptr<bctbx_ECDHContext_t> self(bctbx_CreateECDHContext(algo), bctbx_DestroyECDHContext);
+			std::shared_ptr<bctbx_ECDHContext_t> peer(bctbx_CreateECDHContext(algo), bctbx_DestroyECDHContext);
+			bctbx_ECDHCreateKeyPair(self.get(), rngGet, rng.get());
+			bctbx_ECDHCreateKeyPair(peer.get(), rngGet, rng.get());
+			bctbx_ECDHSetPeerPublicKey(self.get(), peer->selfPublic, self->pointCoordinateLength);
+			return [self]() {
+				bctbx_ECDHComputeSecret(self.get(), NULL, NULL);
+			};
+		}});
+	}
+
+	const struct { const char *name; uint8_t algo; } eddsas[] = {
+		{"Ed25519", BCTBX_EDDSA_25519},
+		{"Ed448", BCTBX_EDDSA_448},
+	};
+	for (const auto &eddsa : eddsas) {
+		uint8_t algo = eddsa.algo;
+		benchmarks.push_back({std::string(eddsa.name) + "-sign", true, [algo](size_t size) -> Operation {
+			std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+			std::shared_ptr<bctbx_EDDSAContext_t> context(bctbx_CreateEDDSAContext(algo), bctbx_DestroyEDDSAContext);
+			bctbx_EDDSACreateKeyPair(context.get(), rngGet, rng.get());
+			auto message = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+			return [context, message]() {
+				uint8_t signature[128];
+				size_t signatureLength = sizeof(signature);
+				bctbx_EDDSA_sign(context.get(), message->data(), message->size(), NULL, 0, signature, &signatureLength);
+			};
+		}});
+		benchmarks.push_back({std::string(eddsa.name) + "-verify", true, [algo](size_t size) -> Operation {
+			std::shared_ptr<bctbx_rng_context_t> rng(bctbx_rng_context_new(), bctbx_rng_context_free);
+			std::shared_ptr<bctbx_EDDSAContext_t> signer(bctbx_CreateEDDSAContext(algo), bctbx_DestroyEDDSAContext);
+			std::shared_ptr<bctbx_EDDSAContext_t> verifier(bctbx_CreateEDDSAContext(algo), bctbx_DestroyEDDSAContext);
+			bctbx_EDDSACreateKeyPair(signer.get(), rngGet, rng.get());
+			bctbx_EDDSA_setPublicKey(verifier.get(), signer->publicKey, signer->pointCoordinateLength);
+			auto message = std::make_shared<std::vector<uint8_t>>(makeBuffer(size));
+			auto signature = std::make_shared<std::vector<uint8_t>>(128);
+			size_t signatureLength = signature->size();
+			bctbx_EDDSA_sign(signer.get(), message->data(), message->size(), NULL, 0, signature->data(), &signatureLength);
+			signature->resize(signatureLength);
+			return [verifier, message, signature]() {
+				if (bctbx_EDDSA_verify(verifier.get(), message->data(), message->size(), NULL, 0, signature->data(), signature->size()) != BCTBX_VERIFY_SUCCESS) {
+					fprintf(stderr, "EdDSA verify failed\n");
+				}
+			};
+		}});
+	}
+}
+
+/* run the operation on one thread until the duration elapsed, checking the clock every batch of calls */
+Result runOperation(const Operation &operation, std::chrono::milliseconds duration) {
+	Result result;
+	uint64_t batch = 1;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t startCycles = readCycles();
+	std::chrono::steady_clock::duration elapsed;
+	do {
+		for (uint64_t i = 0; i < batch; i++) operation();
+		result.operations += batch;
+		elapsed = std::chrono::steady_clock::now() - start;
+		/* keep the clock reads a small fraction of the measured time */
+		if (elapsed < duration / 16) batch *= 2;
+	} while (elapsed < duration);
+	result.cycles = readCycles() - startCycles;
+	result.seconds = std::chrono::duration<double>(elapsed).count();
+	return result;
+}
+
+void runBenchmark(const Benchmark &benchmark, size_t size, unsigned int threadCount, const Options &options) {
+	std::vector<Operation> operations;
+	for (unsigned int i = 0; i < threadCount; i++) {
+		Operation operation = benchmark.factory(size);
+		if (!operation) return;
+		operations.push_back(operation);
+	}
+	/* warm up caches and lazily initialised contexts */
+	for (auto &operation : operations) operation();
+
+	std::vector<Result> results(threadCount);
+	std::vector<std::thread> threads;
+	std::atomic<unsigned int> ready{0};
+	std::chrono::milliseconds duration(options.durationMs);
+	for (unsigned int i = 0; i < threadCount; i++) {
+		threads.emplace_back([&, i]() {
+			/* start together so that the threads really compete */
+			ready++;
+			while (ready.load() < threadCount) std::this_thread::yield();
+			results[i] = runOperation(operations[i], duration);
+		});
+	}
+	for (auto &thread : threads) thread.join();
+
+	double opsPerSecond = 0;
+	double cyclesPerOp = 0;
+	for (const auto &result : results) {
+		opsPerSecond += (double)result.operations / result.seconds;
+		cyclesPerOp += (double)result.cycles / (double)result.operations / threadCount;
+	}
+
+	char cost[32] = "-";
+	if (readCycles() != 0) {
+		if (benchmark.sized) snprintf(cost, sizeof(cost), "%.2f c/B", cyclesPerOp / (double)size);
+		else snprintf(cost, sizeof(cost), "%.0f c/op", cyclesPerOp);
+	}
+	if (benchmark.sized) {
+		printf("%-28s %8zu %4u %14.1f %12.2f %16s\n", benchmark.name.c_str(), size, threadCount,
+			opsPerSecond, opsPerSecond * (double)size / (1024.0 * 1024.0), cost);
+	} else {
+		printf("%-28s %8s %4u %14.1f %12s %16s\n", benchmark.name.c_str(), "-", threadCount, opsPerSecond, "-", cost);
+	}
+	fflush(stdout);
+}
+
+void usage(const char *program) {
+	printf("Usage: %s [options]\n"
+		"  --size <bytes>       message size, may be repeated (default 16 B to 1 MB)\n"
+		"  --threads <count>    number of threads, may be repeated, 0 means all cores (default 1 and all cores)\n"
+		"  --duration <ms>      duration of each measure (default 200)\n"
+		"  --filter <string>    only run the primitives whose name contains this string\n"
+		"  --list               list the primitives and exit\n", program);
+}
+
+bool parseOptions(int argc, char *argv[], Options &options) {
+	std::vector<size_t> sizes;
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--list") {
+			options.list = true;
+			continue;
+		}
+		if (i + 1 >= argc) return false;
+		const char *value = argv[++i];
+		if (arg == "--size") {
+			sizes.push_back((size_t)strtoull(value, NULL, 10));
+		} else if (arg == "--threads") {
+			unsigned int count = (unsigned int)strtoul(value, NULL, 10);
+			if (count == 0) count = std::max(std::thread::hardware_concurrency(), 1U);
+			options.threads.push_back(count);
+		} else if (arg == "--duration") {
+			options.durationMs = (unsigned int)strtoul(value, NULL, 10);
+		} else if (arg == "--filter") {
+			options.filter = value;
+		} else {
+			return false;
+		}
+	}
+	if (!sizes.empty()) options.sizes = sizes;
+	if (options.threads.empty()) {
+		options.threads.push_back(1);
+		unsigned int cores = std::thread::hardware_concurrency();
+		if (cores > 1) options.threads.push_back(cores);
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<Benchmark> benchmarks;
+	addHashBenchmarks(benchmarks);
+	addCipherBenchmarks(benchmarks);
+	addRandomBenchmarks(benchmarks);
+	addKeyDerivationBenchmarks(benchmarks);
+	addPublicKeyBenchmarks(benchmarks);
+
+	if (options.list) {
+		for (const auto &benchmark : benchmarks) printf("%s\n", benchmark.name.c_str());
+		return 0;
+	}
+
+#if defined(HAVE_MBEDTLS)
+	const char *backend = "mbedtls";
+#elif defined(HAVE_POLARSSL)
+	const char *backend = "polarssl";
+#else
+	const char *backend = "unknown";
+#endif
+	printf("bctoolbox crypto benchmark, backend %s, %u cores, sha256 hardware acceleration %s\n", backend,
+		std::thread::hardware_concurrency(), bctbx_sha256_hardware_acceleration() ? "yes" : "no");
+	printf("%-28s %8s %4s %14s %12s %16s\n", "primitive", "size", "thr", "ops/s", "MB/s", "cycles");
+
+	for (const auto &benchmark : benchmarks) {
+		if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) continue;
+		for (unsigned int threadCount : options.threads) {
+			if (benchmark.sized) {
+				for (size_t size : options.sizes) runBenchmark(benchmark, size, threadCount, options);
+			} else {
+				runBenchmark(benchmark, 0, threadCount, options);
+			}
+		}
+	}
+	return 0;
+}
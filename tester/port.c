@@ -19,8 +19,15 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include "bctoolbox_tester.h"
 #include "bctoolbox/port.h"
+#include "bctoolbox/allocator.h"
+#include "bctoolbox/event_loop.h"
+#include "bctoolbox/resolver.h"
+#include "bctoolbox/thread_pool.h"
+#include "bctoolbox/vconnect.h"
 #include "bctoolbox/vfs.h"
 
 static void bytes_to_from_hexa_strings(void) {
@@ -84,6 +91,84 @@ static void bytes_to_from_hexa_strings(void) {
 	BC_ASSERT_EQUAL(bctbx_str_to_uint64((uint8_t *)"fedcba9876543210"), 0xfedcba9876543210, uint64_t, "0x%" PRIx64);
 }
 
+static void hex_base64_codecs(void) {
+	uint8_t bytes[300];
+	uint8_t decoded[300];
+	char hex[601];
+	unsigned char base64[401];
+	unsigned char pem[420];
+	size_t length, i, j;
+
+	for (i = 0; i < sizeof(bytes); i++) bytes[i] = (uint8_t)(i * 151 + 7);
+	/* no leftover terminator: the encoding of an empty input must write its own */
+	memset(base64, 'x', sizeof(base64));
+
+	/* round trips on lengths crossing the vectorized blocks boundaries */
+	for (i = 0; i <= sizeof(bytes); i += 13) {
+		length = sizeof(hex);
+		BC_ASSERT_EQUAL(bctbx_hex_encode(hex, &length, bytes, i), 0, int32_t, "%d");
+		BC_ASSERT_EQUAL(length, 2 * i, size_t, "%zu");
+		BC_ASSERT_EQUAL(strlen(hex), 2 * i, size_t, "%zu");
+		length = sizeof(decoded);
+		BC_ASSERT_EQUAL(bctbx_hex_decode(decoded, &length, hex, 2 * i), 0, int32_t, "%d");
+		BC_ASSERT_EQUAL(length, i, size_t, "%zu");
+		BC_ASSERT_TRUE(memcmp(decoded, bytes, i) == 0);
+
+		length = sizeof(base64);
+		BC_ASSERT_EQUAL(bctbx_base64_encode(base64, &length, bytes, i), 0, int32_t, "%d");
+		BC_ASSERT_EQUAL(length, 4 * ((i + 2) / 3), size_t, "%zu");
+		BC_ASSERT_EQUAL(strlen((const char *)base64), 4 * ((i + 2) / 3), size_t, "%zu");
+		length = sizeof(decoded);
+		BC_ASSERT_EQUAL(bctbx_base64_decode(decoded, &length, base64, 4 * ((i + 2) / 3)), 0, int32_t, "%d");
+		BC_ASSERT_EQUAL(length, i, size_t, "%zu");
+		BC_ASSERT_TRUE(memcmp(decoded, bytes, i) == 0);
+	}
+
+	/* hex: mixed case input, invalid characters, odd length and required lengths */
+	length = sizeof(decoded);
+	BC_ASSERT_EQUAL(bctbx_hex_decode(decoded, &length, "A55aFe", 6), 0, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 3, size_t, "%zu");
+	BC_ASSERT_TRUE(decoded[0] == 0xa5 && decoded[1] == 0x5a && decoded[2] == 0xfe);
+	length = sizeof(decoded);
+	BC_ASSERT_EQUAL(bctbx_hex_decode(decoded, &length, "0123456789abcdef0123456789abcdeg", 32), BCTBX_ERROR_INVALID_INPUT_DATA, int32_t, "%d");
+	length = sizeof(decoded);
+	BC_ASSERT_EQUAL(bctbx_hex_decode(decoded, &length, "a55", 3), BCTBX_ERROR_INVALID_INPUT_DATA, int32_t, "%d");
+	length = 1;
+	BC_ASSERT_EQUAL(bctbx_hex_decode(decoded, &length, "a55a", 4), BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 2, size_t, "%zu");
+	length = 4;
+	BC_ASSERT_EQUAL(bctbx_hex_encode(hex, &length, bytes, 2), BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 5, size_t, "%zu");
+
+	/* base64: PEM line breaks are skipped, misplaced padding and foreign characters are rejected */
+	length = sizeof(base64);
+	BC_ASSERT_EQUAL(bctbx_base64_encode(base64, &length, bytes, 200), 0, int32_t, "%d");
+	for (i = 0, j = 0; i < length; i++) {
+		pem[j++] = base64[i];
+		if (i % 64 == 63) {
+			pem[j++] = '\r';
+			pem[j++] = '\n';
+		}
+	}
+	length = sizeof(decoded);
+	BC_ASSERT_EQUAL(bctbx_base64_decode(decoded, &length, pem, j), 0, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 200, size_t, "%zu");
+	BC_ASSERT_TRUE(memcmp(decoded, bytes, 200) == 0);
+	length = 10;
+	BC_ASSERT_EQUAL(bctbx_base64_decode(decoded, &length, pem, j), BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 200, size_t, "%zu");
+	length = sizeof(decoded);
+	BC_ASSERT_EQUAL(bctbx_base64_decode(decoded, &length, (const unsigned char *)"YQ==YWJj", 8), BCTBX_ERROR_INVALID_BASE64_INPUT, int32_t, "%d");
+	length = sizeof(decoded);
+	BC_ASSERT_EQUAL(bctbx_base64_decode(decoded, &length, (const unsigned char *)"YW Jj", 5), BCTBX_ERROR_INVALID_BASE64_INPUT, int32_t, "%d");
+	length = 4;
+	BC_ASSERT_EQUAL(bctbx_base64_encode(base64, &length, bytes, 3), BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 5, size_t, "%zu");
+	length = 0;
+	BC_ASSERT_EQUAL(bctbx_base64_encode(NULL, &length, bytes, 0), BCTBX_ERROR_OUTPUT_BUFFER_TOO_SMALL, int32_t, "%d");
+	BC_ASSERT_EQUAL(length, 1, size_t, "%zu");
+}
+
 static void time_functions(void) {
 	bctoolboxTimeSpec testTs;
 	bctoolboxTimeSpec y2k,monday6Feb2017;
@@ -134,6 +219,23 @@ static void time_functions(void) {
 	BC_ASSERT_EQUAL(bctbx_time_string_to_sec("15dM12h"), (15*24+12)*3600, uint32_t, "%d");
 }
 
+static void coarse_and_tsc_clocks(void) {
+	uint64_t coarse = bctbx_get_coarse_time_ms();
+	uint64_t precise = bctbx_get_cur_time_ms();
+	uint64_t tsc, elapsedNs, elapsedMs;
+
+	BC_ASSERT_TRUE(bctbx_tsc_frequency() > 0);
+	tsc = bctbx_tsc_read();
+	bctbx_sleep_ms(50);
+	elapsedNs = bctbx_tsc_to_ns(bctbx_tsc_read() - tsc);
+	elapsedMs = bctbx_get_coarse_time_ms() - coarse;
+	/* the coarse clock has a resolution of a few ms, the sleep may last longer than requested */
+	BC_ASSERT_TRUE(elapsedMs >= 40 && elapsedMs < 1000);
+	BC_ASSERT_TRUE(elapsedNs >= 45000000 && elapsedNs < 1000000000);
+	BC_ASSERT_TRUE(bctbx_get_cur_time_ms() - precise >= 50);
+	BC_ASSERT_TRUE(bctbx_tsc_to_ns(bctbx_tsc_frequency()) == 1000000000);
+}
+
 static void bctbx_addrinfo_sort_test(void) {
 	struct addrinfo * res1 = bctbx_name_to_addrinfo(AF_INET6, SOCK_DGRAM, "sip3.linphone.org", 27256);
 	struct addrinfo * res2 = bctbx_ip_address_to_addrinfo(AF_INET6, SOCK_DGRAM, "91.121.209.194", 27256);
@@ -177,6 +279,766 @@ static void bctbx_addrinfo_sort_test(void) {
 	bctbx_freeaddrinfo(res);
 }
 
+typedef struct {
+	bctbx_mutex_t lock;
+	int lookups;
+	int callbacks;
+	bctbx_resolver_query_t *query; /* freed by resolver_stub_free_callback() */
+} resolver_stub_t;
+
+/* a hosts file in a function: known.test and nocache.test (reported with a null TTL) are found, anything else is not */
+static int resolver_stub_lookup(void *user_data, const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res, uint32_t *ttl) {
+	resolver_stub_t *stub = (resolver_stub_t *)user_data;
+	bctbx_mutex_lock(&stub->lock);
+	stub->lookups++;
+	bctbx_mutex_unlock(&stub->lock);
+	/* slow enough for the concurrent queries to find the lookup in progress */
+	bctbx_sleep_ms(100);
+	if (strcmp(node, "known.test") != 0 && strcmp(node, "nocache.test") != 0) return EAI_NONAME;
+	if (strcmp(node, "nocache.test") == 0) *ttl = 0;
+	*res = bctbx_ip_address_to_addrinfo(hints->ai_family, hints->ai_socktype, "192.0.2.1", atoi(service));
+	return *res ? 0 : EAI_FAIL;
+}
+
+static void resolver_stub_callback(void *user_data, int error, const struct addrinfo *result) {
+	resolver_stub_t *stub = (resolver_stub_t *)user_data;
+	BC_ASSERT_EQUAL(error, 0, int, "%d");
+	BC_ASSERT_PTR_NOT_NULL(result);
+	bctbx_mutex_lock(&stub->lock);
+	stub->callbacks++;
+	bctbx_mutex_unlock(&stub->lock);
+}
+
+static void resolver_stub_free_callback(void *user_data, int error, const struct addrinfo *result) {
+	resolver_stub_t *stub = (resolver_stub_t *)user_data;
+	bctbx_resolver_query_t *query;
+	resolver_stub_callback(user_data, error, result);
+	bctbx_mutex_lock(&stub->lock);
+	query = stub->query;
+	stub->query = NULL;
+	bctbx_mutex_unlock(&stub->lock);
+	if (BC_ASSERT_PTR_NOT_NULL(query)) bctbx_resolver_query_free(query);
+}
+
+static int resolver_stub_lookups(resolver_stub_t *stub) {
+	int lookups;
+	bctbx_mutex_lock(&stub->lock);
+	lookups = stub->lookups;
+	bctbx_mutex_unlock(&stub->lock);
+	return lookups;
+}
+
+static int resolver_stub_callbacks(resolver_stub_t *stub) {
+	int callbacks;
+	bctbx_mutex_lock(&stub->lock);
+	callbacks = stub->callbacks;
+	bctbx_mutex_unlock(&stub->lock);
+	return callbacks;
+}
+
+static void async_resolver_test(void) {
+	resolver_stub_t stub = {0};
+	bctbx_resolver_query_t *queries[8];
+	bctbx_resolver_query_t *query;
+	const struct addrinfo *ai = NULL;
+	char ip[64];
+	int port = 0;
+	int i;
+	bctbx_resolver_t *resolver = bctbx_resolver_new(2);
+
+	bctbx_mutex_init(&stub.lock, NULL);
+	bctbx_resolver_set_lookup_func(resolver, resolver_stub_lookup, &stub);
+
+	/* concurrent queries for the same name share one lookup, names are case insensitive */
+	for (i = 0; i < 8; i++) {
+		queries[i] = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, (i & 1) ? "KNOWN.test" : "known.test", 5060, (i < 4) ? resolver_stub_callback : NULL, &stub);
+	}
+	for (i = 0; i < 8; i++) {
+		BC_ASSERT_TRUE(bctbx_resolver_query_wait(queries[i], 5000));
+		BC_ASSERT_EQUAL(bctbx_resolver_query_get_result(queries[i], &ai), 0, int, "%d");
+		if (BC_ASSERT_PTR_NOT_NULL(ai)) {
+			BC_ASSERT_EQUAL(bctbx_addrinfo_to_ip_address(ai, ip, sizeof(ip), &port), 0, int, "%d");
+			BC_ASSERT_STRING_EQUAL(ip, "192.0.2.1");
+			BC_ASSERT_EQUAL(port, 5060, int, "%d");
+		}
+		bctbx_resolver_query_free(queries[i]);
+	}
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 1, int, "%d");
+	BC_ASSERT_EQUAL(resolver_stub_callbacks(&stub), 4, int, "%d");
+
+	/* served from the cache, the callback still comes from a resolver thread */
+	query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "known.test", 5060, resolver_stub_callback, &stub);
+	BC_ASSERT_TRUE(bctbx_resolver_query_wait(query, 5000));
+	BC_ASSERT_EQUAL(resolver_stub_callbacks(&stub), 5, int, "%d");
+	bctbx_resolver_query_free(query);
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 1, int, "%d");
+
+	/* so a cache hit may free its own query from the callback */
+	bctbx_mutex_lock(&stub.lock);
+	stub.query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "known.test", 5060, resolver_stub_free_callback, &stub);
+	bctbx_mutex_unlock(&stub.lock);
+	for (i = 0; i < 500 && resolver_stub_callbacks(&stub) < 6; i++) {
+		bctbx_sleep_ms(10);
+	}
+	BC_ASSERT_EQUAL(resolver_stub_callbacks(&stub), 6, int, "%d");
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 1, int, "%d");
+
+	/* another port is another query */
+	query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "known.test", 5061, NULL, NULL);
+	BC_ASSERT_TRUE(bctbx_resolver_query_wait(query, 5000));
+	bctbx_resolver_query_free(query);
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 2, int, "%d");
+
+	/* unknown names are cached too */
+	for (i = 0; i < 2; i++) {
+		query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "unknown.test", 5060, NULL, NULL);
+		BC_ASSERT_TRUE(bctbx_resolver_query_wait(query, 5000));
+		BC_ASSERT_EQUAL(bctbx_resolver_query_get_result(query, &ai), EAI_NONAME, int, "%d");
+		BC_ASSERT_PTR_NULL(ai);
+		bctbx_resolver_query_free(query);
+	}
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 3, int, "%d");
+
+	/* the TTL reported by the lookup function is honoured */
+	for (i = 0; i < 2; i++) {
+		query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "nocache.test", 5060, NULL, NULL);
+		BC_ASSERT_TRUE(bctbx_resolver_query_wait(query, 5000));
+		BC_ASSERT_EQUAL(bctbx_resolver_query_get_result(query, NULL), 0, int, "%d");
+		bctbx_resolver_query_free(query);
+	}
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 5, int, "%d");
+
+	bctbx_resolver_clear_cache(resolver);
+	query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "known.test", 5060, NULL, NULL);
+	BC_ASSERT_TRUE(bctbx_resolver_query_wait(query, 5000));
+	bctbx_resolver_query_free(query);
+	BC_ASSERT_EQUAL(resolver_stub_lookups(&stub), 6, int, "%d");
+
+	/* a query freed before completion never calls back */
+	query = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "other.test", 5060, resolver_stub_callback, &stub);
+	queries[0] = bctbx_resolver_resolve(resolver, AF_INET, SOCK_DGRAM, "other.test", 5060, NULL, NULL);
+	bctbx_resolver_query_free(query);
+	BC_ASSERT_TRUE(bctbx_resolver_query_wait(queries[0], 5000));
+	bctbx_resolver_query_free(queries[0]);
+
+	/* numeric addresses through the default lookup, no network needed */
+	bctbx_resolver_set_lookup_func(resolver, NULL, NULL);
+	query = bctbx_resolver_resolve(resolver, AF_INET6, SOCK_STREAM, "127.0.0.1", 5061, NULL, NULL);
+	BC_ASSERT_TRUE(bctbx_resolver_query_wait(query, -1));
+	BC_ASSERT_EQUAL(bctbx_resolver_query_get_result(query, &ai), 0, int, "%d");
+	if (BC_ASSERT_PTR_NOT_NULL(ai)) {
+		BC_ASSERT_EQUAL(ai->ai_family, AF_INET6, int, "%d");
+	}
+	bctbx_resolver_query_free(query);
+
+	bctbx_resolver_free(resolver);
+	BC_ASSERT_EQUAL(resolver_stub_callbacks(&stub), 6, int, "%d");
+	bctbx_mutex_destroy(&stub.lock);
+}
+
+static void batched_datagrams_test(void) {
+	struct sockaddr_in address = {0};
+	socklen_t addressLength = sizeof(address);
+	bctbx_socket_t sender = socket(AF_INET, SOCK_DGRAM, 0);
+	bctbx_socket_t receiver = socket(AF_INET, SOCK_DGRAM, 0);
+	bctbx_datagram_t datagrams[80];
+	uint8_t payloads[80][64];
+	uint8_t large[3000];
+	static uint8_t buffers[80][4096];
+	int segments = 0;
+	size_t total = 0;
+	int i, ret;
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	BC_ASSERT_EQUAL(bind(receiver, (struct sockaddr *)&address, sizeof(address)), 0, int, "%d");
+	BC_ASSERT_EQUAL(getsockname(receiver, (struct sockaddr *)&address, &addressLength), 0, int, "%d");
+	bctbx_socket_set_non_blocking(receiver);
+
+	/* more datagrams than a single system call moves */
+	memset(datagrams, 0, sizeof(datagrams));
+	for (i = 0; i < 80; i++) {
+		memset(payloads[i], i, sizeof(payloads[i]));
+		datagrams[i].buffer = payloads[i];
+		datagrams[i].length = 1 + i % 64;
+		memcpy(&datagrams[i].address, &address, sizeof(address));
+		datagrams[i].addressLength = sizeof(address);
+	}
+	BC_ASSERT_EQUAL(bctbx_sendmmsg(sender, datagrams, 80, 0), 80, int, "%d");
+
+	memset(datagrams, 0, sizeof(datagrams));
+	for (i = 0; i < 80; i++) {
+		datagrams[i].buffer = buffers[i];
+		datagrams[i].size = sizeof(buffers[i]);
+	}
+	ret = bctbx_recvmmsg(receiver, datagrams, 80, 0);
+	BC_ASSERT_EQUAL(ret, 80, int, "%d");
+	for (i = 0; i < ret; i++) {
+		int expectedLength = 1 + i % 64;
+		BC_ASSERT_EQUAL((int)datagrams[i].length, expectedLength, int, "%d");
+		BC_ASSERT_EQUAL((int)datagrams[i].segmentSize, (int)datagrams[i].length, int, "%d");
+		BC_ASSERT_EQUAL(buffers[i][0], (uint8_t)i, uint8_t, "%d");
+		BC_ASSERT_EQUAL(datagrams[i].addressLength, (socklen_t)sizeof(struct sockaddr_in), socklen_t, "%d");
+	}
+	/* nothing left: the call does not block on a non blocking socket */
+	BC_ASSERT_EQUAL(bctbx_recvmmsg(receiver, datagrams, 80, 0), -1, int, "%d");
+
+	/* a segmented datagram arrives as three datagrams, or coalesced if the kernel does GRO */
+	bctbx_socket_enable_udp_gro(receiver);
+	for (i = 0; i < 3000; i++) large[i] = (uint8_t)(i / 1000);
+	memset(datagrams, 0, sizeof(bctbx_datagram_t));
+	datagrams[0].buffer = large;
+	datagrams[0].length = sizeof(large);
+	datagrams[0].segmentSize = 1000;
+	memcpy(&datagrams[0].address, &address, sizeof(address));
+	datagrams[0].addressLength = sizeof(address);
+	BC_ASSERT_EQUAL(bctbx_sendmmsg(sender, datagrams, 1, 0), 1, int, "%d");
+
+	memset(datagrams, 0, sizeof(datagrams));
+	for (i = 0; i < 80; i++) {
+		datagrams[i].buffer = buffers[i];
+		datagrams[i].size = sizeof(buffers[i]);
+	}
+	ret = bctbx_recvmmsg(receiver, datagrams, 80, 0);
+	for (i = 0; i < ret; i++) {
+		size_t offset;
+		for (offset = 0; offset < datagrams[i].length; offset += datagrams[i].segmentSize) {
+			BC_ASSERT_EQUAL(buffers[i][offset], (uint8_t)segments, uint8_t, "%d");
+			segments++;
+		}
+		total += datagrams[i].length;
+	}
+	BC_ASSERT_EQUAL(segments, 3, int, "%d");
+	BC_ASSERT_EQUAL((int)total, 3000, int, "%d");
+
+	/* segments cannot be larger than a datagram: the batch stops there, whoever does the segmentation */
+	memset(datagrams, 0, 2 * sizeof(bctbx_datagram_t));
+	for (i = 0; i < 2; i++) {
+		memcpy(&datagrams[i].address, &address, sizeof(address));
+		datagrams[i].addressLength = sizeof(address);
+	}
+	datagrams[0].buffer = large;
+	datagrams[0].length = 100;
+	datagrams[1].length = 70001;
+	datagrams[1].buffer = bctbx_malloc0(datagrams[1].length);
+	datagrams[1].segmentSize = 70000;
+	BC_ASSERT_EQUAL(bctbx_sendmmsg(sender, datagrams, 2, 0), 1, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_sendmmsg(sender, &datagrams[1], 1, 0), -1, int, "%d");
+	BC_ASSERT_EQUAL(getSocketErrorCode(), BCTBX_EINVAL, int, "%d");
+	bctbx_free(datagrams[1].buffer);
+
+	bctbx_socket_close(sender);
+	bctbx_socket_close(receiver);
+}
+
+typedef struct {
+	bctbx_event_loop_t *loop;
+	int datagrams;
+	int oneShot;
+	int periodic;
+	int selfFreed;
+	int tasks;
+	bctbx_event_source_t *source;
+} event_loop_test_t;
+
+static void event_loop_read_cb(void *user_data, bctbx_socket_t fd, int events) {
+	event_loop_test_t *test = (event_loop_test_t *)user_data;
+	char buf[64];
+	BC_ASSERT_TRUE(events & BCTBX_EVENT_READ);
+	/* edge triggered: read until it would block */
+	while (bctbx_recv(fd, buf, sizeof(buf), 0) > 0) test->datagrams++;
+	if (test->datagrams >= 6) {
+		bctbx_event_source_remove(test->source);
+		test->source = NULL;
+	}
+}
+
+static void event_loop_one_shot_cb(void *user_data, bctbx_event_timer_t *timer) {
+	((event_loop_test_t *)user_data)->oneShot++;
+}
+
+static void event_loop_periodic_cb(void *user_data, bctbx_event_timer_t *timer) {
+	event_loop_test_t *test = (event_loop_test_t *)user_data;
+	if (++test->periodic == 3) bctbx_event_timer_stop(timer);
+}
+
+static void event_loop_self_free_cb(void *user_data, bctbx_event_timer_t *timer) {
+	((event_loop_test_t *)user_data)->selfFreed++;
+	bctbx_event_timer_free(timer);
+}
+
+static void event_loop_task(void *user_data) {
+	event_loop_test_t *test = (event_loop_test_t *)user_data;
+	if (++test->tasks == 2) bctbx_event_loop_stop(test->loop);
+}
+
+static void *event_loop_poster(void *user_data) {
+	event_loop_test_t *test = (event_loop_test_t *)user_data;
+	bctbx_sleep_ms(20);
+	bctbx_event_loop_post(test->loop, event_loop_task, test);
+	bctbx_event_loop_post(test->loop, event_loop_task, test);
+	return NULL;
+}
+
+static void event_loop_test(void) {
+	event_loop_test_t test = {0};
+	struct sockaddr_in address = {0};
+	socklen_t addressLength = sizeof(address);
+	bctbx_socket_t sender = socket(AF_INET, SOCK_DGRAM, 0);
+	bctbx_socket_t receiver = socket(AF_INET, SOCK_DGRAM, 0);
+	bctbx_event_timer_t *oneShot, *periodic, *never;
+	bctbx_thread_t thread;
+	uint64_t start;
+	int i;
+
+	test.loop = bctbx_event_loop_new();
+	if (!BC_ASSERT_PTR_NOT_NULL(test.loop)) return;
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	BC_ASSERT_EQUAL(bind(receiver, (struct sockaddr *)&address, sizeof(address)), 0, int, "%d");
+	BC_ASSERT_EQUAL(getsockname(receiver, (struct sockaddr *)&address, &addressLength), 0, int, "%d");
+	bctbx_socket_set_non_blocking(receiver);
+	test.source = bctbx_event_loop_add_source(test.loop, receiver, BCTBX_EVENT_READ, event_loop_read_cb, &test);
+	BC_ASSERT_PTR_NOT_NULL(test.source);
+
+	/* nothing to do: the loop waits for the timeout */
+	start = bctbx_event_loop_get_time_ms(test.loop);
+	BC_ASSERT_EQUAL(bctbx_event_loop_run_once(test.loop, 20), 0, int, "%d");
+	BC_ASSERT_TRUE(bctbx_event_loop_get_time_ms(test.loop) - start >= 19);
+
+	for (i = 0; i < 3; i++) {
+		bctbx_sendto(sender, "x", 1, 0, (struct sockaddr *)&address, addressLength);
+	}
+	BC_ASSERT_EQUAL(bctbx_event_loop_run_once(test.loop, 1000), 1, int, "%d");
+	BC_ASSERT_EQUAL(test.datagrams, 3, int, "%d");
+	/* the source removes itself from its callback */
+	for (i = 0; i < 3; i++) {
+		bctbx_sendto(sender, "x", 1, 0, (struct sockaddr *)&address, addressLength);
+	}
+	BC_ASSERT_EQUAL(bctbx_event_loop_run_once(test.loop, 1000), 1, int, "%d");
+	BC_ASSERT_EQUAL(test.datagrams, 6, int, "%d");
+	BC_ASSERT_PTR_NULL(test.source);
+
+	oneShot = bctbx_event_timer_new(test.loop, event_loop_one_shot_cb, &test);
+	periodic = bctbx_event_timer_new(test.loop, event_loop_periodic_cb, &test);
+	never = bctbx_event_timer_new(test.loop, event_loop_one_shot_cb, &test);
+	bctbx_event_timer_start(oneShot, 30, 0);
+	bctbx_event_timer_start(periodic, 5, 10);
+	bctbx_event_timer_start(bctbx_event_timer_new(test.loop, event_loop_self_free_cb, &test), 0, 0);
+	/* further than a wheel revolution, then stopped */
+	bctbx_event_timer_start(never, 5000, 0);
+	start = bctbx_get_cur_time_ms();
+	while ((test.oneShot < 1 || test.periodic < 3) && bctbx_get_cur_time_ms() - start < 2000) {
+		BC_ASSERT_NOT_EQUAL(bctbx_event_loop_run_once(test.loop, -1), -1, int, "%d");
+	}
+	BC_ASSERT_EQUAL(test.oneShot, 1, int, "%d");
+	BC_ASSERT_EQUAL(test.periodic, 3, int, "%d");
+	BC_ASSERT_EQUAL(test.selfFreed, 1, int, "%d");
+	BC_ASSERT_FALSE(bctbx_event_timer_is_running(oneShot));
+	BC_ASSERT_FALSE(bctbx_event_timer_is_running(periodic));
+	BC_ASSERT_TRUE(bctbx_event_timer_is_running(never));
+	bctbx_event_timer_free(never);
+	bctbx_event_timer_free(periodic);
+	bctbx_event_timer_free(oneShot);
+
+	/* tasks posted from another thread, the last one stops the loop */
+	bctbx_thread_create(&thread, NULL, event_loop_poster, &test);
+	bctbx_event_loop_run(test.loop);
+	bctbx_thread_join(thread, NULL);
+	BC_ASSERT_EQUAL(test.tasks, 2, int, "%d");
+
+	bctbx_event_loop_free(test.loop);
+	bctbx_socket_close(sender);
+	bctbx_socket_close(receiver);
+}
+
+static size_t counted_bytes = 0;
+
+static ssize_t counting_sendmsg(bctbx_socket_t sock, const bctbx_iovec_t *iov, int iovcnt, const struct sockaddr *address, socklen_t address_len, int flags) {
+	size_t length = 0;
+	int i;
+	for (i = 0; i < iovcnt; i++) length += iov[i].iov_len;
+	counted_bytes += length;
+	return (ssize_t)length;
+}
+
+static void vectored_io_test(void) {
+	struct sockaddr_in address = {0};
+	struct sockaddr_storage source;
+	socklen_t addressLength = sizeof(address);
+	socklen_t sourceLength = sizeof(source);
+	bctbx_socket_t sender = socket(AF_INET, SOCK_DGRAM, 0);
+	bctbx_socket_t receiver = socket(AF_INET, SOCK_DGRAM, 0);
+	char header[4] = {'h', 'e', 'a', 'd'};
+	char payload[] = "payload";
+	char headerIn[4] = {0};
+	char payloadIn[32] = {0};
+	bctbx_iovec_t iov[2];
+	bctbx_vsocket_msg_methods_t countingMethods = {BCTBX_VSOCKET_MSG_METHODS_VERSION, counting_sendmsg, NULL};
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	BC_ASSERT_EQUAL(bind(receiver, (struct sockaddr *)&address, sizeof(address)), 0, int, "%d");
+	BC_ASSERT_EQUAL(getsockname(receiver, (struct sockaddr *)&address, &addressLength), 0, int, "%d");
+
+	/* header and payload sent in one datagram without concatenating them, and split again on reception */
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = strlen(payload);
+	BC_ASSERT_EQUAL((int)bctbx_sendmsg(sender, iov, 2, (struct sockaddr *)&address, addressLength, 0), 11, int, "%d");
+	iov[0].iov_base = headerIn;
+	iov[0].iov_len = sizeof(headerIn);
+	iov[1].iov_base = payloadIn;
+	iov[1].iov_len = sizeof(payloadIn);
+	BC_ASSERT_EQUAL((int)bctbx_recvmsg(receiver, iov, 2, (struct sockaddr *)&source, &sourceLength, 0), 11, int, "%d");
+	BC_ASSERT_EQUAL(memcmp(headerIn, header, sizeof(header)), 0, int, "%d");
+	BC_ASSERT_STRING_EQUAL(payloadIn, payload);
+	BC_ASSERT_EQUAL(sourceLength, (socklen_t)sizeof(struct sockaddr_in), socklen_t, "%d");
+
+	/* stand-in methods see the data path */
+	bctbx_vsocket_api_set_msg_methods(&countingMethods);
+	iov[0].iov_len = 1000;
+	iov[1].iov_len = 24;
+	BC_ASSERT_EQUAL((int)bctbx_sendmsg(sender, iov, 2, NULL, 0, 0), 1024, int, "%d");
+	BC_ASSERT_EQUAL((int)counted_bytes, 1024, int, "%d");
+	bctbx_vsocket_api_set_msg_methods(NULL);
+
+	bctbx_socket_close(sender);
+	bctbx_socket_close(receiver);
+}
+
+static void zerocopy_send_test(void) {
+	struct sockaddr_in address = {0};
+	socklen_t addressLength = sizeof(address);
+	bctbx_socket_t server = socket(AF_INET, SOCK_STREAM, 0);
+	bctbx_socket_t client = socket(AF_INET, SOCK_STREAM, 0);
+	bctbx_socket_t peer;
+	bctbx_zerocopy_completion_t completions[4];
+	static char data[65536];
+	char buf[8192];
+	bctbx_iovec_t iov;
+	size_t received = 0;
+	int n = 0;
+	int i;
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	BC_ASSERT_EQUAL(bind(server, (struct sockaddr *)&address, sizeof(address)), 0, int, "%d");
+	BC_ASSERT_EQUAL(getsockname(server, (struct sockaddr *)&address, &addressLength), 0, int, "%d");
+	BC_ASSERT_EQUAL(listen(server, 1), 0, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_connect(client, (struct sockaddr *)&address, addressLength), 0, int, "%d");
+	peer = accept(server, NULL, NULL);
+
+	if (bctbx_socket_enable_zerocopy(client) != 0) {
+		bctbx_warning("zero copy send not supported here, skipping");
+	} else {
+		memset(data, 0x5a, sizeof(data));
+		iov.iov_base = data;
+		iov.iov_len = sizeof(data);
+		BC_ASSERT_EQUAL((int)bctbx_sendmsg(client, &iov, 1, NULL, 0, BCTBX_MSG_ZEROCOPY), (int)sizeof(data), int, "%d");
+		while (received < sizeof(data)) {
+			ssize_t ret = bctbx_recv(peer, buf, sizeof(buf), 0);
+			if (ret <= 0) break;
+			received += (size_t)ret;
+		}
+		BC_ASSERT_EQUAL((int)received, (int)sizeof(data), int, "%d");
+		/* the completion of the first zero copy send on this socket */
+		for (i = 0; i < 100 && n == 0; i++) {
+			n = bctbx_socket_get_zerocopy_completions(client, completions, 4);
+			if (n == 0) bctbx_sleep_ms(10);
+		}
+		BC_ASSERT_EQUAL(n, 1, int, "%d");
+		if (n == 1) {
+			BC_ASSERT_EQUAL(completions[0].first, 0, uint32_t, "%u");
+			BC_ASSERT_EQUAL(completions[0].last, 0, uint32_t, "%u");
+		}
+	}
+	bctbx_socket_close(peer);
+	bctbx_socket_close(client);
+	bctbx_socket_close(server);
+}
+
+typedef struct {
+	bctbx_thread_pool_t *pool;
+	bctbx_mutex_t lock;
+	int count;
+} thread_pool_test_t;
+
+static void thread_pool_count_task(void *user_data) {
+	thread_pool_test_t *test = (thread_pool_test_t *)user_data;
+	bctbx_mutex_lock(&test->lock);
+	test->count++;
+	bctbx_mutex_unlock(&test->lock);
+}
+
+/* submits subtasks to its own pool and waits for them, which must not hold up a single worker pool */
+static void thread_pool_nested_task(void *user_data) {
+	thread_pool_test_t *test = (thread_pool_test_t *)user_data;
+	bctbx_thread_pool_task_t *tasks[8];
+	int i;
+	for (i = 0; i < 8; i++) {
+		tasks[i] = bctbx_thread_pool_submit(test->pool, thread_pool_count_task, test);
+	}
+	for (i = 0; i < 8; i++) {
+		bctbx_thread_pool_task_wait(tasks[i], -1);
+		bctbx_thread_pool_task_free(tasks[i]);
+	}
+}
+
+static int thread_pool_test_count(thread_pool_test_t *test) {
+	int count;
+	bctbx_mutex_lock(&test->lock);
+	count = test->count;
+	bctbx_mutex_unlock(&test->lock);
+	return count;
+}
+
+static void thread_pool_test(void) {
+	thread_pool_test_t test = {0};
+	bctbx_thread_pool_task_t *tasks[100];
+	bctbx_thread_pool_task_t *task;
+	int i;
+
+	bctbx_mutex_init(&test.lock, NULL);
+	/* one worker per processor, so at least one (BC_ASSERT_GREATER accepts equality) */
+	BC_ASSERT_GREATER(bctbx_thread_pool_get_thread_count(bctbx_thread_pool_get_default()), 1, int, "%d");
+
+	test.pool = bctbx_thread_pool_new(4, BCTBX_THREAD_POOL_PIN_WORKERS);
+	BC_ASSERT_EQUAL(bctbx_thread_pool_get_thread_count(test.pool), 4, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_thread_pool_set_worker_affinity(test.pool, 4, 0), -1, int, "%d");
+#ifdef __linux__
+	BC_ASSERT_EQUAL(bctbx_thread_pool_set_worker_affinity(test.pool, 0, 0), 0, int, "%d");
+#endif
+	for (i = 0; i < 100; i++) {
+		tasks[i] = bctbx_thread_pool_submit(test.pool, thread_pool_count_task, &test);
+	}
+	for (i = 0; i < 100; i++) {
+		BC_ASSERT_TRUE(bctbx_thread_pool_task_wait(tasks[i], 5000));
+		bctbx_thread_pool_task_free(tasks[i]);
+	}
+	BC_ASSERT_EQUAL(thread_pool_test_count(&test), 100, int, "%d");
+
+	/* tasks still queued are run before the pool goes away */
+	for (i = 0; i < 100; i++) {
+		bctbx_thread_pool_post(test.pool, thread_pool_count_task, &test);
+	}
+	bctbx_thread_pool_free(test.pool);
+	BC_ASSERT_EQUAL(thread_pool_test_count(&test), 200, int, "%d");
+
+	test.pool = bctbx_thread_pool_new(1, 0);
+	task = bctbx_thread_pool_submit(test.pool, thread_pool_nested_task, &test);
+	BC_ASSERT_TRUE(bctbx_thread_pool_task_wait(task, 5000));
+	bctbx_thread_pool_task_free(task);
+	BC_ASSERT_EQUAL(thread_pool_test_count(&test), 208, int, "%d");
+	bctbx_thread_pool_free(test.pool);
+
+	bctbx_mutex_destroy(&test.lock);
+}
+
+typedef struct {
+	bctbx_adaptive_mutex_t mutex;
+	bctbx_rwlock_t rwlock;
+	int counter;
+	int readers;
+} locks_test_t;
+
+static void *locks_test_adaptive_worker(void *user_data) {
+	locks_test_t *test = (locks_test_t *)user_data;
+	int i;
+	for (i = 0; i < 100000; i++) {
+		bctbx_adaptive_mutex_lock(&test->mutex);
+		test->counter++;
+		bctbx_adaptive_mutex_unlock(&test->mutex);
+	}
+	return NULL;
+}
+
+static void *locks_test_reader(void *user_data) {
+	locks_test_t *test = (locks_test_t *)user_data;
+	bctbx_rwlock_rdlock(&test->rwlock);
+	test->readers++;
+	bctbx_rwlock_rdunlock(&test->rwlock);
+	return NULL;
+}
+
+static void *locks_test_writer(void *user_data) {
+	locks_test_t *test = (locks_test_t *)user_data;
+	int i;
+	for (i = 0; i < 10000; i++) {
+		bctbx_rwlock_wrlock(&test->rwlock);
+		test->counter++;
+		bctbx_rwlock_wrunlock(&test->rwlock);
+	}
+	return NULL;
+}
+
+static void locks_test(void) {
+	locks_test_t test;
+	bctbx_thread_t threads[4];
+	bctbx_lock_stats_t stats;
+	int i;
+
+	memset(&test, 0, sizeof(test));
+	bctbx_adaptive_mutex_init(&test.mutex);
+	BC_ASSERT_EQUAL(bctbx_adaptive_mutex_trylock(&test.mutex), 0, int, "%d");
+	BC_ASSERT_EQUAL(bctbx_adaptive_mutex_trylock(&test.mutex), -1, int, "%d");
+	bctbx_adaptive_mutex_unlock(&test.mutex);
+	bctbx_adaptive_mutex_reset_stats(&test.mutex);
+	for (i = 0; i < 4; i++) {
+		bctbx_thread_create(&threads[i], NULL, locks_test_adaptive_worker, &test);
+	}
+	for (i = 0; i < 4; i++) {
+		bctbx_thread_join(threads[i], NULL);
+	}
+	BC_ASSERT_EQUAL(test.counter, 400000, int, "%d");
+	bctbx_adaptive_mutex_get_stats(&test.mutex, &stats);
+	BC_ASSERT_TRUE(stats.acquisitions == 400000);
+	BC_ASSERT_TRUE(stats.contentions <= stats.acquisitions);
+	bctbx_adaptive_mutex_destroy(&test.mutex);
+
+	/* a reader gets in while another one holds the lock */
+	bctbx_rwlock_init(&test.rwlock, NULL);
+	bctbx_rwlock_rdlock(&test.rwlock);
+	bctbx_thread_create(&threads[0], NULL, locks_test_reader, &test);
+	bctbx_thread_join(threads[0], NULL);
+	bctbx_rwlock_rdunlock(&test.rwlock);
+	BC_ASSERT_EQUAL(test.readers, 1, int, "%d");
+
+	test.counter = 0;
+	for (i = 0; i < 4; i++) {
+		bctbx_thread_create(&threads[i], NULL, locks_test_writer, &test);
+	}
+	for (i = 0; i < 4; i++) {
+		bctbx_thread_join(threads[i], NULL);
+	}
+	BC_ASSERT_EQUAL(test.counter, 40000, int, "%d");
+	bctbx_rwlock_destroy(&test.rwlock);
+}
+
+static void *pool_allocator_worker(void *user_data) {
+	int *failures = (int *)user_data;
+	void *blocks[64];
+	int i, round;
+	for (round = 0; round < 200; round++) {
+		for (i = 0; i < 64; i++) {
+			size_t size = (size_t)(i * 37 + round) % 600;
+			blocks[i] = bctbx_pool_malloc(size);
+			memset(blocks[i], i, size);
+		}
+		for (i = 0; i < 64; i++) {
+			size_t size = (size_t)(i * 37 + round) % 600;
+			if (size > 0 && ((uint8_t *)blocks[i])[size - 1] != (uint8_t)i) (*failures)++;
+			bctbx_pool_free(blocks[i]);
+		}
+	}
+	return NULL;
+}
+
+static void pool_allocator_and_arena(void) {
+	bctbx_pool_allocator_stats_t before, after;
+	bctbx_arena_stats_t arenaStats;
+	bctbx_thread_t threads[4];
+	int failures[4] = {0};
+	bctbx_arena_t *arena;
+	char *str, *big;
+	uint8_t *ptr;
+	int i, misalignment;
+
+	bctbx_pool_allocator_get_stats(&before);
+	str = (char *)bctbx_pool_malloc(10);
+	strcpy(str, "bctoolbox");
+	misalignment = (int)((uintptr_t)str & 15);
+	BC_ASSERT_EQUAL(misalignment, 0, int, "%d");
+	/* growing moves it to a bigger class, then to a big allocation, keeping the content */
+	str = (char *)bctbx_pool_realloc(str, 100);
+	BC_ASSERT_STRING_EQUAL(str, "bctoolbox");
+	str = (char *)bctbx_pool_realloc(str, 3 * BCTBX_POOL_ALLOCATOR_MAX_SIZE);
+	BC_ASSERT_STRING_EQUAL(str, "bctoolbox");
+	big = (char *)bctbx_pool_realloc(NULL, 5 * BCTBX_POOL_ALLOCATOR_MAX_SIZE);
+	bctbx_pool_allocator_get_stats(&after);
+	BC_ASSERT_TRUE(after.bytesInUse - before.bytesInUse == 8 * BCTBX_POOL_ALLOCATOR_MAX_SIZE);
+	BC_ASSERT_TRUE(after.classes[0].allocations == before.classes[0].allocations + 1);
+	BC_ASSERT_TRUE(after.peakBytesReserved >= after.bytesReserved);
+	str = (char *)bctbx_pool_realloc(str, 20);
+	BC_ASSERT_STRING_EQUAL(str, "bctoolbox");
+	bctbx_pool_free(str);
+	bctbx_pool_free(big);
+	bctbx_pool_free(NULL);
+
+	for (i = 0; i < 4; i++) {
+		bctbx_thread_create(&threads[i], NULL, pool_allocator_worker, &failures[i]);
+	}
+	for (i = 0; i < 4; i++) {
+		bctbx_thread_join(threads[i], NULL);
+		BC_ASSERT_EQUAL(failures[i], 0, int, "%d");
+	}
+	bctbx_pool_allocator_get_stats(&after);
+	BC_ASSERT_TRUE(after.bytesInUse == before.bytesInUse);
+
+	arena = bctbx_arena_new(1024);
+	for (i = 0; i < 100; i++) {
+		ptr = (uint8_t *)bctbx_arena_alloc(arena, (size_t)i + 1);
+		misalignment = (int)((uintptr_t)ptr & 15);
+		BC_ASSERT_EQUAL(misalignment, 0, int, "%d");
+		memset(ptr, 0xff, (size_t)i + 1);
+	}
+	ptr = (uint8_t *)bctbx_arena_alloc0(arena, 4000);
+	BC_ASSERT_EQUAL(ptr[3999], 0, int, "%d");
+	str = bctbx_arena_strdup_printf(arena, "%s-%d", "arena", 42);
+	BC_ASSERT_STRING_EQUAL(str, "arena-42");
+	BC_ASSERT_STRING_EQUAL(bctbx_arena_strdup(arena, "copy"), "copy");
+	bctbx_arena_get_stats(arena, &arenaStats);
+	BC_ASSERT_TRUE(arenaStats.bytesUsed > 4000 && arenaStats.bytesReserved >= arenaStats.bytesUsed);
+	bctbx_arena_reset(arena);
+	bctbx_arena_get_stats(arena, &arenaStats);
+	BC_ASSERT_TRUE(arenaStats.bytesUsed == 0);
+	BC_ASSERT_TRUE(arenaStats.peakBytesUsed > 4000);
+	BC_ASSERT_TRUE(arenaStats.bytesReserved <= 1024);
+	BC_ASSERT_PTR_NOT_NULL(bctbx_arena_alloc(arena, 16));
+	/* sizes which would wrap around once aligned and given a block header */
+	BC_ASSERT_PTR_NULL(bctbx_arena_alloc(arena, SIZE_MAX));
+	BC_ASSERT_PTR_NULL(bctbx_arena_alloc(arena, SIZE_MAX - 8));
+	bctbx_arena_free(arena);
+}
+
+static void memory_accounting_test(void) {
+	BctoolboxMemoryFunctions functions;
+	bctbx_memory_stats_t before, after;
+	const char *previousTag;
+	char *kept, *report;
+	void *ptr;
+
+	/* the tester does not install them, the functions are called directly */
+	bctbx_memory_accounting_get_memory_functions(NULL, 1, &functions);
+	BC_ASSERT_TRUE(bctbx_memory_accounting_enabled());
+	bctbx_memory_get_stats(&before);
+	ptr = functions.malloc_fun(100);
+	ptr = functions.realloc_fun(ptr, 1000);
+	bctbx_memory_get_stats(&after);
+	BC_ASSERT_TRUE(after.liveBytes - before.liveBytes == 1000);
+	BC_ASSERT_TRUE(after.allocations == before.allocations + 2);
+	BC_ASSERT_TRUE(after.peakLiveBytes >= after.liveBytes);
+	functions.free_fun(ptr);
+	functions.free_fun(NULL);
+	bctbx_memory_get_stats(&after);
+	BC_ASSERT_TRUE(after.liveBytes == before.liveBytes);
+	BC_ASSERT_TRUE(after.frees == before.frees + 2);
+
+	previousTag = bctbx_memory_set_tag("accounting-test");
+	kept = (char *)functions.malloc_fun(4000);
+	kept = (char *)functions.realloc_fun(kept, 5000);
+	bctbx_memory_set_tag(previousTag);
+	report = bctbx_memory_get_leak_report(10);
+	BC_ASSERT_PTR_NOT_NULL(strstr(report, "accounting-test: 1 allocations, about 5000 bytes"));
+	bctbx_free(report);
+	functions.free_fun(kept);
+	report = bctbx_memory_get_leak_report(10);
+	BC_ASSERT_PTR_NULL(strstr(report, "accounting-test"));
+	bctbx_free(report);
+}
+
 static void bctbx_directory_utils_test(void) {
 	// Create a directory in the writeable one
 	char *tmpDirPath = bctbx_strdup_printf("%s/tmp_dir/", bc_tester_get_writable_dir_prefix());
@@ -239,8 +1101,19 @@ static void bctbx_directory_utils_test(void) {
 
 static test_t utils_tests[] = {
 	TEST_NO_TAG("Bytes to/from Hexa strings", bytes_to_from_hexa_strings),
+	TEST_NO_TAG("Hex and base64 codecs", hex_base64_codecs),
 	TEST_NO_TAG("Time", time_functions),
+	TEST_NO_TAG("Coarse and TSC clocks", coarse_and_tsc_clocks),
 	TEST_NO_TAG("Addrinfo sort", bctbx_addrinfo_sort_test),
+	TEST_NO_TAG("Async resolver", async_resolver_test),
+	TEST_NO_TAG("Batched datagrams", batched_datagrams_test),
+	TEST_NO_TAG("Event loop", event_loop_test),
+	TEST_NO_TAG("Vectored I/O", vectored_io_test),
+	TEST_NO_TAG("Zero copy send", zerocopy_send_test),
+	TEST_NO_TAG("Thread pool", thread_pool_test),
+	TEST_NO_TAG("Locks", locks_test),
+	TEST_NO_TAG("Pool allocator and arena", pool_allocator_and_arena),
+	TEST_NO_TAG("Memory accounting", memory_accounting_test),
 	TEST_NO_TAG("Directory utils", bctbx_directory_utils_test)
 };
 